@@ -0,0 +1,758 @@
+/** @file
+  Bringing controllers up without blocking.
+
+  A controller is brought up in steps: the USB handshake, the report mode
+  switch, the device info query, then the user and factory IMU calibration
+  reads unless the calibration cache has the controller. Every step sends
+  a request and waits for its reply, which comes back through the
+  asynchronous interrupt transfers started first. One shared timer steps all
+  controllers being brought up, so their round trips overlap and a set of
+  pads is up in the time of the slowest one rather than the sum of them.
+
+  YIZD 2021
+
+**/
+
+#include "JoyStick.h"
+
+//
+// Controllers being brought up, and the timer stepping them. The timer only
+// exists while the list is not empty.
+//
+USB_JS_DEV            *mJoyStickActivating[JOYSTICK_MAX_PLAYERS];
+UINTN                 mJoyStickActivatingCount;
+EFI_EVENT             mJoyStickActivateTimer;
+
+/**
+  Send one of the USB commands of the handshake in an 0x80 output report.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Command            The command byte.
+
+  @retval EFI_SUCCESS        The command was sent.
+  @retval Others             The transfer failed.
+
+**/
+STATIC
+EFI_STATUS
+JoyStickSendUsbCommand (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT8          Command
+  )
+{
+  EFI_USB_IO_PROTOCOL *UsbIo;
+  UINT8               OutReport[JOYSTICK_REPORT_SIZE];
+  UINTN               OutSize;
+  UINT32              TransferStatus;
+
+  UsbIo = UsbJoyStickDevice->UsbIo;
+
+  ZeroMem (OutReport, sizeof (OutReport));
+  OutReport[0] = JOYSTICK_OUT_USB_CMD;
+  OutReport[1] = Command;
+  OutSize      = sizeof (OutReport);
+
+  return UsbIo->UsbSyncInterruptTransfer (
+                  UsbIo,
+                  UsbJoyStickDevice->IntOutEndpointDescriptor.EndpointAddress,
+                  OutReport,
+                  &OutSize,
+                  JOYSTICK_SUBCMD_TIMEOUT,
+                  &TransferStatus
+                  );
+}
+
+/**
+  Send the request of the current step, and give it a full step timeout.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+STATIC
+VOID
+JoyStickActivateSend (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_STATUS          Status;
+
+  UsbJoyStickDevice->ActivateTries++;
+  UsbJoyStickDevice->ActivateTicks = JOYSTICK_ACTIVATE_STEP_TIMEOUT / JOYSTICK_ACTIVATE_TICK;
+  UsbJoyStickDevice->SubcmdReplied = FALSE;
+
+  switch (UsbJoyStickDevice->ActivateState) {
+  case JOYSTICK_ACTIVATE_HANDSHAKE:
+    UsbJoyStickDevice->HandshakeReplied = FALSE;
+    Status = JoyStickSendUsbCommand (UsbJoyStickDevice, JOYSTICK_USB_CMD_HANDSHAKE);
+    break;
+
+  case JOYSTICK_ACTIVATE_REPORT_MODE:
+    Status = JoyStickApplyReportPolicy (UsbJoyStickDevice);
+
+    //
+    // Nothing is sent when the controller already is in the selected mode.
+    //
+    if (!EFI_ERROR (Status) &&
+        UsbJoyStickDevice->ReportMode == UsbJoyStickDevice->RequestedReportMode) {
+      UsbJoyStickDevice->SubcmdReplied = TRUE;
+    }
+    break;
+
+  case JOYSTICK_ACTIVATE_DEVICE_INFO:
+    Status = JoyStickSendSubcommand (UsbJoyStickDevice, JOYSTICK_SUBCMD_DEVICE_INFO, NULL, 0, NULL);
+    break;
+
+  case JOYSTICK_ACTIVATE_USER_CAL:
+    Status = JoyStickPostSpiRead (
+               UsbJoyStickDevice,
+               JOYSTICK_SPI_IMU_USER_CAL,
+               2 + sizeof (JOYSTICK_IMU_CALIBRATION)
+               );
+    break;
+
+  case JOYSTICK_ACTIVATE_FACTORY_CAL:
+    Status = JoyStickPostSpiRead (
+               UsbJoyStickDevice,
+               JOYSTICK_SPI_IMU_FACTORY_CAL,
+               sizeof (JOYSTICK_IMU_CALIBRATION)
+               );
+    break;
+
+  default:
+    return;
+  }
+
+  //
+  // A request that could not be sent is tried again at the step timeout.
+  //
+  if (EFI_ERROR (Status)) {
+    JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_START_ERROR, __LINE__, Status);
+  }
+}
+
+/**
+  Move to a step and send its request.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  State              The JOYSTICK_ACTIVATE_* step.
+
+**/
+STATIC
+VOID
+JoyStickActivateEnter (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT8          State
+  )
+{
+  UsbJoyStickDevice->ActivateState = State;
+  UsbJoyStickDevice->ActivateTries = 0;
+  JoyStickActivateSend (UsbJoyStickDevice);
+}
+
+/**
+  Remove a controller from the controllers being brought up, closing the
+  shared timer with the last one.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+STATIC
+VOID
+JoyStickActivateLeave (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_TPL             OldTpl;
+  UINTN               Slot;
+  EFI_EVENT           Timer;
+
+  Timer  = NULL;
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  for (Slot = 0; Slot < JOYSTICK_MAX_PLAYERS; Slot++) {
+    if (mJoyStickActivating[Slot] == UsbJoyStickDevice) {
+      mJoyStickActivating[Slot] = NULL;
+      mJoyStickActivatingCount--;
+      if (mJoyStickActivatingCount == 0) {
+        Timer                  = mJoyStickActivateTimer;
+        mJoyStickActivateTimer = NULL;
+      }
+      break;
+    }
+  }
+  UsbJoyStickDevice->ActivateState = JOYSTICK_ACTIVATE_IDLE;
+  gBS->RestoreTPL (OldTpl);
+
+  if (Timer != NULL) {
+    gBS->CloseEvent (Timer);
+  }
+}
+
+/**
+  End bringing a controller up. On success it joins the merged key stream,
+  otherwise its transfer is stopped.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Status             The outcome of the steps.
+
+**/
+STATIC
+VOID
+JoyStickActivateFinish (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     EFI_STATUS     Status
+  )
+{
+  UINT64              Elapsed;
+
+  JoyStickActivateLeave (UsbJoyStickDevice);
+
+  if (!EFI_ERROR (Status) && !JoyStickPairController (UsbJoyStickDevice)) {
+    Status = JoyStickAddPlayer (UsbJoyStickDevice);
+  }
+
+  if (EFI_ERROR (Status)) {
+    JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_START_ERROR, __LINE__, Status);
+    JoyStickStopTransfers (UsbJoyStickDevice);
+    UsbJoyStickDevice->ActivationFailed = TRUE;
+  } else {
+    UsbJoyStickDevice->Activated = TRUE;
+  }
+
+  //
+  // With PcdJoyStickLazyActivation set, this is the time kept out of Start.
+  //
+  Elapsed = GetTimeInNanoSecond (GetPerformanceCounter () - UsbJoyStickDevice->ActivateBegin);
+  PERF_END (UsbJoyStickDevice->ControllerHandle, "JoyStickActivate", NULL, 0);
+  JOYSTICK_TRACE (
+    EFI_ERROR (Status) ? JOYSTICK_TRACE_LEVEL_ERROR : JOYSTICK_TRACE_LEVEL_INFO,
+    JOYSTICK_TRACE_ACTIVATE,
+    Status,
+    (UINTN) Elapsed
+    );
+}
+
+/**
+  Step the calibration reads of one controller, whose reply has arrived or
+  whose step timed out. Only used with PcdJoyStickMotionSupport, the IMU
+  calibration has no other consumer.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  TimedOut           The step got no reply.
+
+**/
+STATIC
+VOID
+JoyStickActivateCalibrationStep (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     BOOLEAN        TimedOut
+  )
+{
+  UINT8               Data[2 + sizeof (JOYSTICK_IMU_CALIBRATION)];
+
+  switch (UsbJoyStickDevice->ActivateState) {
+  case JOYSTICK_ACTIVATE_DEVICE_INFO:
+    //
+    // Without an address the calibration is read and not cached.
+    //
+    if (TimedOut) {
+      UsbJoyStickDevice->SubcmdPending = 0;
+      UsbJoyStickDevice->MacValid      = FALSE;
+    } else if (JoyStickSetDeviceInfo (UsbJoyStickDevice, UsbJoyStickDevice->SubcmdReply) &&
+               JoyStickLoadCalibration (UsbJoyStickDevice)) {
+      JoyStickActivateFinish (UsbJoyStickDevice, EFI_SUCCESS);
+      return;
+    }
+    JoyStickActivateEnter (UsbJoyStickDevice, JOYSTICK_ACTIVATE_USER_CAL);
+    return;
+
+  case JOYSTICK_ACTIVATE_USER_CAL:
+    if (!TimedOut &&
+        !EFI_ERROR (JoyStickSpiReadData (UsbJoyStickDevice->SubcmdReply, JOYSTICK_SPI_IMU_USER_CAL, Data, sizeof (Data))) &&
+        JoyStickSetImuCalibration (UsbJoyStickDevice, JOYSTICK_SPI_IMU_USER_CAL, Data)) {
+      JoyStickSaveCalibration (UsbJoyStickDevice, JOYSTICK_SPI_IMU_USER_CAL, Data, sizeof (Data));
+      JoyStickActivateFinish (UsbJoyStickDevice, EFI_SUCCESS);
+      return;
+    }
+    UsbJoyStickDevice->SubcmdPending = 0;
+    JoyStickActivateEnter (UsbJoyStickDevice, JOYSTICK_ACTIVATE_FACTORY_CAL);
+    return;
+
+  case JOYSTICK_ACTIVATE_FACTORY_CAL:
+    //
+    // The nominal scale is not cached, the next activation reads again.
+    //
+    if (TimedOut ||
+        EFI_ERROR (JoyStickSpiReadData (UsbJoyStickDevice->SubcmdReply, JOYSTICK_SPI_IMU_FACTORY_CAL, Data, sizeof (JOYSTICK_IMU_CALIBRATION)))) {
+      UsbJoyStickDevice->SubcmdPending = 0;
+      JoyStickSetImuCalibration (UsbJoyStickDevice, 0, NULL);
+    } else {
+      JoyStickSetImuCalibration (UsbJoyStickDevice, JOYSTICK_SPI_IMU_FACTORY_CAL, Data);
+      JoyStickSaveCalibration (UsbJoyStickDevice, JOYSTICK_SPI_IMU_FACTORY_CAL, Data, sizeof (JOYSTICK_IMU_CALIBRATION));
+    }
+    JoyStickActivateFinish (UsbJoyStickDevice, EFI_SUCCESS);
+    return;
+
+  default:
+    return;
+  }
+}
+
+/**
+  Step one controller: move on when the reply of its step has arrived, send
+  the request again or give up on the step when it timed out.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+STATIC
+VOID
+JoyStickActivateStep (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_STATUS          Status;
+  BOOLEAN             Replied;
+  BOOLEAN             TimedOut;
+
+  if (UsbJoyStickDevice->ActivateState == JOYSTICK_ACTIVATE_HANDSHAKE) {
+    Replied = UsbJoyStickDevice->HandshakeReplied;
+  } else {
+    Replied = UsbJoyStickDevice->SubcmdReplied;
+  }
+
+  TimedOut = FALSE;
+  if (!Replied) {
+    if (UsbJoyStickDevice->ActivateTicks > 1) {
+      UsbJoyStickDevice->ActivateTicks--;
+      return;
+    }
+    if (UsbJoyStickDevice->ActivateTries < JOYSTICK_ACTIVATE_TRIES) {
+      JoyStickCountRecovery (UsbJoyStickDevice);
+      JoyStickActivateSend (UsbJoyStickDevice);
+      return;
+    }
+    TimedOut = TRUE;
+  }
+
+  switch (UsbJoyStickDevice->ActivateState) {
+  case JOYSTICK_ACTIVATE_HANDSHAKE:
+    if (TimedOut) {
+      JoyStickActivateFinish (UsbJoyStickDevice, EFI_TIMEOUT);
+      return;
+    }
+
+    //
+    // The controller starts streaming, and takes subcommands, once told to
+    // stop waiting for a Bluetooth host.
+    //
+    Status = JoyStickSendUsbCommand (UsbJoyStickDevice, JOYSTICK_USB_CMD_NO_TIMEOUT);
+    if (EFI_ERROR (Status)) {
+      JoyStickActivateFinish (UsbJoyStickDevice, EFI_UNSUPPORTED);
+      return;
+    }
+    JoyStickActivateEnter (UsbJoyStickDevice, JOYSTICK_ACTIVATE_REPORT_MODE);
+    return;
+
+  case JOYSTICK_ACTIVATE_REPORT_MODE:
+    //
+    // Not fatal, JoyStickHandler decodes either layout.
+    //
+    if (TimedOut) {
+      JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_START_ERROR, __LINE__, EFI_TIMEOUT);
+      UsbJoyStickDevice->SubcmdPending       = 0;
+      UsbJoyStickDevice->RequestedReportMode = UsbJoyStickDevice->ReportMode;
+    }
+    if (!FeaturePcdGet (PcdJoyStickMotionSupport)) {
+      JoyStickActivateFinish (UsbJoyStickDevice, EFI_SUCCESS);
+      return;
+    }
+    JoyStickActivateEnter (UsbJoyStickDevice, JOYSTICK_ACTIVATE_DEVICE_INFO);
+    return;
+
+  case JOYSTICK_ACTIVATE_DEVICE_INFO:
+  case JOYSTICK_ACTIVATE_USER_CAL:
+  case JOYSTICK_ACTIVATE_FACTORY_CAL:
+    if (FeaturePcdGet (PcdJoyStickMotionSupport)) {
+      JoyStickActivateCalibrationStep (UsbJoyStickDevice, TimedOut);
+    }
+    return;
+
+  default:
+    return;
+  }
+}
+
+/**
+  Step every controller being brought up.
+
+  @param  Event        The shared activation timer.
+  @param  Context      Not used.
+
+**/
+STATIC
+VOID
+EFIAPI
+JoyStickActivateTick (
+  IN  EFI_EVENT               Event,
+  IN  VOID                    *Context
+  )
+{
+  UINTN               Slot;
+
+  for (Slot = 0; Slot < JOYSTICK_MAX_PLAYERS; Slot++) {
+    if (mJoyStickActivating[Slot] != NULL) {
+      JoyStickActivateStep (mJoyStickActivating[Slot]);
+    }
+  }
+}
+
+/**
+  Add a controller to the controllers being brought up, creating the shared
+  timer with the first one.
+
+  @param  UsbJoyStickDevice     The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS           The timer steps the controller.
+  @retval EFI_OUT_OF_RESOURCES  Too many controllers are being brought up,
+                                or the timer could not be created.
+
+**/
+STATIC
+EFI_STATUS
+JoyStickActivateJoin (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_STATUS          Status;
+  UINTN               Slot;
+
+  //
+  // Joining runs at TPL_CALLBACK, the timer cannot fire in between.
+  //
+  if (mJoyStickActivateTimer == NULL) {
+    Status = gBS->CreateEvent (
+                    EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                    TPL_CALLBACK,
+                    JoyStickActivateTick,
+                    NULL,
+                    &mJoyStickActivateTimer
+                    );
+    if (EFI_ERROR (Status)) {
+      mJoyStickActivateTimer = NULL;
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Status = gBS->SetTimer (
+                    mJoyStickActivateTimer,
+                    TimerPeriodic,
+                    EFI_TIMER_PERIOD_MILLISECONDS (JOYSTICK_ACTIVATE_TICK)
+                    );
+    if (EFI_ERROR (Status)) {
+      gBS->CloseEvent (mJoyStickActivateTimer);
+      mJoyStickActivateTimer = NULL;
+      return EFI_OUT_OF_RESOURCES;
+    }
+  }
+
+  for (Slot = 0; Slot < JOYSTICK_MAX_PLAYERS; Slot++) {
+    if (mJoyStickActivating[Slot] == NULL) {
+      mJoyStickActivating[Slot] = UsbJoyStickDevice;
+      mJoyStickActivatingCount++;
+      return EFI_SUCCESS;
+    }
+  }
+
+  return EFI_OUT_OF_RESOURCES;
+}
+
+/**
+  Start the asynchronous interrupt transfer of every IN endpoint and set
+  AsyncActive.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        All transfers run.
+  @retval Others             A transfer could not be started, none runs.
+
+**/
+EFI_STATUS
+JoyStickStartTransfers (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_STATUS            Status;
+  JOYSTICK_IN_ENDPOINT  *Endpoint;
+  UINTN                 Index;
+
+  Status = EFI_SUCCESS;
+  for (Index = 0; Index < UsbJoyStickDevice->InEndpointCount && !EFI_ERROR (Status); Index++) {
+    Endpoint = &UsbJoyStickDevice->InEndpoints[Index];
+    Status   = UsbJoyStickDevice->UsbIo->UsbAsyncInterruptTransfer (
+                                           UsbJoyStickDevice->UsbIo,
+                                           Endpoint->Descriptor.EndpointAddress,
+                                           TRUE,
+                                           Endpoint->Descriptor.Interval,
+                                           Endpoint->PacketSize,
+                                           JoyStickHandler,
+                                           Endpoint
+                                           );
+    Endpoint->AsyncActive = (BOOLEAN) !EFI_ERROR (Status);
+  }
+
+  UsbJoyStickDevice->AsyncActive = TRUE;
+  if (EFI_ERROR (Status)) {
+    JoyStickStopTransfers (UsbJoyStickDevice);
+  }
+  return Status;
+}
+
+/**
+  Stop the asynchronous interrupt transfers still running and clear
+  AsyncActive.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickStopTransfers (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  JOYSTICK_IN_ENDPOINT  *Endpoint;
+  UINTN                 Index;
+
+  UsbJoyStickDevice->AsyncActive = FALSE;
+  for (Index = 0; Index < UsbJoyStickDevice->InEndpointCount; Index++) {
+    Endpoint = &UsbJoyStickDevice->InEndpoints[Index];
+    if (!Endpoint->AsyncActive) {
+      continue;
+    }
+    Endpoint->AsyncActive = FALSE;
+    UsbJoyStickDevice->UsbIo->UsbAsyncInterruptTransfer (
+                                UsbJoyStickDevice->UsbIo,
+                                Endpoint->Descriptor.EndpointAddress,
+                                FALSE,
+                                0,
+                                0,
+                                NULL,
+                                NULL
+                                );
+  }
+}
+
+/**
+  Submit again the asynchronous interrupt transfers JoyStickHandler
+  stopped on an error, while the transfers of the controller run.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        Every transfer runs, or none is meant to.
+  @retval Others             A transfer could not be submitted again.
+
+**/
+EFI_STATUS
+JoyStickRestartTransfers (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_STATUS            Status;
+  EFI_STATUS            EndpointStatus;
+  JOYSTICK_IN_ENDPOINT  *Endpoint;
+  EFI_TPL               OldTpl;
+  UINTN                 Index;
+
+  //
+  // JoyStickHandler stops a transfer at TPL_NOTIFY.
+  //
+  Status = EFI_SUCCESS;
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  for (Index = 0; Index < UsbJoyStickDevice->InEndpointCount && UsbJoyStickDevice->AsyncActive; Index++) {
+    Endpoint = &UsbJoyStickDevice->InEndpoints[Index];
+    if (Endpoint->AsyncActive) {
+      continue;
+    }
+    EndpointStatus = UsbJoyStickDevice->UsbIo->UsbAsyncInterruptTransfer (
+                                                 UsbJoyStickDevice->UsbIo,
+                                                 Endpoint->Descriptor.EndpointAddress,
+                                                 TRUE,
+                                                 Endpoint->Descriptor.Interval,
+                                                 Endpoint->PacketSize,
+                                                 JoyStickHandler,
+                                                 Endpoint
+                                                 );
+    Endpoint->AsyncActive = (BOOLEAN) !EFI_ERROR (EndpointStatus);
+    JOYSTICK_TRACE (
+      EFI_ERROR (EndpointStatus) ? JOYSTICK_TRACE_LEVEL_ERROR : JOYSTICK_TRACE_LEVEL_INFO,
+      JOYSTICK_TRACE_RECOVERY,
+      Endpoint->Descriptor.EndpointAddress,
+      EndpointStatus
+      );
+    if (EFI_ERROR (EndpointStatus)) {
+      Status = EndpointStatus;
+    } else {
+      JoyStickCountRecovery (UsbJoyStickDevice);
+    }
+  }
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
+/**
+  Start bringing the controller up: initialize it, start the asynchronous
+  interrupt transfers and send the USB handshake. The shared activation
+  timer takes it through the report mode, device info and IMU calibration
+  steps, then joins the merged key stream and sets Activated.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        The controller is active or being brought up.
+  @retval Others             The controller could not be initialized.
+
+**/
+EFI_STATUS
+JoyStickActivate (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_STATUS          Status;
+  EFI_TPL             OldTpl;
+
+  if (UsbJoyStickDevice->Activated ||
+      UsbJoyStickDevice->ActivateState != JOYSTICK_ACTIVATE_IDLE) {
+    return EFI_SUCCESS;
+  }
+
+  PERF_START (UsbJoyStickDevice->ControllerHandle, "JoyStickActivate", NULL, 0);
+  UsbJoyStickDevice->ActivateBegin = GetPerformanceCounter ();
+
+  Status = InitUSBJoyStick (UsbJoyStickDevice);
+  if (EFI_ERROR (Status)) {
+    JoyStickActivateFinish (UsbJoyStickDevice, EFI_UNSUPPORTED);
+    return EFI_UNSUPPORTED;
+  }
+
+  //
+  // Replies only come through the transfer from here on. The controller
+  // stays in full mode until the report mode step has been answered.
+  //
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  UsbJoyStickDevice->ReportMode          = JOYSTICK_REPORT_MODE_FULL;
+  UsbJoyStickDevice->RequestedReportMode = JOYSTICK_REPORT_MODE_FULL;
+  UsbJoyStickDevice->SubcmdPending       = 0;
+  UsbJoyStickDevice->HandshakeReplied    = FALSE;
+  UsbJoyStickDevice->ActivateState       = JOYSTICK_ACTIVATE_HANDSHAKE;
+
+  Status = JoyStickActivateJoin (UsbJoyStickDevice);
+  if (!EFI_ERROR (Status)) {
+    Status = JoyStickStartTransfers (UsbJoyStickDevice);
+  }
+  if (EFI_ERROR (Status)) {
+    JoyStickActivateFinish (UsbJoyStickDevice, Status);
+    gBS->RestoreTPL (OldTpl);
+    return EFI_UNSUPPORTED;
+  }
+
+  JoyStickActivateEnter (UsbJoyStickDevice, JOYSTICK_ACTIVATE_HANDSHAKE);
+  gBS->RestoreTPL (OldTpl);
+  return EFI_SUCCESS;
+}
+
+/**
+  Ask for the controller to be activated because a consumer wants input.
+
+  Activation starts at TPL_CALLBACK: right away when called below it,
+  otherwise as soon as the TPL drops.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        The controller is active.
+  @retval EFI_NOT_READY      Activation is pending or in progress.
+  @retval EFI_DEVICE_ERROR   Activation failed.
+
+**/
+EFI_STATUS
+JoyStickRequestActivation (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  if (!UsbJoyStickDevice->Activated && !UsbJoyStickDevice->ActivationFailed &&
+      UsbJoyStickDevice->ActivateState == JOYSTICK_ACTIVATE_IDLE) {
+    gBS->SignalEvent (UsbJoyStickDevice->ActivateEvent);
+  }
+
+  if (UsbJoyStickDevice->Activated) {
+    return EFI_SUCCESS;
+  }
+  return UsbJoyStickDevice->ActivationFailed ? EFI_DEVICE_ERROR : EFI_NOT_READY;
+}
+
+/**
+  Run a requested activation.
+
+  @param  Event        The ActivateEvent of the device.
+  @param  Context      Points to USB_JS_DEV instance.
+
+**/
+VOID
+EFIAPI
+JoyStickActivateNotify (
+  IN  EFI_EVENT               Event,
+  IN  VOID                    *Context
+  )
+{
+  USB_JS_DEV          *UsbJoyStickDevice;
+
+  UsbJoyStickDevice = (USB_JS_DEV *) Context;
+  if (UsbJoyStickDevice->ActivationFailed) {
+    return;
+  }
+
+  JoyStickActivate (UsbJoyStickDevice);
+}
+
+/**
+  Take an input report received while the controller is being brought up.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Report             The JOYSTICK_REPORT_SIZE bytes of the report.
+
+**/
+VOID
+JoyStickActivateReport (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report
+  )
+{
+  switch (Report[0]) {
+  case JOYSTICK_IN_USB_REPLY:
+    if (Report[1] == JOYSTICK_USB_CMD_HANDSHAKE) {
+      UsbJoyStickDevice->HandshakeReplied = TRUE;
+    }
+    break;
+
+  case JOYSTICK_IN_SUBCMD_REPLY:
+    JoyStickSubcommandReply (UsbJoyStickDevice, Report);
+    break;
+
+  default:
+    break;
+  }
+}
+
+/**
+  Give up bringing the controller up, before it is stopped.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickCancelActivation (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  if (UsbJoyStickDevice->ActivateState == JOYSTICK_ACTIVATE_IDLE) {
+    return;
+  }
+
+  JoyStickActivateLeave (UsbJoyStickDevice);
+  PERF_END (UsbJoyStickDevice->ControllerHandle, "JoyStickActivate", NULL, 0);
+}
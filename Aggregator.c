@@ -0,0 +1,452 @@
+/** @file
+  Player slots and the merged key stream of all bound controllers.
+
+  Each controller decodes into its own key queue. Readers of any controller's
+  Simple Text Input protocol take the oldest key across all queues, so keys
+  come out in arrival order whichever handle ConSplitter happens to poll, and
+  a pad bursting keys only overflows its own queue.
+
+  Keys carry the performance counter value of their report's arrival. The
+  time from arrival to read is kept per key for GetKeyInfo() and summed up
+  in a histogram for GetQueueStats(). SetKeyEdges() picks the button edges
+  a controller produces keys on.
+
+  YIZD 2021
+
+**/
+
+#include "JoyStick.h"
+
+//
+// Bound controllers by player slot, player N in slot N - 1.
+//
+USB_JS_DEV            *mJoyStickPlayers[JOYSTICK_MAX_PLAYERS];
+
+//
+// Performance counter value at driver load and its direction.
+//
+UINT64                mJoyStickClockStart;
+BOOLEAN               mJoyStickClockUp = TRUE;
+
+//
+// Keys most recently returned by the merged stream, for GetKeyInfo().
+//
+UINT32                mJoyStickKeySequence;
+JOYSTICK_KEY_HISTORY  mJoyStickKeyHistory[JOYSTICK_KEY_HISTORY_SIZE];
+
+//
+// Queue time of every key read, see USB_JOYSTICK_QUEUE_TIME_BUCKETS.
+//
+UINT64                mJoyStickQueueTimeMax;
+UINT32                mJoyStickQueueTimeHistogram[USB_JOYSTICK_QUEUE_TIME_BUCKETS];
+
+/**
+  Give a controller the lowest free player slot and light its player LED.
+
+  @param  UsbJoyStickDevice     The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS           UsbJoyStickDevice->PlayerId is assigned.
+  @retval EFI_OUT_OF_RESOURCES  All player slots are taken.
+
+**/
+EFI_STATUS
+JoyStickAddPlayer (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_TPL             OldTpl;
+  UINTN               Slot;
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  for (Slot = 0; Slot < JOYSTICK_MAX_PLAYERS; Slot++) {
+    if (mJoyStickPlayers[Slot] == NULL) {
+      mJoyStickPlayers[Slot]       = UsbJoyStickDevice;
+      UsbJoyStickDevice->PlayerId  = (UINT8) (Slot + 1);
+      break;
+    }
+  }
+  gBS->RestoreTPL (OldTpl);
+
+  if (Slot == JOYSTICK_MAX_PLAYERS) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  JoyStickShowPlayer (UsbJoyStickDevice, UsbJoyStickDevice->PlayerId);
+  return EFI_SUCCESS;
+}
+
+/**
+  Light the player LED of a player slot on a controller.
+
+  @param  UsbJoyStickDevice     The USB_JS_DEV instance.
+  @param  PlayerId              The player, 1 to JOYSTICK_MAX_PLAYERS.
+
+**/
+VOID
+JoyStickShowPlayer (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT8          PlayerId
+  )
+{
+  UINTN               Slot;
+  UINT8               Lights;
+
+  //
+  // Players 1-4 get a steady LED, players 5-8 a flashing one. Not fatal if
+  // the controller does not take it.
+  //
+  Slot   = PlayerId - 1;
+  Lights = (UINT8) ((Slot < 4) ? (BIT0 << Slot) : (BIT4 << (Slot - 4)));
+  JoyStickSendSubcommand (
+    UsbJoyStickDevice,
+    JOYSTICK_SUBCMD_SET_PLAYER_LIGHTS,
+    &Lights,
+    sizeof (Lights),
+    NULL
+    );
+}
+
+/**
+  Free the player slot of a controller. Keys it queued and not yet read are
+  dropped.
+
+  @param  UsbJoyStickDevice     The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickRemovePlayer (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_TPL             OldTpl;
+
+  if (UsbJoyStickDevice->PlayerId == 0) {
+    return;
+  }
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  mJoyStickPlayers[UsbJoyStickDevice->PlayerId - 1] = NULL;
+  UsbJoyStickDevice->PlayerId = 0;
+  gBS->RestoreTPL (OldTpl);
+}
+
+/**
+  Record the direction the performance counter counts in, so arrival stamps
+  can be taken with a single counter read.
+
+**/
+VOID
+JoyStickInitArrivalClock (
+  VOID
+  )
+{
+  UINT64              StartValue;
+  UINT64              EndValue;
+
+  GetPerformanceCounterProperties (&StartValue, &EndValue);
+  mJoyStickClockUp    = (BOOLEAN) (StartValue < EndValue);
+  mJoyStickClockStart = GetPerformanceCounter ();
+}
+
+/**
+  Return the arrival stamp of an input report. Called at the top of
+  JoyStickHandler, before any decode work.
+
+  @return Performance counter ticks since the driver loaded, increasing
+          with time whichever direction the counter runs.
+
+**/
+UINT64
+JoyStickArrivalStamp (
+  VOID
+  )
+{
+  UINT64              Counter;
+
+  Counter = GetPerformanceCounter ();
+  return mJoyStickClockUp ? Counter - mJoyStickClockStart : mJoyStickClockStart - Counter;
+}
+
+/**
+  Convert an arrival stamp back to a performance counter value.
+
+  @param  Stamp            A value returned by JoyStickArrivalStamp().
+
+  @return The performance counter value the stamp was taken at.
+
+**/
+STATIC
+UINT64
+JoyStickStampToCounter (
+  IN UINT64             Stamp
+  )
+{
+  return mJoyStickClockUp ? mJoyStickClockStart + Stamp : mJoyStickClockStart - Stamp;
+}
+
+/**
+  Add one key's queue time to the histogram.
+
+  @param  QueueTime        Nanoseconds from report arrival to read.
+
+**/
+STATIC
+VOID
+JoyStickRecordQueueTime (
+  IN UINT64             QueueTime
+  )
+{
+  UINT64              MicroSeconds;
+  UINTN               Bucket;
+
+  MicroSeconds = DivU64x32 (QueueTime, 1000);
+  Bucket       = (MicroSeconds == 0) ? 0 : (UINTN) HighBitSet64 (MicroSeconds) + 1;
+  Bucket       = MIN (Bucket, USB_JOYSTICK_QUEUE_TIME_BUCKETS - 1);
+
+  mJoyStickQueueTimeHistogram[Bucket]++;
+  mJoyStickQueueTimeMax = MAX (mJoyStickQueueTimeMax, QueueTime);
+}
+
+/**
+  Check whether any controller has a key queued.
+
+  @retval TRUE             A key can be read from the merged stream.
+  @retval FALSE            All key queues are empty.
+
+**/
+BOOLEAN
+JoyStickMergedKeyPending (
+  VOID
+  )
+{
+  UINTN               Slot;
+
+  for (Slot = 0; Slot < JOYSTICK_MAX_PLAYERS; Slot++) {
+    if (mJoyStickPlayers[Slot] != NULL &&
+        !JoyStickKeyQueueIsEmpty (&mJoyStickPlayers[Slot]->Decoder.Keys)) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/**
+  Take the key with the oldest arrival stamp out of the key queues of all
+  controllers.
+
+  @param  KeyData          Receives the key.
+
+  @retval EFI_SUCCESS      The key was returned.
+  @retval EFI_NOT_READY    All key queues are empty.
+
+**/
+EFI_STATUS
+JoyStickReadMergedKey (
+  OUT EFI_KEY_DATA      *KeyData
+  )
+{
+  EFI_TPL                   OldTpl;
+  UINTN                     Slot;
+  USB_JS_DEV                *Oldest;
+  CONST JOYSTICK_KEY_ENTRY  *Head;
+  UINT64                    OldestArrival;
+  JOYSTICK_KEY_ENTRY        Entry;
+  JOYSTICK_KEY_HISTORY      *History;
+  UINT64                    ReadStamp;
+
+  //
+  // The key queues are filled by JoyStickHandler at TPL_NOTIFY.
+  //
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+
+  Oldest        = NULL;
+  OldestArrival = 0;
+  for (Slot = 0; Slot < JOYSTICK_MAX_PLAYERS; Slot++) {
+    if (mJoyStickPlayers[Slot] == NULL) {
+      continue;
+    }
+    Head = JoyStickPeekKey (&mJoyStickPlayers[Slot]->Decoder.Keys);
+    if (Head != NULL && (Oldest == NULL || Head->Arrival < OldestArrival)) {
+      Oldest        = mJoyStickPlayers[Slot];
+      OldestArrival = Head->Arrival;
+    }
+  }
+
+  if (Oldest == NULL) {
+    gBS->RestoreTPL (OldTpl);
+    return EFI_NOT_READY;
+  }
+
+  JoyStickDequeueKey (&Oldest->Decoder.Keys, &Entry);
+  ReadStamp = JoyStickArrivalStamp ();
+
+  History = &mJoyStickKeyHistory[mJoyStickKeySequence % JOYSTICK_KEY_HISTORY_SIZE];
+  CopyMem (&History->KeyData, &Entry.KeyData, sizeof (EFI_KEY_DATA));
+  History->Info.PlayerId       = Oldest->PlayerId;
+  History->Info.Edge           = (UINT8) (Entry.Edge == JOYSTICK_KEY_RELEASE ?
+                                            USB_JOYSTICK_KEY_RELEASE : USB_JOYSTICK_KEY_PRESS);
+  History->Info.Sequence       = mJoyStickKeySequence++;
+  History->Info.ArrivalCounter = JoyStickStampToCounter (Entry.Arrival);
+  History->Info.ReadCounter    = JoyStickStampToCounter (ReadStamp);
+  History->Info.QueueTime      = GetTimeInNanoSecond (ReadStamp - Entry.Arrival);
+  JoyStickRecordQueueTime (History->Info.QueueTime);
+
+  gBS->RestoreTPL (OldTpl);
+
+  CopyMem (KeyData, &Entry.KeyData, sizeof (EFI_KEY_DATA));
+  return EFI_SUCCESS;
+}
+
+/**
+  Look up a key recently returned by ReadKeyStroke() or ReadKeyStrokeEx().
+
+  @param  This                  The USB_JOYSTICK_KEY_INFO_PROTOCOL instance.
+  @param  KeyData               The key as returned by the Simple Text Input
+                                protocol. Only KeyData->Key is compared.
+  @param  Info                  Receives the information about the key.
+
+  @retval EFI_SUCCESS           Info was filled in.
+  @retval EFI_NOT_FOUND         The key is not among the recently returned ones.
+  @retval EFI_INVALID_PARAMETER KeyData or Info is NULL.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickGetKeyInfo (
+  IN  USB_JOYSTICK_KEY_INFO_PROTOCOL  *This,
+  IN  CONST EFI_KEY_DATA              *KeyData,
+  OUT USB_JOYSTICK_KEY_INFO           *Info
+  )
+{
+  EFI_STATUS              Status;
+  EFI_TPL                 OldTpl;
+  UINTN                   Count;
+  UINTN                   Index;
+  JOYSTICK_KEY_HISTORY    *History;
+
+  if (KeyData == NULL || Info == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Status = EFI_NOT_FOUND;
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+
+  //
+  // Newest first, so a repeated key resolves to its latest occurrence.
+  //
+  Count = MIN (mJoyStickKeySequence, JOYSTICK_KEY_HISTORY_SIZE);
+  for (Index = 1; Index <= Count; Index++) {
+    History = &mJoyStickKeyHistory[(mJoyStickKeySequence - Index) % JOYSTICK_KEY_HISTORY_SIZE];
+    if (History->KeyData.Key.ScanCode == KeyData->Key.ScanCode &&
+        History->KeyData.Key.UnicodeChar == KeyData->Key.UnicodeChar) {
+      CopyMem (Info, &History->Info, sizeof (USB_JOYSTICK_KEY_INFO));
+      Status = EFI_SUCCESS;
+      break;
+    }
+  }
+
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
+/**
+  Return the upper bound of the queue time histogram bucket holding the
+  given rank.
+
+  @param  Rank             1 based rank among the Count keys recorded.
+
+  @return The bucket's upper bound in nanoseconds, at most the maximum seen.
+
+**/
+STATIC
+UINT64
+JoyStickQueueTimePercentile (
+  IN UINT64             Rank
+  )
+{
+  UINT64              Seen;
+  UINTN               Bucket;
+
+  Seen = 0;
+  for (Bucket = 0; Bucket < USB_JOYSTICK_QUEUE_TIME_BUCKETS - 1; Bucket++) {
+    Seen += mJoyStickQueueTimeHistogram[Bucket];
+    if (Seen >= Rank) {
+      return MIN (MultU64x32 (LShiftU64 (1, Bucket), 1000), mJoyStickQueueTimeMax);
+    }
+  }
+  return mJoyStickQueueTimeMax;
+}
+
+/**
+  Summarize the queue time of all keys read from the merged stream.
+
+  @param  This                  The USB_JOYSTICK_KEY_INFO_PROTOCOL instance.
+  @param  Stats                 Receives the statistics, times in nanoseconds.
+
+  @retval EFI_SUCCESS           Stats was filled in.
+  @retval EFI_INVALID_PARAMETER Stats is NULL.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickGetQueueStats (
+  IN  USB_JOYSTICK_KEY_INFO_PROTOCOL  *This,
+  OUT USB_JOYSTICK_QUEUE_STATS        *Stats
+  )
+{
+  EFI_TPL                 OldTpl;
+
+  if (Stats == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+
+  Stats->Count = mJoyStickKeySequence;
+  Stats->Max   = mJoyStickQueueTimeMax;
+  Stats->P50   = JoyStickQueueTimePercentile (DivU64x32 (MultU64x32 (Stats->Count, 50) + 99, 100));
+  Stats->P90   = JoyStickQueueTimePercentile (DivU64x32 (MultU64x32 (Stats->Count, 90) + 99, 100));
+  Stats->P99   = JoyStickQueueTimePercentile (DivU64x32 (MultU64x32 (Stats->Count, 99) + 99, 100));
+  CopyMem (Stats->Histogram, mJoyStickQueueTimeHistogram, sizeof (Stats->Histogram));
+
+  gBS->RestoreTPL (OldTpl);
+  return EFI_SUCCESS;
+}
+
+/**
+  Select the buttons of a controller producing keys on press and on release.
+
+  @param  This                  The USB_JOYSTICK_KEY_INFO_PROTOCOL instance.
+  @param  PressButtons          The buttons producing a key when pressed.
+  @param  ReleaseButtons        The buttons producing a key when released.
+
+  @retval EFI_SUCCESS           The selection applies from the next report.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickSetKeyEdges (
+  IN USB_JOYSTICK_KEY_INFO_PROTOCOL  *This,
+  IN UINT32                          PressButtons,
+  IN UINT32                          ReleaseButtons
+  )
+{
+  USB_JS_DEV              *UsbJoyStickDevice;
+  EFI_TPL                 OldTpl;
+
+  UsbJoyStickDevice = KEY_INFO_USB_JS_DEV_FROM_THIS (This);
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+
+  //
+  // A pair decodes on its owner, and either half may become the owner
+  // when the other is unplugged.
+  //
+  JoyStickSetKeyEdges (&UsbJoyStickDevice->Decoder, PressButtons, ReleaseButtons);
+  if (UsbJoyStickDevice->Partner != NULL) {
+    JoyStickSetKeyEdges (&UsbJoyStickDevice->Partner->Decoder, PressButtons, ReleaseButtons);
+  }
+
+  gBS->RestoreTPL (OldTpl);
+  return EFI_SUCCESS;
+}
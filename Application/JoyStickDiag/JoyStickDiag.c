@@ -0,0 +1,370 @@
+/** @file
+  Shell diagnostic command for the USB JoyStick driver.
+
+  JoyStickDiag trace     Decode the binary trace buffer of UsbJoyStickDxe.
+  JoyStickDiag stats [-w [ms]]
+                         Print the counters of every controller the driver
+                         manages, refreshed every ms milliseconds with -w
+                         until a key is pressed.
+
+  YIZD 2021
+
+**/
+
+#include <Uefi.h>
+
+#include <Guid/JoyStickTrace.h>
+#include <Protocol/JoyStickStats.h>
+#include <Protocol/ShellParameters.h>
+
+#include <Library/BaseLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+
+#define JOYSTICK_DIAG_WATCH_MS    1000
+
+typedef struct {
+  UINT32    Event;
+  CHAR16    *Name;
+} JOYSTICK_TRACE_NAME;
+
+GLOBAL_REMOVE_IF_UNREFERENCED JOYSTICK_TRACE_NAME mJoyStickTraceNames[] = {
+  { JOYSTICK_TRACE_SUPPORTED,    L"Supported"    },
+  { JOYSTICK_TRACE_DEVICE_ID,    L"DeviceId"     },
+  { JOYSTICK_TRACE_START,        L"Start"        },
+  { JOYSTICK_TRACE_START_DONE,   L"StartDone"    },
+  { JOYSTICK_TRACE_START_ERROR,  L"StartError"   },
+  { JOYSTICK_TRACE_ENDPOINT,     L"Endpoint"     },
+  { JOYSTICK_TRACE_STOP,         L"Stop"         },
+  { JOYSTICK_TRACE_INIT,         L"Init"         },
+  { JOYSTICK_TRACE_SUBCMD,       L"Subcommand"   },
+  { JOYSTICK_TRACE_IMU_CAL,      L"ImuCal"       },
+  { JOYSTICK_TRACE_ACTIVATE,     L"Activate"     },
+  { JOYSTICK_TRACE_CAL_CACHE,    L"CalCache"     },
+  { JOYSTICK_TRACE_PAIR,         L"Pair"         },
+  { JOYSTICK_TRACE_RESET,        L"Reset"        },
+  { JOYSTICK_TRACE_RECOVERY,     L"Recovery"     },
+  { JOYSTICK_TRACE_REPORT,       L"Report"       },
+  { JOYSTICK_TRACE_REPORT_ERROR, L"ReportError"  },
+  { JOYSTICK_TRACE_BUTTONS,      L"Buttons"      }
+};
+
+/**
+  Return the name of a trace event.
+
+  @param  Event            The JOYSTICK_TRACE_* event id.
+
+  @return The event name, or "?" for an unknown event.
+
+**/
+STATIC
+CHAR16 *
+JoyStickTraceName (
+  IN UINT32     Event
+  )
+{
+  UINTN         Index;
+
+  for (Index = 0; Index < ARRAY_SIZE (mJoyStickTraceNames); Index++) {
+    if (mJoyStickTraceNames[Index].Event == Event) {
+      return mJoyStickTraceNames[Index].Name;
+    }
+  }
+  return L"?";
+}
+
+/**
+  Convert a performance counter delta to microseconds.
+
+  @param  Trace            The trace buffer, giving the counter properties.
+  @param  Base             The counter value of time zero.
+  @param  Timestamp        The counter value to convert.
+
+  @return Microseconds elapsed from Base to Timestamp.
+
+**/
+STATIC
+UINT64
+JoyStickTraceMicroSeconds (
+  IN CONST JOYSTICK_TRACE_BUFFER  *Trace,
+  IN UINT64                       Base,
+  IN UINT64                       Timestamp
+  )
+{
+  UINT64        Delta;
+  UINT64        Seconds;
+  UINT64        Remainder;
+
+  if (Trace->TimerFrequency == 0) {
+    return 0;
+  }
+
+  if (Trace->TimerStart < Trace->TimerEnd) {
+    Delta = Timestamp - Base;
+  } else {
+    Delta = Base - Timestamp;
+  }
+
+  Seconds = DivU64x64Remainder (Delta, Trace->TimerFrequency, &Remainder);
+  return MultU64x32 (Seconds, 1000000) +
+         DivU64x64Remainder (MultU64x32 (Remainder, 1000000), Trace->TimerFrequency, NULL);
+}
+
+/**
+  Print the records of the trace buffer, oldest first.
+
+  @retval EFI_SUCCESS           The trace buffer was printed.
+  @retval EFI_NOT_FOUND         The driver did not publish a trace buffer.
+  @retval EFI_INCOMPATIBLE_VERSION  The trace buffer layout is not understood.
+
+**/
+STATIC
+EFI_STATUS
+JoyStickDumpTrace (
+  VOID
+  )
+{
+  EFI_STATUS                    Status;
+  JOYSTICK_TRACE_BUFFER         *Trace;
+  CONST JOYSTICK_TRACE_RECORD   *Record;
+  UINT32                        Written;
+  UINT32                        First;
+  UINT32                        Index;
+  UINT64                        Base;
+  UINT64                        MicroSeconds;
+
+  Status = EfiGetSystemConfigurationTable (&gUsbJoyStickTraceGuid, (VOID **) &Trace);
+  if (EFI_ERROR (Status)) {
+    Print (L"JoyStickDiag: no trace buffer, is UsbJoyStickDxe loaded with tracing enabled?\n");
+    return EFI_NOT_FOUND;
+  }
+
+  if (Trace->Signature != JOYSTICK_TRACE_SIGNATURE ||
+      Trace->Version != JOYSTICK_TRACE_VERSION ||
+      Trace->RecordSize != sizeof (JOYSTICK_TRACE_RECORD)) {
+    Print (L"JoyStickDiag: unsupported trace buffer version %d\n", Trace->Version);
+    return EFI_INCOMPATIBLE_VERSION;
+  }
+
+  Written = Trace->Written;
+  First   = (Written > Trace->Capacity) ? Written - Trace->Capacity : 0;
+  Base    = Trace->Records[First % Trace->Capacity].Timestamp;
+
+  Print (L"%d records, %d dropped\n", Written - First, First);
+  Print (L"      Time(us)  Event         Arg0              Arg1\n");
+  for (Index = First; Index != Written; Index++) {
+    Record       = &Trace->Records[Index % Trace->Capacity];
+    MicroSeconds = JoyStickTraceMicroSeconds (Trace, Base, Record->Timestamp);
+    Print (
+      L"%14ld  %-12s  %016lx  %016lx\n",
+      MicroSeconds,
+      JoyStickTraceName (Record->Event),
+      Record->Arg0,
+      Record->Arg1
+      );
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Print the counters of every controller handle carrying the statistics
+  protocol, in handle order.
+
+  @retval EFI_SUCCESS           The counters were printed.
+  @retval EFI_NOT_FOUND         No controller publishes statistics.
+
+**/
+STATIC
+EFI_STATUS
+JoyStickDumpStats (
+  VOID
+  )
+{
+  EFI_STATUS                    Status;
+  EFI_HANDLE                    *Handles;
+  UINTN                         HandleCount;
+  UINTN                         Index;
+  USB_JOYSTICK_STATS_PROTOCOL   *StatsProtocol;
+  USB_JOYSTICK_STATS            Stats;
+  CHAR16                        *Path;
+
+  Status = gBS->LocateHandleBuffer (
+                  ByProtocol,
+                  &gUsbJoyStickStatsProtocolGuid,
+                  NULL,
+                  &HandleCount,
+                  &Handles
+                  );
+  if (EFI_ERROR (Status)) {
+    Print (L"JoyStickDiag: no controller, is UsbJoyStickDxe loaded with statistics enabled?\n");
+    return EFI_NOT_FOUND;
+  }
+
+  for (Index = 0; Index < HandleCount; Index++) {
+    Status = gBS->HandleProtocol (Handles[Index], &gUsbJoyStickStatsProtocolGuid, (VOID **) &StatsProtocol);
+    if (EFI_ERROR (Status) || EFI_ERROR (StatsProtocol->GetStats (StatsProtocol, &Stats))) {
+      continue;
+    }
+
+    Path = ConvertDevicePathToText (DevicePathFromHandle (Handles[Index]), TRUE, TRUE);
+    Print (L"Controller %d  %s\n", Index, (Path != NULL) ? Path : L"?");
+    if (Path != NULL) {
+      FreePool (Path);
+    }
+
+    Print (
+      L"  reports   %ld received  %ld unchanged  %ld errors  %ld recoveries\n",
+      Stats.Reports,
+      Stats.Unchanged,
+      Stats.Errors,
+      Stats.Recoveries
+      );
+    Print (
+      L"  ids       0x30 %ld  0x3F %ld  0x21 %ld  0x81 %ld  other %ld\n",
+      Stats.ReportTypes[USB_JOYSTICK_REPORT_FULL],
+      Stats.ReportTypes[USB_JOYSTICK_REPORT_SIMPLE],
+      Stats.ReportTypes[USB_JOYSTICK_REPORT_SUBCMD_REPLY],
+      Stats.ReportTypes[USB_JOYSTICK_REPORT_USB_REPLY],
+      Stats.ReportTypes[USB_JOYSTICK_REPORT_OTHER]
+      );
+    Print (L"  keys      %ld queued  %ld dropped\n", Stats.KeysQueued, Stats.KeysDropped);
+    Print (L"  transfer  %d ms interval  %d endpoints active\n", Stats.PollInterval, Stats.ActiveEndpoints);
+    Print (
+      L"  callback  %ld calls  p50 %ld ns  p90 %ld ns  p99 %ld ns  max %ld ns\n",
+      Stats.Callbacks,
+      Stats.CallbackP50,
+      Stats.CallbackP90,
+      Stats.CallbackP99,
+      Stats.CallbackMax
+      );
+  }
+
+  FreePool (Handles);
+  return EFI_SUCCESS;
+}
+
+/**
+  Print the counters every Interval milliseconds until a key is pressed.
+
+  @param  Interval              The refresh interval in milliseconds.
+
+  @retval EFI_SUCCESS           A key was pressed.
+  @retval Others                The counters could not be printed, or the
+                                timer not be set.
+
+**/
+STATIC
+EFI_STATUS
+JoyStickWatchStats (
+  IN UINTN                      Interval
+  )
+{
+  EFI_STATUS                    Status;
+  EFI_EVENT                     Events[2];
+  UINTN                         Signaled;
+  EFI_INPUT_KEY                 Key;
+
+  Status = gBS->CreateEvent (EVT_TIMER, 0, NULL, NULL, &Events[0]);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Status = gBS->SetTimer (Events[0], TimerPeriodic, MultU64x32 (Interval, 10000));
+  if (EFI_ERROR (Status)) {
+    gBS->CloseEvent (Events[0]);
+    return Status;
+  }
+  Events[1] = gST->ConIn->WaitForKey;
+
+  for (;;) {
+    gST->ConOut->ClearScreen (gST->ConOut);
+    Print (L"JoyStickDiag stats, every %d ms, any key to stop\n\n", Interval);
+    Status = JoyStickDumpStats ();
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+
+    Status = gBS->WaitForEvent (ARRAY_SIZE (Events), Events, &Signaled);
+    if (EFI_ERROR (Status) || Signaled == 1) {
+      gST->ConIn->ReadKeyStroke (gST->ConIn, &Key);
+      break;
+    }
+  }
+
+  gBS->CloseEvent (Events[0]);
+  return Status;
+}
+
+/**
+  Print the command usage.
+
+**/
+STATIC
+VOID
+JoyStickDiagUsage (
+  VOID
+  )
+{
+  Print (L"Usage: JoyStickDiag trace\n");
+  Print (L"       JoyStickDiag stats [-w [ms]]\n");
+  Print (L"  trace    Decode the binary trace buffer of UsbJoyStickDxe.\n");
+  Print (L"  stats    Print the counters of every controller, with -w every\n");
+  Print (L"           ms milliseconds (default %d) until a key is pressed.\n", JOYSTICK_DIAG_WATCH_MS);
+}
+
+/**
+  Entry point of the JoyStickDiag shell command.
+
+  @param  ImageHandle       The firmware allocated handle for the EFI image.
+  @param  SystemTable       A pointer to the EFI System Table.
+
+  @retval EFI_SUCCESS            The command completed.
+  @retval EFI_INVALID_PARAMETER  The command line is not valid.
+  @retval Others                 The command failed.
+
+**/
+EFI_STATUS
+EFIAPI
+JoyStickDiagEntryPoint (
+  IN EFI_HANDLE           ImageHandle,
+  IN EFI_SYSTEM_TABLE     *SystemTable
+  )
+{
+  EFI_STATUS                     Status;
+  EFI_SHELL_PARAMETERS_PROTOCOL  *ShellParameters;
+  UINTN                          Interval;
+
+  Status = gBS->HandleProtocol (
+                  ImageHandle,
+                  &gEfiShellParametersProtocolGuid,
+                  (VOID **) &ShellParameters
+                  );
+  if (EFI_ERROR (Status) || ShellParameters->Argc < 2) {
+    JoyStickDiagUsage ();
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (StrCmp (ShellParameters->Argv[1], L"trace") == 0) {
+    return JoyStickDumpTrace ();
+  }
+
+  if (StrCmp (ShellParameters->Argv[1], L"stats") == 0) {
+    if (ShellParameters->Argc == 2) {
+      return JoyStickDumpStats ();
+    }
+    if (StrCmp (ShellParameters->Argv[2], L"-w") == 0 && ShellParameters->Argc <= 4) {
+      Interval = JOYSTICK_DIAG_WATCH_MS;
+      if (ShellParameters->Argc == 4) {
+        Interval = StrDecimalToUintn (ShellParameters->Argv[3]);
+      }
+      if (Interval != 0) {
+        return JoyStickWatchStats (Interval);
+      }
+    }
+  }
+
+  JoyStickDiagUsage ();
+  return EFI_INVALID_PARAMETER;
+}
@@ -0,0 +1,203 @@
+/** @file
+  Calibration cache of the USB JoyStick driver.
+
+  Reading the IMU calibration takes up to two SPI read round trips on every
+  Start. The first calibration read from a controller is stored in a
+  non-volatile variable named after its Bluetooth address, and later
+  activations take it from there once its CRC32 and the firmware version
+  match. See Include/Guid/JoyStickCalibration.h.
+
+  YIZD 2021
+
+**/
+
+#include "JoyStick.h"
+
+#define JOYSTICK_CALIBRATION_NAME_LENGTH \
+  (sizeof (JOYSTICK_CALIBRATION_VARIABLE_PREFIX) / sizeof (CHAR16) + 2 * JOYSTICK_MAC_SIZE)
+
+/**
+  Build the name of the calibration variable of a controller.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance, with Mac set.
+  @param  Name               Buffer of JOYSTICK_CALIBRATION_NAME_LENGTH characters.
+
+**/
+STATIC
+VOID
+JoyStickCalibrationName (
+  IN     USB_JS_DEV     *UsbJoyStickDevice,
+  OUT    CHAR16         *Name
+  )
+{
+  STATIC CONST CHAR16 HexDigits[] = L"0123456789ABCDEF";
+  UINTN               Index;
+
+  CopyMem (Name, JOYSTICK_CALIBRATION_VARIABLE_PREFIX, sizeof (JOYSTICK_CALIBRATION_VARIABLE_PREFIX));
+  Name += sizeof (JOYSTICK_CALIBRATION_VARIABLE_PREFIX) / sizeof (CHAR16) - 1;
+
+  for (Index = 0; Index < JOYSTICK_MAC_SIZE; Index++) {
+    *Name++ = HexDigits[UsbJoyStickDevice->Mac[Index] >> 4];
+    *Name++ = HexDigits[UsbJoyStickDevice->Mac[Index] & 0x0F];
+  }
+  *Name = L'\0';
+}
+
+/**
+  Take the device info subcommand reply: keep the Bluetooth address and
+  firmware version keying the calibration cache.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Reply              The 0x21 reply.
+
+  @retval TRUE               The reply was acknowledged and carries an address.
+  @retval FALSE              The controller cannot be told apart, it is not cached.
+
+**/
+BOOLEAN
+JoyStickSetDeviceInfo (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Reply
+  )
+{
+  CONST UINT8         *Data;
+  UINTN               Index;
+
+  UsbJoyStickDevice->MacValid = FALSE;
+  if ((Reply[JOYSTICK_SUBCMD_ACK_OFFSET] & JOYSTICK_SUBCMD_ACK) == 0 ||
+      Reply[JOYSTICK_SUBCMD_ID_OFFSET] != JOYSTICK_SUBCMD_DEVICE_INFO) {
+    return FALSE;
+  }
+
+  Data = &Reply[JOYSTICK_SUBCMD_DATA_OFFSET];
+  UsbJoyStickDevice->Firmware = (UINT16) ((Data[0] << 8) | Data[1]);
+  CopyMem (UsbJoyStickDevice->Mac, &Data[JOYSTICK_DEVICE_INFO_MAC_OFFSET], JOYSTICK_MAC_SIZE);
+
+  //
+  // An all zero or all one address is no address.
+  //
+  for (Index = 1; Index < JOYSTICK_MAC_SIZE; Index++) {
+    if (UsbJoyStickDevice->Mac[Index] != UsbJoyStickDevice->Mac[0]) {
+      break;
+    }
+  }
+  if (Index == JOYSTICK_MAC_SIZE && (UsbJoyStickDevice->Mac[0] == 0x00 || UsbJoyStickDevice->Mac[0] == 0xFF)) {
+    return FALSE;
+  }
+
+  UsbJoyStickDevice->MacValid = TRUE;
+  return TRUE;
+}
+
+/**
+  Apply the cached calibration of the controller.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance, with Mac set.
+
+  @retval TRUE               The IMU scale is set from the cache.
+  @retval FALSE              Nothing valid is cached, the calibration has to
+                             be read from the controller.
+
+**/
+BOOLEAN
+JoyStickLoadCalibration (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_STATUS                     Status;
+  CHAR16                         Name[JOYSTICK_CALIBRATION_NAME_LENGTH];
+  JOYSTICK_CALIBRATION_VARIABLE  Entry;
+  UINTN                          Size;
+  UINT32                         Crc32;
+
+  if (!UsbJoyStickDevice->MacValid) {
+    return FALSE;
+  }
+
+  JoyStickCalibrationName (UsbJoyStickDevice, Name);
+  Size   = sizeof (Entry);
+  Status = gRT->GetVariable (Name, &gUsbJoyStickCalibrationGuid, NULL, &Size, &Entry);
+  if (!EFI_ERROR (Status) && Size != sizeof (Entry)) {
+    Status = EFI_BAD_BUFFER_SIZE;
+  }
+  if (!EFI_ERROR (Status) &&
+      (Entry.Signature != JOYSTICK_CALIBRATION_SIGNATURE ||
+       Entry.Version != JOYSTICK_CALIBRATION_VERSION ||
+       Entry.Firmware != UsbJoyStickDevice->Firmware)) {
+    Status = EFI_INCOMPATIBLE_VERSION;
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = gBS->CalculateCrc32 (&Entry, OFFSET_OF (JOYSTICK_CALIBRATION_VARIABLE, Crc32), &Crc32);
+    if (!EFI_ERROR (Status) && Crc32 != Entry.Crc32) {
+      Status = EFI_CRC_ERROR;
+    }
+  }
+  if (!EFI_ERROR (Status) &&
+      Entry.Address != JOYSTICK_SPI_IMU_USER_CAL && Entry.Address != JOYSTICK_SPI_IMU_FACTORY_CAL) {
+    Status = EFI_VOLUME_CORRUPTED;
+  }
+  if (!EFI_ERROR (Status) &&
+      !JoyStickSetImuCalibration (UsbJoyStickDevice, Entry.Address, Entry.Data)) {
+    Status = EFI_VOLUME_CORRUPTED;
+  }
+
+  JOYSTICK_TRACE (
+    EFI_ERROR (Status) ? JOYSTICK_TRACE_LEVEL_VERBOSE : JOYSTICK_TRACE_LEVEL_INFO,
+    JOYSTICK_TRACE_CAL_CACHE,
+    EFI_ERROR (Status) ? 0 : Entry.Address,
+    Status
+    );
+  return (BOOLEAN) !EFI_ERROR (Status);
+}
+
+/**
+  Store the calibration read from the controller in its cache variable.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Address            JOYSTICK_SPI_IMU_USER_CAL or JOYSTICK_SPI_IMU_FACTORY_CAL.
+  @param  Data               The bytes read at Address.
+  @param  Length             Number of bytes read, at most JOYSTICK_CALIBRATION_DATA_SIZE.
+
+**/
+VOID
+JoyStickSaveCalibration (
+  IN     USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT32         Address,
+  IN     CONST UINT8    *Data,
+  IN     UINTN          Length
+  )
+{
+  EFI_STATUS                     Status;
+  CHAR16                         Name[JOYSTICK_CALIBRATION_NAME_LENGTH];
+  JOYSTICK_CALIBRATION_VARIABLE  Entry;
+
+  if (!UsbJoyStickDevice->MacValid || Length > sizeof (Entry.Data)) {
+    return;
+  }
+
+  ZeroMem (&Entry, sizeof (Entry));
+  Entry.Signature = JOYSTICK_CALIBRATION_SIGNATURE;
+  Entry.Version   = JOYSTICK_CALIBRATION_VERSION;
+  Entry.Firmware  = UsbJoyStickDevice->Firmware;
+  Entry.Address   = Address;
+  CopyMem (Entry.Data, Data, Length);
+
+  Status = gBS->CalculateCrc32 (&Entry, OFFSET_OF (JOYSTICK_CALIBRATION_VARIABLE, Crc32), &Entry.Crc32);
+  if (!EFI_ERROR (Status)) {
+    JoyStickCalibrationName (UsbJoyStickDevice, Name);
+    Status = gRT->SetVariable (
+                    Name,
+                    &gUsbJoyStickCalibrationGuid,
+                    EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+                    sizeof (Entry),
+                    &Entry
+                    );
+  }
+
+  JOYSTICK_TRACE (
+    EFI_ERROR (Status) ? JOYSTICK_TRACE_LEVEL_ERROR : JOYSTICK_TRACE_LEVEL_INFO,
+    JOYSTICK_TRACE_CAL_CACHE,
+    Address,
+    Status
+    );
+}
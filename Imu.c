@@ -0,0 +1,250 @@
+/** @file
+  IMU decoder and Motion Protocol of the USB JoyStick driver.
+
+  Each full input report carries three accelerometer and gyroscope samples.
+  They are only requested from the controller and decoded while a consumer
+  has started the Motion Protocol.
+
+  YIZD 2021
+
+**/
+
+#include "JoyStick.h"
+
+/**
+  Derive the IMU decode scale from calibration read from SPI flash.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Address            JOYSTICK_SPI_IMU_USER_CAL, JOYSTICK_SPI_IMU_FACTORY_CAL,
+                             or 0 for the nominal scale.
+  @param  Data               The bytes read at Address, NULL when Address is 0.
+
+  @retval TRUE               The scale is set.
+  @retval FALSE              The user calibration does not carry its magic,
+                             the scale is unchanged.
+
+**/
+BOOLEAN
+JoyStickSetImuCalibration (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT32         Address,
+  IN     CONST UINT8    *Data OPTIONAL
+  )
+{
+  JOYSTICK_IMU_CALIBRATION  Calibration;
+
+  if (Address == JOYSTICK_SPI_IMU_USER_CAL) {
+    if (Data[0] != JOYSTICK_SPI_USER_CAL_MAGIC0 || Data[1] != JOYSTICK_SPI_USER_CAL_MAGIC1) {
+      return FALSE;
+    }
+    Data += 2;
+  }
+
+  if (Data == NULL) {
+    JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_IMU_CAL, 0, EFI_NOT_FOUND);
+    JoyStickSetImuScale (NULL, &UsbJoyStickDevice->ImuScale);
+    return TRUE;
+  }
+
+  CopyMem (&Calibration, Data, sizeof (Calibration));
+  JoyStickSetImuScale (&Calibration, &UsbJoyStickDevice->ImuScale);
+  JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_INFO, JOYSTICK_TRACE_IMU_CAL, Address, EFI_SUCCESS);
+  return TRUE;
+}
+
+/**
+  Decode the IMU samples of a full report into the motion ring.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Report             The 0x30 input report.
+
+**/
+VOID
+JoyStickImuReport (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report
+  )
+{
+  INT32                       Values[JOYSTICK_IMU_VALUES];
+  USB_JOYSTICK_MOTION_SAMPLE  *Sample;
+  UINTN                       Index;
+
+  JoyStickDecodeImu (Report, &UsbJoyStickDevice->ImuScale, Values);
+
+  //
+  // The oldest sample comes first in the report. A full ring drops its
+  // oldest entry, the sequence number lets readers notice.
+  //
+  for (Index = 0; Index < JOYSTICK_IMU_SAMPLES; Index++) {
+    Sample = &UsbJoyStickDevice->MotionRing[UsbJoyStickDevice->MotionHead];
+    CopyMem (Sample->Accel, &Values[Index * JOYSTICK_IMU_AXES], sizeof (Sample->Accel));
+    CopyMem (Sample->Gyro, &Values[Index * JOYSTICK_IMU_AXES + 3], sizeof (Sample->Gyro));
+    Sample->Sequence = UsbJoyStickDevice->MotionSequence++;
+
+    UsbJoyStickDevice->MotionHead = (UsbJoyStickDevice->MotionHead + 1) % JOYSTICK_MOTION_RING_SIZE;
+    if (UsbJoyStickDevice->MotionCount < JOYSTICK_MOTION_RING_SIZE) {
+      UsbJoyStickDevice->MotionCount++;
+    }
+  }
+}
+
+/**
+  Register a motion consumer. The first consumer switches the controller to
+  full input reports and enables its IMU.
+
+  @param  This                  The USB_JOYSTICK_MOTION_PROTOCOL instance.
+
+  @retval EFI_SUCCESS           The IMU is streaming or has been requested.
+  @retval EFI_NOT_READY         The controller is still being brought up.
+  @retval EFI_DEVICE_ERROR      The controller could not be configured.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickMotionStart (
+  IN USB_JOYSTICK_MOTION_PROTOCOL  *This
+  )
+{
+  EFI_STATUS          Status;
+  USB_JS_DEV          *UsbJoyStickDevice;
+  EFI_TPL             OldTpl;
+  UINT8               Enable;
+
+  UsbJoyStickDevice = MOTION_USB_JS_DEV_FROM_THIS (This);
+
+  if (UsbJoyStickDevice->MotionUsers != 0) {
+    UsbJoyStickDevice->MotionUsers++;
+    return EFI_SUCCESS;
+  }
+
+  //
+  // Subcommands need the controller brought up.
+  //
+  Status = JoyStickRequestActivation (UsbJoyStickDevice);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Enable = 1;
+  Status = JoyStickSendSubcommand (
+             UsbJoyStickDevice,
+             JOYSTICK_SUBCMD_ENABLE_IMU,
+             &Enable,
+             sizeof (Enable),
+             NULL
+             );
+  if (!EFI_ERROR (Status)) {
+    Status = JoyStickAcquireFullReport (UsbJoyStickDevice);
+  }
+  if (EFI_ERROR (Status)) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  UsbJoyStickDevice->MotionHead  = 0;
+  UsbJoyStickDevice->MotionCount = 0;
+  UsbJoyStickDevice->MotionUsers = 1;
+  gBS->RestoreTPL (OldTpl);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Unregister a motion consumer registered by Start(). The last consumer
+  disables the IMU and releases full input reports.
+
+  @param  This                  The USB_JOYSTICK_MOTION_PROTOCOL instance.
+
+  @retval EFI_SUCCESS           The consumer was unregistered.
+  @retval EFI_NOT_STARTED       No consumer is registered.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickMotionStop (
+  IN USB_JOYSTICK_MOTION_PROTOCOL  *This
+  )
+{
+  USB_JS_DEV          *UsbJoyStickDevice;
+  UINT8               Enable;
+
+  UsbJoyStickDevice = MOTION_USB_JS_DEV_FROM_THIS (This);
+
+  if (UsbJoyStickDevice->MotionUsers == 0) {
+    return EFI_NOT_STARTED;
+  }
+
+  UsbJoyStickDevice->MotionUsers--;
+  if (UsbJoyStickDevice->MotionUsers != 0) {
+    return EFI_SUCCESS;
+  }
+
+  Enable = 0;
+  JoyStickSendSubcommand (
+    UsbJoyStickDevice,
+    JOYSTICK_SUBCMD_ENABLE_IMU,
+    &Enable,
+    sizeof (Enable),
+    NULL
+    );
+  JoyStickReleaseFullReport (UsbJoyStickDevice);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Take the oldest unread samples out of the motion ring.
+
+  @param  This                  The USB_JOYSTICK_MOTION_PROTOCOL instance.
+  @param  Count                 On input the capacity of Samples, on output
+                                the number of samples returned.
+  @param  Samples               Buffer receiving the samples, oldest first.
+
+  @retval EFI_SUCCESS           At least one sample was returned.
+  @retval EFI_NOT_READY         No sample is available.
+  @retval EFI_INVALID_PARAMETER Count or Samples is NULL, or *Count is 0.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickMotionRead (
+  IN     USB_JOYSTICK_MOTION_PROTOCOL  *This,
+  IN OUT UINTN                         *Count,
+  OUT    USB_JOYSTICK_MOTION_SAMPLE    *Samples
+  )
+{
+  USB_JS_DEV          *UsbJoyStickDevice;
+  EFI_TPL             OldTpl;
+  UINTN               Tail;
+  UINTN               Index;
+
+  if (Count == NULL || Samples == NULL || *Count == 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  UsbJoyStickDevice = MOTION_USB_JS_DEV_FROM_THIS (This);
+
+  //
+  // The ring is filled by JoyStickHandler at TPL_NOTIFY.
+  //
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+
+  if (UsbJoyStickDevice->MotionCount == 0) {
+    gBS->RestoreTPL (OldTpl);
+    *Count = 0;
+    return EFI_NOT_READY;
+  }
+
+  *Count = MIN (*Count, UsbJoyStickDevice->MotionCount);
+  Tail   = (UsbJoyStickDevice->MotionHead + JOYSTICK_MOTION_RING_SIZE - UsbJoyStickDevice->MotionCount) %
+           JOYSTICK_MOTION_RING_SIZE;
+  for (Index = 0; Index < *Count; Index++) {
+    CopyMem (&Samples[Index], &UsbJoyStickDevice->MotionRing[Tail], sizeof (USB_JOYSTICK_MOTION_SAMPLE));
+    Tail = (Tail + 1) % JOYSTICK_MOTION_RING_SIZE;
+  }
+  UsbJoyStickDevice->MotionCount -= *Count;
+
+  gBS->RestoreTPL (OldTpl);
+
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,59 @@
+/** @file
+  Layout of the calibration cache variables of UsbJoyStickDxe.
+
+  The IMU calibration read from a controller's SPI flash is kept in a
+  non-volatile variable of the USB_JOYSTICK_CALIBRATION_GUID namespace, one
+  per controller, so later boots skip the SPI reads. The variable name is
+  JOYSTICK_CALIBRATION_VARIABLE_PREFIX followed by the controller's
+  Bluetooth address as 12 upper case hex digits.
+
+  YIZD 2021
+
+**/
+
+#ifndef _JOYSTICK_CALIBRATION_GUID_H_
+#define _JOYSTICK_CALIBRATION_GUID_H_
+
+#define USB_JOYSTICK_CALIBRATION_GUID \
+  { \
+    0x956dfb26, 0x302f, 0x4576, { 0xa7, 0x65, 0xb1, 0xe2, 0xf9, 0xa5, 0x35, 0x06 } \
+  }
+
+#define JOYSTICK_CALIBRATION_VARIABLE_PREFIX  L"JoyStickCal"
+#define JOYSTICK_CALIBRATION_SIGNATURE        SIGNATURE_32 ('J', 'S', 'C', 'A')
+#define JOYSTICK_CALIBRATION_VERSION          1
+
+//
+// Room for the calibration as read from SPI flash: the user calibration is
+// its two magic bytes followed by 12 INT16 values, the factory calibration
+// only the values.
+//
+#define JOYSTICK_CALIBRATION_DATA_SIZE        (2 + 24)
+
+#pragma pack(1)
+///
+/// Content of a calibration cache variable.
+///
+typedef struct {
+  UINT32    Signature;
+  UINT16    Version;
+  ///
+  /// Firmware version reported by the controller when the data was read.
+  /// A firmware update invalidates the entry.
+  ///
+  UINT16    Firmware;
+  ///
+  /// SPI flash address the data was read at.
+  ///
+  UINT32    Address;
+  UINT8     Data[JOYSTICK_CALIBRATION_DATA_SIZE];
+  ///
+  /// CRC32 of all the fields above.
+  ///
+  UINT32    Crc32;
+} JOYSTICK_CALIBRATION_VARIABLE;
+#pragma pack()
+
+extern EFI_GUID  gUsbJoyStickCalibrationGuid;
+
+#endif
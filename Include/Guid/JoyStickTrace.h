@@ -0,0 +1,92 @@
+/** @file
+  Layout of the binary trace buffer of UsbJoyStickDxe.
+
+  The driver records fixed-size trace points instead of formatted DEBUG
+  strings and publishes the buffer as an EFI configuration table, so it can
+  be dumped and decoded offline.
+
+  YIZD 2021
+
+**/
+
+#ifndef _JOYSTICK_TRACE_GUID_H_
+#define _JOYSTICK_TRACE_GUID_H_
+
+#define USB_JOYSTICK_TRACE_GUID \
+  { \
+    0x4ba8f3b2, 0xc1a1, 0x48b3, { 0xa2, 0xcc, 0xdb, 0x14, 0xad, 0x0b, 0x2a, 0xd3 } \
+  }
+
+#define JOYSTICK_TRACE_SIGNATURE      SIGNATURE_32 ('J', 'S', 'T', 'R')
+#define JOYSTICK_TRACE_VERSION        1
+
+//
+// Trace levels. A trace point is compiled in when its level is not above
+// PcdJoyStickTraceLevel.
+//
+#define JOYSTICK_TRACE_LEVEL_NONE     0
+#define JOYSTICK_TRACE_LEVEL_ERROR    1
+#define JOYSTICK_TRACE_LEVEL_INFO     2
+#define JOYSTICK_TRACE_LEVEL_VERBOSE  3
+
+//
+// Trace events and the meaning of their two arguments.
+//
+#define JOYSTICK_TRACE_SUPPORTED      0x0001  // Status, 0
+#define JOYSTICK_TRACE_DEVICE_ID      0x0002  // Vendor id, product id
+#define JOYSTICK_TRACE_START          0x0003  // Controller handle, 0
+#define JOYSTICK_TRACE_START_DONE     0x0004  // Status, 0
+#define JOYSTICK_TRACE_START_ERROR    0x0005  // Source line, Status
+#define JOYSTICK_TRACE_ENDPOINT       0x0006  // Endpoint address, interval << 16 | max packet size
+#define JOYSTICK_TRACE_STOP           0x0007  // Controller handle, Status
+#define JOYSTICK_TRACE_INIT           0x0008  // Status, protocol
+#define JOYSTICK_TRACE_SUBCMD         0x0009  // Subcommand id, Status
+#define JOYSTICK_TRACE_IMU_CAL        0x000A  // SPI address used or 0 for nominal, Status
+#define JOYSTICK_TRACE_ACTIVATE       0x000B  // Status, duration in ns
+#define JOYSTICK_TRACE_CAL_CACHE      0x000C  // SPI address cached or 0, Status of the lookup or store
+#define JOYSTICK_TRACE_PAIR           0x000D  // Player id of the pair, TRUE when paired or FALSE when split
+#define JOYSTICK_TRACE_RESET          0x000E  // ExtendedVerification, TRUE when the hardware was verified again
+#define JOYSTICK_TRACE_RECOVERY       0x000F  // Endpoint address, Status of submitting its transfer again
+#define JOYSTICK_TRACE_REPORT         0x0010  // Report id, data length
+#define JOYSTICK_TRACE_REPORT_ERROR   0x0011  // USB transfer result, 0
+#define JOYSTICK_TRACE_BUTTONS        0x0012  // Previous buttons, current buttons
+
+///
+/// One trace point.
+///
+typedef struct {
+  ///
+  /// Performance counter value when the trace point was hit.
+  ///
+  UINT64    Timestamp;
+  UINT32    Event;
+  UINT32    Reserved;
+  UINT64    Arg0;
+  UINT64    Arg1;
+} JOYSTICK_TRACE_RECORD;
+
+///
+/// Trace buffer published as the USB_JOYSTICK_TRACE_GUID configuration table.
+///
+typedef struct {
+  UINT32                   Signature;
+  UINT16                   Version;
+  UINT16                   RecordSize;
+  UINT32                   Capacity;
+  ///
+  /// Number of records written since boot. Record N is stored at index
+  /// N % Capacity, so only the last Capacity records are kept.
+  ///
+  volatile UINT32          Written;
+  ///
+  /// Performance counter frequency in Hz and the values it counts between.
+  ///
+  UINT64                   TimerFrequency;
+  UINT64                   TimerStart;
+  UINT64                   TimerEnd;
+  JOYSTICK_TRACE_RECORD    Records[1];
+} JOYSTICK_TRACE_BUFFER;
+
+extern EFI_GUID  gUsbJoyStickTraceGuid;
+
+#endif
@@ -0,0 +1,164 @@
+/** @file
+  Key info protocol produced by UsbJoyStickDxe on each controller handle.
+
+  All bound controllers feed one key stream, served in arrival order by the
+  Simple Text Input protocols of every controller handle. GetKeyInfo() tells
+  which player produced a key just returned by ReadKeyStroke() or
+  ReadKeyStrokeEx(), when its report arrived and how long it was queued.
+  GetQueueStats() summarizes the queue time of all keys read so far.
+
+  Keys are produced when a button is pressed. SetKeyEdges() selects per
+  button whether a controller produces keys on press, on release or both;
+  GetKeyInfo() tells the edge a key came from.
+
+  YIZD 2021
+
+**/
+
+#ifndef _JOYSTICK_KEY_INFO_H_
+#define _JOYSTICK_KEY_INFO_H_
+
+#define USB_JOYSTICK_KEY_INFO_PROTOCOL_GUID \
+  { \
+    0x9f630489, 0xd696, 0x4e48, { 0xad, 0x48, 0x79, 0x4b, 0x49, 0x08, 0x77, 0x1d } \
+  }
+
+#define USB_JOYSTICK_KEY_INFO_PROTOCOL_REVISION  0x00010001
+
+//
+// Button edge a key was produced on.
+//
+#define USB_JOYSTICK_KEY_PRESS                   0
+#define USB_JOYSTICK_KEY_RELEASE                 1
+
+//
+// Queue time histogram buckets: bucket 0 counts keys read within 1 us of
+// their report arriving, bucket N those read within 2^N us, the last bucket
+// everything slower.
+//
+#define USB_JOYSTICK_QUEUE_TIME_BUCKETS          24
+
+typedef struct _USB_JOYSTICK_KEY_INFO_PROTOCOL USB_JOYSTICK_KEY_INFO_PROTOCOL;
+
+///
+/// Where a key of the merged stream came from.
+///
+typedef struct {
+  ///
+  /// Player slot of the controller, 1 based, assigned in bind order. A slot
+  /// freed by an unplugged controller goes to the next one bound.
+  ///
+  UINT8     PlayerId;
+  ///
+  /// USB_JOYSTICK_KEY_PRESS or USB_JOYSTICK_KEY_RELEASE.
+  ///
+  UINT8     Edge;
+  UINT8     Reserved[2];
+  ///
+  /// Position of the key in the merged stream.
+  ///
+  UINT32    Sequence;
+  ///
+  /// GetPerformanceCounter() when the input report producing the key
+  /// reached the driver, and when the key was read. A consumer compares its
+  /// own reading against ArrivalCounter to get input to action latency.
+  ///
+  UINT64    ArrivalCounter;
+  UINT64    ReadCounter;
+  ///
+  /// Time the key spent in the driver, from report arrival to read, in
+  /// nanoseconds.
+  ///
+  UINT64    QueueTime;
+} USB_JOYSTICK_KEY_INFO;
+
+///
+/// Queue time of all keys read from the merged stream since the driver
+/// loaded. Percentiles are upper bounds taken from the histogram.
+///
+typedef struct {
+  UINT64    Count;
+  UINT64    P50;
+  UINT64    P90;
+  UINT64    P99;
+  UINT64    Max;
+  UINT32    Histogram[USB_JOYSTICK_QUEUE_TIME_BUCKETS];
+} USB_JOYSTICK_QUEUE_STATS;
+
+/**
+  Look up a key recently returned by ReadKeyStroke() or ReadKeyStrokeEx().
+
+  Only the last few keys returned are remembered. When the same key was
+  returned more than once, the most recent one is reported.
+
+  @param  This                  The USB_JOYSTICK_KEY_INFO_PROTOCOL instance.
+  @param  KeyData               The key as returned by the Simple Text Input
+                                protocol. Only KeyData->Key is compared.
+  @param  Info                  Receives the information about the key.
+
+  @retval EFI_SUCCESS           Info was filled in.
+  @retval EFI_NOT_FOUND         The key is not among the recently returned ones.
+  @retval EFI_INVALID_PARAMETER KeyData or Info is NULL.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *USB_JOYSTICK_GET_KEY_INFO)(
+  IN  USB_JOYSTICK_KEY_INFO_PROTOCOL  *This,
+  IN  CONST EFI_KEY_DATA              *KeyData,
+  OUT USB_JOYSTICK_KEY_INFO           *Info
+  );
+
+/**
+  Summarize the queue time of all keys read from the merged stream.
+
+  @param  This                  The USB_JOYSTICK_KEY_INFO_PROTOCOL instance.
+  @param  Stats                 Receives the statistics, times in nanoseconds.
+
+  @retval EFI_SUCCESS           Stats was filled in.
+  @retval EFI_INVALID_PARAMETER Stats is NULL.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *USB_JOYSTICK_GET_QUEUE_STATS)(
+  IN  USB_JOYSTICK_KEY_INFO_PROTOCOL  *This,
+  OUT USB_JOYSTICK_QUEUE_STATS        *Stats
+  );
+
+/**
+  Select the buttons of this controller producing keys on press and on
+  release. A button in both masks produces a key on each edge, a button in
+  neither produces none. Keys already queued are kept.
+
+  Both halves of a Joy-Con pair take the selection.
+
+  @param  This                  The USB_JOYSTICK_KEY_INFO_PROTOCOL instance.
+  @param  PressButtons          The buttons producing a key when pressed,
+                                BIT0 to BIT23 in input report order.
+  @param  ReleaseButtons        The button bits producing a key when released.
+
+  @retval EFI_SUCCESS           The selection applies from the next report.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *USB_JOYSTICK_SET_KEY_EDGES)(
+  IN USB_JOYSTICK_KEY_INFO_PROTOCOL  *This,
+  IN UINT32                          PressButtons,
+  IN UINT32                          ReleaseButtons
+  );
+
+///
+/// Revision 0x00010001 added Edge to USB_JOYSTICK_KEY_INFO and SetKeyEdges().
+///
+struct _USB_JOYSTICK_KEY_INFO_PROTOCOL {
+  UINT64                          Revision;
+  USB_JOYSTICK_GET_KEY_INFO       GetKeyInfo;
+  USB_JOYSTICK_GET_QUEUE_STATS    GetQueueStats;
+  USB_JOYSTICK_SET_KEY_EDGES      SetKeyEdges;
+};
+
+extern EFI_GUID  gUsbJoyStickKeyInfoProtocolGuid;
+
+#endif
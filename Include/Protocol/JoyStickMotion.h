@@ -0,0 +1,105 @@
+/** @file
+  Motion protocol produced by UsbJoyStickDxe on each controller handle.
+
+  A consumer calls Start() to have the controller stream IMU data, then polls
+  Read() for calibrated samples. IMU data is neither requested nor decoded
+  while no consumer has called Start().
+
+  YIZD 2021
+
+**/
+
+#ifndef _JOYSTICK_MOTION_H_
+#define _JOYSTICK_MOTION_H_
+
+#define USB_JOYSTICK_MOTION_PROTOCOL_GUID \
+  { \
+    0x8076d9ec, 0x44f0, 0x45d2, { 0x87, 0xb4, 0xb4, 0x08, 0x94, 0xae, 0x8c, 0xcc } \
+  }
+
+#define USB_JOYSTICK_MOTION_PROTOCOL_REVISION  0x00010000
+
+typedef struct _USB_JOYSTICK_MOTION_PROTOCOL USB_JOYSTICK_MOTION_PROTOCOL;
+
+///
+/// One calibrated IMU sample. Full input reports carry three of them.
+///
+typedef struct {
+  ///
+  /// Acceleration on X, Y and Z in milli-g.
+  ///
+  INT32     Accel[3];
+  ///
+  /// Angular rate around X, Y and Z in centi-degrees per second.
+  ///
+  INT32     Gyro[3];
+  ///
+  /// Incremented by one for every sample, gaps show samples lost to overrun.
+  ///
+  UINT32    Sequence;
+} USB_JOYSTICK_MOTION_SAMPLE;
+
+/**
+  Register a motion consumer. The first consumer switches the controller to
+  full input reports and enables its IMU.
+
+  @param  This                  The USB_JOYSTICK_MOTION_PROTOCOL instance.
+
+  @retval EFI_SUCCESS           The IMU is streaming or has been requested.
+  @retval EFI_NOT_READY         The controller is still being brought up.
+  @retval EFI_DEVICE_ERROR      The controller could not be configured.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *USB_JOYSTICK_MOTION_START)(
+  IN USB_JOYSTICK_MOTION_PROTOCOL  *This
+  );
+
+/**
+  Unregister a motion consumer registered by Start(). The last consumer
+  disables the IMU and releases full input reports.
+
+  @param  This                  The USB_JOYSTICK_MOTION_PROTOCOL instance.
+
+  @retval EFI_SUCCESS           The consumer was unregistered.
+  @retval EFI_NOT_STARTED       No consumer is registered.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *USB_JOYSTICK_MOTION_STOP)(
+  IN USB_JOYSTICK_MOTION_PROTOCOL  *This
+  );
+
+/**
+  Take the oldest unread samples out of the motion ring.
+
+  @param  This                  The USB_JOYSTICK_MOTION_PROTOCOL instance.
+  @param  Count                 On input the capacity of Samples, on output
+                                the number of samples returned.
+  @param  Samples               Buffer receiving the samples, oldest first.
+
+  @retval EFI_SUCCESS           At least one sample was returned.
+  @retval EFI_NOT_READY         No sample is available.
+  @retval EFI_INVALID_PARAMETER Count or Samples is NULL, or *Count is 0.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *USB_JOYSTICK_MOTION_READ)(
+  IN     USB_JOYSTICK_MOTION_PROTOCOL  *This,
+  IN OUT UINTN                         *Count,
+  OUT    USB_JOYSTICK_MOTION_SAMPLE    *Samples
+  );
+
+struct _USB_JOYSTICK_MOTION_PROTOCOL {
+  UINT64                       Revision;
+  USB_JOYSTICK_MOTION_START    Start;
+  USB_JOYSTICK_MOTION_STOP     Stop;
+  USB_JOYSTICK_MOTION_READ     Read;
+};
+
+extern EFI_GUID  gUsbJoyStickMotionProtocolGuid;
+
+#endif
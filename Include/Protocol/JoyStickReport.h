@@ -0,0 +1,104 @@
+/** @file
+  Raw report protocol produced by UsbJoyStickDxe on each controller handle.
+
+  A consumer registers a callback to see the input reports exactly as the
+  controller sent them. Callbacks run at TPL_NOTIFY from the driver's report
+  handler and receive a pointer into the driver's transfer buffer, which is
+  only valid for the duration of the call.
+
+  YIZD 2021
+
+**/
+
+#ifndef _JOYSTICK_REPORT_H_
+#define _JOYSTICK_REPORT_H_
+
+#define USB_JOYSTICK_REPORT_PROTOCOL_GUID \
+  { \
+    0xf5c2fdd0, 0xb07d, 0x460a, { 0xad, 0xd8, 0x8e, 0xc2, 0xc9, 0x18, 0xae, 0xaa } \
+  }
+
+#define USB_JOYSTICK_REPORT_PROTOCOL_REVISION  0x00010000
+
+///
+/// Highest report byte a filter can cover.
+///
+#define USB_JOYSTICK_REPORT_FILTER_BYTES       64
+
+typedef struct _USB_JOYSTICK_REPORT_PROTOCOL USB_JOYSTICK_REPORT_PROTOCOL;
+
+/**
+  Receive one input report.
+
+  @param  Report                The report, starting with its report id.
+                                Must not be modified or kept after return.
+  @param  Length                The report length in bytes.
+  @param  Context               The context passed to Register().
+
+**/
+typedef
+VOID
+(EFIAPI *USB_JOYSTICK_REPORT_CALLBACK)(
+  IN CONST UINT8  *Report,
+  IN UINTN        Length,
+  IN VOID         *Context
+  );
+
+/**
+  Register a report callback.
+
+  Without a filter (FilterLength 0) the callback sees every report. With a
+  filter it only sees reports in which a byte of the range differs from the
+  previous report.
+
+  @param  This                  The USB_JOYSTICK_REPORT_PROTOCOL instance.
+  @param  Callback              The function to call at TPL_NOTIFY.
+  @param  Context               Passed to Callback.
+  @param  FilterOffset          First report byte of the filter.
+  @param  FilterLength          Number of bytes of the filter, 0 for none.
+  @param  Registration          Receives the handle for Unregister().
+
+  @retval EFI_SUCCESS           The callback is registered.
+  @retval EFI_INVALID_PARAMETER Callback or Registration is NULL, or the
+                                filter ends past USB_JOYSTICK_REPORT_FILTER_BYTES.
+  @retval EFI_OUT_OF_RESOURCES  All registration slots are taken.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *USB_JOYSTICK_REPORT_REGISTER)(
+  IN  USB_JOYSTICK_REPORT_PROTOCOL  *This,
+  IN  USB_JOYSTICK_REPORT_CALLBACK  Callback,
+  IN  VOID                          *Context OPTIONAL,
+  IN  UINTN                         FilterOffset,
+  IN  UINTN                         FilterLength,
+  OUT VOID                          **Registration
+  );
+
+/**
+  Remove a callback registered by Register(). It may be called from within
+  the callback itself.
+
+  @param  This                  The USB_JOYSTICK_REPORT_PROTOCOL instance.
+  @param  Registration          The handle returned by Register().
+
+  @retval EFI_SUCCESS           The callback is removed.
+  @retval EFI_INVALID_PARAMETER Registration is not a registered handle.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *USB_JOYSTICK_REPORT_UNREGISTER)(
+  IN USB_JOYSTICK_REPORT_PROTOCOL  *This,
+  IN VOID                          *Registration
+  );
+
+struct _USB_JOYSTICK_REPORT_PROTOCOL {
+  UINT64                            Revision;
+  USB_JOYSTICK_REPORT_REGISTER      Register;
+  USB_JOYSTICK_REPORT_UNREGISTER    Unregister;
+};
+
+extern EFI_GUID  gUsbJoyStickReportProtocolGuid;
+
+#endif
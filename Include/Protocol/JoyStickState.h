@@ -0,0 +1,77 @@
+/** @file
+  Gamepad state protocol produced by UsbJoyStickDxe on each controller handle.
+
+  GetState() returns the complete controller state as of the latest input
+  report, for consumers that want the pad itself rather than keystrokes.
+  It never blocks the driver and never returns a partially updated state.
+
+  YIZD 2021
+
+**/
+
+#ifndef _JOYSTICK_STATE_H_
+#define _JOYSTICK_STATE_H_
+
+#define USB_JOYSTICK_STATE_PROTOCOL_GUID \
+  { \
+    0x0355cffd, 0x5510, 0x4206, { 0xbf, 0x6f, 0x70, 0xee, 0x53, 0x80, 0x6c, 0xff } \
+  }
+
+#define USB_JOYSTICK_STATE_PROTOCOL_REVISION  0x00010000
+
+typedef struct _USB_JOYSTICK_STATE_PROTOCOL USB_JOYSTICK_STATE_PROTOCOL;
+
+///
+/// Snapshot of the controller state.
+///
+typedef struct {
+  ///
+  /// Incremented by one for every input report decoded into the state.
+  ///
+  UINT32    Sequence;
+  ///
+  /// Debounced buttons, BIT0 to BIT23 in input report order.
+  ///
+  UINT32    Buttons;
+  ///
+  /// Filtered left X, left Y, right X and right Y, centered on 0 and scaled
+  /// to the INT16 range. No per controller stick calibration is applied.
+  ///
+  INT16     Sticks[4];
+  ///
+  /// Latest acceleration in milli-g, only updated while a consumer has
+  /// started the Motion Protocol.
+  ///
+  INT32     Accel[3];
+  ///
+  /// Latest angular rate in centi-degrees per second, only updated while a
+  /// consumer has started the Motion Protocol.
+  ///
+  INT32     Gyro[3];
+} USB_JOYSTICK_STATE;
+
+/**
+  Copy out the controller state as of the latest input report.
+
+  @param  This                  The USB_JOYSTICK_STATE_PROTOCOL instance.
+  @param  State                 Receives the state.
+
+  @retval EFI_SUCCESS           The state was returned.
+  @retval EFI_INVALID_PARAMETER State is NULL.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *USB_JOYSTICK_GET_STATE)(
+  IN  USB_JOYSTICK_STATE_PROTOCOL  *This,
+  OUT USB_JOYSTICK_STATE           *State
+  );
+
+struct _USB_JOYSTICK_STATE_PROTOCOL {
+  UINT64                    Revision;
+  USB_JOYSTICK_GET_STATE    GetState;
+};
+
+extern EFI_GUID  gUsbJoyStickStateProtocolGuid;
+
+#endif
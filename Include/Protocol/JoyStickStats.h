@@ -0,0 +1,120 @@
+/** @file
+  Statistics protocol produced by UsbJoyStickDxe on each controller handle.
+
+  GetStats() returns the counters of one controller since it was bound:
+  the input reports it sent and their mix of report ids, what decoding
+  made of them, transfer errors and the recovery attempts that followed,
+  and how long the interrupt transfer callback ran. It never raises the
+  TPL, so reading the counters does not hold off the interrupt transfers.
+
+  YIZD 2021
+
+**/
+
+#ifndef _JOYSTICK_STATS_H_
+#define _JOYSTICK_STATS_H_
+
+#define USB_JOYSTICK_STATS_PROTOCOL_GUID \
+  { \
+    0x7ee380aa, 0x9938, 0x40b2, { 0xac, 0xc7, 0x9b, 0x06, 0x37, 0x06, 0x8b, 0x94 } \
+  }
+
+#define USB_JOYSTICK_STATS_PROTOCOL_REVISION      0x00010001
+
+//
+// Callback time histogram buckets: bucket 0 counts callbacks returning
+// within 1 us, bucket N those returning within 2^N us, the last bucket
+// everything slower.
+//
+#define USB_JOYSTICK_CALLBACK_TIME_BUCKETS        16
+
+//
+// Input report types counted in ReportTypes: full (0x30), simple HID
+// (0x3F), subcommand reply (0x21), USB command reply (0x81), and any other
+// report id, which the driver drops.
+//
+#define USB_JOYSTICK_REPORT_FULL                  0
+#define USB_JOYSTICK_REPORT_SIMPLE                1
+#define USB_JOYSTICK_REPORT_SUBCMD_REPLY          2
+#define USB_JOYSTICK_REPORT_USB_REPLY             3
+#define USB_JOYSTICK_REPORT_OTHER                 4
+#define USB_JOYSTICK_REPORT_TYPES                 5
+
+typedef struct _USB_JOYSTICK_STATS_PROTOCOL USB_JOYSTICK_STATS_PROTOCOL;
+
+///
+/// Counters of one controller. Percentiles are upper bounds taken from the
+/// histogram.
+///
+typedef struct {
+  ///
+  /// Input reports received, subcommand replies and ignored report ids
+  /// included.
+  ///
+  UINT64    Reports;
+  ///
+  /// Reports decoded without a button change, which produce no key.
+  ///
+  UINT64    Unchanged;
+  ///
+  /// Keys produced by the reports of this controller, and the ones lost
+  /// because the key queue was full.
+  ///
+  UINT64    KeysQueued;
+  UINT64    KeysDropped;
+  ///
+  /// Failed interrupt transfers, and transfers too short for a report.
+  ///
+  UINT64    Errors;
+  ///
+  /// Transfers submitted again after an error, activation requests
+  /// resent, and failed activations retried by Reset().
+  ///
+  UINT64    Recoveries;
+  ///
+  /// Polling interval of the interrupt transfers in milliseconds, and the
+  /// number of interrupt IN endpoints with a transfer running.
+  ///
+  UINT32    PollInterval;
+  UINT32    ActiveEndpoints;
+  ///
+  /// Interrupt transfer callbacks and their duration in nanoseconds.
+  ///
+  UINT64    Callbacks;
+  UINT64    CallbackP50;
+  UINT64    CallbackP90;
+  UINT64    CallbackP99;
+  UINT64    CallbackMax;
+  UINT32    CallbackHistogram[USB_JOYSTICK_CALLBACK_TIME_BUCKETS];
+  ///
+  /// Reports received by USB_JOYSTICK_REPORT_* type, from revision
+  /// 0x00010001 on. They add up to Reports.
+  ///
+  UINT64    ReportTypes[USB_JOYSTICK_REPORT_TYPES];
+} USB_JOYSTICK_STATS;
+
+/**
+  Copy out the counters of the controller.
+
+  @param  This                  The USB_JOYSTICK_STATS_PROTOCOL instance.
+  @param  Stats                 Receives the counters.
+
+  @retval EFI_SUCCESS           The counters were returned.
+  @retval EFI_INVALID_PARAMETER Stats is NULL.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *USB_JOYSTICK_GET_STATS)(
+  IN  USB_JOYSTICK_STATS_PROTOCOL  *This,
+  OUT USB_JOYSTICK_STATS           *Stats
+  );
+
+struct _USB_JOYSTICK_STATS_PROTOCOL {
+  UINT64                    Revision;
+  USB_JOYSTICK_GET_STATS    GetStats;
+};
+
+extern EFI_GUID  gUsbJoyStickStatsProtocolGuid;
+
+#endif
@@ -16,6 +16,17 @@ EFI_DRIVER_BINDING_PROTOCOL gUsbJoyStickDriverBinding = {
 	NULL
 };
 
+//
+// Side and stick filter tuning of the supported models. The Pro Controller
+// streams full reports every 8ms, a Joy-Con every 15ms; their sticks rest
+// within a few counts of jitter.
+//
+GLOBAL_REMOVE_IF_UNREFERENCED JOYSTICK_MODEL mJoyStickModels[] = {
+  { JOYSTICK_PID,          JOYSTICK_SIDE_NONE,  { 125, 1000, 8000, 5000 } },
+  { JOYSTICK_PID_JOYCON_L, JOYSTICK_SIDE_LEFT,  { 66,  1000, 8000, 5000 } },
+  { JOYSTICK_PID_JOYCON_R, JOYSTICK_SIDE_RIGHT, { 66,  1000, 8000, 5000 } }
+};
+
 
 /**
   Entrypoint of USB Keyboard Driver.
@@ -38,6 +49,9 @@ USBJoyStickDriverBindingEntryPoint (
 {
   EFI_STATUS              Status;
 
+  JoyStickTraceInit ();
+  JoyStickInitArrivalClock ();
+
   Status = EfiLibInstallDriverBindingComponentName2 (
              ImageHandle,
              SystemTable,
@@ -85,7 +99,7 @@ USBJoyStickDriverBindingSupported (
                   EFI_OPEN_PROTOCOL_BY_DRIVER
                   );
   if (EFI_ERROR (Status)) {
-	  DEBUG((EFI_D_ERROR,"[JoyStick Driver] Not Supported \r\n")); 
+	  JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_INFO, JOYSTICK_TRACE_SUPPORTED, Status, 0);
     return Status;
   }
 
@@ -96,12 +110,9 @@ USBJoyStickDriverBindingSupported (
   Status = EFI_SUCCESS;
 
   if (!IsUSBJoyStick (UsbIo)) {
-	  DEBUG((EFI_D_ERROR,"[JoyStick Driver] Not Supported \r\n")); 
 	  Status = EFI_UNSUPPORTED;
   }
-  else{
-          DEBUG((EFI_D_ERROR,"[JoyStick Driver] Supported \r\n"));
-  }
+  JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_INFO, JOYSTICK_TRACE_SUPPORTED, Status, 0);
 
   gBS->CloseProtocol (
          Controller,
@@ -113,6 +124,154 @@ USBJoyStickDriverBindingSupported (
   return Status;
  }
 
+/**
+  Uninstall the optional protocols selected by the feature flags from a
+  controller. Protocols that are not installed are skipped.
+
+  @param  Controller             The controller handle.
+  @param  UsbJoyStickDevice      The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS            No selected protocol is left installed.
+  @retval Other                  A protocol is still in use.
+
+**/
+STATIC
+EFI_STATUS
+JoyStickUninstallFeatures (
+  IN EFI_HANDLE                     Controller,
+  IN USB_JS_DEV                     *UsbJoyStickDevice
+  )
+{
+  EFI_STATUS                        Status;
+  EFI_STATUS                        Result;
+
+  Result = EFI_SUCCESS;
+  if (FeaturePcdGet (PcdJoyStickStatsSupport)) {
+    Status = gBS->UninstallMultipleProtocolInterfaces (
+                    Controller,
+                    &gUsbJoyStickStatsProtocolGuid,
+                    &UsbJoyStickDevice->Stats,
+                    NULL
+                    );
+    if (Status != EFI_NOT_FOUND && EFI_ERROR (Status)) {
+      Result = Status;
+    }
+  }
+
+  if (FeaturePcdGet (PcdJoyStickReportSupport)) {
+    Status = gBS->UninstallMultipleProtocolInterfaces (
+                    Controller,
+                    &gUsbJoyStickReportProtocolGuid,
+                    &UsbJoyStickDevice->RawReport,
+                    NULL
+                    );
+    if (Status != EFI_NOT_FOUND && EFI_ERROR (Status)) {
+      Result = Status;
+    }
+  }
+
+  if (FeaturePcdGet (PcdJoyStickStateSupport)) {
+    Status = gBS->UninstallMultipleProtocolInterfaces (
+                    Controller,
+                    &gUsbJoyStickStateProtocolGuid,
+                    &UsbJoyStickDevice->State,
+                    NULL
+                    );
+    if (Status != EFI_NOT_FOUND && EFI_ERROR (Status)) {
+      Result = Status;
+    }
+  }
+
+  if (FeaturePcdGet (PcdJoyStickMotionSupport)) {
+    Status = gBS->UninstallMultipleProtocolInterfaces (
+                    Controller,
+                    &gUsbJoyStickMotionProtocolGuid,
+                    &UsbJoyStickDevice->Motion,
+                    NULL
+                    );
+    if (Status != EFI_NOT_FOUND && EFI_ERROR (Status)) {
+      Result = Status;
+    }
+  }
+
+  return Result;
+}
+
+/**
+  Install the optional protocols selected by the feature flags on a
+  controller. The protocols left out are never referenced, so their code
+  is not linked into the image.
+
+  @param  Controller             The controller handle.
+  @param  UsbJoyStickDevice      The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS            The selected protocols are installed.
+  @retval Other                  No optional protocol is installed.
+
+**/
+STATIC
+EFI_STATUS
+JoyStickInstallFeatures (
+  IN EFI_HANDLE                     Controller,
+  IN USB_JS_DEV                     *UsbJoyStickDevice
+  )
+{
+  EFI_STATUS                        Status;
+
+  Status = EFI_SUCCESS;
+  if (FeaturePcdGet (PcdJoyStickMotionSupport)) {
+    UsbJoyStickDevice->Motion.Revision   = USB_JOYSTICK_MOTION_PROTOCOL_REVISION;
+    UsbJoyStickDevice->Motion.Start      = USBJoyStickMotionStart;
+    UsbJoyStickDevice->Motion.Stop       = USBJoyStickMotionStop;
+    UsbJoyStickDevice->Motion.Read       = USBJoyStickMotionRead;
+    Status = gBS->InstallMultipleProtocolInterfaces (
+                    &Controller,
+                    &gUsbJoyStickMotionProtocolGuid,
+                    &UsbJoyStickDevice->Motion,
+                    NULL
+                    );
+  }
+
+  if (!EFI_ERROR (Status) && FeaturePcdGet (PcdJoyStickStateSupport)) {
+    UsbJoyStickDevice->State.Revision    = USB_JOYSTICK_STATE_PROTOCOL_REVISION;
+    UsbJoyStickDevice->State.GetState    = USBJoyStickGetState;
+    Status = gBS->InstallMultipleProtocolInterfaces (
+                    &Controller,
+                    &gUsbJoyStickStateProtocolGuid,
+                    &UsbJoyStickDevice->State,
+                    NULL
+                    );
+  }
+
+  if (!EFI_ERROR (Status) && FeaturePcdGet (PcdJoyStickReportSupport)) {
+    UsbJoyStickDevice->RawReport.Revision   = USB_JOYSTICK_REPORT_PROTOCOL_REVISION;
+    UsbJoyStickDevice->RawReport.Register   = USBJoyStickRegisterReport;
+    UsbJoyStickDevice->RawReport.Unregister = USBJoyStickUnregisterReport;
+    Status = gBS->InstallMultipleProtocolInterfaces (
+                    &Controller,
+                    &gUsbJoyStickReportProtocolGuid,
+                    &UsbJoyStickDevice->RawReport,
+                    NULL
+                    );
+  }
+
+  if (!EFI_ERROR (Status) && FeaturePcdGet (PcdJoyStickStatsSupport)) {
+    UsbJoyStickDevice->Stats.Revision    = USB_JOYSTICK_STATS_PROTOCOL_REVISION;
+    UsbJoyStickDevice->Stats.GetStats    = USBJoyStickGetStats;
+    Status = gBS->InstallMultipleProtocolInterfaces (
+                    &Controller,
+                    &gUsbJoyStickStatsProtocolGuid,
+                    &UsbJoyStickDevice->Stats,
+                    NULL
+                    );
+  }
+
+  if (EFI_ERROR (Status)) {
+    JoyStickUninstallFeatures (Controller, UsbJoyStickDevice);
+  }
+  return Status;
+}
+
 /**
   Starts the keyboard device with this driver.
 
@@ -142,15 +301,15 @@ USBJoyStickDriverBindingStart (
       EFI_USB_IO_PROTOCOL           *UsbIo;
       USB_JS_DEV                    *UsbJoyStickDevice;
       UINT8                         EndpointNumber;
-      UINT8                         InEndpointAddr;
-      UINT8                         InPollingInterval;
-      UINT8                         InPacketSize;
-      UINT8                         OutEndpointAddr;
+      UINT8                         Index;
+      UINTN                         InPacketSize;
       EFI_USB_ENDPOINT_DESCRIPTOR   EndpointDescriptor;
-      BOOLEAN                       Found;
+      JOYSTICK_IN_ENDPOINT          *InEndpoint;
+      BOOLEAN                       OutFound;
       EFI_TPL                       OldTpl;
-      UINT32                        TransferStatus;
       
+      JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_INFO, JOYSTICK_TRACE_START, (UINTN) Controller, 0);
+
       OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
 
       Status = gBS->OpenProtocol (
@@ -162,12 +321,16 @@ USBJoyStickDriverBindingStart (
 		      EFI_OPEN_PROTOCOL_BY_DRIVER
 		      );
       if(EFI_ERROR (Status)){
-              DEBUG((EFI_D_ERROR,"[JoyStick Driver] Protocol Guid ProtocolError \r\n"));
-	      return Status;
+              JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_START_ERROR, __LINE__, Status);
+	      goto ErrorExit1;
       }
 
       UsbJoyStickDevice = AllocateZeroPool (sizeof (USB_JS_DEV));
-      //ASSERT (UsbKeyboardDevice != NULL);
+      if (UsbJoyStickDevice == NULL) {
+        Status = EFI_OUT_OF_RESOURCES;
+        JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_START_ERROR, __LINE__, Status);
+        goto ErrorExit;
+      }
       
       Status = gBS->OpenProtocol(
 		      Controller,
@@ -179,8 +342,8 @@ USBJoyStickDriverBindingStart (
 		      );
 
       if (EFI_ERROR (Status)) {
-              DEBUG((EFI_D_ERROR,"[JoyStick Driver]Device Path Protocol Error \r\n"));
-	     return Status;
+              JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_START_ERROR, __LINE__, Status);
+	     goto ErrorExit;
       }
       
       UsbJoyStickDevice->UsbIo = UsbIo;      
@@ -191,28 +354,32 @@ USBJoyStickDriverBindingStart (
 		      );
 
       EndpointNumber = UsbJoyStickDevice->InterfaceDescriptor.NumEndpoints;
-      DEBUG((EFI_D_ERROR,"Endpoint Number: %x\r\n",EndpointNumber));
       
-      Found = FALSE;
-      for(UINT8 i=0; i < EndpointNumber; i++)
-      {
-	      UsbIo->UsbGetEndpointDescriptor(
-			      UsbIo,
-			      i,
-			      &EndpointDescriptor
-			      );
-	      if(((EndpointDescriptor.Attributes & (BIT0|BIT1))== USB_ENDPOINT_INTERRUPT) &&
-		      ((EndpointDescriptor.EndpointAddress & USB_ENDPOINT_DIR_IN)==0)){
-          Found = TRUE;
-          DEBUG((EFI_D_ERROR,"Out Endpoint Address: %x\r\n",EndpointDescriptor.EndpointAddress));
-		      CopyMem(&UsbJoyStickDevice->IntOutEndpointDescriptor,&EndpointDescriptor,sizeof(EndpointDescriptor));
-	      }
-	      if(((EndpointDescriptor.Attributes & (BIT0|BIT1))== USB_ENDPOINT_INTERRUPT) &&
-		      ((EndpointDescriptor.EndpointAddress & USB_ENDPOINT_DIR_IN)!=0)){
-          Found = TRUE;
-          DEBUG((EFI_D_ERROR,"In Endpoint Address: %x\r\n",EndpointDescriptor.EndpointAddress));
-		      CopyMem(&UsbJoyStickDevice->IntInEndpointDescriptor,&EndpointDescriptor,sizeof(EndpointDescriptor));
-	      }
+      //
+      // Every interrupt IN endpoint gets a transfer of its own, requests go
+      // out on the first interrupt OUT endpoint.
+      //
+      OutFound = FALSE;
+      UsbJoyStickDevice->InEndpointCount = 0;
+      for (Index = 0; Index < EndpointNumber; Index++) {
+        UsbIo->UsbGetEndpointDescriptor (
+                 UsbIo,
+                 Index,
+                 &EndpointDescriptor
+                 );
+        if ((EndpointDescriptor.Attributes & (BIT0|BIT1)) != USB_ENDPOINT_INTERRUPT) {
+          continue;
+        }
+        if ((EndpointDescriptor.EndpointAddress & USB_ENDPOINT_DIR_IN) == 0) {
+          if (!OutFound) {
+            OutFound = TRUE;
+            CopyMem (&UsbJoyStickDevice->IntOutEndpointDescriptor, &EndpointDescriptor, sizeof (EndpointDescriptor));
+          }
+        } else if (UsbJoyStickDevice->InEndpointCount < JOYSTICK_MAX_IN_ENDPOINTS) {
+          InEndpoint         = &UsbJoyStickDevice->InEndpoints[UsbJoyStickDevice->InEndpointCount++];
+          InEndpoint->Device = UsbJoyStickDevice;
+          CopyMem (&InEndpoint->Descriptor, &EndpointDescriptor, sizeof (EndpointDescriptor));
+        }
       }
 
       REPORT_STATUS_CODE_WITH_DEVICE_PATH (
@@ -221,14 +388,17 @@ USBJoyStickDriverBindingStart (
         UsbJoyStickDevice->DevicePath
       );
       
-      if(Found == FALSE)
-      {
-        DEBUG((EFI_D_ERROR,"No Endpoint Found\r\n"));
+      //
+      // The handshake needs both directions.
+      //
+      if (UsbJoyStickDevice->InEndpointCount == 0 || !OutFound) {
         Status = EFI_UNSUPPORTED;
-        return Status;
+        JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_START_ERROR, __LINE__, Status);
+        goto ErrorExit;
       }
 
       UsbJoyStickDevice->Signature                         = USB_JS_DEV_SIGNATURE;
+      UsbJoyStickDevice->Side                              = JOYSTICK_SIDE_NONE;
       UsbJoyStickDevice->SimpleInput.Reset                 = USBJoyStickReset;
       UsbJoyStickDevice->SimpleInput.ReadKeyStroke         = USBJoyStickReadKeyStroke;
       
@@ -237,9 +407,60 @@ USBJoyStickDriverBindingStart (
       UsbJoyStickDevice->SimpleInputEx.SetState            = USBJoyStickSetState;
       UsbJoyStickDevice->SimpleInputEx.RegisterKeyNotify   = USBJoyStickRegisterKeyNotify;
       UsbJoyStickDevice->SimpleInputEx.UnregisterKeyNotify = USBJoyStickUnregisterKeyNotify;
+      InitializeListHead (&UsbJoyStickDevice->NotifyList);
+
+      UsbJoyStickDevice->KeyInfo.Revision                  = USB_JOYSTICK_KEY_INFO_PROTOCOL_REVISION;
+      UsbJoyStickDevice->KeyInfo.GetKeyInfo                = USBJoyStickGetKeyInfo;
+      UsbJoyStickDevice->KeyInfo.GetQueueStats             = USBJoyStickGetQueueStats;
+      UsbJoyStickDevice->KeyInfo.SetKeyEdges               = USBJoyStickSetKeyEdges;
+
+      Status = gBS->CreateEvent (
+                   EVT_NOTIFY_WAIT,
+                   TPL_NOTIFY,
+                   USBJoyStickWaitForKey,
+                   UsbJoyStickDevice,
+                   &(UsbJoyStickDevice->SimpleInput.WaitForKey)
+      );
+      if (EFI_ERROR (Status)) {
+        JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_START_ERROR, __LINE__, Status);
+        goto ErrorExit;
+      }
 
+      Status = gBS->CreateEvent (
+                   EVT_NOTIFY_WAIT,
+                   TPL_NOTIFY,
+                   USBJoyStickWaitForKey,
+                   UsbJoyStickDevice,
+                   &(UsbJoyStickDevice->SimpleInputEx.WaitForKeyEx)
+      );
+      if (EFI_ERROR (Status)) {
+        JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_START_ERROR, __LINE__, Status);
+        goto ErrorExit;
+      }
 
+      Status = gBS->CreateEvent (
+                   EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                   TPL_NOTIFY,
+                   JoyStickRecoveryHandler,
+                   UsbJoyStickDevice,
+                   &UsbJoyStickDevice->DelayedRecoveryEvent
+      );
+      if (EFI_ERROR (Status)) {
+        JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_START_ERROR, __LINE__, Status);
+        goto ErrorExit;
+      }
 
+      Status = gBS->CreateEvent (
+                   EVT_NOTIFY_SIGNAL,
+                   TPL_CALLBACK,
+                   JoyStickKeyNotifyProcessHandler,
+                   UsbJoyStickDevice,
+                   &UsbJoyStickDevice->KeyNotifyProcessEvent
+      );
+      if (EFI_ERROR (Status)) {
+        JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_START_ERROR, __LINE__, Status);
+        goto ErrorExit;
+      }
 
       Status = gBS->InstallMultipleProtocolInterfaces (
                    &Controller,
@@ -247,130 +468,76 @@ USBJoyStickDriverBindingStart (
                    &UsbJoyStickDevice->SimpleInput,
                    &gEfiSimpleTextInputExProtocolGuid,
                    &UsbJoyStickDevice->SimpleInputEx,
+                   &gUsbJoyStickKeyInfoProtocolGuid,
+                   &UsbJoyStickDevice->KeyInfo,
                    NULL
       );
+      if (!EFI_ERROR (Status)) {
+        Status = JoyStickInstallFeatures (Controller, UsbJoyStickDevice);
+        if (EFI_ERROR (Status)) {
+          gBS->UninstallMultipleProtocolInterfaces (
+                     Controller,
+                     &gEfiSimpleTextInProtocolGuid,
+                     &UsbJoyStickDevice->SimpleInput,
+                     &gEfiSimpleTextInputExProtocolGuid,
+                     &UsbJoyStickDevice->SimpleInputEx,
+                     &gUsbJoyStickKeyInfoProtocolGuid,
+                     &UsbJoyStickDevice->KeyInfo,
+                     NULL
+          );
+        }
+      }
       if (EFI_ERROR(Status))
       {
-        DEBUG((EFI_D_ERROR,"InstallMultipleProtocolInterface Failed!\r\n"));        
+        JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_START_ERROR, __LINE__, Status);
         Status = EFI_UNSUPPORTED;
-        return Status;
+        goto ErrorExit;
       }
       UsbJoyStickDevice->ControllerHandle = Controller;
       
-      Status = UsbJoyStickDevice->SimpleInputEx.Reset (
-                   &UsbJoyStickDevice->SimpleInputEx,
-                   TRUE
-      );
-      if(EFI_ERROR(Status))
-      {
-        DEBUG((EFI_D_ERROR,"SimpleInputEx Reset Failed\r\n"));
-        gBS->UninstallMultipleProtocolInterfaces(
-                   Controller,
-                   &gEfiSimpleTextOutProtocolGuid,
-                   &UsbJoyStickDevice->SimpleInput,
-                   &gEfiSimpleTextOutProtocolGuid,
-                   &UsbJoyStickDevice->SimpleInputEx,
-                   NULL
-        );
-        Status = EFI_UNSUPPORTED;
-        return Status;
-      }
-
-      OutEndpointAddr   = UsbJoyStickDevice->IntOutEndpointDescriptor.EndpointAddress;
-      DEBUG((EFI_D_ERROR,"Interrupt Out Endpoint Address: %x\r\n",OutEndpointAddr));
-
-      InEndpointAddr    = UsbJoyStickDevice->IntInEndpointDescriptor.EndpointAddress;
-      InPollingInterval = UsbJoyStickDevice->IntInEndpointDescriptor.Interval;
-      InPacketSize      = (UINT8) (UsbJoyStickDevice->IntInEndpointDescriptor.MaxPacketSize);
-
-      DEBUG((EFI_D_ERROR,"Interrupt In Endpoint Address: %x, Interval: %x, PacketSize: %x\r\n",InEndpointAddr,InPollingInterval,InPacketSize));
-      
-      UINT8 *IntOutData;
-      UINTN IntOutSize = 64;
-      IntOutData = AllocateZeroPool (64);
-      IntOutData[0]    = 0x80;
-      IntOutData[1]    = 0x02;  
-      TransferStatus   = 0;
-
-      Status = UsbIo->UsbSyncInterruptTransfer (
-                   UsbIo,
-                   OutEndpointAddr,
-                   IntOutData,
-                   &IntOutSize,
-                   0,
-                   &TransferStatus
-      );
-      if(EFI_ERROR(Status))
-      {
-        DEBUG((EFI_D_ERROR,"Send Interrupt Transfer failed\r\n"));
-        Status = EFI_UNSUPPORTED;
-        return Status;
-      }
-
-      Status = UsbIo->UsbSyncInterruptTransfer (
-                   UsbIo,
-                   InEndpointAddr,
-                   IntOutData,
-                   &IntOutSize,
-                   0,
-                   &TransferStatus
-      );
-      if(EFI_ERROR(Status))
-      {
-        DEBUG((EFI_D_ERROR,"Receive Interrupt Transfer failed\r\n"));
-        Status = EFI_UNSUPPORTED;
-        return Status;
+      //
+      // wMaxPacketSize holds the packet size in bits 0-10 and, on high speed
+      // endpoints, the additional transactions per microframe in bits 11-12.
+      // Transfers are sized in whole reports, JoyStickHandler walks them.
+      //
+      for (Index = 0; Index < UsbJoyStickDevice->InEndpointCount; Index++) {
+        InEndpoint        = &UsbJoyStickDevice->InEndpoints[Index];
+        InPacketSize      = (InEndpoint->Descriptor.MaxPacketSize & 0x7FF) *
+                            (((InEndpoint->Descriptor.MaxPacketSize >> 11) & 0x3) + 1);
+        InPacketSize      = MAX (
+                              InPacketSize - InPacketSize % JOYSTICK_REPORT_SIZE,
+                              (UINTN) MAX (FixedPcdGet8 (PcdJoyStickReportsPerTransfer), 1) * JOYSTICK_REPORT_SIZE
+                              );
+        InEndpoint->PacketSize = InPacketSize;
+
+        JOYSTICK_TRACE (
+          JOYSTICK_TRACE_LEVEL_INFO,
+          JOYSTICK_TRACE_ENDPOINT,
+          InEndpoint->Descriptor.EndpointAddress,
+          (InEndpoint->Descriptor.Interval << 16) | InPacketSize
+          );
       }
+      JOYSTICK_TRACE (
+        JOYSTICK_TRACE_LEVEL_INFO,
+        JOYSTICK_TRACE_ENDPOINT,
+        UsbJoyStickDevice->IntOutEndpointDescriptor.EndpointAddress,
+        0
+        );
 
-      IntOutData[0]    = 0x80;
-      IntOutData[1]    = 0x04; 
-      Status = UsbIo->UsbSyncInterruptTransfer (
-                   UsbIo,
-                   OutEndpointAddr,
-                   IntOutData,
-                   &IntOutSize,
-                   0,
-                   &TransferStatus
+      Status = gBS->CreateEvent (
+                   EVT_NOTIFY_SIGNAL,
+                   TPL_CALLBACK,
+                   JoyStickActivateNotify,
+                   UsbJoyStickDevice,
+                   &UsbJoyStickDevice->ActivateEvent
       );
-      if(EFI_ERROR(Status))
-      {
-        DEBUG((EFI_D_ERROR,"Send Interrupt Transfer failed\r\n"));
-        Status = EFI_UNSUPPORTED;
-        return Status;
+      if (!EFI_ERROR (Status) && !FixedPcdGetBool (PcdJoyStickLazyActivation)) {
+        Status = JoyStickActivate (UsbJoyStickDevice);
       }
-
-      Status = UsbIo->UsbSyncInterruptTransfer (
-                   UsbIo,
-                   InEndpointAddr,
-                   IntOutData,
-                   &IntOutSize,
-                   0,
-                   &TransferStatus
-      );
       if(EFI_ERROR(Status))
       {
-        DEBUG((EFI_D_ERROR,"Receive Interrupt Transfer failed\r\n"));
-        Status = EFI_UNSUPPORTED;
-        return Status;
-      }
-
-      FreePool(IntOutData);
-      
-      Status = UsbIo->UsbAsyncInterruptTransfer (
-                   UsbIo,
-                   InEndpointAddr,
-                   TRUE,
-                   InPollingInterval,
-                   InPacketSize,
-                   JoyStickHandler,
-                   UsbJoyStickDevice
-      );
-
-      if(EFI_ERROR(Status))
-      {
-        DEBUG((EFI_D_ERROR,"Submit Async Interrupt Transfer failed\r\n"));
-        Status = EFI_UNSUPPORTED;
-        return Status;
+        JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_START_ERROR, __LINE__, Status);
+        goto ErrorExit;
       }
 
       UsbJoyStickDevice->ControllerNameTable = NULL;
@@ -390,7 +557,54 @@ USBJoyStickDriverBindingStart (
       );
       gBS->RestoreTPL(OldTpl);
 
+      JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_INFO, JOYSTICK_TRACE_START_DONE, EFI_SUCCESS, 0);
       return EFI_SUCCESS;
+
+//
+// Error handler. Everything created so far goes away again.
+//
+ErrorExit:
+      if (UsbJoyStickDevice != NULL) {
+        if (UsbJoyStickDevice->ControllerHandle != NULL) {
+          JoyStickUninstallFeatures (Controller, UsbJoyStickDevice);
+          gBS->UninstallMultipleProtocolInterfaces (
+                     Controller,
+                     &gEfiSimpleTextInProtocolGuid,
+                     &UsbJoyStickDevice->SimpleInput,
+                     &gEfiSimpleTextInputExProtocolGuid,
+                     &UsbJoyStickDevice->SimpleInputEx,
+                     &gUsbJoyStickKeyInfoProtocolGuid,
+                     &UsbJoyStickDevice->KeyInfo,
+                     NULL
+          );
+        }
+        if (UsbJoyStickDevice->ActivateEvent != NULL) {
+          gBS->CloseEvent (UsbJoyStickDevice->ActivateEvent);
+        }
+        if (UsbJoyStickDevice->DelayedRecoveryEvent != NULL) {
+          gBS->CloseEvent (UsbJoyStickDevice->DelayedRecoveryEvent);
+        }
+        if (UsbJoyStickDevice->KeyNotifyProcessEvent != NULL) {
+          gBS->CloseEvent (UsbJoyStickDevice->KeyNotifyProcessEvent);
+        }
+        if (UsbJoyStickDevice->SimpleInputEx.WaitForKeyEx != NULL) {
+          gBS->CloseEvent (UsbJoyStickDevice->SimpleInputEx.WaitForKeyEx);
+        }
+        if (UsbJoyStickDevice->SimpleInput.WaitForKey != NULL) {
+          gBS->CloseEvent (UsbJoyStickDevice->SimpleInput.WaitForKey);
+        }
+        FreePool (UsbJoyStickDevice);
+      }
+      gBS->CloseProtocol (
+             Controller,
+             &gEfiUsbIoProtocolGuid,
+             This->DriverBindingHandle,
+             Controller
+      );
+
+ErrorExit1:
+      gBS->RestoreTPL (OldTpl);
+      return Status;
 }
 
 /**
@@ -420,6 +634,7 @@ USBJoyStickDriverBindingStop (
   EFI_STATUS                      Status;
   EFI_SIMPLE_TEXT_INPUT_PROTOCOL  *SimpleInput;
   USB_JS_DEV                      *UsbJoyStickDevice;
+  LIST_ENTRY                      *Link;
 
   Status = gBS->OpenProtocol (
               Controller,
@@ -447,38 +662,82 @@ USBJoyStickDriverBindingStop (
 
   UsbJoyStickDevice = USB_JS_DEV_FROM_THIS (SimpleInput);
 
-  UsbJoyStickDevice->UsbIo->UsbAsyncInterruptTransfer (
-                      UsbJoyStickDevice->UsbIo,
-                      UsbJoyStickDevice->IntInEndpointDescriptor.EndpointAddress,
-                      FALSE,
-                      UsbJoyStickDevice->IntInEndpointDescriptor.Interval,
-                      0,
-                      NULL,
-                      NULL
-  );
-  
-  gBS->CloseProtocol (
-         Controller,
-         &gEfiUsbIoProtocolGuid,
-         This->DriverBindingHandle,
-         Controller
-  );
-
+  //
+  // A consumer may refuse to let the protocols go. The device then stays
+  // bound and running, and Stop() can be retried; the optional protocols
+  // already uninstalled are skipped by then.
+  //
   Status = gBS->UninstallMultipleProtocolInterfaces (
                 Controller,
                 &gEfiSimpleTextInProtocolGuid,
                 &UsbJoyStickDevice->SimpleInput,
                 &gEfiSimpleTextInputExProtocolGuid,
                 &UsbJoyStickDevice->SimpleInputEx,
+                &gUsbJoyStickKeyInfoProtocolGuid,
+                &UsbJoyStickDevice->KeyInfo,
                 NULL
   );
+  if (EFI_ERROR (Status)) {
+    JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_STOP, (UINTN) Controller, Status);
+    return Status;
+  }
+
+  Status = JoyStickUninstallFeatures (Controller, UsbJoyStickDevice);
+  if (EFI_ERROR (Status)) {
+    gBS->InstallMultipleProtocolInterfaces (
+           &Controller,
+           &gEfiSimpleTextInProtocolGuid,
+           &UsbJoyStickDevice->SimpleInput,
+           &gEfiSimpleTextInputExProtocolGuid,
+           &UsbJoyStickDevice->SimpleInputEx,
+           &gUsbJoyStickKeyInfoProtocolGuid,
+           &UsbJoyStickDevice->KeyInfo,
+           NULL
+    );
+    JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_STOP, (UINTN) Controller, Status);
+    return Status;
+  }
+
+  //
+  // A controller nobody read from was never activated, one that is still
+  // being brought up already runs its transfer. No failed transfer is
+  // submitted again once the recovery timer is gone.
+  //
+  gBS->CloseEvent (UsbJoyStickDevice->ActivateEvent);
+  gBS->CloseEvent (UsbJoyStickDevice->DelayedRecoveryEvent);
+  JoyStickCancelActivation (UsbJoyStickDevice);
+  JoyStickStopTransfers (UsbJoyStickDevice);
+
+  JoyStickUnpairController (UsbJoyStickDevice);
+  JoyStickRemovePlayer (UsbJoyStickDevice);
+
+  gBS->CloseProtocol (
+         Controller,
+         &gEfiUsbIoProtocolGuid,
+         This->DriverBindingHandle,
+         Controller
+  );
+
+  gBS->CloseEvent (UsbJoyStickDevice->SimpleInput.WaitForKey);
+  gBS->CloseEvent (UsbJoyStickDevice->SimpleInputEx.WaitForKeyEx);
+
+  //
+  // No key is queued for a notification once the transfers are stopped.
+  //
+  gBS->CloseEvent (UsbJoyStickDevice->KeyNotifyProcessEvent);
+  while (!IsListEmpty (&UsbJoyStickDevice->NotifyList)) {
+    Link = GetFirstNode (&UsbJoyStickDevice->NotifyList);
+    RemoveEntryList (Link);
+    FreePool (USB_JS_CONSOLE_IN_EX_NOTIFY_FROM_LINK (Link));
+  }
+
   if(UsbJoyStickDevice->ControllerNameTable !=NULL)
   {
     FreeUnicodeStringTable (UsbJoyStickDevice->ControllerNameTable);
   }
   FreePool (UsbJoyStickDevice);
 
-
+  JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_INFO, JOYSTICK_TRACE_STOP, (UINTN) Controller, Status);
 
   return Status;
 
@@ -493,7 +752,7 @@ USBJoyStickDriverBindingStop (
   There are 2 types of reset for USB keyboard.
   For non-exhaustive reset, only keyboard buffer is cleared.
   For exhaustive reset, in addition to clearance of keyboard buffer, the hardware status
-  is also re-initialized.
+  is also re-initialized, once a transfer has failed since it last was.
 
   @param  This                 Protocol instance pointer.
   @param  ExtendedVerification Driver may perform diagnostics on reset.
@@ -511,6 +770,8 @@ USBJoyStickReset (
   {
     EFI_STATUS       Status;
     USB_JS_DEV       *UsbJoyStickDevice;
+    USB_JS_DEV       *Owner;
+    EFI_TPL          OldTpl;
 
     UsbJoyStickDevice = USB_JS_DEV_FROM_THIS (This);
     REPORT_STATUS_CODE_WITH_DEVICE_PATH (
@@ -519,19 +780,60 @@ USBJoyStickReset (
             UsbJoyStickDevice->DevicePath
     );
 
+    REPORT_STATUS_CODE_WITH_DEVICE_PATH (
+      EFI_PROGRESS_CODE,
+      (EFI_PERIPHERAL_KEYBOARD | EFI_P_KEYBOARD_PC_CLEAR_BUFFER),
+      UsbJoyStickDevice->DevicePath
+      );
+
+    //
+    // Both resets drop the keys not read yet, from the queue of the pair
+    // owner for a Joy-Con half. Buttons still held stay held, so they do
+    // not produce their key again.
+    //
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    Owner  = UsbJoyStickDevice;
+    if (Owner->Partner != NULL && !Owner->PairOwner) {
+      Owner = Owner->Partner;
+    }
+    JoyStickFlushKeys (&Owner->Decoder.Keys);
+    gBS->RestoreTPL (OldTpl);
+
     if(!ExtendedVerification) {
-          REPORT_STATUS_CODE_WITH_DEVICE_PATH (
-            EFI_PROGRESS_CODE,
-            (EFI_PERIPHERAL_KEYBOARD | EFI_P_KEYBOARD_PC_CLEAR_BUFFER),
-            UsbJoyStickDevice->DevicePath
-    );
+      JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_VERBOSE, JOYSTICK_TRACE_RESET, FALSE, FALSE);
+      return EFI_SUCCESS;
+    }
 
-        // Clear buffer
+    //
+    // The hardware of a controller that is not active yet is initialized
+    // on its first use, which also retries a failed activation.
+    //
+    if (!UsbJoyStickDevice->Activated) {
+      if (UsbJoyStickDevice->ActivationFailed) {
+        JoyStickCountRecovery (UsbJoyStickDevice);
+      }
+      UsbJoyStickDevice->ActivationFailed = FALSE;
+      return EFI_SUCCESS;
+    }
 
-    return EFI_SUCCESS;
+    //
+    // ConSplitter resets every console input on each screen change, and
+    // the requests of JoyStickVerifyHardware() take about a millisecond
+    // each. They are only repeated once a transfer has failed since they
+    // last succeeded. The decoder keeps its state and key edges, and the
+    // transfers stopped by the failure run again without waiting for
+    // DelayedRecoveryEvent.
+    //
+    if (UsbJoyStickDevice->HardwareVerified) {
+      JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_VERBOSE, JOYSTICK_TRACE_RESET, TRUE, FALSE);
+      return EFI_SUCCESS;
     }
 
-    Status = InitUSBJoyStick(UsbJoyStickDevice);
+    JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_VERBOSE, JOYSTICK_TRACE_RESET, TRUE, TRUE);
+    Status = JoyStickVerifyHardware (UsbJoyStickDevice);
+    if (!EFI_ERROR (Status)) {
+      Status = JoyStickRestartTransfers (UsbJoyStickDevice);
+    }
     if(EFI_ERROR(Status)){
       return EFI_DEVICE_ERROR;
     }
@@ -559,8 +861,25 @@ USBJoyStickReadKeyStroke (
   OUT EFI_INPUT_KEY                    *Key
   )
   {
-    return EFI_SUCCESS;
+    EFI_STATUS       Status;
+    EFI_KEY_DATA     KeyData;
+
+    if (Key == NULL) {
+      return EFI_INVALID_PARAMETER;
+    }
+
+    JoyStickRequestActivation (USB_JS_DEV_FROM_THIS (This));
+
+    //
+    // Every controller serves the keys of all of them, oldest first.
+    //
+    Status = JoyStickReadMergedKey (&KeyData);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
 
+    CopyMem (Key, &KeyData.Key, sizeof (EFI_INPUT_KEY));
+    return EFI_SUCCESS;
   }
 
 //
@@ -629,7 +948,12 @@ USBJoyStickReadKeyStrokeEx (
   OUT EFI_KEY_DATA                      *KeyData
   )
   {
-    return EFI_SUCCESS;
+    if (KeyData == NULL) {
+      return EFI_INVALID_PARAMETER;
+    }
+
+    JoyStickRequestActivation (TEXT_INPUT_EX_USB_JS_DEV_FROM_THIS (This));
+    return JoyStickReadMergedKey (KeyData);
   }
 
 /**
@@ -656,6 +980,43 @@ USBJoyStickSetState (
     return EFI_SUCCESS;
   }
 
+/**
+  Check whether a pressed key matches a registered key.
+
+  @param  RegisteredData    The key registered for a notification.
+  @param  InputData         The pressed key.
+
+  @retval TRUE              The key matches the registration.
+  @retval FALSE             The key does not match.
+
+**/
+STATIC
+BOOLEAN
+JoyStickIsKeyRegistered (
+  IN CONST EFI_KEY_DATA  *RegisteredData,
+  IN CONST EFI_KEY_DATA  *InputData
+  )
+{
+  if (RegisteredData->Key.ScanCode != InputData->Key.ScanCode ||
+      RegisteredData->Key.UnicodeChar != InputData->Key.UnicodeChar) {
+    return FALSE;
+  }
+
+  //
+  // A shift or toggle state is only compared when the registration has
+  // one. The controller reports neither, so such keys never match.
+  //
+  if ((RegisteredData->KeyState.KeyShiftState & EFI_SHIFT_STATE_VALID) != 0 &&
+      RegisteredData->KeyState.KeyShiftState != InputData->KeyState.KeyShiftState) {
+    return FALSE;
+  }
+  if ((RegisteredData->KeyState.KeyToggleState & EFI_TOGGLE_STATE_VALID) != 0 &&
+      RegisteredData->KeyState.KeyToggleState != InputData->KeyState.KeyToggleState) {
+    return FALSE;
+  }
+  return TRUE;
+}
+
 /**
   Register a notification function for a particular keystroke for the input device.
 
@@ -684,6 +1045,55 @@ USBJoyStickRegisterKeyNotify (
   OUT VOID                               **NotifyHandle
   )
   {
+    USB_JS_DEV                      *UsbJoyStickDevice;
+    USB_JS_CONSOLE_IN_EX_NOTIFY     *NewNotify;
+    USB_JS_CONSOLE_IN_EX_NOTIFY     *CurrentNotify;
+    LIST_ENTRY                      *Link;
+    EFI_TPL                         OldTpl;
+
+    if (KeyData == NULL || NotifyHandle == NULL || KeyNotificationFunction == NULL) {
+      return EFI_INVALID_PARAMETER;
+    }
+
+    UsbJoyStickDevice = TEXT_INPUT_EX_USB_JS_DEV_FROM_THIS (This);
+
+    //
+    // Boot managers register their hotkeys here: the hotkey scan window
+    // is a consumer of input like any read.
+    //
+    JoyStickRequestActivation (UsbJoyStickDevice);
+
+    //
+    // Return the existing handle if the same key and function are already
+    // registered.
+    //
+    for (Link = GetFirstNode (&UsbJoyStickDevice->NotifyList);
+         !IsNull (&UsbJoyStickDevice->NotifyList, Link);
+         Link = GetNextNode (&UsbJoyStickDevice->NotifyList, Link)) {
+      CurrentNotify = USB_JS_CONSOLE_IN_EX_NOTIFY_FROM_LINK (Link);
+      if (JoyStickIsKeyRegistered (&CurrentNotify->KeyData, KeyData) &&
+          CurrentNotify->KeyNotificationFn == KeyNotificationFunction) {
+        *NotifyHandle = &CurrentNotify->NotifyEntry;
+        return EFI_SUCCESS;
+      }
+    }
+
+    NewNotify = AllocateZeroPool (sizeof (USB_JS_CONSOLE_IN_EX_NOTIFY));
+    if (NewNotify == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    NewNotify->Signature         = USB_JS_CONSOLE_IN_EX_NOTIFY_SIGNATURE;
+    NewNotify->KeyNotificationFn = KeyNotificationFunction;
+    CopyMem (&NewNotify->KeyData, KeyData, sizeof (EFI_KEY_DATA));
+
+    //
+    // The transfer handler walks the list at TPL_NOTIFY.
+    //
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    InsertTailList (&UsbJoyStickDevice->NotifyList, &NewNotify->NotifyEntry);
+    gBS->RestoreTPL (OldTpl);
+
+    *NotifyHandle = &NewNotify->NotifyEntry;
     return EFI_SUCCESS;
   }
 
@@ -705,24 +1115,122 @@ USBJoyStickUnregisterKeyNotify (
   IN VOID                               *NotificationHandle
   )
   {
-    return EFI_SUCCESS;
+    USB_JS_DEV                      *UsbJoyStickDevice;
+    USB_JS_CONSOLE_IN_EX_NOTIFY     *CurrentNotify;
+    LIST_ENTRY                      *Link;
+    EFI_TPL                         OldTpl;
+
+    if (NotificationHandle == NULL) {
+      return EFI_INVALID_PARAMETER;
+    }
+
+    UsbJoyStickDevice = TEXT_INPUT_EX_USB_JS_DEV_FROM_THIS (This);
+
+    for (Link = GetFirstNode (&UsbJoyStickDevice->NotifyList);
+         !IsNull (&UsbJoyStickDevice->NotifyList, Link);
+         Link = GetNextNode (&UsbJoyStickDevice->NotifyList, Link)) {
+      CurrentNotify = USB_JS_CONSOLE_IN_EX_NOTIFY_FROM_LINK (Link);
+      if (NotificationHandle == &CurrentNotify->NotifyEntry) {
+        OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+        RemoveEntryList (&CurrentNotify->NotifyEntry);
+        gBS->RestoreTPL (OldTpl);
+
+        FreePool (CurrentNotify);
+        return EFI_SUCCESS;
+      }
+    }
+
+    //
+    // Cannot find the matching entry in database.
+    //
+    return EFI_INVALID_PARAMETER;
   }
 
 
 /**
- * 
- * Initialize USB JoyStick device and all private structures.
- * @param UsbJoyStickDevice   The USB_JS_DEV instance.
- * 
- * @retval EFI_SUCCESS        Initialization is successful.
- * @retval EFI_DEVICE_ERROR   JoyStick initialization failed.
- * 
- * 
- **/
+  Handler function for WaitForKey event.
+
+  @param  Event        Event to be signaled when a key is pressed.
+  @param  Context      Points to USB_JS_DEV instance.
+
+**/
+VOID
+EFIAPI
+USBJoyStickWaitForKey (
+  IN  EFI_EVENT               Event,
+  IN  VOID                    *Context
+  )
+{
+  JoyStickRequestActivation ((USB_JS_DEV *) Context);
+
+  if (JoyStickMergedKeyPending ()) {
+    gBS->SignalEvent (Event);
+  }
+}
+
+/**
+  Process the queued key notifications.
+
+  Calls the notification function of every registration that matches a
+  key of NotifyKeys, oldest key first.
+
+  @param  Event        The KeyNotifyProcessEvent.
+  @param  Context      Points to USB_JS_DEV instance.
+
+**/
+VOID
+EFIAPI
+JoyStickKeyNotifyProcessHandler (
+  IN  EFI_EVENT               Event,
+  IN  VOID                    *Context
+  )
+{
+  USB_JS_DEV                      *UsbJoyStickDevice;
+  USB_JS_CONSOLE_IN_EX_NOTIFY     *CurrentNotify;
+  LIST_ENTRY                      *Link;
+  JOYSTICK_KEY_ENTRY              Entry;
+  EFI_STATUS                      Status;
+  EFI_TPL                         OldTpl;
+
+  UsbJoyStickDevice = (USB_JS_DEV *) Context;
+
+  while (TRUE) {
+    //
+    // The transfer handler appends to NotifyKeys at TPL_NOTIFY.
+    //
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    Status = JoyStickDequeueKey (&UsbJoyStickDevice->NotifyKeys, &Entry);
+    gBS->RestoreTPL (OldTpl);
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+
+    for (Link = GetFirstNode (&UsbJoyStickDevice->NotifyList);
+         !IsNull (&UsbJoyStickDevice->NotifyList, Link);
+         Link = GetNextNode (&UsbJoyStickDevice->NotifyList, Link)) {
+      CurrentNotify = USB_JS_CONSOLE_IN_EX_NOTIFY_FROM_LINK (Link);
+      if (JoyStickIsKeyRegistered (&CurrentNotify->KeyData, &Entry.KeyData)) {
+        CurrentNotify->KeyNotificationFn (&Entry.KeyData);
+      }
+    }
+  }
+}
+
+/**
+  Read the configuration of the controller and leave its interface in
+  report protocol, setting HardwareVerified when both succeed. Only the
+  control transfers are issued, the decoder is left as it is.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        The controller answered its configuration.
+  @retval Others             The configuration could not be read.
+
+**/
 EFI_STATUS
-InitUSBJoyStick (
+JoyStickVerifyHardware (
   IN OUT USB_JS_DEV     *UsbJoyStickDevice
-)
+  )
 {
   UINT16       ConfigValue;
   UINT8        Protocol;
@@ -734,7 +1242,6 @@ InitUSBJoyStick (
     (EFI_PERIPHERAL_KEYBOARD|EFI_P_KEYBOARD_PC_SELF_TEST),
     UsbJoyStickDevice->DevicePath
   );
-  DEBUG((EFI_D_INFO,"JoyStick Init"));
 
   Status = UsbGetConfiguration (
     UsbJoyStickDevice->UsbIo,
@@ -743,26 +1250,82 @@ InitUSBJoyStick (
   );
 
   if(EFI_ERROR(Status)){
-    DEBUG((EFI_D_INFO,"Get Configuration Failed"));
+    JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_INIT, Status, 0);
     return Status;
   }
 
-  UsbGetProtocolRequest (
+  Status = UsbGetProtocolRequest (
     UsbJoyStickDevice->UsbIo,
     UsbJoyStickDevice->InterfaceDescriptor.InterfaceNumber,
     &Protocol
   );
 
-  if(Protocol!= 0)
+  if(!EFI_ERROR(Status) && Protocol!= 0)
   {
-    UsbSetProtocolRequest (
+    Status = UsbSetProtocolRequest (
       UsbJoyStickDevice->UsbIo,
       UsbJoyStickDevice->InterfaceDescriptor.InterfaceNumber,
       0
     );
   }
 
-  ZeroMem (UsbJoyStickDevice->LastReport,sizeof(UINT8)*64);
+  //
+  // A controller refusing the protocol requests still works, but is asked
+  // again on the next exhaustive Reset().
+  //
+  UsbJoyStickDevice->HardwareVerified = (BOOLEAN) !EFI_ERROR (Status);
+  return EFI_SUCCESS;
+}
+
+/**
+ * 
+ * Initialize USB JoyStick device and all private structures.
+ * @param UsbJoyStickDevice   The USB_JS_DEV instance.
+ * 
+ * @retval EFI_SUCCESS        Initialization is successful.
+ * @retval EFI_DEVICE_ERROR   JoyStick initialization failed.
+ * 
+ * 
+ **/
+EFI_STATUS
+InitUSBJoyStick (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+)
+{
+  EFI_STATUS   Status;
+  EFI_USB_DEVICE_DESCRIPTOR  DeviceDescriptor;
+  UINTN        Index;
+
+  Status = JoyStickVerifyHardware (UsbJoyStickDevice);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  JoyStickInitDecoder (&UsbJoyStickDevice->Decoder);
+  JoyStickSetDebounce (&UsbJoyStickDevice->Decoder, FixedPcdGet8 (PcdJoyStickDebounceReports));
+  JoyStickSetKeyEdges (
+    &UsbJoyStickDevice->Decoder,
+    FixedPcdGet32 (PcdJoyStickPressKeyButtons),
+    FixedPcdGet32 (PcdJoyStickReleaseKeyButtons)
+    );
+
+  //
+  // Models without a tuning entry report their sticks unfiltered.
+  //
+  UsbJoyStickDevice->Side = JOYSTICK_SIDE_NONE;
+  Status = UsbJoyStickDevice->UsbIo->UsbGetDeviceDescriptor (
+                                       UsbJoyStickDevice->UsbIo,
+                                       &DeviceDescriptor
+                                       );
+  if (!EFI_ERROR (Status)) {
+    for (Index = 0; Index < ARRAY_SIZE (mJoyStickModels); Index++) {
+      if (mJoyStickModels[Index].ProductId == DeviceDescriptor.IdProduct) {
+        JoyStickSetStickFilter (&UsbJoyStickDevice->Decoder, &mJoyStickModels[Index].StickFilter);
+        UsbJoyStickDevice->Side = mJoyStickModels[Index].Side;
+        break;
+      }
+    }
+  }
   return EFI_SUCCESS;
 }
 
@@ -795,11 +1358,17 @@ IsUSBJoyStick(
 	  return FALSE;
   }
   
-  DEBUG((EFI_D_INFO,"Vendor ID = 0x%04x \r\n", DeviceDescriptor.IdVendor));
-  DEBUG((EFI_D_INFO,"Product ID = 0x%04x \r\n", DeviceDescriptor.IdProduct));
+  JOYSTICK_TRACE (
+    JOYSTICK_TRACE_LEVEL_VERBOSE,
+    JOYSTICK_TRACE_DEVICE_ID,
+    DeviceDescriptor.IdVendor,
+    DeviceDescriptor.IdProduct
+    );
   
   if(DeviceDescriptor.IdVendor == NINTENDO_HID &&
-     DeviceDescriptor.IdProduct == JOYSTICK_PID
+     (DeviceDescriptor.IdProduct == JOYSTICK_PID ||
+      DeviceDescriptor.IdProduct == JOYSTICK_PID_JOYCON_L ||
+      DeviceDescriptor.IdProduct == JOYSTICK_PID_JOYCON_R)
     ){
 	  return TRUE;
   }
@@ -807,6 +1376,267 @@ IsUSBJoyStick(
 
 }
 
+/**
+  Take a 0x30 full input report: buttons, sticks and IMU samples.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Report             The input report.
+
+  @retval TRUE               The report carries input to decode.
+
+**/
+STATIC
+BOOLEAN
+JoyStickFullReport (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report
+  )
+{
+  UsbJoyStickDevice->ReportMode = JOYSTICK_REPORT_MODE_FULL;
+  return TRUE;
+}
+
+/**
+  Take a 0x3F simple HID input report, sent on button changes only.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Report             The input report.
+
+  @retval TRUE               The report carries input to decode.
+
+**/
+STATIC
+BOOLEAN
+JoyStickSimpleReport (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report
+  )
+{
+  UsbJoyStickDevice->ReportMode = JOYSTICK_REPORT_MODE_SIMPLE;
+  return TRUE;
+}
+
+/**
+  Take a 0x21 subcommand reply. It carries the same button and stick bytes
+  as a full report.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Report             The input report.
+
+  @retval TRUE               The report carries input to decode.
+
+**/
+STATIC
+BOOLEAN
+JoyStickSubcmdReport (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report
+  )
+{
+  JoyStickSubcommandReply (UsbJoyStickDevice, Report);
+  return TRUE;
+}
+
+/**
+  Take a 0x81 USB command reply. Only the handshake waits for one, later
+  replies carry nothing.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Report             The input report.
+
+  @retval FALSE              The report carries no input.
+
+**/
+STATIC
+BOOLEAN
+JoyStickUsbReply (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report
+  )
+{
+  return FALSE;
+}
+
+//
+// Input report ids taken once the controller is up. Reports of any other
+// id are dropped before they are decoded.
+//
+GLOBAL_REMOVE_IF_UNREFERENCED JOYSTICK_REPORT_DISPATCH mJoyStickReportDispatch[] = {
+  { JOYSTICK_IN_FULL,          USB_JOYSTICK_REPORT_FULL,         JoyStickFullReport   },
+  { JOYSTICK_IN_SIMPLE_HID,    USB_JOYSTICK_REPORT_SIMPLE,       JoyStickSimpleReport },
+  { JOYSTICK_IN_SUBCMD_REPLY,  USB_JOYSTICK_REPORT_SUBCMD_REPLY, JoyStickSubcmdReport },
+  { JOYSTICK_IN_USB_REPLY,     USB_JOYSTICK_REPORT_USB_REPLY,    JoyStickUsbReply     }
+};
+
+/**
+  Look up the dispatch entry of an input report id.
+
+  @param  ReportId           Byte 0 of the report.
+
+  @return The entry, or NULL for an id the driver drops.
+
+**/
+STATIC
+CONST JOYSTICK_REPORT_DISPATCH *
+JoyStickFindReportDispatch (
+  IN UINT8              ReportId
+  )
+{
+  UINTN                 Index;
+
+  for (Index = 0; Index < ARRAY_SIZE (mJoyStickReportDispatch); Index++) {
+    if (mJoyStickReportDispatch[Index].ReportId == ReportId) {
+      return &mJoyStickReportDispatch[Index];
+    }
+  }
+  return NULL;
+}
+
+/**
+  Copy the pressed keys a report queued that match a key notification to
+  NotifyKeys, and signal KeyNotifyProcessEvent for them.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance whose decoder queued the keys.
+  @param  Count              The number of keys the report queued, the last
+                             ones of the key queue.
+
+**/
+STATIC
+VOID
+JoyStickQueueKeyNotifies (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT32         Count
+  )
+{
+  JOYSTICK_KEY_QUEUE              *Keys;
+  CONST JOYSTICK_KEY_ENTRY        *Entry;
+  USB_JS_CONSOLE_IN_EX_NOTIFY     *CurrentNotify;
+  LIST_ENTRY                      *Link;
+  UINTN                           Index;
+  BOOLEAN                         Queued;
+
+  Keys   = &UsbJoyStickDevice->Decoder.Keys;
+  Index  = (Keys->Tail - Count) & (JOYSTICK_KEY_QUEUE_SIZE - 1);
+  Queued = FALSE;
+  for (; Count > 0; Count--, Index = (Index + 1) & (JOYSTICK_KEY_QUEUE_SIZE - 1)) {
+    Entry = &Keys->Buffer[Index];
+    if (Entry->Edge != JOYSTICK_KEY_PRESS) {
+      continue;
+    }
+    for (Link = GetFirstNode (&UsbJoyStickDevice->NotifyList);
+         !IsNull (&UsbJoyStickDevice->NotifyList, Link);
+         Link = GetNextNode (&UsbJoyStickDevice->NotifyList, Link)) {
+      CurrentNotify = USB_JS_CONSOLE_IN_EX_NOTIFY_FROM_LINK (Link);
+      if (JoyStickIsKeyRegistered (&CurrentNotify->KeyData, &Entry->KeyData)) {
+        if (!EFI_ERROR (JoyStickEnqueueKey (&UsbJoyStickDevice->NotifyKeys, Entry))) {
+          Queued = TRUE;
+        }
+        break;
+      }
+    }
+  }
+
+  if (Queued) {
+    gBS->SignalEvent (UsbJoyStickDevice->KeyNotifyProcessEvent);
+  }
+}
+
+/**
+  Decode one input report of an interrupt transfer.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Dispatch           The dispatch entry of the report id, NULL to
+                             drop the report.
+  @param  Report             The JOYSTICK_REPORT_SIZE bytes of the report.
+  @param  Arrival            The arrival stamp of the transfer.
+
+**/
+STATIC
+VOID
+JoyStickHandleReport (
+  IN OUT USB_JS_DEV                      *UsbJoyStickDevice,
+  IN     CONST JOYSTICK_REPORT_DISPATCH  *Dispatch,
+  IN     UINT8                           *Report,
+  IN     UINT64                          Arrival
+  )
+{
+  USB_JS_DEV            *Source;
+  JOYSTICK_KEY_QUEUE    *Keys;
+  UINT32                Queued;
+  UINT32                Dropped;
+  UINT32                OldButtons;
+  BOOLEAN               Changed;
+  UINT8                 Merged[JOYSTICK_REPORT_SIZE];
+
+  //
+  // Raw subscribers see every report, including ids the driver drops. They
+  // run with the statistics published, so they may read them.
+  //
+  if (FeaturePcdGet (PcdJoyStickReportSupport) && UsbJoyStickDevice->SubscriberMap != 0) {
+    JoyStickStatsPause (UsbJoyStickDevice);
+    JoyStickNotifySubscribers (UsbJoyStickDevice, Report, JOYSTICK_REPORT_SIZE);
+    JoyStickStatsResume (UsbJoyStickDevice);
+  }
+
+  if (Dispatch == NULL || !Dispatch->Handler (UsbJoyStickDevice, Report)) {
+    return;
+  }
+
+  //
+  // IMU samples change with every full report, so they are decoded ahead
+  // of the button change check. Skipped while no motion consumer is started.
+  //
+  if (FeaturePcdGet (PcdJoyStickMotionSupport) &&
+      UsbJoyStickDevice->MotionUsers != 0 && Report[0] == JOYSTICK_IN_FULL) {
+    JoyStickImuReport (UsbJoyStickDevice, Report);
+  }
+
+  //
+  // The halves of a Joy-Con pair decode as one pad, in the owner of the pair.
+  // The report and its keys are counted in the half that sent it.
+  //
+  Source = UsbJoyStickDevice;
+  if (UsbJoyStickDevice->Partner != NULL) {
+    UsbJoyStickDevice = JoyStickPairReport (UsbJoyStickDevice, Report, Arrival, Merged, &Arrival);
+    if (UsbJoyStickDevice == NULL) {
+      return;
+    }
+    Report = Merged;
+  }
+
+  Keys       = &UsbJoyStickDevice->Decoder.Keys;
+  Queued     = Keys->Queued;
+  Dropped    = Keys->Dropped;
+  OldButtons = UsbJoyStickDevice->Decoder.Buttons;
+  Changed    = JoyStickProcessReport (&UsbJoyStickDevice->Decoder, Report, Arrival);
+  JOYSTICK_COUNT (Source, KeysQueued, (UINT32) (Keys->Queued - Queued));
+  JOYSTICK_COUNT (Source, KeysDropped, (UINT32) (Keys->Dropped - Dropped));
+
+  //
+  // The keys of a pair are notified to the registrations of its owner.
+  //
+  if (Keys->Queued != Queued && !IsListEmpty (&UsbJoyStickDevice->NotifyList)) {
+    JoyStickQueueKeyNotifies (UsbJoyStickDevice, Keys->Queued - Queued);
+  }
+
+  //
+  // Sticks and IMU move without button changes, publish every report.
+  //
+  if (FeaturePcdGet (PcdJoyStickStateSupport)) {
+    JoyStickPublishState (UsbJoyStickDevice, Report);
+  }
+  if (!Changed) {
+    JOYSTICK_COUNT (Source, Unchanged, 1);
+    return;
+  }
+  JOYSTICK_TRACE (
+    JOYSTICK_TRACE_LEVEL_VERBOSE,
+    JOYSTICK_TRACE_BUTTONS,
+    OldButtons,
+    UsbJoyStickDevice->Decoder.Buttons
+    );
+}
+
 /**
   Handler function for USB JoyStick's asynchronous interrupt transfer.
 
@@ -816,7 +1646,7 @@ IsUSBJoyStick(
   @param  Data             A pointer to a buffer that is filled with key data which is
                            retrieved via asynchronous interrupt transfer.
   @param  DataLength       Indicates the size of the data buffer.
-  @param  Context          Pointing to USB_JS_DEV instance.
+  @param  Context          The JOYSTICK_IN_ENDPOINT the transfer belongs to.
   @param  Result           Indicates the result of the asynchronous interrupt transfer.
 
   @retval EFI_SUCCESS      Asynchronous interrupt transfer is handled successfully.
@@ -832,18 +1662,28 @@ JoyStickHandler (
   IN  UINT32        Result
   )
   {
+    JOYSTICK_IN_ENDPOINT  *InEndpoint;
     USB_JS_DEV            *UsbJoyStickDevice;
+    CONST JOYSTICK_REPORT_DISPATCH  *Dispatch;
     EFI_USB_IO_PROTOCOL   *UsbIo;
     UINT32                UsbStatus;
     UINT8                 *CurrentReportData;
-    UINT8                 *OldReportData;
-    UINTN                 Index;
-
-    UsbJoyStickDevice = (USB_JS_DEV *) Context;
+    UINT64                Arrival;
+
+    //
+    // Stamp the report before anything else, so queue time covers decoding.
+    //
+    Arrival           = JoyStickArrivalStamp ();
+    InEndpoint        = (JOYSTICK_IN_ENDPOINT *) Context;
+    UsbJoyStickDevice = InEndpoint->Device;
     UsbIo             = UsbJoyStickDevice->UsbIo;
-    
+    JoyStickStatsBegin (UsbJoyStickDevice);
+
     if(Result != EFI_USB_NOERROR)
     {
+      JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_REPORT_ERROR, Result, 0);
+      JOYSTICK_COUNT (UsbJoyStickDevice, Errors, 1);
+      UsbJoyStickDevice->HardwareVerified = FALSE;
       REPORT_STATUS_CODE_WITH_DEVICE_PATH (
             EFI_ERROR_CODE | EFI_ERROR_MINOR,
             (EFI_PERIPHERAL_KEYBOARD | EFI_P_EC_INPUT_ERROR),
@@ -853,77 +1693,89 @@ JoyStickHandler (
       if(((Result & EFI_USB_ERR_STALL ) == EFI_USB_ERR_STALL)) {
         UsbClearEndpointHalt (
           UsbIo,
-          UsbJoyStickDevice->IntInEndpointDescriptor.EndpointAddress,
+          InEndpoint->Descriptor.EndpointAddress,
           &UsbStatus
         );
       }
 
+      //
+      // Only this endpoint's transfer stops, the others keep reporting.
+      // DelayedRecoveryEvent submits it again.
+      //
+      InEndpoint->AsyncActive = FALSE;
       UsbIo->UsbAsyncInterruptTransfer (
           UsbIo,
-          UsbJoyStickDevice->IntInEndpointDescriptor.EndpointAddress,
+          InEndpoint->Descriptor.EndpointAddress,
           FALSE,
           0,
           0,
           NULL,
           NULL
       );
-        return EFI_DEVICE_ERROR;    
-    }
-
-    CurrentReportData = (UINT8 *) Data;
-    OldReportData     = UsbJoyStickDevice->LastReport;
-    //Check for Button
-    for (Index = 3; Index < 6; Index++)
-    {
-      if(OldReportData[Index]!=CurrentReportData[Index]){
-          break;
-      }
+      gBS->SetTimer (
+             UsbJoyStickDevice->DelayedRecoveryEvent,
+             TimerRelative,
+             EFI_USB_INTERRUPT_DELAY
+             );
+      JoyStickStatsEnd (UsbJoyStickDevice, Arrival);
+      return EFI_DEVICE_ERROR;
     }
 
-    if (Index == 6)
-    {
+    //
+    // A transfer holds whole reports back to back, the trailing partial
+    // report of a short transfer is dropped.
+    //
+    if (Data == NULL || DataLength < JOYSTICK_REPORT_SIZE) {
+      JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_ERROR, JOYSTICK_TRACE_REPORT_ERROR, 0, DataLength);
+      JOYSTICK_COUNT (UsbJoyStickDevice, Errors, 1);
+      UsbJoyStickDevice->HardwareVerified = FALSE;
+      JoyStickStatsEnd (UsbJoyStickDevice, Arrival);
       return EFI_SUCCESS;
     }
-    //DEBUG((EFI_D_INFO,"Button Data: 0x%02x\n\r", CurrentReportData[3]));
-
-    
-    if(((CurrentReportData[3] & 0x1)== 0x0 )&& ((BOOLEAN)(OldReportData[3] & (UINT8)0x1) == (UINT8)0x1))
-    {
-      Print(L"Y");
-    }
-    
-    if(((CurrentReportData[3] & (UINT8)(0x1<<1)) == 0x0 )&& ((OldReportData[3] & (UINT8)(0x1<<1)) == (UINT8)(0x1<<1)))
-    {
-      Print(L"X");
-    } 
 
-    if(((CurrentReportData[3] & (UINT8)(0x1<<2)) == 0x0 )&& ((OldReportData[3] & (UINT8)(0x1<<2)) == (UINT8)(0x1<<2)))
-    {
-      Print(L"B");
-    } 
+    JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_VERBOSE, JOYSTICK_TRACE_REPORT, ((UINT8 *) Data)[0], DataLength);
+
+    for (CurrentReportData = (UINT8 *) Data;
+         DataLength >= JOYSTICK_REPORT_SIZE;
+         CurrentReportData += JOYSTICK_REPORT_SIZE, DataLength -= JOYSTICK_REPORT_SIZE) {
+      Dispatch = JoyStickFindReportDispatch (CurrentReportData[0]);
+      JOYSTICK_COUNT (UsbJoyStickDevice, Reports, 1);
+      JOYSTICK_COUNT (
+        UsbJoyStickDevice,
+        ReportTypes[(Dispatch != NULL) ? Dispatch->Type : USB_JOYSTICK_REPORT_OTHER],
+        1
+        );
 
-    if(((CurrentReportData[3] & (UINT8)(0x1<<3)) == 0x0 )&& ((OldReportData[3] & (UINT8)(0x1<<3)) == (UINT8)(0x1<<3)))
-    {
-      Print(L"A");
-    } 
-    /*
-    if(((CurrentReportData[5] & (UINT8)(0x1<<4)) == 0x0 )&& ((OldReportData[5] & (UINT8)(0x1<<4)) == (UINT8)(0x1<<4)))
-    {
-      Print(L"SR");
-    }
-    
-    if(((CurrentReportData[5] & (UINT8)(0x1<<5)) == 0x0 )&& ((OldReportData[5] & (UINT8)(0x1<<5)) == (UINT8)(0x1<<5)))
-    {
-      Print(L"SL");
-    } 
-    */
-//Update last report
-    for (int i=0;i<64;i++)
-    {
-       UsbJoyStickDevice->LastReport[i]=CurrentReportData[i];
+      //
+      // Until the controller is up only its replies matter.
+      //
+      if (UsbJoyStickDevice->ActivateState != JOYSTICK_ACTIVATE_IDLE) {
+        JoyStickActivateReport (UsbJoyStickDevice, CurrentReportData);
+        continue;
+      }
+      JoyStickHandleReport (UsbJoyStickDevice, Dispatch, CurrentReportData, Arrival);
     }
-    
-
 
+    JoyStickStatsEnd (UsbJoyStickDevice, Arrival);
     return EFI_SUCCESS;
   }
+
+/**
+  Timer handler for the delayed recovery of failed transfers.
+
+  A transfer that failed was stopped by JoyStickHandler, after clearing
+  the halt of its endpoint. This handler submits it again.
+
+  @param  Event            The DelayedRecoveryEvent.
+  @param  Context          The USB_JS_DEV instance.
+
+**/
+VOID
+EFIAPI
+JoyStickRecoveryHandler (
+  IN  EFI_EVENT     Event,
+  IN  VOID          *Context
+  )
+{
+  JoyStickRestartTransfers ((USB_JS_DEV *) Context);
+}
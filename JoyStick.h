@@ -9,6 +9,9 @@
 #define _JOYSTICK_H_
 
 
+#ifdef JOYSTICK_HOST_BUILD
+#include <HostDxe.h>
+#else
 #include <Uefi.h>
 
 #include<Protocol/SimpleTextIn.h>
@@ -28,39 +31,366 @@
 #include<Library/PcdLib.h>
 #include<Library/UefiUsbLib.h>
 #include<Library/HiiLib.h>
+#include<Library/TimerLib.h>
+#include<Library/SynchronizationLib.h>
+#include<Library/BaseLib.h>
+#include<Library/PerformanceLib.h>
 
 #include<IndustryStandard/Usb.h>
+#endif
+
+#include<Protocol/JoyStickMotion.h>
+#include<Protocol/JoyStickKeyInfo.h>
+#include<Protocol/JoyStickState.h>
+#include<Protocol/JoyStickReport.h>
+#include<Protocol/JoyStickStats.h>
+#include<Guid/JoyStickTrace.h>
+#include<Guid/JoyStickCalibration.h>
+
+#include "JoyStickCore.h"
 
 
 #define NINTENDO_HID  0x057E
 #define JOYSTICK_PID  0x2009
+#define JOYSTICK_PID_JOYCON_L  0x2006
+#define JOYSTICK_PID_JOYCON_R  0x2007
+
+//
+// Report IDs sent to the controller on the interrupt OUT endpoint.
+//
+#define JOYSTICK_OUT_RUMBLE_SUBCMD      0x01
+#define JOYSTICK_OUT_USB_CMD            0x80
+
+//
+// Commands of an 0x80 output report. The handshake is answered by an 0x81
+// report echoing it, the other one starts the input reports.
+//
+#define JOYSTICK_USB_CMD_HANDSHAKE      0x02
+#define JOYSTICK_USB_CMD_NO_TIMEOUT     0x04
+
+//
+// Subcommands carried by a 0x01 output report. The reply comes back in a
+// 0x21 input report with the ACK at byte 13 and the echoed id at byte 14.
+//
+#define JOYSTICK_SUBCMD_DEVICE_INFO     0x02
+#define JOYSTICK_SUBCMD_SET_REPORT_MODE 0x03
+#define JOYSTICK_SUBCMD_SPI_READ        0x10
+#define JOYSTICK_SUBCMD_SET_PLAYER_LIGHTS 0x30
+#define JOYSTICK_SUBCMD_ENABLE_IMU      0x40
+
+#define JOYSTICK_SUBCMD_ACK_OFFSET      13
+#define JOYSTICK_SUBCMD_ID_OFFSET       14
+#define JOYSTICK_SUBCMD_DATA_OFFSET     15
+#define JOYSTICK_SUBCMD_ACK             BIT7
+
+//
+// Time to wait for one input report while matching a subcommand reply,
+// and how many non-matching reports may arrive before giving up.
+//
+#define JOYSTICK_SUBCMD_TIMEOUT         100
+#define JOYSTICK_SUBCMD_MAX_POLL        16
+
+//
+// Input report modes selected by JOYSTICK_SUBCMD_SET_REPORT_MODE.
+// Simple HID mode is enough for text navigation and produces smaller, less
+// frequent reports; full mode is needed for sticks and IMU data.
+//
+#define JOYSTICK_REPORT_MODE_FULL       JOYSTICK_IN_FULL
+#define JOYSTICK_REPORT_MODE_SIMPLE     JOYSTICK_IN_SIMPLE_HID
+
+//
+// SPI flash reads: the reply echoes address and length at byte 15, the data
+// follows at byte 20.
+//
+#define JOYSTICK_SPI_DATA_OFFSET        20
+#define JOYSTICK_SPI_MAX_READ           0x1D
+
+#define JOYSTICK_SPI_IMU_FACTORY_CAL    0x6020
+#define JOYSTICK_SPI_IMU_USER_CAL       0x8026
+#define JOYSTICK_SPI_USER_CAL_MAGIC0    0xB2
+#define JOYSTICK_SPI_USER_CAL_MAGIC1    0xA1
+
+//
+// Device info reply: firmware version at data byte 0, the Bluetooth address
+// at data byte 4.
+//
+#define JOYSTICK_DEVICE_INFO_MAC_OFFSET 4
+#define JOYSTICK_MAC_SIZE               6
+
+//
+// Steps of bringing a controller up, see Activation.c. The controllers
+// being brought up share one timer ticking every JOYSTICK_ACTIVATE_TICK
+// ms; a step is sent up to JOYSTICK_ACTIVATE_TRIES times and waits
+// JOYSTICK_ACTIVATE_STEP_TIMEOUT ms for its reply each time.
+//
+#define JOYSTICK_ACTIVATE_IDLE          0
+#define JOYSTICK_ACTIVATE_HANDSHAKE     1
+#define JOYSTICK_ACTIVATE_REPORT_MODE   2
+#define JOYSTICK_ACTIVATE_DEVICE_INFO   3
+#define JOYSTICK_ACTIVATE_USER_CAL      4
+#define JOYSTICK_ACTIVATE_FACTORY_CAL   5
+
+#define JOYSTICK_ACTIVATE_TICK          1
+#define JOYSTICK_ACTIVATE_STEP_TIMEOUT  JOYSTICK_SUBCMD_TIMEOUT
+#define JOYSTICK_ACTIVATE_TRIES         3
+
+#define JOYSTICK_MOTION_RING_SIZE       32
+
+//
+// Player slots shared by all bound controllers, and how many of the keys
+// last returned by the merged key stream GetKeyInfo() remembers.
+//
+#define JOYSTICK_MAX_PLAYERS            8
+#define JOYSTICK_KEY_HISTORY_SIZE       8
+
+//
+// Interrupt IN endpoints bound per controller. Endpoints past the limit
+// are left unused.
+//
+#define JOYSTICK_MAX_IN_ENDPOINTS       4
+
+//
+// Raw report callbacks per controller, at most 32.
+//
+#define JOYSTICK_MAX_REPORT_SUBSCRIBERS 8
+
+//
+// Number of records kept by the trace buffer, a power of two.
+//
+#define JOYSTICK_TRACE_CAPACITY         256
+
+//
+// Record a binary trace point. Trace points above PcdJoyStickTraceLevel are
+// removed at compile time, the others cost a few stores and no formatting.
+//
+#define JOYSTICK_TRACE(Level, Event, Arg0, Arg1) \
+  do { \
+    if ((Level) <= FixedPcdGet8 (PcdJoyStickTraceLevel)) { \
+      JoyStickTraceWrite ((Event), (UINT64) (Arg0), (UINT64) (Arg1)); \
+    } \
+  } while (FALSE)
+
+//
+// Add to a counter of the statistics of a device. Only used by
+// JoyStickHandler, between JoyStickStatsBegin() and JoyStickStatsEnd();
+// removed at compile time without PcdJoyStickStatsSupport.
+//
+#define JOYSTICK_COUNT(Device, Counter, Value) \
+  do { \
+    if (FeaturePcdGet (PcdJoyStickStatsSupport)) { \
+      (Device)->StatsSnapshot.Counter += (Value); \
+    } \
+  } while (FALSE)
 
 #define USB_JS_DEV_SIGNATURE SIGNATURE_32 ('u', 'k', 'b', 'd')
-#define USB_JS_CONSOLE_IN_EX_NOTIFY_SIGNATURE SIGNAGURE_32 ('u', 'k', 'b', 'x')
+#define USB_JS_CONSOLE_IN_EX_NOTIFY_SIGNATURE SIGNATURE_32 ('u', 'k', 'b', 'x')
+
+//
+// A key notification registered through RegisterKeyNotify(), linked in the
+// NotifyList of the controller. Its NotifyEntry is the notify handle.
+//
+typedef struct {
+  UINTN                           Signature;
+  EFI_KEY_DATA                    KeyData;
+  EFI_KEY_NOTIFY_FUNCTION         KeyNotificationFn;
+  LIST_ENTRY                      NotifyEntry;
+} USB_JS_CONSOLE_IN_EX_NOTIFY;
+
+//
+// A raw report callback. Filter is the mask of report bytes it watches,
+// 0 for all reports.
+//
+typedef struct {
+  USB_JOYSTICK_REPORT_CALLBACK    Callback;
+  VOID                            *Context;
+  UINT64                          Filter;
+} JOYSTICK_REPORT_SUBSCRIBER;
+
+//
+// An interrupt IN endpoint and its asynchronous transfer. Each endpoint
+// runs a transfer of its own into JoyStickHandler with this as the context;
+// the reports of all of them are decoded into the pad of Device in the
+// order they arrive.
+//
+typedef struct {
+  struct _USB_JS_DEV              *Device;
+  EFI_USB_ENDPOINT_DESCRIPTOR     Descriptor;
+  UINTN                           PacketSize;
+  BOOLEAN                         AsyncActive;
+} JOYSTICK_IN_ENDPOINT;
 
 /*
  * Structure to describe USB JoyStick device
  *
  */
 
-typedef struct{
+typedef struct _USB_JS_DEV {
 	UINTN                           Signature;
 	EFI_HANDLE                      ControllerHandle;
   EFI_DEVICE_PATH_PROTOCOL        *DevicePath;
-	//EFI_EVENT                       DelayedRecoveryEvent;
+	//
+	// Submits again the transfers JoyStickHandler stopped on an error,
+	// EFI_USB_INTERRUPT_DELAY after it.
+	//
+	EFI_EVENT                       DelayedRecoveryEvent;
 	EFI_SIMPLE_TEXT_INPUT_PROTOCOL  SimpleInput;
 	EFI_SIMPLE_TEXT_INPUT_EX_PROTOCOL SimpleInputEx;
 	EFI_USB_IO_PROTOCOL             *UsbIo;
 
 	EFI_USB_INTERFACE_DESCRIPTOR    InterfaceDescriptor;
-	EFI_USB_ENDPOINT_DESCRIPTOR     IntInEndpointDescriptor;
   EFI_USB_ENDPOINT_DESCRIPTOR     IntOutEndpointDescriptor;
+  //
+  // Interrupt IN endpoints of the interface, in descriptor order. Requests
+  // sent before the transfers run read their reply from the first one.
+  //
+  JOYSTICK_IN_ENDPOINT            InEndpoints[JOYSTICK_MAX_IN_ENDPOINTS];
+  UINT8                           InEndpointCount;
 	EFI_UNICODE_STRING_TABLE        *ControllerNameTable;
   
-  UINT8                           LastReport[64];
-  //UINT8                           CurrReport[64];
+  JOYSTICK_DECODER                Decoder;
+
+  //
+  // Key notifications. Pressed keys that match a registration are copied
+  // to NotifyKeys by the transfer handler, KeyNotifyProcessEvent calls the
+  // notification functions at TPL_CALLBACK.
+  //
+  LIST_ENTRY                      NotifyList;
+  JOYSTICK_KEY_QUEUE              NotifyKeys;
+  EFI_EVENT                       KeyNotifyProcessEvent;
+
+  //
+  // Handshake and asynchronous transfer, deferred to the first consumer
+  // when PcdJoyStickLazyActivation is set. ActivateEvent starts it at
+  // TPL_CALLBACK, the shared activation timer steps it through
+  // ActivateState; a failed activation is only retried by Reset().
+  //
+  EFI_EVENT                       ActivateEvent;
+  BOOLEAN                         Activated;
+  BOOLEAN                         ActivationFailed;
+  UINT8                           ActivateState;
+  UINT8                           ActivateTries;
+  UINTN                           ActivateTicks;
+  BOOLEAN                         HandshakeReplied;
+  UINT64                          ActivateBegin;
+
+  //
+  // Set once JoyStickVerifyHardware() has read the configuration and left the
+  // interface in report protocol, cleared by a failed interrupt transfer.
+  // An exhaustive Reset() only repeats those requests while it is clear.
+  //
+  BOOLEAN                         HardwareVerified;
+
+  //
+  // Keys of the calibration cache, from the device info subcommand.
+  //
+  BOOLEAN                         MacValid;
+  UINT8                           Mac[JOYSTICK_MAC_SIZE];
+  UINT16                          Firmware;
+
+  //
+  // Subcommand engine and input report mode.
+  //
+  BOOLEAN                         AsyncActive;
+  UINT8                           SubcmdCounter;
+  UINT8                           SubcmdPending;
+  BOOLEAN                         SubcmdReplied;
+  UINT8                           SubcmdReply[JOYSTICK_REPORT_SIZE];
+  UINT8                           ReportMode;
+  UINT8                           RequestedReportMode;
+  UINTN                           FullReportUsers;
+
+  //
+  // IMU decode and motion ring, only fed while MotionUsers is not zero.
+  //
+  USB_JOYSTICK_MOTION_PROTOCOL    Motion;
+  UINTN                           MotionUsers;
+  JOYSTICK_IMU_SCALE              ImuScale;
+  UINT32                          MotionSequence;
+  UINTN                           MotionHead;
+  UINTN                           MotionCount;
+  USB_JOYSTICK_MOTION_SAMPLE      MotionRing[JOYSTICK_MOTION_RING_SIZE];
+
+  //
+  // Player slot, 0 while the controller is not part of the merged stream.
+  //
+  USB_JOYSTICK_KEY_INFO_PROTOCOL  KeyInfo;
+  UINT8                           PlayerId;
+
+  //
+  // Joy-Con half: its JOYSTICK_SIDE_*, and the other half once paired. A
+  // pair decodes as one pad in the half that was activated first, the
+  // PairOwner, which keeps the player slot and the Pair merge state.
+  //
+  UINT8                           Side;
+  struct _USB_JS_DEV              *Partner;
+  BOOLEAN                         PairOwner;
+  JOYSTICK_PAIR                   Pair;
+
+  //
+  // Gamepad state snapshot, written under the StateSequence lock.
+  //
+  USB_JOYSTICK_STATE_PROTOCOL     State;
+  volatile UINT32                 StateSequence;
+  USB_JOYSTICK_STATE              StateSnapshot;
+
+  //
+  // Raw report callbacks by slot, SubscriberMap has a bit per used slot.
+  // LastReport is only kept while a registration has a filter.
+  //
+  USB_JOYSTICK_REPORT_PROTOCOL    RawReport;
+  UINT32                          SubscriberMap;
+  UINT64                          SubscriberFilters;
+  JOYSTICK_REPORT_SUBSCRIBER      Subscribers[JOYSTICK_MAX_REPORT_SUBSCRIBERS];
+  UINT64                          LastReport[JOYSTICK_REPORT_SIZE / sizeof (UINT64)];
+
+  //
+  // Counters, written under the StatsSequence lock at TPL_NOTIFY. The
+  // percentiles, poll interval and endpoints of the snapshot are only
+  // filled in by GetStats().
+  //
+  USB_JOYSTICK_STATS_PROTOCOL     Stats;
+  volatile UINT32                 StatsSequence;
+  USB_JOYSTICK_STATS              StatsSnapshot;
 }USB_JS_DEV;
 
+//
+// Handler of one input report id, after activation. Returns TRUE when the
+// report carries buttons and sticks to decode.
+//
+typedef
+BOOLEAN
+(*JOYSTICK_REPORT_HANDLER) (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report
+  );
+
+//
+// An input report id the driver takes, its USB_JOYSTICK_REPORT_* type for
+// the statistics and its handler.
+//
+typedef struct {
+  UINT8                           ReportId;
+  UINT8                           Type;
+  JOYSTICK_REPORT_HANDLER         Handler;
+} JOYSTICK_REPORT_DISPATCH;
+
+//
+// Per model tuning, looked up by USB product id.
+//
+typedef struct {
+  UINT16                          ProductId;
+  UINT8                           Side;
+  JOYSTICK_STICK_FILTER_PARAMS    StickFilter;
+} JOYSTICK_MODEL;
+
+//
+// A key returned by the merged key stream.
+//
+typedef struct {
+  EFI_KEY_DATA                    KeyData;
+  USB_JOYSTICK_KEY_INFO           Info;
+} JOYSTICK_KEY_HISTORY;
+
 typedef struct{
   BOOLEAN   DPAD_DOWN;
   BOOLEAN   DPAD_RIGHT;
@@ -88,10 +418,27 @@ extern EFI_DRIVER_BINDING_PROTOCOL   gUsbJoyStickDriverBinding;
 extern EFI_COMPONENT_NAME_PROTOCOL   gUsbJoyStickComponentName;
 extern EFI_COMPONENT_NAME2_PROTOCOL  gUsbJoyStickComponentName2;
 
+//
+// Bound controllers by player slot, see Aggregator.c.
+//
+extern USB_JS_DEV                    *mJoyStickPlayers[JOYSTICK_MAX_PLAYERS];
+
 #define USB_JS_DEV_FROM_THIS(a) \
 	CR(a,USB_JS_DEV,SimpleInput,USB_JS_DEV_SIGNATURE)
 #define TEXT_INPUT_EX_USB_JS_DEV_FROM_THIS(a) \
 	CR(a,USB_JS_DEV,SimpleInputEx,USB_JS_DEV_SIGNATURE)
+#define MOTION_USB_JS_DEV_FROM_THIS(a) \
+	CR(a,USB_JS_DEV,Motion,USB_JS_DEV_SIGNATURE)
+#define STATE_USB_JS_DEV_FROM_THIS(a) \
+	CR(a,USB_JS_DEV,State,USB_JS_DEV_SIGNATURE)
+#define REPORT_USB_JS_DEV_FROM_THIS(a) \
+	CR(a,USB_JS_DEV,RawReport,USB_JS_DEV_SIGNATURE)
+#define USB_JS_CONSOLE_IN_EX_NOTIFY_FROM_LINK(a) \
+	CR(a,USB_JS_CONSOLE_IN_EX_NOTIFY,NotifyEntry,USB_JS_CONSOLE_IN_EX_NOTIFY_SIGNATURE)
+#define KEY_INFO_USB_JS_DEV_FROM_THIS(a) \
+	CR(a,USB_JS_DEV,KeyInfo,USB_JS_DEV_SIGNATURE)
+#define STATS_USB_JS_DEV_FROM_THIS(a) \
+	CR(a,USB_JS_DEV,Stats,USB_JS_DEV_SIGNATURE)
 
 
 
@@ -293,7 +640,7 @@ UsbJoyStickComponentNameGetControllerName (
   There are 2 types of reset for USB keyboard.
   For non-exhaustive reset, only keyboard buffer is cleared.
   For exhaustive reset, in addition to clearance of keyboard buffer, the hardware status
-  is also re-initialized.
+  is also re-initialized, once a transfer has failed since it last was.
 
   @param  This                 Protocol instance pointer.
   @param  ExtendedVerification Driver may perform diagnostics on reset.
@@ -449,6 +796,53 @@ USBJoyStickUnregisterKeyNotify (
   IN VOID                               *NotificationHandle
   );
 
+/**
+  Handler function for WaitForKey event.
+
+  @param  Event        Event to be signaled when a key is pressed.
+  @param  Context      Points to USB_JS_DEV instance.
+
+**/
+VOID
+EFIAPI
+USBJoyStickWaitForKey (
+  IN  EFI_EVENT               Event,
+  IN  VOID                    *Context
+  );
+
+/**
+  Process the queued key notifications.
+
+  Calls the notification function of every registration that matches a
+  key of NotifyKeys, oldest key first.
+
+  @param  Event        The KeyNotifyProcessEvent.
+  @param  Context      Points to USB_JS_DEV instance.
+
+**/
+VOID
+EFIAPI
+JoyStickKeyNotifyProcessHandler (
+  IN  EFI_EVENT               Event,
+  IN  VOID                    *Context
+  );
+
+/**
+  Read the configuration of the controller and leave its interface in
+  report protocol, setting HardwareVerified when both succeed. Only the
+  control transfers are issued, the decoder is left as it is.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        The controller answered its configuration.
+  @retval Others             The configuration could not be read.
+
+**/
+EFI_STATUS
+JoyStickVerifyHardware (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
 /**
  * 
  * Initialize USB JoyStick device and all private structures.
@@ -464,8 +858,6 @@ InitUSBJoyStick (
   IN OUT USB_JS_DEV     *UsbJoyStickDevice
 );
 
-
-
 /**
  *
  * Uses USB I/O to check if the device is a USB JoyStick device.
@@ -481,6 +873,821 @@ IsUSBJoyStick(
   IN EFI_USB_IO_PROTOCOL           *UsbIo
   );
 
+//
+// Functions of controller activation
+//
+/**
+  Start bringing the controller up: initialize it, start the asynchronous
+  interrupt transfers and send the USB handshake. The shared activation
+  timer takes it through the report mode, device info and IMU calibration
+  steps, then joins the merged key stream and sets Activated.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        The controller is active or being brought up.
+  @retval Others             The controller could not be initialized.
+
+**/
+EFI_STATUS
+JoyStickActivate (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Ask for the controller to be activated because a consumer wants input.
+
+  Activation starts at TPL_CALLBACK: right away when called below it,
+  otherwise as soon as the TPL drops.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        The controller is active.
+  @retval EFI_NOT_READY      Activation is pending or in progress.
+  @retval EFI_DEVICE_ERROR   Activation failed.
+
+**/
+EFI_STATUS
+JoyStickRequestActivation (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Run a requested activation.
+
+  @param  Event        The ActivateEvent of the device.
+  @param  Context      Points to USB_JS_DEV instance.
+
+**/
+VOID
+EFIAPI
+JoyStickActivateNotify (
+  IN  EFI_EVENT               Event,
+  IN  VOID                    *Context
+  );
+
+/**
+  Take an input report received while the controller is being brought up.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Report             The JOYSTICK_REPORT_SIZE bytes of the report.
+
+**/
+VOID
+JoyStickActivateReport (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report
+  );
+
+/**
+  Start the asynchronous interrupt transfer of every IN endpoint and set
+  AsyncActive.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        All transfers run.
+  @retval Others             A transfer could not be started, none runs.
+
+**/
+EFI_STATUS
+JoyStickStartTransfers (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Stop the asynchronous interrupt transfers still running and clear
+  AsyncActive.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickStopTransfers (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Submit again the asynchronous interrupt transfers JoyStickHandler
+  stopped on an error, while the transfers of the controller run.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        Every transfer runs, or none is meant to.
+  @retval Others             A transfer could not be submitted again.
+
+**/
+EFI_STATUS
+JoyStickRestartTransfers (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Give up bringing the controller up, before it is stopped.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickCancelActivation (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+//
+// Functions of the calibration cache
+//
+/**
+  Take the device info subcommand reply: keep the Bluetooth address and
+  firmware version keying the calibration cache.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Reply              The 0x21 reply.
+
+  @retval TRUE               The reply was acknowledged and carries an address.
+  @retval FALSE              The controller cannot be told apart, it is not cached.
+
+**/
+BOOLEAN
+JoyStickSetDeviceInfo (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Reply
+  );
+
+/**
+  Apply the cached calibration of the controller.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance, with Mac set.
+
+  @retval TRUE               The IMU scale is set from the cache.
+  @retval FALSE              Nothing valid is cached, the calibration has to
+                             be read from the controller.
+
+**/
+BOOLEAN
+JoyStickLoadCalibration (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Store the calibration read from the controller in its cache variable.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Address            JOYSTICK_SPI_IMU_USER_CAL or JOYSTICK_SPI_IMU_FACTORY_CAL.
+  @param  Data               The bytes read at Address.
+  @param  Length             Number of bytes read, at most JOYSTICK_CALIBRATION_DATA_SIZE.
+
+**/
+VOID
+JoyStickSaveCalibration (
+  IN     USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT32         Address,
+  IN     CONST UINT8    *Data,
+  IN     UINTN          Length
+  );
+
+//
+// Functions of the trace buffer
+//
+/**
+  Allocate the trace buffer and publish it as the USB_JOYSTICK_TRACE_GUID
+  configuration table. Trace points are dropped if this fails.
+
+**/
+VOID
+JoyStickTraceInit (
+  VOID
+  );
+
+/**
+  Append one record to the trace buffer, overwriting the oldest one.
+
+  Use JOYSTICK_TRACE rather than calling this directly, so that trace points
+  above the configured level are compiled out.
+
+  @param  Event            The JOYSTICK_TRACE_* event id.
+  @param  Arg0             First event argument.
+  @param  Arg1             Second event argument.
+
+**/
+VOID
+JoyStickTraceWrite (
+  IN UINT32     Event,
+  IN UINT64     Arg0,
+  IN UINT64     Arg1
+  );
+
+//
+// Functions of the Nintendo subcommand engine
+//
+/**
+  Send a subcommand to the controller in a 0x01 output report.
+
+  Before the asynchronous interrupt transfer is running the reply is matched
+  synchronously against the 0x21 input reports. Once it is running the
+  subcommand is only posted and the reply is consumed by JoyStickHandler.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  SubcmdId           The subcommand id.
+  @param  Args               The subcommand arguments, may be NULL if ArgsLength is 0.
+  @param  ArgsLength         The number of argument bytes.
+  @param  Reply              Optional buffer of JOYSTICK_REPORT_SIZE bytes receiving
+                             the whole 0x21 reply. Must be NULL once the
+                             asynchronous interrupt transfer is running.
+
+  @retval EFI_SUCCESS            The subcommand was acknowledged, or posted.
+  @retval EFI_INVALID_PARAMETER  ArgsLength is too large, or Reply is not NULL
+                                 while the asynchronous transfer is running.
+  @retval EFI_TIMEOUT            No matching reply was received.
+  @retval EFI_DEVICE_ERROR       The controller did not acknowledge the subcommand.
+
+**/
+EFI_STATUS
+JoyStickSendSubcommand (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT8          SubcmdId,
+  IN     CONST UINT8    *Args,
+  IN     UINTN          ArgsLength,
+  OUT    UINT8          *Reply OPTIONAL
+  );
+
+/**
+  Consume a 0x21 subcommand reply received by JoyStickHandler. The reply
+  to the pending subcommand is kept in SubcmdReply.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Report             The 0x21 input report.
+
+**/
+VOID
+JoyStickSubcommandReply (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report
+  );
+
+/**
+  Select the input report mode the controller should use.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Mode               JOYSTICK_REPORT_MODE_FULL or JOYSTICK_REPORT_MODE_SIMPLE.
+
+  @retval EFI_SUCCESS        The mode is set, or the switch has been posted.
+  @retval Others             The subcommand failed.
+
+**/
+EFI_STATUS
+JoyStickSetReportMode (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT8          Mode
+  );
+
+/**
+  Apply the report mode policy: full reports while any consumer needs sticks
+  or IMU data, simple HID reports otherwise. Joy-Con halves stay in full
+  mode, their simple HID layout is sideways and cannot be paired.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        The selected mode is set, or the switch has been posted.
+  @retval Others             The subcommand failed.
+
+**/
+EFI_STATUS
+JoyStickApplyReportPolicy (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Register a consumer that needs full 0x30 input reports, switching the
+  controller to full mode when it is the first one.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        Full mode is active or has been requested.
+  @retval Others             The mode switch failed.
+
+**/
+EFI_STATUS
+JoyStickAcquireFullReport (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Drop a consumer registered by JoyStickAcquireFullReport, returning the
+  controller to simple HID mode when it was the last one.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickReleaseFullReport (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Post a read of the controller's SPI flash with the SPI read subcommand.
+  The reply is left in SubcmdReply, see JoyStickSpiReadData().
+
+  Only usable while the asynchronous interrupt transfer is running.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Address            The SPI flash address.
+  @param  Length             Number of bytes to read, at most JOYSTICK_SPI_MAX_READ.
+
+  @retval EFI_SUCCESS            The read was posted.
+  @retval EFI_INVALID_PARAMETER  Length is too large.
+  @retval Others                 The subcommand could not be sent.
+
+**/
+EFI_STATUS
+JoyStickPostSpiRead (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT32         Address,
+  IN     UINTN          Length
+  );
+
+/**
+  Extract the data of an SPI read from its 0x21 reply.
+
+  @param  Reply              The 0x21 reply.
+  @param  Address            The SPI flash address that was read.
+  @param  Buffer             Buffer receiving the data.
+  @param  Length             Number of bytes that were read.
+
+  @retval EFI_SUCCESS            The data was copied.
+  @retval EFI_DEVICE_ERROR       The read was not acknowledged, or the
+                                 reply does not match the request.
+
+**/
+EFI_STATUS
+JoyStickSpiReadData (
+  IN     CONST UINT8    *Reply,
+  IN     UINT32         Address,
+  OUT    VOID           *Buffer,
+  IN     UINTN          Length
+  );
+
+//
+// Functions of Joy-Con pairing
+//
+/**
+  Pair a Joy-Con half that finished activation with an activated half of
+  the other side that has no partner yet. The half found keeps its player
+  slot and decodes the pair, the new half joins it without a slot.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval TRUE               The controller joined a pair, it takes no
+                             player slot.
+  @retval FALSE              The controller is not a Joy-Con half, or no
+                             half to pair with is bound.
+
+**/
+BOOLEAN
+JoyStickPairController (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Split the pair of a Joy-Con half that is going away. The other half
+  carries on alone, with the player slot of the pair.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickUnpairController (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Feed an input report of a paired Joy-Con half to the pair.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance, paired.
+  @param  Report             The input report.
+  @param  Arrival            The arrival stamp of the report.
+  @param  Merged             Buffer of JOYSTICK_REPORT_SIZE bytes receiving
+                             the report of the pair.
+  @param  MergedArrival      Receives the arrival stamp of Merged.
+
+  @return The owner of the pair, which decodes Merged, or NULL while the
+          pair waits for the report of the other half.
+
+**/
+USB_JS_DEV *
+JoyStickPairReport (
+  IN     USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report,
+  IN     UINT64         Arrival,
+  OUT    UINT8          *Merged,
+  OUT    UINT64         *MergedArrival
+  );
+
+//
+// Functions of the IMU decoder and Motion Protocol
+//
+/**
+  Derive the IMU decode scale from calibration read from SPI flash.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Address            JOYSTICK_SPI_IMU_USER_CAL, JOYSTICK_SPI_IMU_FACTORY_CAL,
+                             or 0 for the nominal scale.
+  @param  Data               The bytes read at Address, NULL when Address is 0.
+
+  @retval TRUE               The scale is set.
+  @retval FALSE              The user calibration does not carry its magic,
+                             the scale is unchanged.
+
+**/
+BOOLEAN
+JoyStickSetImuCalibration (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT32         Address,
+  IN     CONST UINT8    *Data OPTIONAL
+  );
+
+/**
+  Decode the IMU samples of a full report into the motion ring.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Report             The 0x30 input report.
+
+**/
+VOID
+JoyStickImuReport (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report
+  );
+
+/**
+  Register a motion consumer. The first consumer switches the controller to
+  full input reports and enables its IMU.
+
+  @param  This                  The USB_JOYSTICK_MOTION_PROTOCOL instance.
+
+  @retval EFI_SUCCESS           The IMU is streaming or has been requested.
+  @retval EFI_NOT_READY         The controller is still being brought up.
+  @retval EFI_DEVICE_ERROR      The controller could not be configured.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickMotionStart (
+  IN USB_JOYSTICK_MOTION_PROTOCOL  *This
+  );
+
+/**
+  Unregister a motion consumer registered by Start(). The last consumer
+  disables the IMU and releases full input reports.
+
+  @param  This                  The USB_JOYSTICK_MOTION_PROTOCOL instance.
+
+  @retval EFI_SUCCESS           The consumer was unregistered.
+  @retval EFI_NOT_STARTED       No consumer is registered.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickMotionStop (
+  IN USB_JOYSTICK_MOTION_PROTOCOL  *This
+  );
+
+/**
+  Take the oldest unread samples out of the motion ring.
+
+  @param  This                  The USB_JOYSTICK_MOTION_PROTOCOL instance.
+  @param  Count                 On input the capacity of Samples, on output
+                                the number of samples returned.
+  @param  Samples               Buffer receiving the samples, oldest first.
+
+  @retval EFI_SUCCESS           At least one sample was returned.
+  @retval EFI_NOT_READY         No sample is available.
+  @retval EFI_INVALID_PARAMETER Count or Samples is NULL, or *Count is 0.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickMotionRead (
+  IN     USB_JOYSTICK_MOTION_PROTOCOL  *This,
+  IN OUT UINTN                         *Count,
+  OUT    USB_JOYSTICK_MOTION_SAMPLE    *Samples
+  );
+
+/**
+  Give a controller the lowest free player slot and light its player LED.
+
+  @param  UsbJoyStickDevice     The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS           UsbJoyStickDevice->PlayerId is assigned.
+  @retval EFI_OUT_OF_RESOURCES  All player slots are taken.
+
+**/
+EFI_STATUS
+JoyStickAddPlayer (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Free the player slot of a controller. Keys it queued and not yet read are
+  dropped.
+
+  @param  UsbJoyStickDevice     The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickRemovePlayer (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Light the player LED of a player slot on a controller.
+
+  @param  UsbJoyStickDevice     The USB_JS_DEV instance.
+  @param  PlayerId              The player, 1 to JOYSTICK_MAX_PLAYERS.
+
+**/
+VOID
+JoyStickShowPlayer (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT8          PlayerId
+  );
+
+/**
+  Record the direction the performance counter counts in, so arrival stamps
+  can be taken with a single counter read.
+
+**/
+VOID
+JoyStickInitArrivalClock (
+  VOID
+  );
+
+/**
+  Return the arrival stamp of an input report. Called at the top of
+  JoyStickHandler, before any decode work.
+
+  @return Performance counter ticks since the driver loaded, increasing
+          with time whichever direction the counter runs.
+
+**/
+UINT64
+JoyStickArrivalStamp (
+  VOID
+  );
+
+/**
+  Check whether any controller has a key queued.
+
+  @retval TRUE             A key can be read from the merged stream.
+  @retval FALSE            All key queues are empty.
+
+**/
+BOOLEAN
+JoyStickMergedKeyPending (
+  VOID
+  );
+
+/**
+  Take the key with the oldest arrival stamp out of the key queues of all
+  controllers.
+
+  @param  KeyData          Receives the key.
+
+  @retval EFI_SUCCESS      The key was returned.
+  @retval EFI_NOT_READY    All key queues are empty.
+
+**/
+EFI_STATUS
+JoyStickReadMergedKey (
+  OUT EFI_KEY_DATA      *KeyData
+  );
+
+/**
+  Look up a key recently returned by ReadKeyStroke() or ReadKeyStrokeEx().
+
+  @param  This                  The USB_JOYSTICK_KEY_INFO_PROTOCOL instance.
+  @param  KeyData               The key as returned by the Simple Text Input
+                                protocol. Only KeyData->Key is compared.
+  @param  Info                  Receives the information about the key.
+
+  @retval EFI_SUCCESS           Info was filled in.
+  @retval EFI_NOT_FOUND         The key is not among the recently returned ones.
+  @retval EFI_INVALID_PARAMETER KeyData or Info is NULL.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickGetKeyInfo (
+  IN  USB_JOYSTICK_KEY_INFO_PROTOCOL  *This,
+  IN  CONST EFI_KEY_DATA              *KeyData,
+  OUT USB_JOYSTICK_KEY_INFO           *Info
+  );
+
+/**
+  Summarize the queue time of all keys read from the merged stream.
+
+  @param  This                  The USB_JOYSTICK_KEY_INFO_PROTOCOL instance.
+  @param  Stats                 Receives the statistics, times in nanoseconds.
+
+  @retval EFI_SUCCESS           Stats was filled in.
+  @retval EFI_INVALID_PARAMETER Stats is NULL.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickGetQueueStats (
+  IN  USB_JOYSTICK_KEY_INFO_PROTOCOL  *This,
+  OUT USB_JOYSTICK_QUEUE_STATS        *Stats
+  );
+
+/**
+  Select the buttons of a controller producing keys on press and on release.
+
+  @param  This                  The USB_JOYSTICK_KEY_INFO_PROTOCOL instance.
+  @param  PressButtons          The buttons producing a key when pressed.
+  @param  ReleaseButtons        The buttons producing a key when released.
+
+  @retval EFI_SUCCESS           The selection applies from the next report.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickSetKeyEdges (
+  IN USB_JOYSTICK_KEY_INFO_PROTOCOL  *This,
+  IN UINT32                          PressButtons,
+  IN UINT32                          ReleaseButtons
+  );
+
+/**
+  Publish the state decoded from an input report. The state of a Joy-Con
+  pair is published to both halves.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance, the owner of a pair.
+  @param  Report             The input report, already decoded.
+
+**/
+VOID
+JoyStickPublishState (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report
+  );
+
+/**
+  Copy out the controller state as of the latest input report.
+
+  @param  This                  The USB_JOYSTICK_STATE_PROTOCOL instance.
+  @param  State                 Receives the state.
+
+  @retval EFI_SUCCESS           The state was returned.
+  @retval EFI_INVALID_PARAMETER State is NULL.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickGetState (
+  IN  USB_JOYSTICK_STATE_PROTOCOL  *This,
+  OUT USB_JOYSTICK_STATE           *State
+  );
+
+/**
+  Open the statistics of a device for update by JoyStickHandler.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickStatsBegin (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Publish the statistics updated since JoyStickStatsBegin() and close them
+  for update while JoyStickHandler calls out of the driver, so a raw report
+  subscriber reading them at TPL_NOTIFY does not wait on its own caller.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickStatsPause (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Open the statistics again after JoyStickStatsPause().
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickStatsResume (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Record the duration of an interrupt transfer callback and publish the
+  statistics updated since JoyStickStatsBegin().
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Entry              The arrival stamp taken when the callback
+                             was entered.
+
+**/
+VOID
+JoyStickStatsEnd (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT64         Entry
+  );
+
+/**
+  Count a recovery attempt made outside of JoyStickHandler.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickCountRecovery (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  );
+
+/**
+  Copy out the counters of the controller.
+
+  @param  This                  The USB_JOYSTICK_STATS_PROTOCOL instance.
+  @param  Stats                 Receives the counters.
+
+  @retval EFI_SUCCESS           The counters were returned.
+  @retval EFI_INVALID_PARAMETER Stats is NULL.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickGetStats (
+  IN  USB_JOYSTICK_STATS_PROTOCOL  *This,
+  OUT USB_JOYSTICK_STATS           *Stats
+  );
+
+/**
+  Hand an input report to the registered callbacks.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance, with subscribers.
+  @param  Report             The input report in the transfer buffer.
+  @param  Length             The report length in bytes.
+
+**/
+VOID
+JoyStickNotifySubscribers (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report,
+  IN     UINTN          Length
+  );
+
+/**
+  Register a report callback.
+
+  Without a filter (FilterLength 0) the callback sees every report. With a
+  filter it only sees reports in which a byte of the range differs from the
+  previous report.
+
+  @param  This                  The USB_JOYSTICK_REPORT_PROTOCOL instance.
+  @param  Callback              The function to call at TPL_NOTIFY.
+  @param  Context               Passed to Callback.
+  @param  FilterOffset          First report byte of the filter.
+  @param  FilterLength          Number of bytes of the filter, 0 for none.
+  @param  Registration          Receives the handle for Unregister().
+
+  @retval EFI_SUCCESS           The callback is registered.
+  @retval EFI_INVALID_PARAMETER Callback or Registration is NULL, or the
+                                filter ends past USB_JOYSTICK_REPORT_FILTER_BYTES.
+  @retval EFI_OUT_OF_RESOURCES  All registration slots are taken.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickRegisterReport (
+  IN  USB_JOYSTICK_REPORT_PROTOCOL  *This,
+  IN  USB_JOYSTICK_REPORT_CALLBACK  Callback,
+  IN  VOID                          *Context OPTIONAL,
+  IN  UINTN                         FilterOffset,
+  IN  UINTN                         FilterLength,
+  OUT VOID                          **Registration
+  );
+
+/**
+  Remove a callback registered by Register(). It may be called from within
+  the callback itself.
+
+  @param  This                  The USB_JOYSTICK_REPORT_PROTOCOL instance.
+  @param  Registration          The handle returned by Register().
+
+  @retval EFI_SUCCESS           The callback is removed.
+  @retval EFI_INVALID_PARAMETER Registration is not a registered handle.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickUnregisterReport (
+  IN USB_JOYSTICK_REPORT_PROTOCOL  *This,
+  IN VOID                          *Registration
+  );
+
 /**
   Handler function for USB JoyStick's asynchronous interrupt transfer.
 
@@ -490,7 +1697,7 @@ IsUSBJoyStick(
   @param  Data             A pointer to a buffer that is filled with key data which is
                            retrieved via asynchronous interrupt transfer.
   @param  DataLength       Indicates the size of the data buffer.
-  @param  Context          Pointing to USB_JS_DEV instance.
+  @param  Context          The JOYSTICK_IN_ENDPOINT the transfer belongs to.
   @param  Result           Indicates the result of the asynchronous interrupt transfer.
 
   @retval EFI_SUCCESS      Asynchronous interrupt transfer is handled successfully.
@@ -506,4 +1713,21 @@ JoyStickHandler (
   IN  UINT32        Result
   );
 
+/**
+  Timer handler for the delayed recovery of failed transfers.
+
+  A transfer that failed was stopped by JoyStickHandler, after clearing
+  the halt of its endpoint. This handler submits it again.
+
+  @param  Event            The DelayedRecoveryEvent.
+  @param  Context          The USB_JS_DEV instance.
+
+**/
+VOID
+EFIAPI
+JoyStickRecoveryHandler (
+  IN  EFI_EVENT     Event,
+  IN  VOID          *Context
+  );
+
 #endif
@@ -0,0 +1,874 @@
+/** @file
+  OS independent core of the USB JoyStick driver.
+
+  Everything here works on plain buffers and structures, with no UEFI
+  service calls, so it runs unchanged in the driver's transfer callback and
+  in host tools.
+
+  YIZD 2021
+
+**/
+
+#include "JoyStickCore.h"
+
+//
+// Key produced by each button.
+//
+typedef struct {
+  UINT32    Button;
+  UINT16    ScanCode;
+  CHAR16    UnicodeChar;
+} JOYSTICK_KEY_MAP;
+
+GLOBAL_REMOVE_IF_UNREFERENCED CONST JOYSTICK_KEY_MAP mJoyStickKeyMap[] = {
+  { JOYSTICK_BUTTON_UP,     SCAN_UP,        CHAR_NULL            },
+  { JOYSTICK_BUTTON_DOWN,   SCAN_DOWN,      CHAR_NULL            },
+  { JOYSTICK_BUTTON_LEFT,   SCAN_LEFT,      CHAR_NULL            },
+  { JOYSTICK_BUTTON_RIGHT,  SCAN_RIGHT,     CHAR_NULL            },
+  { JOYSTICK_BUTTON_A,      SCAN_NULL,      CHAR_CARRIAGE_RETURN },
+  { JOYSTICK_BUTTON_B,      SCAN_ESC,       CHAR_NULL            },
+  { JOYSTICK_BUTTON_X,      SCAN_NULL,      L' '                 },
+  { JOYSTICK_BUTTON_Y,      SCAN_NULL,      CHAR_TAB             },
+  { JOYSTICK_BUTTON_PLUS,   SCAN_NULL,      L'+'                 },
+  { JOYSTICK_BUTTON_MINUS,  SCAN_NULL,      L'-'                 },
+  { JOYSTICK_BUTTON_L,      SCAN_PAGE_UP,   CHAR_NULL            },
+  { JOYSTICK_BUTTON_R,      SCAN_PAGE_DOWN, CHAR_NULL            }
+};
+
+//
+// Simple HID (0x3F) button bits, indexed by bit position within bytes 1-2,
+// translated to the bit position within bytes 3-5 of a full 0x30 report.
+//
+GLOBAL_REMOVE_IF_UNREFERENCED CONST UINT8 mSimpleToFullButton[16] = {
+  2,  3,  0,  1,  22, 6,  23, 7,    // B A Y X L R ZL ZR
+  8,  9,  11, 10, 12, 13, 0xFF, 0xFF // - + LS RS Home Capture
+};
+
+//
+// Simple HID hat switch value translated to the D-pad bits of byte 5.
+//
+GLOBAL_REMOVE_IF_UNREFERENCED CONST UINT8 mSimpleHatToDpad[9] = {
+  0x02, 0x06, 0x04, 0x05, 0x01, 0x09, 0x08, 0x0A, 0x00
+};
+
+/**
+  Rewrite a simple HID (0x3F) report in the layout of a full (0x30) report,
+  so the decode path only deals with one layout.
+
+  @param  Simple           The 0x3F input report.
+  @param  Full             Buffer of JOYSTICK_REPORT_SIZE bytes receiving the
+                           equivalent 0x30 layout.
+
+**/
+VOID
+JoyStickNormalizeSimpleReport (
+  IN  CONST UINT8   *Simple,
+  OUT UINT8         *Full
+  )
+{
+  UINT16          Buttons;
+  UINT16          Axis[4];
+  UINTN           Index;
+  UINT8           Target;
+
+  ZeroMem (Full, JOYSTICK_REPORT_SIZE);
+  Full[0] = JOYSTICK_IN_SIMPLE_HID;
+
+  Buttons = (UINT16) (Simple[1] | (Simple[2] << 8));
+  for (Index = 0; Index < 16; Index++) {
+    Target = mSimpleToFullButton[Index];
+    if ((Buttons & (1 << Index)) != 0 && Target != 0xFF) {
+      Full[3 + (Target >> 3)] |= (UINT8) (1 << (Target & 7));
+    }
+  }
+  if (Simple[3] < ARRAY_SIZE (mSimpleHatToDpad)) {
+    Full[5] |= mSimpleHatToDpad[Simple[3]];
+  }
+
+  //
+  // 16-bit little endian stick axes become 12-bit packed pairs.
+  //
+  for (Index = 0; Index < 4; Index++) {
+    Axis[Index] = (UINT16) ((Simple[4 + Index * 2] | (Simple[5 + Index * 2] << 8)) >> 4);
+  }
+  for (Index = 0; Index < 2; Index++) {
+    Full[6 + Index * 3] = (UINT8) Axis[Index * 2];
+    Full[7 + Index * 3] = (UINT8) (((Axis[Index * 2] >> 8) & 0x0F) | ((Axis[Index * 2 + 1] & 0x0F) << 4));
+    Full[8 + Index * 3] = (UINT8) (Axis[Index * 2 + 1] >> 4);
+  }
+}
+
+/**
+  Return the packed button word of a full or subcommand reply report.
+
+  @param  Report           The input report in the 0x30 layout.
+
+  @return The JOYSTICK_BUTTON_* bits of the buttons held.
+
+**/
+UINT32
+JoyStickDecodeButtons (
+  IN CONST UINT8    *Report
+  )
+{
+  return (Report[JOYSTICK_BUTTON_OFFSET] |
+          (Report[JOYSTICK_BUTTON_OFFSET + 1] << 8) |
+          (Report[JOYSTICK_BUTTON_OFFSET + 2] << 16)) & JOYSTICK_BUTTON_MASK;
+}
+
+/**
+  Check whether the key queue is empty.
+
+  @param  Queue            The key queue.
+
+  @retval TRUE             The queue is empty.
+  @retval FALSE            The queue holds at least one key.
+
+**/
+BOOLEAN
+JoyStickKeyQueueIsEmpty (
+  IN CONST JOYSTICK_KEY_QUEUE  *Queue
+  )
+{
+  return (BOOLEAN) (Queue->Head == Queue->Tail);
+}
+
+/**
+  Append a key to the key queue.
+
+  @param  Queue            The key queue.
+  @param  Entry            The key to append.
+
+  @retval EFI_SUCCESS          The key was queued.
+  @retval EFI_OUT_OF_RESOURCES The queue is full, the key was dropped.
+
+**/
+EFI_STATUS
+JoyStickEnqueueKey (
+  IN OUT JOYSTICK_KEY_QUEUE        *Queue,
+  IN     CONST JOYSTICK_KEY_ENTRY  *Entry
+  )
+{
+  UINTN         Next;
+
+  Next = (Queue->Tail + 1) & (JOYSTICK_KEY_QUEUE_SIZE - 1);
+  if (Next == Queue->Head) {
+    Queue->Dropped++;
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  CopyMem (&Queue->Buffer[Queue->Tail], Entry, sizeof (JOYSTICK_KEY_ENTRY));
+  Queue->Tail = Next;
+  Queue->Queued++;
+  return EFI_SUCCESS;
+}
+
+/**
+  Return the oldest key of the key queue without removing it.
+
+  @param  Queue            The key queue.
+
+  @return The oldest key, or NULL if the queue is empty.
+
+**/
+CONST JOYSTICK_KEY_ENTRY *
+JoyStickPeekKey (
+  IN CONST JOYSTICK_KEY_QUEUE  *Queue
+  )
+{
+  if (JoyStickKeyQueueIsEmpty (Queue)) {
+    return NULL;
+  }
+  return &Queue->Buffer[Queue->Head];
+}
+
+/**
+  Remove the oldest key from the key queue.
+
+  @param  Queue            The key queue.
+  @param  Entry            Receives the key.
+
+  @retval EFI_SUCCESS      A key was removed.
+  @retval EFI_NOT_READY    The queue is empty.
+
+**/
+EFI_STATUS
+JoyStickDequeueKey (
+  IN OUT JOYSTICK_KEY_QUEUE  *Queue,
+  OUT    JOYSTICK_KEY_ENTRY  *Entry
+  )
+{
+  if (JoyStickKeyQueueIsEmpty (Queue)) {
+    return EFI_NOT_READY;
+  }
+
+  CopyMem (Entry, &Queue->Buffer[Queue->Head], sizeof (JOYSTICK_KEY_ENTRY));
+  Queue->Head = (Queue->Head + 1) & (JOYSTICK_KEY_QUEUE_SIZE - 1);
+  return EFI_SUCCESS;
+}
+
+/**
+  Drop every key of the key queue.
+
+  @param  Queue            The key queue.
+
+**/
+VOID
+JoyStickFlushKeys (
+  IN OUT JOYSTICK_KEY_QUEUE  *Queue
+  )
+{
+  Queue->Head = Queue->Tail;
+}
+
+/**
+  Translate pressed or released buttons to keys and append them to the key
+  queue.
+
+  @param  Queue            The key queue.
+  @param  Buttons          The JOYSTICK_BUTTON_* bits of the buttons.
+  @param  Edge             JOYSTICK_KEY_PRESS or JOYSTICK_KEY_RELEASE, stored
+                           with the keys.
+  @param  Arrival          Arrival stamp stored with the keys.
+
+  @return The number of keys queued. Keys that do not fit are dropped.
+
+**/
+UINTN
+JoyStickQueueKeys (
+  IN OUT JOYSTICK_KEY_QUEUE  *Queue,
+  IN     UINT32              Buttons,
+  IN     UINT8               Edge,
+  IN     UINT64              Arrival
+  )
+{
+  JOYSTICK_KEY_ENTRY  Entry;
+  UINTN               Index;
+  UINTN               Queued;
+
+  ZeroMem (&Entry, sizeof (Entry));
+  Entry.Arrival = Arrival;
+  Entry.Edge    = Edge;
+  Queued = 0;
+  for (Index = 0; Index < ARRAY_SIZE (mJoyStickKeyMap) && Buttons != 0; Index++) {
+    if ((Buttons & mJoyStickKeyMap[Index].Button) == 0) {
+      continue;
+    }
+    Buttons &= ~mJoyStickKeyMap[Index].Button;
+
+    Entry.KeyData.Key.ScanCode    = mJoyStickKeyMap[Index].ScanCode;
+    Entry.KeyData.Key.UnicodeChar = mJoyStickKeyMap[Index].UnicodeChar;
+    if (!EFI_ERROR (JoyStickEnqueueKey (Queue, &Entry))) {
+      Queued++;
+    }
+  }
+  return Queued;
+}
+
+/**
+  Reset a decoder: no button held, an empty key queue and keys produced on
+  button presses only.
+
+  @param  Decoder          The decoder to reset.
+
+**/
+VOID
+JoyStickInitDecoder (
+  OUT JOYSTICK_DECODER    *Decoder
+  )
+{
+  ZeroMem (Decoder, sizeof (JOYSTICK_DECODER));
+  Decoder->PressKeys        = JOYSTICK_BUTTON_MASK;
+  Decoder->Debounce.Reports = 1;
+}
+
+/**
+  Select the buttons producing keys on press and on release. A button in
+  both masks produces a key on each edge.
+
+  @param  Decoder          The decoder.
+  @param  PressKeys        The JOYSTICK_BUTTON_* bits producing a key when
+                           the button is pressed.
+  @param  ReleaseKeys      The JOYSTICK_BUTTON_* bits producing a key when
+                           the button is released.
+
+**/
+VOID
+JoyStickSetKeyEdges (
+  IN OUT JOYSTICK_DECODER  *Decoder,
+  IN     UINT32            PressKeys,
+  IN     UINT32            ReleaseKeys
+  )
+{
+  Decoder->PressKeys   = PressKeys & JOYSTICK_BUTTON_MASK;
+  Decoder->ReleaseKeys = ReleaseKeys & JOYSTICK_BUTTON_MASK;
+}
+
+/**
+  Set how many consecutive reports a button change must be seen in before
+  it is accepted. 0 and 1 accept every change at once.
+
+  @param  Decoder          The decoder.
+  @param  Reports          The debounce window in report periods, at most
+                           JOYSTICK_DEBOUNCE_MAX.
+
+**/
+VOID
+JoyStickSetDebounce (
+  IN OUT JOYSTICK_DECODER  *Decoder,
+  IN     UINT8             Reports
+  )
+{
+  ZeroMem (Decoder->Debounce.Counter, sizeof (Decoder->Debounce.Counter));
+  Decoder->Debounce.Stable  = Decoder->Buttons;
+  Decoder->Debounce.Reports = (UINT8) MIN (MAX (Reports, 1), JOYSTICK_DEBOUNCE_MAX);
+}
+
+/**
+  Debounce a packed button word.
+
+  @param  Debounce         The debounce state.
+  @param  Raw              The JOYSTICK_BUTTON_* bits of the current report.
+
+  @return The debounced button word.
+
+**/
+UINT32
+JoyStickDebounceButtons (
+  IN OUT JOYSTICK_DEBOUNCE  *Debounce,
+  IN     UINT32             Raw
+  )
+{
+  UINT32        Changed;
+  UINT32        Carry;
+  UINT32        Next;
+  UINT32        Reached;
+  UINTN         Bit;
+
+  //
+  // Count reports that disagree with the stable state, restart the count of
+  // buttons that agree again, and flip the buttons whose count reaches the
+  // window. Counters are incremented as a ripple carry across the bit
+  // planes.
+  //
+  Changed = Raw ^ Debounce->Stable;
+  Carry   = Changed;
+  Reached = Changed;
+  for (Bit = 0; Bit < JOYSTICK_DEBOUNCE_BITS; Bit++) {
+    Next                    = Debounce->Counter[Bit] & Carry;
+    Debounce->Counter[Bit]  = (Debounce->Counter[Bit] ^ Carry) & Changed;
+    Carry                   = Next;
+    Reached                &= ((Debounce->Reports >> Bit) & 1) != 0 ?
+                              Debounce->Counter[Bit] : ~Debounce->Counter[Bit];
+  }
+
+  for (Bit = 0; Bit < JOYSTICK_DEBOUNCE_BITS; Bit++) {
+    Debounce->Counter[Bit] &= ~Reached;
+  }
+  Debounce->Stable ^= Reached;
+
+  return Debounce->Stable;
+}
+
+/**
+  Compute the Q12 smoothing factor of a first order low pass filter.
+
+  @param  Cutoff           The cutoff frequency in milli-Hz.
+  @param  ReportRate       The sample rate in Hz.
+
+  @return The weight of a new sample, 2 pi fc / (2 pi fc + rate).
+
+**/
+STATIC
+INT32
+JoyStickFilterAlpha (
+  IN UINT32     Cutoff,
+  IN UINT32     ReportRate
+  )
+{
+  UINT32        Omega;
+
+  //
+  // 2 pi fc / rate in Q12, with 2 pi as 25736 / 4096. Cutoffs above the
+  // Nyquist frequency smooth no further.
+  //
+  Cutoff = MIN (Cutoff, ReportRate * 500);
+  Omega  = (UINT32) DivU64x32 (MultU64x32 (Cutoff, 25736), ReportRate * 1000);
+  return (INT32) ((Omega << JOYSTICK_STICK_ALPHA_SHIFT) / (Omega + (1 << JOYSTICK_STICK_ALPHA_SHIFT)));
+}
+
+/**
+  Select the stick filter parameters of the controller model.
+
+  @param  Decoder          The decoder.
+  @param  Params           The filter parameters, NULL to pass stick values
+                           through unfiltered.
+
+**/
+VOID
+JoyStickSetStickFilter (
+  IN OUT JOYSTICK_DECODER                    *Decoder,
+  IN     CONST JOYSTICK_STICK_FILTER_PARAMS  *Params OPTIONAL
+  )
+{
+  JOYSTICK_STICK_FILTER   *Filter;
+
+  Filter = &Decoder->StickFilter;
+  ZeroMem (Filter, sizeof (JOYSTICK_STICK_FILTER));
+  if (Params == NULL || Params->ReportRate == 0) {
+    return;
+  }
+
+  CopyMem (&Filter->Params, Params, sizeof (JOYSTICK_STICK_FILTER_PARAMS));
+  Filter->DerivativeAlpha = JoyStickFilterAlpha (Params->DerivativeCutoff, Params->ReportRate);
+  Filter->Enabled         = TRUE;
+}
+
+/**
+  Unpack the 12-bit stick axes of a report in the 0x30 layout.
+
+  @param  Report           The input report.
+  @param  Axes             Receives left X, left Y, right X, right Y.
+
+**/
+VOID
+JoyStickDecodeSticks (
+  IN  CONST UINT8   *Report,
+  OUT UINT16        *Axes
+  )
+{
+  CONST UINT8   *Stick;
+  UINTN         Index;
+
+  for (Index = 0; Index < 2; Index++) {
+    Stick               = Report + JOYSTICK_STICK_OFFSET + Index * 3;
+    Axes[Index * 2]     = (UINT16) (Stick[0] | ((Stick[1] & 0x0F) << 8));
+    Axes[Index * 2 + 1] = (UINT16) ((Stick[1] >> 4) | (Stick[2] << 4));
+  }
+}
+
+/**
+  Run one report's stick axes through the adaptive filter.
+
+  @param  Filter           The filter state.
+  @param  Raw              The unfiltered axes.
+  @param  Filtered         Receives the filtered axes.
+
+**/
+VOID
+JoyStickFilterSticks (
+  IN OUT JOYSTICK_STICK_FILTER  *Filter,
+  IN     CONST UINT16           *Raw,
+  OUT    UINT16                 *Filtered
+  )
+{
+  JOYSTICK_AXIS_FILTER  *Axis;
+  UINTN                 Index;
+  INT32                 Sample;
+  INT32                 Delta;
+  UINT32                Speed;
+  UINT32                Cutoff;
+  INT32                 Alpha;
+
+  for (Index = 0; Index < JOYSTICK_STICK_AXES; Index++) {
+    Axis   = &Filter->Axis[Index];
+    Sample = (INT32) Raw[Index] << JOYSTICK_STICK_FRACTION_SHIFT;
+
+    if (!Filter->Primed) {
+      Axis->Value      = Sample;
+      Axis->Derivative = 0;
+      Axis->Last       = Sample;
+      Filtered[Index]  = Raw[Index];
+      continue;
+    }
+
+    //
+    // Smoothed speed in counts per report, then the cutoff it calls for.
+    //
+    Delta             = Sample - Axis->Last;
+    Axis->Last        = Sample;
+    Axis->Derivative += ((Delta - Axis->Derivative) * Filter->DerivativeAlpha) >> JOYSTICK_STICK_ALPHA_SHIFT;
+
+    Speed  = (UINT32) ((Axis->Derivative < 0) ? -Axis->Derivative : Axis->Derivative);
+    Speed  = (Speed * Filter->Params.ReportRate) >> JOYSTICK_STICK_FRACTION_SHIFT;
+    Cutoff = Filter->Params.MinCutoff + (UINT32) DivU64x32 (MultU64x32 (Speed, Filter->Params.Beta), 1000);
+    Alpha  = JoyStickFilterAlpha (Cutoff, Filter->Params.ReportRate);
+
+    Axis->Value    += ((Sample - Axis->Value) * Alpha) >> JOYSTICK_STICK_ALPHA_SHIFT;
+    Filtered[Index] = (UINT16) ((Axis->Value + (1 << (JOYSTICK_STICK_FRACTION_SHIFT - 1))) >> JOYSTICK_STICK_FRACTION_SHIFT);
+  }
+  Filter->Primed = TRUE;
+}
+
+/**
+  Decode one input report: filter the sticks, debounce the buttons, detect
+  changes, translate pressed and released buttons to keys as the decoder's
+  key edges select and queue them.
+
+  Simple HID (0x3F) reports are rewritten in the full (0x30) layout first.
+  They are only sent on change, so they bypass the debounce window and the
+  stick filter, both of which count in report periods; the driver only
+  selects simple HID mode while the debounce window is off.
+  Reports of other types are ignored.
+
+  @param  Decoder          The decoder state.
+  @param  Report           The input report, JOYSTICK_REPORT_SIZE bytes.
+  @param  Arrival          Arrival stamp of the report, stored with its keys.
+
+  @retval TRUE             The button state changed.
+  @retval FALSE            The button state is unchanged, or the report
+                           carries no input.
+
+**/
+BOOLEAN
+JoyStickProcessReport (
+  IN OUT JOYSTICK_DECODER    *Decoder,
+  IN     CONST UINT8         *Report,
+  IN     UINT64              Arrival
+  )
+{
+  UINT8         NormalizedReport[JOYSTICK_REPORT_SIZE];
+  UINT16        Sticks[JOYSTICK_STICK_AXES];
+  UINT32        Buttons;
+  UINT32        Pressed;
+  UINT32        Released;
+
+  switch (Report[0]) {
+  case JOYSTICK_IN_FULL:
+  case JOYSTICK_IN_SUBCMD_REPLY:
+    break;
+
+  case JOYSTICK_IN_SIMPLE_HID:
+    JoyStickNormalizeSimpleReport (Report, NormalizedReport);
+    Report = NormalizedReport;
+    break;
+
+  default:
+    return FALSE;
+  }
+
+  JoyStickDecodeSticks (Report, Sticks);
+  Buttons = JoyStickDecodeButtons (Report);
+  if (Report[0] == JOYSTICK_IN_SIMPLE_HID || !Decoder->StickFilter.Enabled) {
+    CopyMem (Decoder->Sticks, Sticks, sizeof (Decoder->Sticks));
+    Decoder->StickFilter.Primed = FALSE;
+  } else {
+    JoyStickFilterSticks (&Decoder->StickFilter, Sticks, Decoder->Sticks);
+  }
+
+  if (Report[0] == JOYSTICK_IN_SIMPLE_HID) {
+    ZeroMem (Decoder->Debounce.Counter, sizeof (Decoder->Debounce.Counter));
+    Decoder->Debounce.Stable = Buttons;
+  } else {
+    Buttons = JoyStickDebounceButtons (&Decoder->Debounce, Buttons);
+  }
+
+  if (Buttons == Decoder->Buttons) {
+    return FALSE;
+  }
+
+  //
+  // Keys are produced on the press edge, so a key is readable one debounce
+  // window after the button goes down instead of when it comes back up.
+  // Releases are queued first: a button let go in the same report as
+  // another is pressed went down before it.
+  //
+  Pressed  = Buttons & ~Decoder->Buttons & Decoder->PressKeys;
+  Released = Decoder->Buttons & ~Buttons & Decoder->ReleaseKeys;
+  if (Released != 0) {
+    JoyStickQueueKeys (&Decoder->Keys, Released, JOYSTICK_KEY_RELEASE, Arrival);
+  }
+  if (Pressed != 0) {
+    JoyStickQueueKeys (&Decoder->Keys, Pressed, JOYSTICK_KEY_PRESS, Arrival);
+  }
+
+  Decoder->Buttons = Buttons;
+  return TRUE;
+}
+
+/**
+  Set the held buttons of a decoder without producing keys, for a decoder
+  taking over the input of another one.
+
+  @param  Decoder          The decoder.
+  @param  Buttons          The JOYSTICK_BUTTON_* bits held.
+
+**/
+VOID
+JoyStickSetButtons (
+  IN OUT JOYSTICK_DECODER  *Decoder,
+  IN     UINT32            Buttons
+  )
+{
+  Decoder->Buttons         = Buttons;
+  Decoder->Debounce.Stable = Buttons;
+  ZeroMem (Decoder->Debounce.Counter, sizeof (Decoder->Debounce.Counter));
+}
+
+//
+// Input of a Joy-Con half that has not reported yet: no button held and
+// both sticks centered.
+//
+GLOBAL_REMOVE_IF_UNREFERENCED CONST UINT8 mJoyStickIdleHalf[JOYSTICK_REPORT_SIZE] = {
+  JOYSTICK_IN_FULL, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x08, 0x80, 0x00, 0x08, 0x80
+};
+
+/**
+  Reset the merge state of a Joy-Con pair: nothing received from either half.
+
+  @param  Pair             The pair.
+
+**/
+VOID
+JoyStickInitPair (
+  OUT JOYSTICK_PAIR    *Pair
+  )
+{
+  ZeroMem (Pair, sizeof (*Pair));
+}
+
+/**
+  Merge the latest reports of both halves: the buttons of each side and the
+  stick of each side. The other bytes are those of the left half.
+
+  @param  Pair             The pair.
+  @param  Merged           Receives the report of the pair.
+
+**/
+STATIC
+VOID
+JoyStickMergePair (
+  IN  CONST JOYSTICK_PAIR  *Pair,
+  OUT UINT8                *Merged
+  )
+{
+  CONST UINT8   *Left;
+  CONST UINT8   *Right;
+  UINT32        Buttons;
+
+  Left  = Pair->Half[JOYSTICK_SIDE_LEFT].Valid ? Pair->Half[JOYSTICK_SIDE_LEFT].Report : mJoyStickIdleHalf;
+  Right = Pair->Half[JOYSTICK_SIDE_RIGHT].Valid ? Pair->Half[JOYSTICK_SIDE_RIGHT].Report : mJoyStickIdleHalf;
+
+  CopyMem (Merged, Left, JOYSTICK_REPORT_SIZE);
+  Merged[0] = JOYSTICK_IN_FULL;
+
+  Buttons = (JoyStickDecodeButtons (Left) & JOYSTICK_LEFT_BUTTONS) |
+            (JoyStickDecodeButtons (Right) & JOYSTICK_RIGHT_BUTTONS);
+  Merged[JOYSTICK_BUTTON_OFFSET]     = (UINT8) Buttons;
+  Merged[JOYSTICK_BUTTON_OFFSET + 1] = (UINT8) (Buttons >> 8);
+  Merged[JOYSTICK_BUTTON_OFFSET + 2] = (UINT8) (Buttons >> 16);
+
+  CopyMem (&Merged[JOYSTICK_STICK_OFFSET + 3], &Right[JOYSTICK_STICK_OFFSET + 3], 3);
+}
+
+/**
+  Take a report of one half of a Joy-Con pair and, once a report of the
+  pair is complete, merge both halves into one full (0x30) report.
+
+  Reports are aligned by arrival: a report of each half makes one report of
+  the pair, stamped with the later arrival, so buttons pressed together on
+  both halves change in the same decode step. When a half sends a second
+  report before the other half sent one, its first report is merged with
+  the other half's last one, so a silent half delays the pair by at most
+  one report period. Until a half has reported, its buttons are released
+  and its stick centered.
+
+  @param  Pair             The pair.
+  @param  Side             JOYSTICK_SIDE_LEFT or JOYSTICK_SIDE_RIGHT.
+  @param  Report           The input report of the half.
+  @param  Arrival          Arrival stamp of the report.
+  @param  Merged           Buffer of JOYSTICK_REPORT_SIZE bytes receiving
+                           the report of the pair.
+  @param  MergedArrival    Receives the arrival stamp of the merged report.
+
+  @retval TRUE             Merged holds a report of the pair to decode.
+  @retval FALSE            The report is kept until the other half reports,
+                           or it carries no input.
+
+**/
+BOOLEAN
+JoyStickMergeHalfReport (
+  IN OUT JOYSTICK_PAIR  *Pair,
+  IN     UINT8          Side,
+  IN     CONST UINT8    *Report,
+  IN     UINT64         Arrival,
+  OUT    UINT8          *Merged,
+  OUT    UINT64         *MergedArrival
+  )
+{
+  JOYSTICK_PAIR_HALF  *This;
+  JOYSTICK_PAIR_HALF  *Other;
+  BOOLEAN             Ready;
+
+  //
+  // Halves are kept in full mode, their simple HID layout is sideways.
+  //
+  if ((Report[0] != JOYSTICK_IN_FULL && Report[0] != JOYSTICK_IN_SUBCMD_REPLY) ||
+      Side >= JOYSTICK_SIDES) {
+    return FALSE;
+  }
+
+  This  = &Pair->Half[Side];
+  Other = &Pair->Half[Side ^ 1];
+
+  Ready = FALSE;
+  if (This->Pending) {
+    JoyStickMergePair (Pair, Merged);
+    *MergedArrival = This->Arrival;
+    Ready          = TRUE;
+  }
+
+  CopyMem (This->Report, Report, JOYSTICK_REPORT_SIZE);
+  This->Arrival = Arrival;
+  This->Valid   = TRUE;
+  This->Pending = TRUE;
+
+  if (!Ready && Other->Pending) {
+    JoyStickMergePair (Pair, Merged);
+    *MergedArrival = Arrival;
+    This->Pending  = FALSE;
+    Other->Pending = FALSE;
+    Ready          = TRUE;
+  }
+  return Ready;
+}
+
+//
+// Calibration used when the controller's SPI flash cannot be read: +-8 g
+// accelerometer and +-2000 dps gyroscope full scale.
+//
+GLOBAL_REMOVE_IF_UNREFERENCED CONST JOYSTICK_IMU_CALIBRATION mJoyStickNominalImuCalibration = {
+  { 0, 0, 0 },
+  { 16384, 16384, 16384 },
+  { 0, 0, 0 },
+  { 13371, 13371, 13371 }
+};
+
+//
+// Reference values of the calibration: the accelerometer sensitivity is the
+// reading at 4 g, the gyroscope sensitivity the reading at 936 dps. Scaled
+// to the output units of milli-g and centi-degrees per second.
+//
+#define JOYSTICK_IMU_ACCEL_REFERENCE    4000
+#define JOYSTICK_IMU_GYRO_REFERENCE     93600
+
+/**
+  Compute the fixed point scale of one axis.
+
+  @param  Reference        The output value at the calibration point.
+  @param  Origin           The calibrated zero reading.
+  @param  Sensitivity      The reading at the calibration point.
+
+  @return The scale, or 0 when the calibration is unusable.
+
+**/
+STATIC
+INT32
+JoyStickImuAxisScale (
+  IN INT32    Reference,
+  IN INT16    Origin,
+  IN INT16    Sensitivity
+  )
+{
+  INT32       Divisor;
+  INT32       Scale;
+
+  Divisor = (INT32) Sensitivity - (INT32) Origin;
+  if (Divisor <= 0) {
+    return 0;
+  }
+
+  //
+  // The decoder multiplies a difference of two INT16 by the scale, keep the
+  // product within INT32.
+  //
+  Scale = (Reference << JOYSTICK_IMU_SCALE_SHIFT) / Divisor;
+  if (Scale <= 0 || Scale > MAX_INT16) {
+    return 0;
+  }
+  return Scale;
+}
+
+/**
+  Derive the per value offset and fixed point scale from an IMU calibration.
+
+  @param  Calibration      The IMU calibration, NULL for the nominal one.
+  @param  Scale            The decode scale to fill in.
+
+**/
+VOID
+JoyStickSetImuScale (
+  IN  CONST JOYSTICK_IMU_CALIBRATION  *Calibration OPTIONAL,
+  OUT JOYSTICK_IMU_SCALE              *Scale
+  )
+{
+  INT32       AxisOffset[JOYSTICK_IMU_AXES];
+  INT32       AxisScale[JOYSTICK_IMU_AXES];
+  UINTN       Axis;
+  UINTN       Index;
+
+  if (Calibration == NULL) {
+    Calibration = &mJoyStickNominalImuCalibration;
+  }
+
+  for (Axis = 0; Axis < 3; Axis++) {
+    AxisOffset[Axis]     = Calibration->AccelOrigin[Axis];
+    AxisScale[Axis]      = JoyStickImuAxisScale (
+                             JOYSTICK_IMU_ACCEL_REFERENCE,
+                             Calibration->AccelOrigin[Axis],
+                             Calibration->AccelSensitivity[Axis]
+                             );
+    AxisOffset[Axis + 3] = Calibration->GyroOrigin[Axis];
+    AxisScale[Axis + 3]  = JoyStickImuAxisScale (
+                             JOYSTICK_IMU_GYRO_REFERENCE,
+                             Calibration->GyroOrigin[Axis],
+                             Calibration->GyroSensitivity[Axis]
+                             );
+  }
+
+  for (Axis = 0; Axis < JOYSTICK_IMU_AXES; Axis++) {
+    if (AxisScale[Axis] == 0 && Calibration != &mJoyStickNominalImuCalibration) {
+      JoyStickSetImuScale (NULL, Scale);
+      return;
+    }
+  }
+
+  for (Index = 0; Index < JOYSTICK_IMU_VALUES; Index++) {
+    Scale->Offset[Index] = AxisOffset[Index % JOYSTICK_IMU_AXES];
+    Scale->Scale[Index]  = AxisScale[Index % JOYSTICK_IMU_AXES];
+  }
+}
+
+/**
+  Convert the three IMU samples of a full report to calibrated fixed point
+  values in one pass.
+
+  The loop is a plain element-wise map over the packed INT16 data with
+  per value tables, so host compilers can vectorize it; DXE builds run it
+  as scalar code.
+
+  @param  Report           The 0x30 input report.
+  @param  Scale            The decode scale.
+  @param  Values           Receives JOYSTICK_IMU_VALUES values, sample by sample,
+                           accelerometer in milli-g then gyroscope in
+                           centi-degrees per second.
+
+**/
+VOID
+JoyStickDecodeImu (
+  IN  CONST UINT8               *Report,
+  IN  CONST JOYSTICK_IMU_SCALE  *Scale,
+  OUT INT32                     *Values
+  )
+{
+  CONST UINT8   *Raw;
+  UINTN         Index;
+  INT32         Value;
+
+  Raw = Report + JOYSTICK_IMU_OFFSET;
+  for (Index = 0; Index < JOYSTICK_IMU_VALUES; Index++) {
+    Value         = (INT16) (Raw[Index * 2] | (Raw[Index * 2 + 1] << 8));
+    Values[Index] = ((Value - Scale->Offset[Index]) * Scale->Scale[Index]) >> JOYSTICK_IMU_SCALE_SHIFT;
+  }
+}
@@ -0,0 +1,589 @@
+/** @file
+ * OS independent core of the USB JoyStick driver
+ *  Input report layouts, button and IMU decode, key translation and the
+ *  key queue. Only base types and the Simple Text Input Ex key definitions
+ *  are used, so host tools build the same code with JOYSTICK_HOST_BUILD.
+ *   YIZD 2021
+ *   */
+
+
+#ifndef _JOYSTICK_CORE_H_
+#define _JOYSTICK_CORE_H_
+
+#ifdef JOYSTICK_HOST_BUILD
+#include <HostUefi.h>
+#else
+#include <Uefi.h>
+#include <Protocol/SimpleTextInEx.h>
+#include <Library/BaseMemoryLib.h>
+#endif
+
+
+#define JOYSTICK_REPORT_SIZE            64
+
+//
+// Report IDs received from the controller on the interrupt IN endpoint.
+//
+#define JOYSTICK_IN_SUBCMD_REPLY        0x21
+#define JOYSTICK_IN_FULL                0x30
+#define JOYSTICK_IN_SIMPLE_HID          0x3F
+#define JOYSTICK_IN_USB_REPLY           0x81
+
+//
+// Buttons, as packed in bytes 3-5 of full (0x30) and subcommand reply
+// (0x21) reports: byte 3 is the right side, byte 4 shared, byte 5 the left.
+//
+#define JOYSTICK_BUTTON_OFFSET          3
+#define JOYSTICK_BUTTON_Y               BIT0
+#define JOYSTICK_BUTTON_X               BIT1
+#define JOYSTICK_BUTTON_B               BIT2
+#define JOYSTICK_BUTTON_A               BIT3
+#define JOYSTICK_BUTTON_RIGHT_SR        BIT4
+#define JOYSTICK_BUTTON_RIGHT_SL        BIT5
+#define JOYSTICK_BUTTON_R               BIT6
+#define JOYSTICK_BUTTON_ZR              BIT7
+#define JOYSTICK_BUTTON_MINUS           BIT8
+#define JOYSTICK_BUTTON_PLUS            BIT9
+#define JOYSTICK_BUTTON_RSTICK          BIT10
+#define JOYSTICK_BUTTON_LSTICK          BIT11
+#define JOYSTICK_BUTTON_HOME            BIT12
+#define JOYSTICK_BUTTON_CAPTURE         BIT13
+#define JOYSTICK_BUTTON_DOWN            BIT16
+#define JOYSTICK_BUTTON_UP              BIT17
+#define JOYSTICK_BUTTON_RIGHT           BIT18
+#define JOYSTICK_BUTTON_LEFT            BIT19
+#define JOYSTICK_BUTTON_LEFT_SR         BIT20
+#define JOYSTICK_BUTTON_LEFT_SL         BIT21
+#define JOYSTICK_BUTTON_L               BIT22
+#define JOYSTICK_BUTTON_ZL              BIT23
+
+//
+// Byte 4 bit 7 reports the charging grip, it is not a button.
+//
+#define JOYSTICK_BUTTON_MASK            0x00FF3FFF
+
+//
+// A Joy-Con sends full reports with only its half of the buttons and
+// sticks. Of the shared byte 4, minus, the left stick and capture belong
+// to the left half.
+//
+#define JOYSTICK_SIDE_LEFT              0
+#define JOYSTICK_SIDE_RIGHT             1
+#define JOYSTICK_SIDES                  2
+#define JOYSTICK_SIDE_NONE              0xFF
+
+#define JOYSTICK_LEFT_BUTTONS           (0x00FF0000 | JOYSTICK_BUTTON_MINUS | \
+                                         JOYSTICK_BUTTON_LSTICK | JOYSTICK_BUTTON_CAPTURE)
+#define JOYSTICK_RIGHT_BUTTONS          (0x000000FF | JOYSTICK_BUTTON_PLUS | \
+                                         JOYSTICK_BUTTON_RSTICK | JOYSTICK_BUTTON_HOME)
+
+//
+// Stick axes are 12-bit values packed in pairs: left X and Y at bytes 6-8,
+// right X and Y at bytes 9-11.
+//
+#define JOYSTICK_STICK_OFFSET           6
+#define JOYSTICK_STICK_AXES             4
+
+//
+// Stick filter fixed point formats: filtered values carry 4 fraction bits,
+// smoothing factors are Q12.
+//
+#define JOYSTICK_STICK_FRACTION_SHIFT   4
+#define JOYSTICK_STICK_ALPHA_SHIFT      12
+
+//
+// Full reports carry three IMU samples of six little endian INT16 values
+// (accelerometer X Y Z, gyroscope X Y Z) starting at byte 13.
+//
+#define JOYSTICK_IMU_OFFSET             13
+#define JOYSTICK_IMU_SAMPLES            3
+#define JOYSTICK_IMU_AXES               6
+#define JOYSTICK_IMU_VALUES             (JOYSTICK_IMU_SAMPLES * JOYSTICK_IMU_AXES)
+#define JOYSTICK_IMU_SCALE_SHIFT        12
+
+//
+// Debounce counters are JOYSTICK_DEBOUNCE_BITS wide, so a button change can
+// be required to hold for up to JOYSTICK_DEBOUNCE_MAX reports.
+//
+#define JOYSTICK_DEBOUNCE_BITS          4
+#define JOYSTICK_DEBOUNCE_MAX           ((1 << JOYSTICK_DEBOUNCE_BITS) - 1)
+
+//
+// Number of keys the key queue holds, a power of two. One slot is kept
+// free to tell a full queue from an empty one.
+//
+#define JOYSTICK_KEY_QUEUE_SIZE         32
+
+//
+// Button edge a queued key was produced on.
+//
+#define JOYSTICK_KEY_PRESS              0
+#define JOYSTICK_KEY_RELEASE            1
+
+//
+// IMU calibration as stored in SPI flash.
+//
+#pragma pack(1)
+typedef struct {
+  INT16     AccelOrigin[3];
+  INT16     AccelSensitivity[3];
+  INT16     GyroOrigin[3];
+  INT16     GyroSensitivity[3];
+} JOYSTICK_IMU_CALIBRATION;
+#pragma pack()
+
+//
+// Per value offset and fixed point scale, laid out for all values of a full
+// report so the decoder is a single pass over the packed INT16 data.
+//
+typedef struct {
+  INT32     Offset[JOYSTICK_IMU_VALUES];
+  INT32     Scale[JOYSTICK_IMU_VALUES];
+} JOYSTICK_IMU_SCALE;
+
+//
+// A queued key and the arrival stamp of the report that produced it. Keys
+// of several decoders are merged in arrival order, so stamps must increase
+// with time across all decoders.
+//
+typedef struct {
+  EFI_KEY_DATA    KeyData;
+  UINT64          Arrival;
+  UINT8           Edge;
+} JOYSTICK_KEY_ENTRY;
+
+//
+// Queued and Dropped count the keys appended and the ones that did not
+// fit, wrapping around; they are read as differences.
+//
+typedef struct {
+  UINTN                 Head;
+  UINTN                 Tail;
+  UINT32                Queued;
+  UINT32                Dropped;
+  JOYSTICK_KEY_ENTRY    Buffer[JOYSTICK_KEY_QUEUE_SIZE];
+} JOYSTICK_KEY_QUEUE;
+
+//
+// Parameters of the adaptive (1 euro) stick filter of one controller model.
+// The cutoff frequency grows from MinCutoff with stick speed, so the filter
+// smooths heavily at rest and barely delays a flick.
+//
+typedef struct {
+  ///
+  /// Rate of the reports carrying stick data, in Hz.
+  ///
+  UINT32    ReportRate;
+  ///
+  /// Cutoff at rest, in milli-Hz.
+  ///
+  UINT32    MinCutoff;
+  ///
+  /// Cutoff added per count per second of stick speed, in micro-Hz.
+  ///
+  UINT32    Beta;
+  ///
+  /// Cutoff of the speed estimate, in milli-Hz.
+  ///
+  UINT32    DerivativeCutoff;
+} JOYSTICK_STICK_FILTER_PARAMS;
+
+typedef struct {
+  INT32     Value;
+  INT32     Derivative;
+  INT32     Last;
+} JOYSTICK_AXIS_FILTER;
+
+typedef struct {
+  JOYSTICK_STICK_FILTER_PARAMS  Params;
+  BOOLEAN                       Enabled;
+  BOOLEAN                       Primed;
+  INT32                         DerivativeAlpha;
+  JOYSTICK_AXIS_FILTER          Axis[JOYSTICK_STICK_AXES];
+} JOYSTICK_STICK_FILTER;
+
+//
+// Bit-sliced debounce state. Counter[N] holds bit N of a per-button count
+// of consecutive reports disagreeing with Stable, one button per bit
+// position, so all buttons are debounced by the same few word operations.
+//
+typedef struct {
+  UINT32    Stable;
+  UINT32    Counter[JOYSTICK_DEBOUNCE_BITS];
+  UINT8     Reports;
+} JOYSTICK_DEBOUNCE;
+
+//
+// State carried from one input report to the next.
+//
+typedef struct {
+  UINT32                  Buttons;
+  ///
+  /// Buttons producing a key when pressed, and when released.
+  ///
+  UINT32                  PressKeys;
+  UINT32                  ReleaseKeys;
+  JOYSTICK_DEBOUNCE       Debounce;
+  ///
+  /// Filtered stick axes, left X, left Y, right X, right Y, 0 to 4095.
+  ///
+  UINT16                  Sticks[JOYSTICK_STICK_AXES];
+  JOYSTICK_STICK_FILTER   StickFilter;
+  JOYSTICK_KEY_QUEUE      Keys;
+} JOYSTICK_DECODER;
+
+//
+// Latest report of each half of a Joy-Con pair. A pending report has not
+// been merged into a report of the pair yet.
+//
+typedef struct {
+  UINT8     Report[JOYSTICK_REPORT_SIZE];
+  UINT64    Arrival;
+  BOOLEAN   Valid;
+  BOOLEAN   Pending;
+} JOYSTICK_PAIR_HALF;
+
+typedef struct {
+  JOYSTICK_PAIR_HALF    Half[JOYSTICK_SIDES];
+} JOYSTICK_PAIR;
+
+
+/**
+  Reset a decoder: no button held, an empty key queue and keys produced on
+  button presses only.
+
+  @param  Decoder          The decoder to reset.
+
+**/
+VOID
+JoyStickInitDecoder (
+  OUT JOYSTICK_DECODER    *Decoder
+  );
+
+/**
+  Set how many consecutive reports a button change must be seen in before
+  it is accepted. 0 and 1 accept every change at once.
+
+  @param  Decoder          The decoder.
+  @param  Reports          The debounce window in report periods, at most
+                           JOYSTICK_DEBOUNCE_MAX.
+
+**/
+VOID
+JoyStickSetDebounce (
+  IN OUT JOYSTICK_DECODER  *Decoder,
+  IN     UINT8             Reports
+  );
+
+/**
+  Select the buttons producing keys on press and on release. A button in
+  both masks produces a key on each edge.
+
+  @param  Decoder          The decoder.
+  @param  PressKeys        The JOYSTICK_BUTTON_* bits producing a key when
+                           the button is pressed.
+  @param  ReleaseKeys      The JOYSTICK_BUTTON_* bits producing a key when
+                           the button is released.
+
+**/
+VOID
+JoyStickSetKeyEdges (
+  IN OUT JOYSTICK_DECODER  *Decoder,
+  IN     UINT32            PressKeys,
+  IN     UINT32            ReleaseKeys
+  );
+
+/**
+  Select the stick filter parameters of the controller model.
+
+  @param  Decoder          The decoder.
+  @param  Params           The filter parameters, NULL to pass stick values
+                           through unfiltered.
+
+**/
+VOID
+JoyStickSetStickFilter (
+  IN OUT JOYSTICK_DECODER                    *Decoder,
+  IN     CONST JOYSTICK_STICK_FILTER_PARAMS  *Params OPTIONAL
+  );
+
+/**
+  Unpack the 12-bit stick axes of a report in the 0x30 layout.
+
+  @param  Report           The input report.
+  @param  Axes             Receives left X, left Y, right X, right Y.
+
+**/
+VOID
+JoyStickDecodeSticks (
+  IN  CONST UINT8   *Report,
+  OUT UINT16        *Axes
+  );
+
+/**
+  Run one report's stick axes through the adaptive filter.
+
+  @param  Filter           The filter state.
+  @param  Raw              The unfiltered axes.
+  @param  Filtered         Receives the filtered axes.
+
+**/
+VOID
+JoyStickFilterSticks (
+  IN OUT JOYSTICK_STICK_FILTER  *Filter,
+  IN     CONST UINT16           *Raw,
+  OUT    UINT16                 *Filtered
+  );
+
+/**
+  Debounce a packed button word.
+
+  @param  Debounce         The debounce state.
+  @param  Raw              The JOYSTICK_BUTTON_* bits of the current report.
+
+  @return The debounced button word.
+
+**/
+UINT32
+JoyStickDebounceButtons (
+  IN OUT JOYSTICK_DEBOUNCE  *Debounce,
+  IN     UINT32             Raw
+  );
+
+/**
+  Decode one input report: filter the sticks, debounce the buttons, detect
+  changes, translate pressed and released buttons to keys as the decoder's
+  key edges select and queue them.
+
+  Simple HID (0x3F) reports are rewritten in the full (0x30) layout first.
+  They are only sent on change, so they bypass the debounce window and the
+  stick filter, both of which count in report periods.
+  Reports of other types are ignored.
+
+  @param  Decoder          The decoder state.
+  @param  Report           The input report, JOYSTICK_REPORT_SIZE bytes.
+  @param  Arrival          Arrival stamp of the report, stored with its keys.
+
+  @retval TRUE             The button state changed.
+  @retval FALSE            The button state is unchanged, or the report
+                           carries no input.
+
+**/
+BOOLEAN
+JoyStickProcessReport (
+  IN OUT JOYSTICK_DECODER    *Decoder,
+  IN     CONST UINT8         *Report,
+  IN     UINT64              Arrival
+  );
+
+/**
+  Set the held buttons of a decoder without producing keys, for a decoder
+  taking over the input of another one.
+
+  @param  Decoder          The decoder.
+  @param  Buttons          The JOYSTICK_BUTTON_* bits held.
+
+**/
+VOID
+JoyStickSetButtons (
+  IN OUT JOYSTICK_DECODER  *Decoder,
+  IN     UINT32            Buttons
+  );
+
+/**
+  Reset the merge state of a Joy-Con pair: nothing received from either half.
+
+  @param  Pair             The pair.
+
+**/
+VOID
+JoyStickInitPair (
+  OUT JOYSTICK_PAIR    *Pair
+  );
+
+/**
+  Take a report of one half of a Joy-Con pair and, once a report of the
+  pair is complete, merge both halves into one full (0x30) report.
+
+  Reports are aligned by arrival: a report of each half makes one report of
+  the pair, stamped with the later arrival, so buttons pressed together on
+  both halves change in the same decode step. When a half sends a second
+  report before the other half sent one, its first report is merged with
+  the other half's last one, so a silent half delays the pair by at most
+  one report period. Until a half has reported, its buttons are released
+  and its stick centered.
+
+  @param  Pair             The pair.
+  @param  Side             JOYSTICK_SIDE_LEFT or JOYSTICK_SIDE_RIGHT.
+  @param  Report           The input report of the half.
+  @param  Arrival          Arrival stamp of the report.
+  @param  Merged           Buffer of JOYSTICK_REPORT_SIZE bytes receiving
+                           the report of the pair.
+  @param  MergedArrival    Receives the arrival stamp of the merged report.
+
+  @retval TRUE             Merged holds a report of the pair to decode.
+  @retval FALSE            The report is kept until the other half reports,
+                           or it carries no input.
+
+**/
+BOOLEAN
+JoyStickMergeHalfReport (
+  IN OUT JOYSTICK_PAIR  *Pair,
+  IN     UINT8          Side,
+  IN     CONST UINT8    *Report,
+  IN     UINT64         Arrival,
+  OUT    UINT8          *Merged,
+  OUT    UINT64         *MergedArrival
+  );
+
+/**
+  Rewrite a simple HID (0x3F) report in the layout of a full (0x30) report,
+  so the decode path only deals with one layout.
+
+  @param  Simple           The 0x3F input report.
+  @param  Full             Buffer of JOYSTICK_REPORT_SIZE bytes receiving the
+                           equivalent 0x30 layout.
+
+**/
+VOID
+JoyStickNormalizeSimpleReport (
+  IN  CONST UINT8   *Simple,
+  OUT UINT8         *Full
+  );
+
+/**
+  Return the packed button word of a full or subcommand reply report.
+
+  @param  Report           The input report in the 0x30 layout.
+
+  @return The JOYSTICK_BUTTON_* bits of the buttons held.
+
+**/
+UINT32
+JoyStickDecodeButtons (
+  IN CONST UINT8    *Report
+  );
+
+/**
+  Translate pressed or released buttons to keys and append them to the key
+  queue.
+
+  @param  Queue            The key queue.
+  @param  Buttons          The JOYSTICK_BUTTON_* bits of the buttons.
+  @param  Edge             JOYSTICK_KEY_PRESS or JOYSTICK_KEY_RELEASE, stored
+                           with the keys.
+  @param  Arrival          Arrival stamp stored with the keys.
+
+  @return The number of keys queued. Keys that do not fit are dropped.
+
+**/
+UINTN
+JoyStickQueueKeys (
+  IN OUT JOYSTICK_KEY_QUEUE  *Queue,
+  IN     UINT32              Buttons,
+  IN     UINT8               Edge,
+  IN     UINT64              Arrival
+  );
+
+/**
+  Check whether the key queue is empty.
+
+  @param  Queue            The key queue.
+
+  @retval TRUE             The queue is empty.
+  @retval FALSE            The queue holds at least one key.
+
+**/
+BOOLEAN
+JoyStickKeyQueueIsEmpty (
+  IN CONST JOYSTICK_KEY_QUEUE  *Queue
+  );
+
+/**
+  Append a key to the key queue.
+
+  @param  Queue            The key queue.
+  @param  Entry            The key to append.
+
+  @retval EFI_SUCCESS          The key was queued.
+  @retval EFI_OUT_OF_RESOURCES The queue is full, the key was dropped.
+
+**/
+EFI_STATUS
+JoyStickEnqueueKey (
+  IN OUT JOYSTICK_KEY_QUEUE        *Queue,
+  IN     CONST JOYSTICK_KEY_ENTRY  *Entry
+  );
+
+/**
+  Return the oldest key of the key queue without removing it.
+
+  @param  Queue            The key queue.
+
+  @return The oldest key, or NULL if the queue is empty.
+
+**/
+CONST JOYSTICK_KEY_ENTRY *
+JoyStickPeekKey (
+  IN CONST JOYSTICK_KEY_QUEUE  *Queue
+  );
+
+/**
+  Remove the oldest key from the key queue.
+
+  @param  Queue            The key queue.
+  @param  Entry            Receives the key.
+
+  @retval EFI_SUCCESS      A key was removed.
+  @retval EFI_NOT_READY    The queue is empty.
+
+**/
+EFI_STATUS
+JoyStickDequeueKey (
+  IN OUT JOYSTICK_KEY_QUEUE  *Queue,
+  OUT    JOYSTICK_KEY_ENTRY  *Entry
+  );
+
+/**
+  Drop every key of the key queue.
+
+  @param  Queue            The key queue.
+
+**/
+VOID
+JoyStickFlushKeys (
+  IN OUT JOYSTICK_KEY_QUEUE  *Queue
+  );
+
+/**
+  Derive the per value offset and fixed point scale from an IMU calibration.
+
+  @param  Calibration      The IMU calibration, NULL for the nominal one.
+  @param  Scale            The decode scale to fill in.
+
+**/
+VOID
+JoyStickSetImuScale (
+  IN  CONST JOYSTICK_IMU_CALIBRATION  *Calibration OPTIONAL,
+  OUT JOYSTICK_IMU_SCALE              *Scale
+  );
+
+/**
+  Convert the three IMU samples of a full report to calibrated fixed point
+  values in one pass.
+
+  @param  Report           The 0x30 input report.
+  @param  Scale            The decode scale.
+  @param  Values           Receives JOYSTICK_IMU_VALUES values, sample by sample,
+                           accelerometer in milli-g then gyroscope in
+                           centi-degrees per second.
+
+**/
+VOID
+JoyStickDecodeImu (
+  IN  CONST UINT8               *Report,
+  IN  CONST JOYSTICK_IMU_SCALE  *Scale,
+  OUT INT32                     *Values
+  );
+
+#endif
@@ -0,0 +1,156 @@
+/** @file
+  Joy-Con pairing of the USB JoyStick driver.
+
+  A left and a right Joy-Con bind as two controllers with half a layout
+  each. Once both are activated they are paired into one pad: the half
+  activated first owns the pair, its player slot, decoder and state, and
+  both halves feed their reports to JoyStickMergeHalfReport(), which
+  aligns them by arrival so a chord across the halves is decoded in one
+  step.
+
+  Pairs are made and split at TPL_NOTIFY, the TPL of the report handlers
+  of both halves.
+
+  YIZD 2021
+
+**/
+
+#include "JoyStick.h"
+
+/**
+  Pair a Joy-Con half that finished activation with an activated half of
+  the other side that has no partner yet. The half found keeps its player
+  slot and decodes the pair, the new half joins it without a slot.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval TRUE               The controller joined a pair, it takes no
+                             player slot.
+  @retval FALSE              The controller is not a Joy-Con half, or no
+                             half to pair with is bound.
+
+**/
+BOOLEAN
+JoyStickPairController (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_TPL             OldTpl;
+  USB_JS_DEV          *Owner;
+  UINTN               Slot;
+
+  if (UsbJoyStickDevice->Side == JOYSTICK_SIDE_NONE || UsbJoyStickDevice->PlayerId != 0) {
+    return FALSE;
+  }
+  if (UsbJoyStickDevice->Partner != NULL) {
+    return TRUE;
+  }
+
+  //
+  // Every activated half without a partner holds a player slot.
+  //
+  Owner  = NULL;
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  for (Slot = 0; Slot < JOYSTICK_MAX_PLAYERS; Slot++) {
+    Owner = mJoyStickPlayers[Slot];
+    if (Owner != NULL && Owner->Partner == NULL &&
+        Owner->Side != JOYSTICK_SIDE_NONE && Owner->Side != UsbJoyStickDevice->Side) {
+      break;
+    }
+  }
+  if (Slot == JOYSTICK_MAX_PLAYERS) {
+    gBS->RestoreTPL (OldTpl);
+    return FALSE;
+  }
+
+  JoyStickInitPair (&Owner->Pair);
+  Owner->PairOwner              = TRUE;
+  Owner->Partner                = UsbJoyStickDevice;
+  UsbJoyStickDevice->PairOwner  = FALSE;
+  UsbJoyStickDevice->Partner    = Owner;
+  gBS->RestoreTPL (OldTpl);
+
+  JoyStickShowPlayer (UsbJoyStickDevice, Owner->PlayerId);
+  JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_INFO, JOYSTICK_TRACE_PAIR, Owner->PlayerId, TRUE);
+  return TRUE;
+}
+
+/**
+  Split the pair of a Joy-Con half that is going away. The other half
+  carries on alone, with the player slot of the pair.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickUnpairController (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_TPL             OldTpl;
+  USB_JS_DEV          *Partner;
+  UINT32              Buttons;
+
+  Partner = UsbJoyStickDevice->Partner;
+  if (Partner == NULL) {
+    return;
+  }
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+
+  //
+  // The remaining half keeps the buttons of its side held in the pair, so
+  // it neither loses nor repeats a key. Keys the owner queued and not yet
+  // read go with its slot.
+  //
+  Buttons = (Partner->Side == JOYSTICK_SIDE_LEFT) ? JOYSTICK_LEFT_BUTTONS : JOYSTICK_RIGHT_BUTTONS;
+  if (UsbJoyStickDevice->PairOwner) {
+    Buttons &= UsbJoyStickDevice->Decoder.Buttons;
+    Partner->PlayerId                              = UsbJoyStickDevice->PlayerId;
+    mJoyStickPlayers[Partner->PlayerId - 1]        = Partner;
+    UsbJoyStickDevice->PlayerId                    = 0;
+  } else {
+    Buttons &= Partner->Decoder.Buttons;
+  }
+  JoyStickSetButtons (&Partner->Decoder, Buttons);
+
+  Partner->Partner              = NULL;
+  Partner->PairOwner            = FALSE;
+  UsbJoyStickDevice->Partner    = NULL;
+  UsbJoyStickDevice->PairOwner  = FALSE;
+  gBS->RestoreTPL (OldTpl);
+
+  JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_INFO, JOYSTICK_TRACE_PAIR, Partner->PlayerId, FALSE);
+}
+
+/**
+  Feed an input report of a paired Joy-Con half to the pair.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance, paired.
+  @param  Report             The input report.
+  @param  Arrival            The arrival stamp of the report.
+  @param  Merged             Buffer of JOYSTICK_REPORT_SIZE bytes receiving
+                             the report of the pair.
+  @param  MergedArrival      Receives the arrival stamp of Merged.
+
+  @return The owner of the pair, which decodes Merged, or NULL while the
+          pair waits for the report of the other half.
+
+**/
+USB_JS_DEV *
+JoyStickPairReport (
+  IN     USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report,
+  IN     UINT64         Arrival,
+  OUT    UINT8          *Merged,
+  OUT    UINT64         *MergedArrival
+  )
+{
+  USB_JS_DEV          *Owner;
+
+  Owner = UsbJoyStickDevice->PairOwner ? UsbJoyStickDevice : UsbJoyStickDevice->Partner;
+  if (!JoyStickMergeHalfReport (&Owner->Pair, UsbJoyStickDevice->Side, Report, Arrival, Merged, MergedArrival)) {
+    return NULL;
+  }
+  return Owner;
+}
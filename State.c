@@ -0,0 +1,122 @@
+/** @file
+  Gamepad State Protocol of the USB JoyStick driver.
+
+  The snapshot is written by JoyStickHandler at TPL_NOTIFY and read at any
+  TPL through a sequence lock: the writer makes the sequence odd while it
+  updates the snapshot, and a reader retries its copy until it saw the same
+  even sequence before and after. Readers never raise the TPL, so polling
+  does not hold off report decoding.
+
+  YIZD 2021
+
+**/
+
+#include "JoyStick.h"
+
+/**
+  Publish the state decoded from an input report. The state of a Joy-Con
+  pair is published to both halves.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance, the owner of a pair.
+  @param  Report             The input report, already decoded.
+
+**/
+VOID
+JoyStickPublishState (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report
+  )
+{
+  USB_JOYSTICK_STATE          *State;
+  USB_JOYSTICK_MOTION_SAMPLE  *Sample;
+  USB_JS_DEV                  *Partner;
+  UINTN                       Index;
+
+  State = &UsbJoyStickDevice->StateSnapshot;
+
+  UsbJoyStickDevice->StateSequence++;
+  MemoryFence ();
+
+  State->Sequence++;
+  State->Buttons = UsbJoyStickDevice->Decoder.Buttons;
+  for (Index = 0; Index < JOYSTICK_STICK_AXES; Index++) {
+    State->Sticks[Index] = (INT16) (((INT32) UsbJoyStickDevice->Decoder.Sticks[Index] - 2048) * 16);
+  }
+
+  //
+  // The newest sample of the report is the last one put in the motion ring.
+  //
+  if (UsbJoyStickDevice->MotionUsers != 0 && Report[0] == JOYSTICK_IN_FULL) {
+    Sample = &UsbJoyStickDevice->MotionRing[
+               (UsbJoyStickDevice->MotionHead + JOYSTICK_MOTION_RING_SIZE - 1) % JOYSTICK_MOTION_RING_SIZE
+               ];
+    CopyMem (State->Accel, Sample->Accel, sizeof (State->Accel));
+    CopyMem (State->Gyro, Sample->Gyro, sizeof (State->Gyro));
+  }
+
+  MemoryFence ();
+  UsbJoyStickDevice->StateSequence++;
+
+  //
+  // A pair decodes as one pad in its owner, the other half has no state
+  // of its own to publish. Pairing changes at TPL_NOTIFY, so Partner is
+  // stable here.
+  //
+  Partner = UsbJoyStickDevice->Partner;
+  if (Partner != NULL) {
+    Partner->StateSequence++;
+    MemoryFence ();
+    CopyMem (&Partner->StateSnapshot, State, sizeof (USB_JOYSTICK_STATE));
+    MemoryFence ();
+    Partner->StateSequence++;
+  }
+}
+
+/**
+  Copy out the controller state as of the latest input report.
+
+  @param  This                  The USB_JOYSTICK_STATE_PROTOCOL instance.
+  @param  State                 Receives the state.
+
+  @retval EFI_SUCCESS           The state was returned.
+  @retval EFI_INVALID_PARAMETER State is NULL.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickGetState (
+  IN  USB_JOYSTICK_STATE_PROTOCOL  *This,
+  OUT USB_JOYSTICK_STATE           *State
+  )
+{
+  USB_JS_DEV          *UsbJoyStickDevice;
+  UINT32              Sequence;
+
+  if (State == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  UsbJoyStickDevice = STATE_USB_JS_DEV_FROM_THIS (This);
+  JoyStickRequestActivation (UsbJoyStickDevice);
+
+  //
+  // An odd sequence is only seen from another processor while the handler
+  // is mid update; on the processor running the handler it has completed
+  // before a lower TPL reader resumes.
+  //
+  for (;;) {
+    Sequence = UsbJoyStickDevice->StateSequence;
+    if ((Sequence & 1) != 0) {
+      CpuPause ();
+      continue;
+    }
+
+    MemoryFence ();
+    CopyMem (State, &UsbJoyStickDevice->StateSnapshot, sizeof (USB_JOYSTICK_STATE));
+    MemoryFence ();
+
+    if (UsbJoyStickDevice->StateSequence == Sequence) {
+      return EFI_SUCCESS;
+    }
+  }
+}
@@ -0,0 +1,232 @@
+/** @file
+  Statistics Protocol of the USB JoyStick driver.
+
+  The counters are written by JoyStickHandler at TPL_NOTIFY, which opens
+  the sequence lock once per callback and closes it while raw report
+  subscribers run, and by the few recovery paths running below it, which
+  raise to TPL_NOTIFY for their single update.
+  GetStats() reads them like GetState() reads the state snapshot, without
+  raising the TPL, so a diagnostic watching the counters does not delay
+  the interrupt transfers.
+
+  YIZD 2021
+
+**/
+
+#include "JoyStick.h"
+
+/**
+  Open the statistics of a device for update by JoyStickHandler.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickStatsBegin (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  if (!FeaturePcdGet (PcdJoyStickStatsSupport)) {
+    return;
+  }
+
+  UsbJoyStickDevice->StatsSequence++;
+  MemoryFence ();
+}
+
+/**
+  Publish the statistics updated since JoyStickStatsBegin() and close them
+  for update while JoyStickHandler calls out of the driver, so a raw report
+  subscriber reading them at TPL_NOTIFY does not wait on its own caller.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickStatsPause (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  if (!FeaturePcdGet (PcdJoyStickStatsSupport)) {
+    return;
+  }
+
+  MemoryFence ();
+  UsbJoyStickDevice->StatsSequence++;
+}
+
+/**
+  Open the statistics again after JoyStickStatsPause().
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickStatsResume (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  if (!FeaturePcdGet (PcdJoyStickStatsSupport)) {
+    return;
+  }
+
+  UsbJoyStickDevice->StatsSequence++;
+  MemoryFence ();
+}
+
+/**
+  Record the duration of an interrupt transfer callback and publish the
+  statistics updated since JoyStickStatsBegin().
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Entry              The arrival stamp taken when the callback
+                             was entered.
+
+**/
+VOID
+JoyStickStatsEnd (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT64         Entry
+  )
+{
+  USB_JOYSTICK_STATS  *Stats;
+  UINT64              Duration;
+  UINT64              MicroSeconds;
+  UINTN               Bucket;
+
+  if (!FeaturePcdGet (PcdJoyStickStatsSupport)) {
+    return;
+  }
+
+  Stats        = &UsbJoyStickDevice->StatsSnapshot;
+  Duration     = GetTimeInNanoSecond (JoyStickArrivalStamp () - Entry);
+  MicroSeconds = DivU64x32 (Duration, 1000);
+  Bucket       = (MicroSeconds == 0) ? 0 : (UINTN) HighBitSet64 (MicroSeconds) + 1;
+  Bucket       = MIN (Bucket, USB_JOYSTICK_CALLBACK_TIME_BUCKETS - 1);
+
+  Stats->Callbacks++;
+  Stats->CallbackHistogram[Bucket]++;
+  Stats->CallbackMax = MAX (Stats->CallbackMax, Duration);
+
+  MemoryFence ();
+  UsbJoyStickDevice->StatsSequence++;
+}
+
+/**
+  Count a recovery attempt made outside of JoyStickHandler.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickCountRecovery (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_TPL             OldTpl;
+
+  if (!FeaturePcdGet (PcdJoyStickStatsSupport)) {
+    return;
+  }
+
+  //
+  // The handler must not open the lock while it is held here.
+  //
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  UsbJoyStickDevice->StatsSequence++;
+  MemoryFence ();
+  UsbJoyStickDevice->StatsSnapshot.Recoveries++;
+  MemoryFence ();
+  UsbJoyStickDevice->StatsSequence++;
+  gBS->RestoreTPL (OldTpl);
+}
+
+/**
+  Return the upper bound of the callback time histogram bucket holding the
+  given rank.
+
+  @param  Stats            The statistics, with histogram and maximum.
+  @param  Rank             1 based rank among the callbacks recorded.
+
+  @return The bucket's upper bound in nanoseconds, at most the maximum seen.
+
+**/
+STATIC
+UINT64
+JoyStickCallbackPercentile (
+  IN CONST USB_JOYSTICK_STATS  *Stats,
+  IN UINT64                    Rank
+  )
+{
+  UINT64              Seen;
+  UINTN               Bucket;
+
+  Seen = 0;
+  for (Bucket = 0; Bucket < USB_JOYSTICK_CALLBACK_TIME_BUCKETS - 1; Bucket++) {
+    Seen += Stats->CallbackHistogram[Bucket];
+    if (Seen >= Rank) {
+      return MIN (MultU64x32 (LShiftU64 (1, Bucket), 1000), Stats->CallbackMax);
+    }
+  }
+  return Stats->CallbackMax;
+}
+
+/**
+  Copy out the counters of the controller.
+
+  Unlike the other protocols this does not activate a controller waiting
+  for its first consumer: looking at the counters changes nothing.
+
+  @param  This                  The USB_JOYSTICK_STATS_PROTOCOL instance.
+  @param  Stats                 Receives the counters.
+
+  @retval EFI_SUCCESS           The counters were returned.
+  @retval EFI_INVALID_PARAMETER Stats is NULL.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickGetStats (
+  IN  USB_JOYSTICK_STATS_PROTOCOL  *This,
+  OUT USB_JOYSTICK_STATS           *Stats
+  )
+{
+  USB_JS_DEV          *UsbJoyStickDevice;
+  UINT32              Sequence;
+  UINTN               Index;
+
+  if (Stats == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  UsbJoyStickDevice = STATS_USB_JS_DEV_FROM_THIS (This);
+
+  for (;;) {
+    Sequence = UsbJoyStickDevice->StatsSequence;
+    if ((Sequence & 1) != 0) {
+      CpuPause ();
+      continue;
+    }
+
+    MemoryFence ();
+    CopyMem (Stats, &UsbJoyStickDevice->StatsSnapshot, sizeof (USB_JOYSTICK_STATS));
+    MemoryFence ();
+
+    if (UsbJoyStickDevice->StatsSequence == Sequence) {
+      break;
+    }
+  }
+
+  Stats->PollInterval    = UsbJoyStickDevice->InEndpoints[0].Descriptor.Interval;
+  Stats->ActiveEndpoints = 0;
+  for (Index = 0; Index < UsbJoyStickDevice->InEndpointCount; Index++) {
+    if (UsbJoyStickDevice->InEndpoints[Index].AsyncActive) {
+      Stats->ActiveEndpoints++;
+    }
+  }
+
+  Stats->CallbackP50 = JoyStickCallbackPercentile (Stats, DivU64x32 (MultU64x32 (Stats->Callbacks, 50) + 99, 100));
+  Stats->CallbackP90 = JoyStickCallbackPercentile (Stats, DivU64x32 (MultU64x32 (Stats->Callbacks, 90) + 99, 100));
+  Stats->CallbackP99 = JoyStickCallbackPercentile (Stats, DivU64x32 (MultU64x32 (Stats->Callbacks, 99) + 99, 100));
+  return EFI_SUCCESS;
+}
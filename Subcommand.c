@@ -0,0 +1,403 @@
+/** @file
+  Nintendo subcommand engine and input report mode selection.
+
+  Subcommands are sent in 0x01 output reports together with a neutral rumble
+  payload, and answered by 0x21 input reports that echo the subcommand id.
+
+  YIZD 2021
+
+**/
+
+#include "JoyStick.h"
+
+//
+// Neutral rumble payload for both motors, sent with every subcommand.
+//
+GLOBAL_REMOVE_IF_UNREFERENCED CONST UINT8 mJoyStickNeutralRumble[8] = {
+  0x00, 0x01, 0x40, 0x40, 0x00, 0x01, 0x40, 0x40
+};
+
+/**
+  Wait for the 0x21 reply to a subcommand by reading input reports directly.
+
+  Only used while the asynchronous interrupt transfer is not running, as it
+  would otherwise compete for the same reports.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  SubcmdId           The subcommand id to match.
+  @param  Reply              Buffer of JOYSTICK_REPORT_SIZE bytes receiving the reply.
+
+  @retval EFI_SUCCESS        The matching reply was received.
+  @retval EFI_TIMEOUT        No matching reply within JOYSTICK_SUBCMD_MAX_POLL reports.
+
+**/
+STATIC
+EFI_STATUS
+JoyStickWaitSubcommandReply (
+  IN  USB_JS_DEV     *UsbJoyStickDevice,
+  IN  UINT8          SubcmdId,
+  OUT UINT8          *Reply
+  )
+{
+  EFI_STATUS          Status;
+  EFI_USB_IO_PROTOCOL *UsbIo;
+  UINTN               Poll;
+  UINTN               ReplySize;
+  UINT32              TransferStatus;
+
+  UsbIo = UsbJoyStickDevice->UsbIo;
+
+  for (Poll = 0; Poll < JOYSTICK_SUBCMD_MAX_POLL; Poll++) {
+    ReplySize = JOYSTICK_REPORT_SIZE;
+    Status = UsbIo->UsbSyncInterruptTransfer (
+                      UsbIo,
+                      UsbJoyStickDevice->InEndpoints[0].Descriptor.EndpointAddress,
+                      Reply,
+                      &ReplySize,
+                      JOYSTICK_SUBCMD_TIMEOUT,
+                      &TransferStatus
+                      );
+    if (EFI_ERROR (Status)) {
+      continue;
+    }
+
+    if ((ReplySize > JOYSTICK_SUBCMD_ID_OFFSET) &&
+        (Reply[0] == JOYSTICK_IN_SUBCMD_REPLY) &&
+        (Reply[JOYSTICK_SUBCMD_ID_OFFSET] == SubcmdId)) {
+      return EFI_SUCCESS;
+    }
+  }
+
+  return EFI_TIMEOUT;
+}
+
+/**
+  Send a subcommand to the controller in a 0x01 output report.
+
+  Before the asynchronous interrupt transfer is running the reply is matched
+  synchronously against the 0x21 input reports. Once it is running the
+  subcommand is only posted and the reply is consumed by JoyStickHandler.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  SubcmdId           The subcommand id.
+  @param  Args               The subcommand arguments, may be NULL if ArgsLength is 0.
+  @param  ArgsLength         The number of argument bytes.
+  @param  Reply              Optional buffer of JOYSTICK_REPORT_SIZE bytes receiving
+                             the whole 0x21 reply. Must be NULL once the
+                             asynchronous interrupt transfer is running.
+
+  @retval EFI_SUCCESS            The subcommand was acknowledged, or posted.
+  @retval EFI_INVALID_PARAMETER  ArgsLength is too large, or Reply is not NULL
+                                 while the asynchronous transfer is running.
+  @retval EFI_TIMEOUT            No matching reply was received.
+  @retval EFI_DEVICE_ERROR       The controller did not acknowledge the subcommand.
+
+**/
+EFI_STATUS
+JoyStickSendSubcommand (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT8          SubcmdId,
+  IN     CONST UINT8    *Args,
+  IN     UINTN          ArgsLength,
+  OUT    UINT8          *Reply OPTIONAL
+  )
+{
+  EFI_STATUS          Status;
+  EFI_USB_IO_PROTOCOL *UsbIo;
+  UINT8               OutReport[JOYSTICK_REPORT_SIZE];
+  UINT8               InReport[JOYSTICK_REPORT_SIZE];
+  UINTN               OutSize;
+  UINT32              TransferStatus;
+
+  if (ArgsLength > JOYSTICK_REPORT_SIZE - 11) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (UsbJoyStickDevice->AsyncActive && Reply != NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  UsbIo = UsbJoyStickDevice->UsbIo;
+
+  ZeroMem (OutReport, sizeof (OutReport));
+  OutReport[0] = JOYSTICK_OUT_RUMBLE_SUBCMD;
+  OutReport[1] = UsbJoyStickDevice->SubcmdCounter;
+  CopyMem (&OutReport[2], mJoyStickNeutralRumble, sizeof (mJoyStickNeutralRumble));
+  OutReport[10] = SubcmdId;
+  if (ArgsLength != 0) {
+    CopyMem (&OutReport[11], Args, ArgsLength);
+  }
+  UsbJoyStickDevice->SubcmdCounter = (UINT8) ((UsbJoyStickDevice->SubcmdCounter + 1) & 0x0F);
+
+  //
+  // Record the pending id before sending, the reply may be handled by
+  // JoyStickHandler before UsbSyncInterruptTransfer returns.
+  //
+  UsbJoyStickDevice->SubcmdPending = SubcmdId;
+
+  OutSize = sizeof (OutReport);
+  Status = UsbIo->UsbSyncInterruptTransfer (
+                    UsbIo,
+                    UsbJoyStickDevice->IntOutEndpointDescriptor.EndpointAddress,
+                    OutReport,
+                    &OutSize,
+                    JOYSTICK_SUBCMD_TIMEOUT,
+                    &TransferStatus
+                    );
+  if (EFI_ERROR (Status)) {
+    UsbJoyStickDevice->SubcmdPending = 0;
+    return Status;
+  }
+
+  if (UsbJoyStickDevice->AsyncActive) {
+    return EFI_SUCCESS;
+  }
+
+  if (Reply == NULL) {
+    Reply = InReport;
+  }
+  Status = JoyStickWaitSubcommandReply (UsbJoyStickDevice, SubcmdId, Reply);
+  UsbJoyStickDevice->SubcmdPending = 0;
+  if (!EFI_ERROR (Status) && (Reply[JOYSTICK_SUBCMD_ACK_OFFSET] & JOYSTICK_SUBCMD_ACK) == 0) {
+    Status = EFI_DEVICE_ERROR;
+  }
+
+  JOYSTICK_TRACE (JOYSTICK_TRACE_LEVEL_INFO, JOYSTICK_TRACE_SUBCMD, SubcmdId, Status);
+  return Status;
+}
+
+/**
+  Consume a 0x21 subcommand reply received by JoyStickHandler. The reply
+  to the pending subcommand is kept in SubcmdReply.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Report             The 0x21 input report.
+
+**/
+VOID
+JoyStickSubcommandReply (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report
+  )
+{
+  if (UsbJoyStickDevice->SubcmdPending == 0 ||
+      Report[JOYSTICK_SUBCMD_ID_OFFSET] != UsbJoyStickDevice->SubcmdPending) {
+    return;
+  }
+  UsbJoyStickDevice->SubcmdPending = 0;
+  CopyMem (UsbJoyStickDevice->SubcmdReply, Report, JOYSTICK_REPORT_SIZE);
+  UsbJoyStickDevice->SubcmdReplied = TRUE;
+
+  if ((Report[JOYSTICK_SUBCMD_ACK_OFFSET] & JOYSTICK_SUBCMD_ACK) == 0) {
+    return;
+  }
+
+  if (Report[JOYSTICK_SUBCMD_ID_OFFSET] == JOYSTICK_SUBCMD_SET_REPORT_MODE) {
+    UsbJoyStickDevice->ReportMode = UsbJoyStickDevice->RequestedReportMode;
+  }
+}
+
+/**
+  Select the input report mode the controller should use.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Mode               JOYSTICK_REPORT_MODE_FULL or JOYSTICK_REPORT_MODE_SIMPLE.
+
+  @retval EFI_SUCCESS        The mode is set, or the switch has been posted.
+  @retval Others             The subcommand failed.
+
+**/
+EFI_STATUS
+JoyStickSetReportMode (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT8          Mode
+  )
+{
+  EFI_STATUS          Status;
+
+  if (UsbJoyStickDevice->ReportMode == Mode &&
+      UsbJoyStickDevice->RequestedReportMode == Mode) {
+    return EFI_SUCCESS;
+  }
+
+  UsbJoyStickDevice->RequestedReportMode = Mode;
+  Status = JoyStickSendSubcommand (
+             UsbJoyStickDevice,
+             JOYSTICK_SUBCMD_SET_REPORT_MODE,
+             &Mode,
+             sizeof (Mode),
+             NULL
+             );
+  if (EFI_ERROR (Status)) {
+    UsbJoyStickDevice->RequestedReportMode = UsbJoyStickDevice->ReportMode;
+    return Status;
+  }
+
+  if (!UsbJoyStickDevice->AsyncActive) {
+    UsbJoyStickDevice->ReportMode = Mode;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Apply the report mode policy: full reports while any consumer needs sticks
+  or IMU data, simple HID reports otherwise. Joy-Con halves stay in full
+  mode, their simple HID layout is sideways and cannot be paired. So does
+  any controller while buttons are debounced: simple HID reports are only
+  sent on change, so a chattering button sends one per bounce and there is
+  no steady stream of reports to count the debounce window in.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        The selected mode is set, or the switch has been posted.
+  @retval Others             The subcommand failed.
+
+**/
+EFI_STATUS
+JoyStickApplyReportPolicy (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  if (UsbJoyStickDevice->FullReportUsers != 0 || UsbJoyStickDevice->Side != JOYSTICK_SIDE_NONE ||
+      FixedPcdGet8 (PcdJoyStickDebounceReports) > 1) {
+    return JoyStickSetReportMode (UsbJoyStickDevice, JOYSTICK_REPORT_MODE_FULL);
+  }
+  return JoyStickSetReportMode (UsbJoyStickDevice, JOYSTICK_REPORT_MODE_SIMPLE);
+}
+
+/**
+  Register a consumer that needs full 0x30 input reports, switching the
+  controller to full mode when it is the first one.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+  @retval EFI_SUCCESS        Full mode is active or has been requested.
+  @retval Others             The mode switch failed.
+
+**/
+EFI_STATUS
+JoyStickAcquireFullReport (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  EFI_STATUS          Status;
+
+  UsbJoyStickDevice->FullReportUsers++;
+  if (UsbJoyStickDevice->FullReportUsers != 1) {
+    return EFI_SUCCESS;
+  }
+
+  Status = JoyStickApplyReportPolicy (UsbJoyStickDevice);
+  if (EFI_ERROR (Status)) {
+    UsbJoyStickDevice->FullReportUsers--;
+  }
+  return Status;
+}
+
+/**
+  Drop a consumer registered by JoyStickAcquireFullReport, returning the
+  controller to simple HID mode when it was the last one.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+VOID
+JoyStickReleaseFullReport (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  ASSERT (UsbJoyStickDevice->FullReportUsers != 0);
+  if (UsbJoyStickDevice->FullReportUsers == 0) {
+    return;
+  }
+
+  UsbJoyStickDevice->FullReportUsers--;
+  if (UsbJoyStickDevice->FullReportUsers == 0) {
+    JoyStickApplyReportPolicy (UsbJoyStickDevice);
+  }
+}
+
+/**
+  Post a read of the controller's SPI flash with the SPI read subcommand.
+  The reply is left in SubcmdReply, see JoyStickSpiReadData().
+
+  Only usable while the asynchronous interrupt transfer is running.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+  @param  Address            The SPI flash address.
+  @param  Length             Number of bytes to read, at most JOYSTICK_SPI_MAX_READ.
+
+  @retval EFI_SUCCESS            The read was posted.
+  @retval EFI_INVALID_PARAMETER  Length is too large.
+  @retval Others                 The subcommand could not be sent.
+
+**/
+EFI_STATUS
+JoyStickPostSpiRead (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     UINT32         Address,
+  IN     UINTN          Length
+  )
+{
+  UINT8               Args[5];
+
+  if (Length > JOYSTICK_SPI_MAX_READ || !UsbJoyStickDevice->AsyncActive) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Args[0] = (UINT8) Address;
+  Args[1] = (UINT8) (Address >> 8);
+  Args[2] = (UINT8) (Address >> 16);
+  Args[3] = (UINT8) (Address >> 24);
+  Args[4] = (UINT8) Length;
+
+  UsbJoyStickDevice->SubcmdReplied = FALSE;
+  return JoyStickSendSubcommand (
+           UsbJoyStickDevice,
+           JOYSTICK_SUBCMD_SPI_READ,
+           Args,
+           sizeof (Args),
+           NULL
+           );
+}
+
+/**
+  Extract the data of an SPI read from its 0x21 reply.
+
+  @param  Reply              The 0x21 reply.
+  @param  Address            The SPI flash address that was read.
+  @param  Buffer             Buffer receiving the data.
+  @param  Length             Number of bytes that were read.
+
+  @retval EFI_SUCCESS            The data was copied.
+  @retval EFI_DEVICE_ERROR       The read was not acknowledged, or the
+                                 reply does not match the request.
+
+**/
+EFI_STATUS
+JoyStickSpiReadData (
+  IN     CONST UINT8    *Reply,
+  IN     UINT32         Address,
+  OUT    VOID           *Buffer,
+  IN     UINTN          Length
+  )
+{
+  CONST UINT8         *Echo;
+
+  if ((Reply[JOYSTICK_SUBCMD_ACK_OFFSET] & JOYSTICK_SUBCMD_ACK) == 0 ||
+      Reply[JOYSTICK_SUBCMD_ID_OFFSET] != JOYSTICK_SUBCMD_SPI_READ) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  //
+  // The reply echoes the requested address and length ahead of the data.
+  //
+  Echo = &Reply[JOYSTICK_SUBCMD_DATA_OFFSET];
+  if (Echo[0] != (UINT8) Address || Echo[1] != (UINT8) (Address >> 8) ||
+      Echo[2] != (UINT8) (Address >> 16) || Echo[3] != (UINT8) (Address >> 24) ||
+      Echo[4] != (UINT8) Length || Length > JOYSTICK_SPI_MAX_READ) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  CopyMem (Buffer, &Reply[JOYSTICK_SPI_DATA_OFFSET], Length);
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,239 @@
+/** @file
+  Raw Report Protocol of the USB JoyStick driver.
+
+  Registrations live in a small per controller table with a bitmap of the
+  used slots, so a controller without subscribers pays one test per report.
+  A filtered registration keeps its byte range as a mask of report bytes;
+  it is skipped unless the mask meets the bytes that changed since the
+  previous report.
+
+  YIZD 2021
+
+**/
+
+#include "JoyStick.h"
+
+/**
+  Compute which bytes of a report differ from the previous report.
+
+  @param  Previous         The previous report, 8 byte aligned.
+  @param  Report           The new report.
+
+  @return A mask with bit N set when byte N differs.
+
+**/
+STATIC
+UINT64
+JoyStickReportChanges (
+  IN CONST UINT64   *Previous,
+  IN CONST UINT8    *Report
+  )
+{
+  UINT64        Changes;
+  UINT64        Diff;
+  UINTN         Word;
+  UINTN         Byte;
+
+  Changes = 0;
+  for (Word = 0; Word < JOYSTICK_REPORT_SIZE / sizeof (UINT64); Word++) {
+    Diff = Previous[Word] ^ ReadUnaligned64 ((CONST UINT64 *) (Report + Word * sizeof (UINT64)));
+    if (Diff == 0) {
+      continue;
+    }
+    for (Byte = 0; Byte < sizeof (UINT64); Byte++) {
+      if ((RShiftU64 (Diff, Byte * 8) & 0xFF) != 0) {
+        Changes |= LShiftU64 (1, Word * sizeof (UINT64) + Byte);
+      }
+    }
+  }
+  return Changes;
+}
+
+/**
+  Hand an input report to the registered callbacks.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance, with subscribers.
+  @param  Report             The input report in the transfer buffer.
+  @param  Length             The report length in bytes.
+
+**/
+VOID
+JoyStickNotifySubscribers (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice,
+  IN     CONST UINT8    *Report,
+  IN     UINTN          Length
+  )
+{
+  JOYSTICK_REPORT_SUBSCRIBER  *Subscriber;
+  UINT32                      Pending;
+  UINTN                       Slot;
+  UINT64                      Changes;
+
+  Changes = 0;
+  if (UsbJoyStickDevice->SubscriberFilters != 0) {
+    Changes = JoyStickReportChanges (UsbJoyStickDevice->LastReport, Report);
+    CopyMem (UsbJoyStickDevice->LastReport, Report, JOYSTICK_REPORT_SIZE);
+  }
+
+  //
+  // A callback may unregister any slot, so the bitmap is rechecked.
+  //
+  Pending = UsbJoyStickDevice->SubscriberMap;
+  while (Pending != 0) {
+    Slot     = (UINTN) LowBitSet32 (Pending);
+    Pending &= Pending - 1;
+    if ((UsbJoyStickDevice->SubscriberMap & (1U << Slot)) == 0) {
+      continue;
+    }
+
+    Subscriber = &UsbJoyStickDevice->Subscribers[Slot];
+    if (Subscriber->Filter != 0 && (Subscriber->Filter & Changes) == 0) {
+      continue;
+    }
+    Subscriber->Callback (Report, Length, Subscriber->Context);
+  }
+}
+
+/**
+  Recompute the union of the filter masks of all registrations.
+
+  @param  UsbJoyStickDevice  The USB_JS_DEV instance.
+
+**/
+STATIC
+VOID
+JoyStickUpdateSubscriberFilters (
+  IN OUT USB_JS_DEV     *UsbJoyStickDevice
+  )
+{
+  UINTN         Slot;
+  UINT64        Filters;
+
+  Filters = 0;
+  for (Slot = 0; Slot < JOYSTICK_MAX_REPORT_SUBSCRIBERS; Slot++) {
+    if ((UsbJoyStickDevice->SubscriberMap & (1U << Slot)) != 0) {
+      Filters |= UsbJoyStickDevice->Subscribers[Slot].Filter;
+    }
+  }
+  UsbJoyStickDevice->SubscriberFilters = Filters;
+}
+
+/**
+  Register a report callback.
+
+  Without a filter (FilterLength 0) the callback sees every report. With a
+  filter it only sees reports in which a byte of the range differs from the
+  previous report.
+
+  @param  This                  The USB_JOYSTICK_REPORT_PROTOCOL instance.
+  @param  Callback              The function to call at TPL_NOTIFY.
+  @param  Context               Passed to Callback.
+  @param  FilterOffset          First report byte of the filter.
+  @param  FilterLength          Number of bytes of the filter, 0 for none.
+  @param  Registration          Receives the handle for Unregister().
+
+  @retval EFI_SUCCESS           The callback is registered.
+  @retval EFI_INVALID_PARAMETER Callback or Registration is NULL, or the
+                                filter ends past USB_JOYSTICK_REPORT_FILTER_BYTES.
+  @retval EFI_OUT_OF_RESOURCES  All registration slots are taken.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickRegisterReport (
+  IN  USB_JOYSTICK_REPORT_PROTOCOL  *This,
+  IN  USB_JOYSTICK_REPORT_CALLBACK  Callback,
+  IN  VOID                          *Context OPTIONAL,
+  IN  UINTN                         FilterOffset,
+  IN  UINTN                         FilterLength,
+  OUT VOID                          **Registration
+  )
+{
+  USB_JS_DEV                  *UsbJoyStickDevice;
+  JOYSTICK_REPORT_SUBSCRIBER  *Subscriber;
+  EFI_TPL                     OldTpl;
+  UINTN                       Slot;
+  UINT64                      Filter;
+
+  if (Callback == NULL || Registration == NULL ||
+      FilterOffset > USB_JOYSTICK_REPORT_FILTER_BYTES ||
+      FilterLength > USB_JOYSTICK_REPORT_FILTER_BYTES - FilterOffset) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  UsbJoyStickDevice = REPORT_USB_JS_DEV_FROM_THIS (This);
+
+  Filter = 0;
+  if (FilterLength != 0) {
+    Filter = (FilterLength == USB_JOYSTICK_REPORT_FILTER_BYTES) ? MAX_UINT64 : LShiftU64 (1, FilterLength) - 1;
+    Filter = LShiftU64 (Filter, FilterOffset);
+  }
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  for (Slot = 0; Slot < JOYSTICK_MAX_REPORT_SUBSCRIBERS; Slot++) {
+    if ((UsbJoyStickDevice->SubscriberMap & (1U << Slot)) == 0) {
+      break;
+    }
+  }
+  if (Slot == JOYSTICK_MAX_REPORT_SUBSCRIBERS) {
+    gBS->RestoreTPL (OldTpl);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Subscriber           = &UsbJoyStickDevice->Subscribers[Slot];
+  Subscriber->Callback = Callback;
+  Subscriber->Context  = Context;
+  Subscriber->Filter   = Filter;
+  UsbJoyStickDevice->SubscriberMap |= 1U << Slot;
+  JoyStickUpdateSubscriberFilters (UsbJoyStickDevice);
+  gBS->RestoreTPL (OldTpl);
+
+  JoyStickRequestActivation (UsbJoyStickDevice);
+
+  *Registration = Subscriber;
+  return EFI_SUCCESS;
+}
+
+/**
+  Remove a callback registered by Register(). It may be called from within
+  the callback itself.
+
+  @param  This                  The USB_JOYSTICK_REPORT_PROTOCOL instance.
+  @param  Registration          The handle returned by Register().
+
+  @retval EFI_SUCCESS           The callback is removed.
+  @retval EFI_INVALID_PARAMETER Registration is not a registered handle.
+
+**/
+EFI_STATUS
+EFIAPI
+USBJoyStickUnregisterReport (
+  IN USB_JOYSTICK_REPORT_PROTOCOL  *This,
+  IN VOID                          *Registration
+  )
+{
+  USB_JS_DEV          *UsbJoyStickDevice;
+  EFI_TPL             OldTpl;
+  UINTN               Slot;
+
+  UsbJoyStickDevice = REPORT_USB_JS_DEV_FROM_THIS (This);
+
+  for (Slot = 0; Slot < JOYSTICK_MAX_REPORT_SUBSCRIBERS; Slot++) {
+    if (Registration == &UsbJoyStickDevice->Subscribers[Slot]) {
+      break;
+    }
+  }
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  if (Slot == JOYSTICK_MAX_REPORT_SUBSCRIBERS ||
+      (UsbJoyStickDevice->SubscriberMap & (1U << Slot)) == 0) {
+    gBS->RestoreTPL (OldTpl);
+    return EFI_INVALID_PARAMETER;
+  }
+
+  UsbJoyStickDevice->SubscriberMap &= ~(1U << Slot);
+  JoyStickUpdateSubscriberFilters (UsbJoyStickDevice);
+  gBS->RestoreTPL (OldTpl);
+
+  return EFI_SUCCESS;
+}
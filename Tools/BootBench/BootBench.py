@@ -0,0 +1,430 @@
+## @file
+#  Boot time cost of UsbJoyStickDxe in OVMF under QEMU.
+#
+#  Builds OVMF with the driver next to UsbKbDxe, boots it with TCG behind
+#  an xHCI controller carrying --kbd keyboards, --tablet tablets and
+#  --storage disks spread over --hubs hubs, and reads the firmware
+#  performance records (FPDT) once the shell runs. The DXE core records
+#  every DriverBinding Supported() and Start() call with the FILE_GUID of
+#  the driver and the controller handle; the ones of UsbJoyStickDxe are
+#  summed per boot:
+#
+#    supported_calls   Supported() calls, on every controller of the boot.
+#    supported_ns      Their mean cost, the price of each unrelated USB
+#                      interface and of every other handle.
+#    start_calls       Start() calls, none without a controller to bind.
+#    start_ns          Their mean cost.
+#
+#  The guest memory is saved over QMP and searched for the FPDT ACPI table,
+#  whose boot performance table pointer leads to the records. The median
+#  of --boots boots is kept, TCG timings varying from boot to boot.
+#
+#  With --baseline the results are compared to a file of "<config> <metric>
+#  <value>" lines, <config> naming the device counts. A mean slower than its
+#  baseline by more than --threshold percent is a regression and fails the
+#  run. --update writes the results into a baseline, keeping the lines of
+#  the other configs.
+#
+#  The firmware needs PERFORMANCE_ENABLE of OvmfPkgX64.dsc. The driver is
+#  found through PACKAGES_PATH as UsbJoyStickDxe, whatever the name of
+#  this checkout.
+#
+#  BootBench.py --edk2 DIR [--skip-build] [--target RELEASE|DEBUG|NOOPT]
+#               [--toolchain TAG] [--qemu PATH] [--kbd N] [--tablet N]
+#               [--storage N] [--hubs N] [--passthrough VID:PID]
+#               [--boots N] [--timeout S] [--baseline FILE]
+#               [--threshold PCT] [--update FILE]
+#
+#  YIZD 2021
+##
+
+import argparse
+import json
+import os
+import shutil
+import socket
+import statistics
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+import uuid
+
+DRIVER_DIR        = os.path.abspath (os.path.join (os.path.dirname (__file__), '..', '..'))
+DRIVER_INF        = 'UsbJoyStickDxe/UsbJoyStickDxe.inf'
+ANCHOR_INF        = 'MdeModulePkg/Bus/Usb/UsbKbDxe/UsbKbDxe.inf'
+PLATFORM_DSC      = 'OvmfPkg/OvmfPkgX64.dsc'
+PLATFORM_FDF      = 'OvmfPkg/OvmfPkgX64.fdf'
+BENCH_PKG         = 'BootBenchPkg'
+BENCH_OUTPUT      = 'Build/OvmfBootBench'
+
+GUEST_MEMORY_MB   = 256
+
+#
+# Ports of a usb-hub, and the USB 2 root ports of qemu-xhci.
+#
+HUB_PORTS         = 8
+XHCI_PORTS        = 4
+DEFAULT_BOOTS     = 3
+DEFAULT_TIMEOUT   = 300
+DEFAULT_THRESHOLD = 50
+
+#
+# Shell banners on the serial console. The performance records are
+# complete once the boot manager launched the shell.
+#
+SHELL_MARKERS     = (b'Shell>', b'startup.nsh')
+
+#
+# ACPI FPDT and its records, MdePkg/Include/IndustryStandard/Acpi50.h and
+# MdeModulePkg/Include/Guid/ExtendedFirmwarePerformance.h.
+#
+FPDT_SIGNATURE                  = b'FPDT'
+FBPT_SIGNATURE                  = b'FBPT'
+ACPI_HEADER_SIZE                = 36
+FPDT_BOOT_POINTER_TYPE          = 0x0000
+FPDT_GUID_QWORD_EVENT_TYPE      = 0x1013
+FPDT_GUID_QWORD_STRING_TYPE     = 0x1014
+MODULE_DB_START_ID              = 0x05
+MODULE_DB_END_ID                = 0x06
+MODULE_DB_SUPPORT_START_ID      = 0x07
+MODULE_DB_SUPPORT_END_ID        = 0x08
+
+#
+# Header, ProgressID, ApicID, Timestamp, Guid and Qword, packed.
+#
+GUID_QWORD_RECORD               = struct.Struct ('<HBBHIQ16sQ')
+
+METRICS = ('supported_calls', 'supported_ns', 'start_calls', 'start_ns')
+
+def Fail (Message):
+    sys.stderr.write ('BootBench: %s\n' % Message)
+    sys.exit (1)
+
+def DriverFileGuid ():
+    with open (os.path.join (DRIVER_DIR, 'UsbJoyStickDxe.inf')) as Inf:
+        for Line in Inf:
+            Fields = Line.split ('=')
+            if len (Fields) == 2 and Fields[0].strip () == 'FILE_GUID':
+                return uuid.UUID (Fields[1].strip ())
+    Fail ('no FILE_GUID in UsbJoyStickDxe.inf')
+
+def InsertAfter (Text, Anchor, Line, Path):
+    for Existing in Text.splitlines (True):
+        if Existing.strip ().split ()[-1:] == [Anchor] and not Existing.lstrip ().startswith ('#'):
+            Indent = Existing[:len (Existing) - len (Existing.lstrip ())]
+            return Text.replace (Existing, Existing + Indent + Line + Existing[len (Existing.rstrip ('\r\n')):], 1)
+    Fail ('%s not found in %s' % (Anchor, Path))
+
+def PreparePackages (Edk2, Scratch):
+    """
+    Lay out the scratch package directory: UsbJoyStickDxe linked to this
+    checkout, and BootBenchPkg holding copies of the OVMF DSC and FDF with
+    the driver listed after UsbKbDxe.
+    """
+    os.symlink (DRIVER_DIR, os.path.join (Scratch, 'UsbJoyStickDxe'))
+    os.mkdir (os.path.join (Scratch, BENCH_PKG))
+
+    with open (os.path.join (Edk2, PLATFORM_DSC), newline = '') as File:
+        Dsc = File.read ()
+    if 'PERFORMANCE_ENABLE' not in Dsc:
+        Fail ('%s has no PERFORMANCE_ENABLE, the firmware would keep no records' % PLATFORM_DSC)
+    Dsc = Dsc.replace (PLATFORM_FDF, BENCH_PKG + '/OvmfBootBench.fdf')
+    Dsc = Dsc.replace ('Build/OvmfX64', BENCH_OUTPUT)
+    Dsc = InsertAfter (Dsc, ANCHOR_INF, DRIVER_INF, PLATFORM_DSC)
+
+    with open (os.path.join (Edk2, PLATFORM_FDF), newline = '') as File:
+        Fdf = File.read ()
+    Fdf = InsertAfter (Fdf, ANCHOR_INF, 'INF  ' + DRIVER_INF, PLATFORM_FDF)
+
+    with open (os.path.join (Scratch, BENCH_PKG, 'OvmfBootBench.dsc'), 'w', newline = '') as File:
+        File.write (Dsc)
+    with open (os.path.join (Scratch, BENCH_PKG, 'OvmfBootBench.fdf'), 'w', newline = '') as File:
+        File.write (Fdf)
+
+def Build (Edk2, Scratch, Target, Toolchain):
+    Environment = dict (os.environ)
+    Environment['WORKSPACE']     = Edk2
+    Environment['PACKAGES_PATH'] = os.pathsep.join ([Edk2, Scratch])
+    Command = ('. ./edksetup.sh > /dev/null && build -q -a X64 -t %s -b %s -p %s/OvmfBootBench.dsc '
+               '-D PERFORMANCE_ENABLE=TRUE' % (Toolchain, Target, BENCH_PKG))
+    if subprocess.call (['bash', '-c', Command], cwd = Edk2, env = Environment) != 0:
+        Fail ('the OVMF build failed')
+
+def FirmwarePath (Edk2, Target, Toolchain):
+    return os.path.join (Edk2, BENCH_OUTPUT, '%s_%s' % (Target, Toolchain), 'FV', 'OVMF.fd')
+
+def ConfigName (Args):
+    Name = 'k%dt%ds%dh%d' % (Args.kbd, Args.tablet, Args.storage, Args.hubs)
+    if Args.passthrough:
+        Name += 'p'
+    return Name
+
+def UsbDevices (Args, Disk):
+    """
+    The xHCI controller with the hubs on its first ports and the devices
+    spread over the hub ports, or over the root ports without hubs.
+    """
+    Devices = ['-device', 'qemu-xhci,id=xhci']
+    for Hub in range (Args.hubs):
+        Devices += ['-device', 'usb-hub,bus=xhci.0,port=%d' % (Hub + 1)]
+
+    Ports = []
+    if Args.hubs == 0:
+        Ports = ['%d' % (Port + 1) for Port in range (XHCI_PORTS)]
+    for Port in range (HUB_PORTS):
+        for Hub in range (Args.hubs):
+            Ports.append ('%d.%d' % (Hub + 1, Port + 1))
+
+    Plugged = [('usb-kbd', '')] * Args.kbd + [('usb-tablet', '')] * Args.tablet
+    for Index in range (Args.storage):
+        Devices += ['-drive', 'if=none,id=disk%d,format=raw,file=%s,snapshot=on' % (Index, Disk)]
+        Plugged.append (('usb-storage', ',drive=disk%d' % Index))
+    if len (Plugged) > len (Ports):
+        Fail ('%d devices do not fit on %d ports, add --hubs' % (len (Plugged), len (Ports)))
+
+    for (Device, Extra), Port in zip (Plugged, Ports):
+        Devices += ['-device', '%s,bus=xhci.0,port=%s%s' % (Device, Port, Extra)]
+
+    if Args.passthrough:
+        Vendor, Product = Args.passthrough.split (':')
+        Devices += ['-device', 'usb-host,vendorid=0x%s,productid=0x%s' % (Vendor, Product)]
+    return Devices
+
+def Qmp (Path, Commands):
+    Connection = socket.socket (socket.AF_UNIX, socket.SOCK_STREAM)
+    Connection.connect (Path)
+    Stream = Connection.makefile ('rw')
+    Stream.readline ()
+    for Command in [{'execute': 'qmp_capabilities'}] + Commands:
+        Stream.write (json.dumps (Command) + '\n')
+        Stream.flush ()
+        while True:
+            Reply = json.loads (Stream.readline ())
+            if 'error' in Reply:
+                Fail ('QMP %s: %s' % (Command['execute'], Reply['error'].get ('desc')))
+            if 'return' in Reply:
+                break
+    Connection.close ()
+
+def Boot (Args, Firmware, Scratch, Disk):
+    """
+    Boot once up to the shell and save the guest memory.
+
+    @return The memory image.
+    """
+    Serial = os.path.join (Scratch, 'serial.log')
+    Socket = os.path.join (Scratch, 'qmp.sock')
+    Memory = os.path.join (Scratch, 'memory.bin')
+    for Path in (Serial, Socket, Memory):
+        if os.path.exists (Path):
+            os.unlink (Path)
+
+    Command = [Args.qemu, '-machine', 'q35,accel=tcg', '-m', str (GUEST_MEMORY_MB),
+               '-bios', Firmware, '-display', 'none', '-net', 'none', '-no-reboot',
+               '-serial', 'file:' + Serial, '-qmp', 'unix:%s,server=on,wait=off' % Socket]
+    Command += UsbDevices (Args, Disk)
+    Qemu = subprocess.Popen (Command, stdin = subprocess.DEVNULL)
+
+    try:
+        Deadline = time.time () + Args.timeout
+        while True:
+            if Qemu.poll () is not None:
+                Fail ('QEMU exited with %d before the shell' % Qemu.returncode)
+            if time.time () > Deadline:
+                Fail ('no shell on the serial console after %d s' % Args.timeout)
+            if os.path.exists (Serial):
+                with open (Serial, 'rb') as File:
+                    Log = File.read ()
+                if any (Marker in Log for Marker in SHELL_MARKERS):
+                    break
+            time.sleep (0.5)
+
+        Qmp (Socket, [{'execute': 'stop'},
+                      {'execute': 'pmemsave', 'arguments': {'val': 0, 'size': GUEST_MEMORY_MB << 20, 'filename': Memory}},
+                      {'execute': 'quit'}])
+        Qemu.wait (30)
+    finally:
+        if Qemu.poll () is None:
+            Qemu.kill ()
+            Qemu.wait ()
+
+    with open (Memory, 'rb') as File:
+        return File.read ()
+
+def FindFbpt (Memory):
+    """
+    Find the FPDT by its signature and checksum, and follow its boot
+    performance table pointer.
+
+    @return The FBPT records, without the FBPT header.
+    """
+    Offset = Memory.find (FPDT_SIGNATURE)
+    while Offset >= 0:
+        Length, = struct.unpack_from ('<I', Memory, Offset + 4)
+        if ACPI_HEADER_SIZE < Length <= 0x1000 and Offset + Length <= len (Memory) and \
+           sum (Memory[Offset:Offset + Length]) & 0xFF == 0:
+            Record = Offset + ACPI_HEADER_SIZE
+            while Record + 4 <= Offset + Length:
+                Type, RecordLength = struct.unpack_from ('<HB', Memory, Record)
+                if RecordLength == 0:
+                    break
+                if Type == FPDT_BOOT_POINTER_TYPE:
+                    Address, = struct.unpack_from ('<Q', Memory, Record + 8)
+                    if Memory[Address:Address + 4] != FBPT_SIGNATURE:
+                        Fail ('the FPDT points to no FBPT at 0x%x' % Address)
+                    TableLength, = struct.unpack_from ('<I', Memory, Address + 4)
+                    return Memory[Address + 8:Address + TableLength]
+                Record += RecordLength
+        Offset = Memory.find (FPDT_SIGNATURE, Offset + 1)
+    Fail ('no FPDT in guest memory')
+
+def DriverCalls (Records, FileGuid):
+    """
+    Pair the Supported() and Start() records of a driver by controller.
+
+    @return Lists of the Supported() and Start() durations in nanoseconds.
+    """
+    Pending   = {}
+    Supported = []
+    Start     = []
+    Offset    = 0
+    while Offset + 4 <= len (Records):
+        Type, Length = struct.unpack_from ('<HB', Records, Offset)
+        if Length == 0:
+            break
+        if Type in (FPDT_GUID_QWORD_EVENT_TYPE, FPDT_GUID_QWORD_STRING_TYPE) and Length >= GUID_QWORD_RECORD.size:
+            _, _, _, Progress, _, Timestamp, Guid, Controller = GUID_QWORD_RECORD.unpack_from (Records, Offset)
+            if uuid.UUID (bytes_le = Guid) == FileGuid:
+                if Progress in (MODULE_DB_SUPPORT_START_ID, MODULE_DB_START_ID):
+                    Pending[(Progress, Controller)] = Timestamp
+                elif Progress == MODULE_DB_SUPPORT_END_ID:
+                    Begin = Pending.pop ((MODULE_DB_SUPPORT_START_ID, Controller), None)
+                    if Begin is not None:
+                        Supported.append (Timestamp - Begin)
+                elif Progress == MODULE_DB_END_ID:
+                    Begin = Pending.pop ((MODULE_DB_START_ID, Controller), None)
+                    if Begin is not None:
+                        Start.append (Timestamp - Begin)
+        Offset += Length
+    return Supported, Start
+
+def Summarize (Boots):
+    """
+    The median over the boots of each metric.
+    """
+    Results = {}
+    for Metric in METRICS:
+        Results[Metric] = statistics.median ([Boot[Metric] for Boot in Boots])
+    return Results
+
+def Measure (Supported, Start):
+    return {
+        'supported_calls': len (Supported),
+        'supported_ns':    statistics.mean (Supported) if Supported else 0,
+        'start_calls':     len (Start),
+        'start_ns':        statistics.mean (Start) if Start else 0,
+        }
+
+def ReadBaseline (Path):
+    Baseline = {}
+    with open (Path) as File:
+        for Line in File:
+            Fields = Line.split ()
+            if len (Fields) == 3 and not Fields[0].startswith ('#'):
+                Baseline[(Fields[0], Fields[1])] = float (Fields[2])
+    return Baseline
+
+def WriteBaseline (Path, Config, Results):
+    Baseline = ReadBaseline (Path) if os.path.exists (Path) else {}
+    for Metric in METRICS:
+        Baseline[(Config, Metric)] = Results[Metric]
+    with open (Path, 'w') as File:
+        File.write ('# BootBench baseline, UsbJoyStickDxe DriverBinding calls and their mean\n'
+                    '# nanoseconds per device config. Regenerate with BootBench.py --update after\n'
+                    '# an intended change, on the machine the comparison runs on.\n')
+        for (Name, Metric), Value in sorted (Baseline.items (), key = lambda Item: (Item[0][0], METRICS.index (Item[0][1]))):
+            File.write ('%-12s %-16s %12.0f\n' % (Name, Metric, Value))
+
+def Compare (Config, Results, Baseline, Threshold):
+    """
+    @return The number of regressions.
+    """
+    Regressions = 0
+    for Metric in ('supported_ns', 'start_ns'):
+        Reference = Baseline.get ((Config, Metric))
+        if Reference is None or Reference == 0 or Results[Metric] == 0:
+            continue
+        Change = (Results[Metric] - Reference) * 100 / Reference
+        if Change > Threshold:
+            print ('regression   %-16s %12.0f  baseline %12.0f  %+.1f%%' % (Metric, Results[Metric], Reference, Change))
+            Regressions += 1
+    for Metric in ('supported_calls', 'start_calls'):
+        Reference = Baseline.get ((Config, Metric))
+        if Reference is not None and Results[Metric] != Reference:
+            print ('note         %-16s %12.0f  baseline %12.0f' % (Metric, Results[Metric], Reference))
+    return Regressions
+
+def main ():
+    Parser = argparse.ArgumentParser (description = 'Boot time cost of UsbJoyStickDxe in OVMF under QEMU.')
+    Parser.add_argument ('--edk2', required = True, help = 'edk2 tree with OvmfPkg and BaseTools built')
+    Parser.add_argument ('--skip-build', action = 'store_true', help = 'boot the firmware of the last build')
+    Parser.add_argument ('--target', default = 'RELEASE', choices = ('RELEASE', 'DEBUG', 'NOOPT'))
+    Parser.add_argument ('--toolchain', default = 'GCC5')
+    Parser.add_argument ('--qemu', default = 'qemu-system-x86_64')
+    Parser.add_argument ('--kbd', type = int, default = 2, help = 'usb-kbd devices (default 2)')
+    Parser.add_argument ('--tablet', type = int, default = 2, help = 'usb-tablet devices (default 2)')
+    Parser.add_argument ('--storage', type = int, default = 2, help = 'usb-storage devices (default 2)')
+    Parser.add_argument ('--hubs', type = int, default = 1, help = 'usb-hub devices holding them (default 1)')
+    Parser.add_argument ('--passthrough', metavar = 'VID:PID', help = 'host controller to bind, hex ids')
+    Parser.add_argument ('--boots', type = int, default = DEFAULT_BOOTS)
+    Parser.add_argument ('--timeout', type = int, default = DEFAULT_TIMEOUT, help = 'seconds to the shell per boot')
+    Parser.add_argument ('--baseline', metavar = 'FILE')
+    Parser.add_argument ('--threshold', type = float, default = DEFAULT_THRESHOLD, metavar = 'PCT')
+    Parser.add_argument ('--update', metavar = 'FILE')
+    Args = Parser.parse_args ()
+
+    if Args.boots < 1 or min (Args.kbd, Args.tablet, Args.storage, Args.hubs) < 0 or \
+       Args.hubs > XHCI_PORTS:
+        Parser.error ('counts out of range')
+
+    Edk2     = os.path.abspath (Args.edk2)
+    FileGuid = DriverFileGuid ()
+    Config   = ConfigName (Args)
+    Scratch  = tempfile.mkdtemp (prefix = 'BootBench')
+    try:
+        if not Args.skip_build:
+            PreparePackages (Edk2, Scratch)
+            Build (Edk2, Scratch, Args.target, Args.toolchain)
+        Firmware = FirmwarePath (Edk2, Args.target, Args.toolchain)
+        if not os.path.exists (Firmware):
+            Fail ('no firmware at %s' % Firmware)
+
+        Disk = os.path.join (Scratch, 'disk.img')
+        with open (Disk, 'wb') as File:
+            File.truncate (16 << 20)
+
+        Boots = []
+        for Index in range (Args.boots):
+            Supported, Start = DriverCalls (FindFbpt (Boot (Args, Firmware, Scratch, Disk)), FileGuid)
+            Boots.append (Measure (Supported, Start))
+            print ('boot %-7d supported %4d calls %10.0f ns  start %2d calls %12.0f ns' % (
+                   Index + 1, Boots[-1]['supported_calls'], Boots[-1]['supported_ns'],
+                   Boots[-1]['start_calls'], Boots[-1]['start_ns']))
+    finally:
+        shutil.rmtree (Scratch, ignore_errors = True)
+
+    Results = Summarize (Boots)
+    for Metric in METRICS:
+        print ('%-12s %-16s %12.0f' % (Config, Metric, Results[Metric]))
+
+    Regressions = 0
+    if Args.baseline:
+        Regressions = Compare (Config, Results, ReadBaseline (Args.baseline), Args.threshold)
+    if Args.update:
+        WriteBaseline (Args.update, Config, Results)
+    return 1 if Regressions else 0
+
+if __name__ == '__main__':
+    sys.exit (main ())
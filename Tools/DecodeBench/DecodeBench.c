@@ -0,0 +1,717 @@
+/** @file
+  Microbenchmarks of the decode path JoyStickHandler runs for every input
+  report, one stage at a time, in nanoseconds per report:
+
+    change    JoyStickDecodeButtons and the comparison with the last
+              buttons, where most reports leave the path.
+    edges     JoyStickDebounceButtons and the press and release edges.
+    sticks    JoyStickDecodeSticks and the adaptive stick filter.
+    imu       JoyStickDecodeImu of the three samples.
+    keys      JoyStickQueueKeys of the edges found.
+    queue     JoyStickEnqueueKey and JoyStickDequeueKey of one key.
+    process   JoyStickProcessReport, the stages together.
+
+  Every stage runs over the synthesized streams idle (a pad at rest), mash
+  (buttons pressed and bounced every few reports) and sweep (sticks moving
+  over their range), and over every --replay capture of back to back
+  JOYSTICK_REPORT_SIZE byte reports, the format UhidBridge replays. The
+  fastest of BENCH_PASSES passes is kept.
+
+  With --baseline the results are compared to a file of "<stream> <stage>
+  <ns>" lines. A result slower than its baseline by more than --threshold
+  percent, and by more than BENCH_SLACK_NS, is a regression and fails the
+  run. --update writes the results as a new baseline.
+
+  DecodeBench [--baseline FILE] [--threshold PCT] [--update FILE]
+              [--replay FILE]...
+
+  YIZD 2021
+
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "JoyStickCore.h"
+
+#define BENCH_SYNTH_REPORTS       4096
+#define BENCH_PASSES              64
+#define BENCH_MAX_STREAMS         16
+#define BENCH_DEFAULT_THRESHOLD   25
+#define BENCH_DEBOUNCE            2
+#define BENCH_STICK_CENTER        2048
+
+//
+// Absolute slack on top of the threshold, so stages costing a nanosecond
+// or two do not fail on timer noise.
+//
+#define BENCH_SLACK_NS            0.5
+
+//
+// Buttons the mash stream presses, the ones producing keys.
+//
+#define BENCH_MASH_BUTTONS        (JOYSTICK_BUTTON_UP | JOYSTICK_BUTTON_DOWN | \
+                                   JOYSTICK_BUTTON_LEFT | JOYSTICK_BUTTON_RIGHT | \
+                                   JOYSTICK_BUTTON_A | JOYSTICK_BUTTON_B | \
+                                   JOYSTICK_BUTTON_X | JOYSTICK_BUTTON_Y | \
+                                   JOYSTICK_BUTTON_PLUS | JOYSTICK_BUTTON_MINUS | \
+                                   JOYSTICK_BUTTON_L | JOYSTICK_BUTTON_R)
+
+typedef struct {
+  CONST char  *Name;
+  UINT8       (*Reports)[JOYSTICK_REPORT_SIZE];
+  UINTN       Count;
+  ///
+  /// Raw buttons of each report, and the press and release edges the
+  /// debounced decoder finds in it.
+  ///
+  UINT32      *Buttons;
+  UINT32      *Edges;
+} BENCH_STREAM;
+
+typedef struct {
+  JOYSTICK_DECODER      Decoder;
+  JOYSTICK_IMU_SCALE    Scale;
+} BENCH_STATE;
+
+typedef struct {
+  CONST char  *Name;
+  UINT64      (*Run)(IN OUT BENCH_STATE *State, IN CONST BENCH_STREAM *Stream);
+} BENCH_STAGE;
+
+typedef struct {
+  char        Stream[64];
+  char        Stage[16];
+  double      Ns;
+} BENCH_BASELINE;
+
+//
+// Stick filter of the Pro Controller entry of the driver's model table.
+//
+STATIC CONST JOYSTICK_STICK_FILTER_PARAMS  mBenchStickFilter = { 125, 1000, 8000, 5000 };
+
+//
+// Results of the stages, kept where the compiler cannot drop them.
+//
+STATIC volatile UINT64  mBenchSink;
+
+STATIC UINT32           mBenchRandom = 1;
+
+/**
+  Return CLOCK_MONOTONIC in nanoseconds.
+
+**/
+STATIC
+UINT64
+BenchNow (
+  VOID
+  )
+{
+  struct timespec   Now;
+
+  clock_gettime (CLOCK_MONOTONIC, &Now);
+  return (UINT64) Now.tv_sec * 1000000000ULL + (UINT64) Now.tv_nsec;
+}
+
+STATIC
+UINT32
+BenchRandom (
+  VOID
+  )
+{
+  mBenchRandom ^= mBenchRandom << 13;
+  mBenchRandom ^= mBenchRandom >> 17;
+  mBenchRandom ^= mBenchRandom << 5;
+  return mBenchRandom;
+}
+
+/**
+  Fill a full (0x30) report: buttons, sticks and IMU samples of a few
+  counts of noise around rest.
+
+**/
+STATIC
+VOID
+BenchPackReport (
+  OUT UINT8         *Report,
+  IN  UINTN         Index,
+  IN  UINT32        Buttons,
+  IN  CONST UINT16  *Axes
+  )
+{
+  UINTN     Pair;
+  UINTN     Value;
+  INT16     Imu;
+
+  ZeroMem (Report, JOYSTICK_REPORT_SIZE);
+  Report[0] = JOYSTICK_IN_FULL;
+  Report[1] = (UINT8) Index;
+  Report[2] = 0x8E;
+  Report[JOYSTICK_BUTTON_OFFSET]     = (UINT8) Buttons;
+  Report[JOYSTICK_BUTTON_OFFSET + 1] = (UINT8) (Buttons >> 8);
+  Report[JOYSTICK_BUTTON_OFFSET + 2] = (UINT8) (Buttons >> 16);
+
+  for (Pair = 0; Pair < 2; Pair++) {
+    Report[JOYSTICK_STICK_OFFSET + Pair * 3]     = (UINT8) Axes[Pair * 2];
+    Report[JOYSTICK_STICK_OFFSET + Pair * 3 + 1] = (UINT8) (((Axes[Pair * 2] >> 8) & 0x0F) |
+                                                            ((Axes[Pair * 2 + 1] & 0x0F) << 4));
+    Report[JOYSTICK_STICK_OFFSET + Pair * 3 + 2] = (UINT8) (Axes[Pair * 2 + 1] >> 4);
+  }
+
+  for (Value = 0; Value < JOYSTICK_IMU_VALUES; Value++) {
+    Imu = (INT16) ((INT32) (BenchRandom () % 33) - 16);
+    Report[JOYSTICK_IMU_OFFSET + Value * 2]     = (UINT8) Imu;
+    Report[JOYSTICK_IMU_OFFSET + Value * 2 + 1] = (UINT8) ((UINT16) Imu >> 8);
+  }
+}
+
+/**
+  Synthesize a stream.
+
+  idle     No button, sticks within two counts of center.
+  mash     A random set of key buttons every four reports, one in four
+           presses bouncing for a report.
+  sweep    No button, both sticks swept edge to edge out of phase.
+
+  @retval 0                The stream was generated.
+  @retval -1               Out of memory.
+
+**/
+STATIC
+int
+BenchSynthesize (
+  IN  CONST char      *Name,
+  OUT BENCH_STREAM    *Stream
+  )
+{
+  UINTN     Index;
+  UINTN     Axis;
+  UINT32    Buttons;
+  UINT32    Held;
+  UINT16    Axes[JOYSTICK_STICK_AXES];
+  UINTN     Phase;
+
+  Stream->Name    = Name;
+  Stream->Count   = BENCH_SYNTH_REPORTS;
+  Stream->Reports = calloc (Stream->Count, JOYSTICK_REPORT_SIZE);
+  if (Stream->Reports == NULL) {
+    return -1;
+  }
+
+  Held = 0;
+  for (Index = 0; Index < Stream->Count; Index++) {
+    Buttons = 0;
+    for (Axis = 0; Axis < JOYSTICK_STICK_AXES; Axis++) {
+      Axes[Axis] = (UINT16) (BENCH_STICK_CENTER - 2 + BenchRandom () % 5);
+    }
+
+    if (strcmp (Name, "mash") == 0) {
+      if (Index % 4 == 0) {
+        Held = BenchRandom () & BENCH_MASH_BUTTONS;
+      }
+      Buttons = Held;
+      if (Index % 4 == 1 && (BenchRandom () & 3) == 0) {
+        Buttons = 0;
+      }
+    } else if (strcmp (Name, "sweep") == 0) {
+      for (Axis = 0; Axis < JOYSTICK_STICK_AXES; Axis++) {
+        Phase      = (Index * 32 + Axis * 1024) % 8192;
+        Axes[Axis] = (UINT16) (Phase < 4096 ? Phase : 8191 - Phase);
+      }
+    }
+
+    BenchPackReport (Stream->Reports[Index], Index, Buttons, Axes);
+  }
+  return 0;
+}
+
+/**
+  Load a capture of back to back JOYSTICK_REPORT_SIZE byte reports.
+
+  @retval 0                The file was loaded.
+  @retval -1               The file could not be read or holds no report.
+
+**/
+STATIC
+int
+BenchLoadReplay (
+  IN  CONST char      *Path,
+  OUT BENCH_STREAM    *Stream
+  )
+{
+  FILE      *File;
+  long      Size;
+
+  File = fopen (Path, "rb");
+  if (File == NULL) {
+    perror (Path);
+    return -1;
+  }
+
+  fseek (File, 0, SEEK_END);
+  Size = ftell (File);
+  fseek (File, 0, SEEK_SET);
+
+  Stream->Name    = strrchr (Path, '/') != NULL ? strrchr (Path, '/') + 1 : Path;
+  Stream->Count   = (UINTN) Size / JOYSTICK_REPORT_SIZE;
+  Stream->Reports = calloc (Stream->Count ? Stream->Count : 1, JOYSTICK_REPORT_SIZE);
+  if (Stream->Count == 0 || Stream->Reports == NULL ||
+      fread (Stream->Reports, JOYSTICK_REPORT_SIZE, Stream->Count, File) != Stream->Count) {
+    fprintf (stderr, "%s: no complete %d byte report\n", Path, JOYSTICK_REPORT_SIZE);
+    fclose (File);
+    return -1;
+  }
+
+  fclose (File);
+  return 0;
+}
+
+/**
+  Bring a state to the one of a freshly bound Pro Controller.
+
+**/
+STATIC
+VOID
+BenchReset (
+  OUT BENCH_STATE   *State
+  )
+{
+  JoyStickInitDecoder (&State->Decoder);
+  JoyStickSetDebounce (&State->Decoder, BENCH_DEBOUNCE);
+  JoyStickSetStickFilter (&State->Decoder, &mBenchStickFilter);
+  JoyStickSetImuScale (NULL, &State->Scale);
+}
+
+/**
+  Fill in the raw buttons and the key edges of a stream, so the edge and
+  key stages are fed what the stages before them produce.
+
+  @retval 0                The stream was prepared.
+  @retval -1               Out of memory.
+
+**/
+STATIC
+int
+BenchPrepare (
+  IN OUT BENCH_STREAM   *Stream
+  )
+{
+  BENCH_STATE   State;
+  UINT8         Full[JOYSTICK_REPORT_SIZE];
+  CONST UINT8   *Report;
+  UINT32        Buttons;
+  UINTN         Index;
+
+  Stream->Buttons = calloc (Stream->Count, sizeof (UINT32));
+  Stream->Edges   = calloc (Stream->Count, sizeof (UINT32));
+  if (Stream->Buttons == NULL || Stream->Edges == NULL) {
+    return -1;
+  }
+
+  BenchReset (&State);
+  for (Index = 0; Index < Stream->Count; Index++) {
+    Report = Stream->Reports[Index];
+    if (Report[0] == JOYSTICK_IN_SIMPLE_HID) {
+      JoyStickNormalizeSimpleReport (Report, Full);
+      Report = Full;
+    }
+    Stream->Buttons[Index] = JoyStickDecodeButtons (Report);
+
+    Buttons = State.Decoder.Buttons;
+    JoyStickProcessReport (&State.Decoder, Stream->Reports[Index], Index);
+    Stream->Edges[Index] = Buttons ^ State.Decoder.Buttons;
+    State.Decoder.Keys.Head = State.Decoder.Keys.Tail;
+  }
+  return 0;
+}
+
+STATIC
+UINT64
+BenchChange (
+  IN OUT BENCH_STATE          *State,
+  IN     CONST BENCH_STREAM   *Stream
+  )
+{
+  UINT32    Last;
+  UINT32    Buttons;
+  UINT64    Changes;
+  UINTN     Index;
+
+  Last    = State->Decoder.Buttons;
+  Changes = 0;
+  for (Index = 0; Index < Stream->Count; Index++) {
+    Buttons  = JoyStickDecodeButtons (Stream->Reports[Index]);
+    Changes += (Buttons != Last);
+    Last     = Buttons;
+  }
+  return Changes;
+}
+
+STATIC
+UINT64
+BenchEdges (
+  IN OUT BENCH_STATE          *State,
+  IN     CONST BENCH_STREAM   *Stream
+  )
+{
+  JOYSTICK_DECODER  *Decoder;
+  UINT32            Buttons;
+  UINT64            Edges;
+  UINTN             Index;
+
+  Decoder = &State->Decoder;
+  Edges   = 0;
+  for (Index = 0; Index < Stream->Count; Index++) {
+    Buttons = JoyStickDebounceButtons (&Decoder->Debounce, Stream->Buttons[Index]);
+    Edges  += (Buttons & ~Decoder->Buttons & Decoder->PressKeys) |
+              (Decoder->Buttons & ~Buttons & Decoder->ReleaseKeys);
+    Decoder->Buttons = Buttons;
+  }
+  return Edges;
+}
+
+STATIC
+UINT64
+BenchSticks (
+  IN OUT BENCH_STATE          *State,
+  IN     CONST BENCH_STREAM   *Stream
+  )
+{
+  UINT16    Raw[JOYSTICK_STICK_AXES];
+  UINT16    Filtered[JOYSTICK_STICK_AXES];
+  UINT64    Sum;
+  UINTN     Index;
+
+  Sum = 0;
+  for (Index = 0; Index < Stream->Count; Index++) {
+    JoyStickDecodeSticks (Stream->Reports[Index], Raw);
+    JoyStickFilterSticks (&State->Decoder.StickFilter, Raw, Filtered);
+    Sum += Filtered[0] + Filtered[3];
+  }
+  return Sum;
+}
+
+STATIC
+UINT64
+BenchImu (
+  IN OUT BENCH_STATE          *State,
+  IN     CONST BENCH_STREAM   *Stream
+  )
+{
+  INT32     Values[JOYSTICK_IMU_VALUES];
+  UINT64    Sum;
+  UINTN     Index;
+
+  Sum = 0;
+  for (Index = 0; Index < Stream->Count; Index++) {
+    JoyStickDecodeImu (Stream->Reports[Index], &State->Scale, Values);
+    Sum += (UINT32) (Values[0] + Values[JOYSTICK_IMU_VALUES - 1]);
+  }
+  return Sum;
+}
+
+STATIC
+UINT64
+BenchKeys (
+  IN OUT BENCH_STATE          *State,
+  IN     CONST BENCH_STREAM   *Stream
+  )
+{
+  JOYSTICK_KEY_QUEUE  *Queue;
+  UINT64              Keys;
+  UINTN               Index;
+
+  Queue = &State->Decoder.Keys;
+  Keys  = 0;
+  for (Index = 0; Index < Stream->Count; Index++) {
+    if (Stream->Edges[Index] != 0) {
+      Keys += JoyStickQueueKeys (Queue, Stream->Edges[Index], JOYSTICK_KEY_PRESS, Index);
+      Queue->Head = Queue->Tail;
+    }
+  }
+  return Keys;
+}
+
+STATIC
+UINT64
+BenchQueue (
+  IN OUT BENCH_STATE          *State,
+  IN     CONST BENCH_STREAM   *Stream
+  )
+{
+  JOYSTICK_KEY_QUEUE  *Queue;
+  JOYSTICK_KEY_ENTRY  Entry;
+  UINT64              Sum;
+  UINTN               Index;
+
+  Queue = &State->Decoder.Keys;
+  ZeroMem (&Entry, sizeof (Entry));
+  Sum = 0;
+  for (Index = 0; Index < Stream->Count; Index++) {
+    Entry.Arrival = Index;
+    JoyStickEnqueueKey (Queue, &Entry);
+    JoyStickDequeueKey (Queue, &Entry);
+    Sum += Entry.Arrival;
+  }
+  return Sum;
+}
+
+STATIC
+UINT64
+BenchProcess (
+  IN OUT BENCH_STATE          *State,
+  IN     CONST BENCH_STREAM   *Stream
+  )
+{
+  UINT64    Changes;
+  UINTN     Index;
+
+  Changes = 0;
+  for (Index = 0; Index < Stream->Count; Index++) {
+    Changes += JoyStickProcessReport (&State->Decoder, Stream->Reports[Index], Index);
+    State->Decoder.Keys.Head = State->Decoder.Keys.Tail;
+  }
+  return Changes;
+}
+
+STATIC CONST BENCH_STAGE  mBenchStages[] = {
+  { "change",  BenchChange  },
+  { "edges",   BenchEdges   },
+  { "sticks",  BenchSticks  },
+  { "imu",     BenchImu     },
+  { "keys",    BenchKeys    },
+  { "queue",   BenchQueue   },
+  { "process", BenchProcess }
+};
+
+/**
+  Time a stage over a stream.
+
+  @return The fastest pass in nanoseconds per report.
+
+**/
+STATIC
+double
+BenchMeasure (
+  IN CONST BENCH_STAGE    *Stage,
+  IN CONST BENCH_STREAM   *Stream
+  )
+{
+  BENCH_STATE   State;
+  UINT64        Best;
+  UINT64        Begin;
+  UINT64        Elapsed;
+  UINTN         Pass;
+
+  Best = (UINT64) -1;
+  for (Pass = 0; Pass < BENCH_PASSES; Pass++) {
+    BenchReset (&State);
+    Begin       = BenchNow ();
+    mBenchSink += Stage->Run (&State, Stream);
+    Elapsed     = BenchNow () - Begin;
+    Best        = MIN (Best, Elapsed);
+  }
+  return (double) Best / (double) Stream->Count;
+}
+
+/**
+  Load a baseline file. Lines are "<stream> <stage> <ns>", '#' starts a
+  comment.
+
+  @return The number of entries, or -1 if the file could not be read.
+
+**/
+STATIC
+int
+BenchLoadBaseline (
+  IN  CONST char        *Path,
+  OUT BENCH_BASELINE    *Baseline,
+  IN  UINTN             Capacity
+  )
+{
+  FILE      *File;
+  char      Line[256];
+  UINTN     Count;
+  UINTN     Number;
+
+  File = fopen (Path, "r");
+  if (File == NULL) {
+    perror (Path);
+    return -1;
+  }
+
+  Count  = 0;
+  Number = 0;
+  while (fgets (Line, sizeof (Line), File) != NULL) {
+    Number++;
+    if (strchr (Line, '#') != NULL) {
+      *strchr (Line, '#') = '\0';
+    }
+    if (strspn (Line, " \t\r\n") == strlen (Line)) {
+      continue;
+    }
+    if (Count == Capacity ||
+        sscanf (Line, "%63s %15s %lf", Baseline[Count].Stream, Baseline[Count].Stage, &Baseline[Count].Ns) != 3) {
+      fprintf (stderr, "%s:%lu: expected \"<stream> <stage> <ns>\"\n", Path, (unsigned long) Number);
+      fclose (File);
+      return -1;
+    }
+    Count++;
+  }
+
+  fclose (File);
+  return (int) Count;
+}
+
+STATIC
+CONST BENCH_BASELINE *
+BenchFindBaseline (
+  IN CONST BENCH_BASELINE   *Baseline,
+  IN UINTN                  Count,
+  IN CONST char             *Stream,
+  IN CONST char             *Stage
+  )
+{
+  UINTN   Index;
+
+  for (Index = 0; Index < Count; Index++) {
+    if (strcmp (Baseline[Index].Stream, Stream) == 0 && strcmp (Baseline[Index].Stage, Stage) == 0) {
+      return &Baseline[Index];
+    }
+  }
+  return NULL;
+}
+
+STATIC
+VOID
+BenchUsage (
+  VOID
+  )
+{
+  fprintf (
+    stderr,
+    "Usage: DecodeBench [--baseline FILE] [--threshold PCT] [--update FILE] [--replay FILE]...\n"
+    "  --baseline FILE  Fail on a stage slower than its baseline in FILE.\n"
+    "  --threshold PCT  Slowdown allowed over the baseline (default %d).\n"
+    "  --update FILE    Write the results to FILE as the new baseline.\n"
+    "  --replay FILE    Also time a capture of back to back %d byte reports.\n",
+    BENCH_DEFAULT_THRESHOLD,
+    JOYSTICK_REPORT_SIZE
+    );
+}
+
+int
+main (
+  int   argc,
+  char  **argv
+  )
+{
+  STATIC CONST char       *SynthNames[] = { "idle", "mash", "sweep" };
+  STATIC BENCH_BASELINE   Baseline[BENCH_MAX_STREAMS * ARRAY_SIZE (mBenchStages)];
+  BENCH_STREAM            Streams[BENCH_MAX_STREAMS];
+  CONST BENCH_BASELINE    *Base;
+  CONST char              *BaselinePath;
+  CONST char              *UpdatePath;
+  FILE                    *Update;
+  UINTN                   StreamCount;
+  UINTN                   BaselineCount;
+  UINTN                   Threshold;
+  UINTN                   Regressions;
+  UINTN                   Stream;
+  UINTN                   Stage;
+  double                  Ns;
+  int                     Loaded;
+  int                     Index;
+
+  BaselinePath = NULL;
+  UpdatePath   = NULL;
+  Threshold    = BENCH_DEFAULT_THRESHOLD;
+  StreamCount  = 0;
+  ZeroMem (Streams, sizeof (Streams));
+
+  for (Index = 0; Index < (int) ARRAY_SIZE (SynthNames); Index++) {
+    if (BenchSynthesize (SynthNames[Index], &Streams[StreamCount++]) != 0) {
+      fprintf (stderr, "out of memory\n");
+      return 1;
+    }
+  }
+
+  for (Index = 1; Index < argc; Index++) {
+    if (strcmp (argv[Index], "--baseline") == 0 && Index + 1 < argc) {
+      BaselinePath = argv[++Index];
+    } else if (strcmp (argv[Index], "--threshold") == 0 && Index + 1 < argc) {
+      Threshold = strtoul (argv[++Index], NULL, 0);
+    } else if (strcmp (argv[Index], "--update") == 0 && Index + 1 < argc) {
+      UpdatePath = argv[++Index];
+    } else if (strcmp (argv[Index], "--replay") == 0 && Index + 1 < argc && StreamCount < BENCH_MAX_STREAMS) {
+      if (BenchLoadReplay (argv[++Index], &Streams[StreamCount++]) != 0) {
+        return 1;
+      }
+    } else {
+      BenchUsage ();
+      return 2;
+    }
+  }
+
+  BaselineCount = 0;
+  if (BaselinePath != NULL) {
+    Loaded = BenchLoadBaseline (BaselinePath, Baseline, ARRAY_SIZE (Baseline));
+    if (Loaded < 0) {
+      return 1;
+    }
+    BaselineCount = (UINTN) Loaded;
+  }
+
+  Update = NULL;
+  if (UpdatePath != NULL) {
+    Update = fopen (UpdatePath, "w");
+    if (Update == NULL) {
+      perror (UpdatePath);
+      return 1;
+    }
+    fprintf (
+      Update,
+      "# DecodeBench baseline, nanoseconds per report of each stage over each\n"
+      "# stream. Regenerate with DecodeBench --update after an intended change,\n"
+      "# on the machine the comparison runs on.\n"
+      );
+  }
+
+  Regressions = 0;
+  printf ("%-12s %-8s %10s %10s %8s\n", "stream", "stage", "ns/report", "baseline", "change");
+  for (Stream = 0; Stream < StreamCount; Stream++) {
+    if (BenchPrepare (&Streams[Stream]) != 0) {
+      fprintf (stderr, "out of memory\n");
+      return 1;
+    }
+    for (Stage = 0; Stage < ARRAY_SIZE (mBenchStages); Stage++) {
+      Ns   = BenchMeasure (&mBenchStages[Stage], &Streams[Stream]);
+      Base = BenchFindBaseline (Baseline, BaselineCount, Streams[Stream].Name, mBenchStages[Stage].Name);
+      printf ("%-12s %-8s %10.2f", Streams[Stream].Name, mBenchStages[Stage].Name, Ns);
+      if (Base == NULL) {
+        printf ("\n");
+      } else if (Ns > Base->Ns * (100 + Threshold) / 100 && Ns > Base->Ns + BENCH_SLACK_NS) {
+        printf (" %10.2f %+7.0f%%  REGRESSION\n", Base->Ns, (Ns / Base->Ns - 1) * 100);
+        Regressions++;
+      } else {
+        printf (" %10.2f %+7.0f%%\n", Base->Ns, (Ns / Base->Ns - 1) * 100);
+      }
+      if (Update != NULL) {
+        fprintf (Update, "%-12s %-8s %8.2f\n", Streams[Stream].Name, mBenchStages[Stage].Name, Ns);
+      }
+    }
+  }
+
+  if (Update != NULL) {
+    fclose (Update);
+  }
+
+  if (Regressions != 0) {
+    fprintf (stderr, "%lu stage(s) slower than the baseline by more than %lu%%\n",
+      (unsigned long) Regressions, (unsigned long) Threshold);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,1226 @@
+/** @file
+  Minimal DXE environment for running the USB JoyStick driver in host tools.
+
+  Provides the boot services, libraries and GUIDs declared by HostDxe.h on a
+  virtual clock. There is one processor and no real interrupts: the device
+  model and timer events run when the clock is advanced, and notifications
+  held off by a raised TPL run when it is restored, as they would on the
+  firmware's timer interrupt.
+
+  YIZD 2021
+
+**/
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <HostDxe.h>
+
+#define HOST_MAX_PROTOCOLS        16
+#define HOST_MAX_HANDLES          64
+#define HOST_MAX_EVENTS           64
+#define HOST_MAX_CONFIG_TABLES    8
+#define HOST_MAX_VARIABLES        16
+#define HOST_MAX_VARIABLE_NAME    64
+
+typedef struct {
+  EFI_GUID    *Guid;
+  VOID        *Interface;
+  EFI_HANDLE  OpenedByDriver;
+} HOST_PROTOCOL;
+
+typedef struct {
+  BOOLEAN         InUse;
+  UINTN           Count;
+  HOST_PROTOCOL   Protocols[HOST_MAX_PROTOCOLS];
+} HOST_HANDLE;
+
+typedef struct {
+  BOOLEAN           InUse;
+  UINT32            Type;
+  EFI_TPL           NotifyTpl;
+  EFI_EVENT_NOTIFY  Notify;
+  VOID              *Context;
+  BOOLEAN           Signaled;
+  BOOLEAN           NotifyPending;
+  EFI_TIMER_DELAY   TimerType;
+  UINT64            Period;
+  UINT64            Trigger;
+} HOST_EVENT;
+
+typedef struct {
+  EFI_GUID    *Guid;
+  VOID        *Table;
+} HOST_CONFIG_TABLE;
+
+typedef struct {
+  BOOLEAN     InUse;
+  CHAR16      Name[HOST_MAX_VARIABLE_NAME];
+  EFI_GUID    Guid;
+  UINT32      Attributes;
+  UINTN       Size;
+  VOID        *Data;
+} HOST_VARIABLE;
+
+EFI_GUID  gEfiUsbIoProtocolGuid             = { 0x2B2F68D6, 0x0CD2, 0x44CF, { 0x8E, 0x8B, 0xBB, 0xA2, 0x0B, 0x1B, 0x5B, 0x75 } };
+EFI_GUID  gEfiDevicePathProtocolGuid        = { 0x09576E91, 0x6D3F, 0x11D2, { 0x8E, 0x39, 0x00, 0xA0, 0xC9, 0x69, 0x72, 0x3B } };
+EFI_GUID  gEfiSimpleTextInProtocolGuid      = { 0x387477C1, 0x69C7, 0x11D2, { 0x8E, 0x39, 0x00, 0xA0, 0xC9, 0x69, 0x72, 0x3B } };
+EFI_GUID  gEfiSimpleTextInputExProtocolGuid = { 0xDD9E7534, 0x7762, 0x4698, { 0x8C, 0x14, 0xF5, 0x85, 0x17, 0xA6, 0x25, 0xAA } };
+EFI_GUID  gEfiSimpleTextOutProtocolGuid     = { 0x387477C2, 0x69C7, 0x11D2, { 0x8E, 0x39, 0x00, 0xA0, 0xC9, 0x69, 0x72, 0x3B } };
+EFI_GUID  gEfiDriverBindingProtocolGuid     = { 0x18A031AB, 0xB443, 0x4D1A, { 0xA5, 0xC0, 0x0C, 0x09, 0x26, 0x1E, 0x9F, 0x71 } };
+
+//
+// Package GUIDs, as declared in UsbJoyStickDxe.dec.
+//
+EFI_GUID  gUsbJoyStickTraceGuid             = { 0x4ba8f3b2, 0xc1a1, 0x48b3, { 0xa2, 0xcc, 0xdb, 0x14, 0xad, 0x0b, 0x2a, 0xd3 } };
+EFI_GUID  gUsbJoyStickCalibrationGuid       = { 0x956dfb26, 0x302f, 0x4576, { 0xa7, 0x65, 0xb1, 0xe2, 0xf9, 0xa5, 0x35, 0x06 } };
+EFI_GUID  gUsbJoyStickMotionProtocolGuid    = { 0x8076d9ec, 0x44f0, 0x45d2, { 0x87, 0xb4, 0xb4, 0x08, 0x94, 0xae, 0x8c, 0xcc } };
+EFI_GUID  gUsbJoyStickKeyInfoProtocolGuid   = { 0x9f630489, 0xd696, 0x4e48, { 0xad, 0x48, 0x79, 0x4b, 0x49, 0x08, 0x77, 0x1d } };
+EFI_GUID  gUsbJoyStickStateProtocolGuid     = { 0x0355cffd, 0x5510, 0x4206, { 0xbf, 0x6f, 0x70, 0xee, 0x53, 0x80, 0x6c, 0xff } };
+EFI_GUID  gUsbJoyStickReportProtocolGuid    = { 0xf5c2fdd0, 0xb07d, 0x460a, { 0xad, 0xd8, 0x8e, 0xc2, 0xc9, 0x18, 0xae, 0xaa } };
+EFI_GUID  gUsbJoyStickStatsProtocolGuid     = { 0x7ee380aa, 0x9938, 0x40b2, { 0xac, 0xc7, 0x9b, 0x06, 0x37, 0x06, 0x8b, 0x94 } };
+
+STATIC UINT64             mHostNow;
+STATIC EFI_TPL            mHostTpl = TPL_APPLICATION;
+STATIC UINTN              mHostDispatchDepth;
+STATIC HOST_HANDLE        mHostHandles[HOST_MAX_HANDLES];
+STATIC HOST_EVENT         mHostEvents[HOST_MAX_EVENTS];
+STATIC HOST_CONFIG_TABLE  mHostConfigTables[HOST_MAX_CONFIG_TABLES];
+STATIC HOST_VARIABLE      mHostVariables[HOST_MAX_VARIABLES];
+
+STATIC
+UINTN
+HostStrLen (
+  IN CONST CHAR16   *String
+  );
+STATIC UINT64             (*mHostDevicePoll)(IN UINT64 Now, IN VOID *Context);
+STATIC VOID               *mHostDeviceContext;
+
+/**
+  Report a failed ASSERT and abort.
+
+**/
+VOID
+HostAssert (
+  IN CONST CHAR8  *FileName,
+  IN UINTN        LineNumber,
+  IN CONST CHAR8  *Description
+  )
+{
+  fprintf (stderr, "ASSERT %s(%u): %s\n", FileName, (unsigned) LineNumber, Description);
+  abort ();
+}
+
+STATIC
+BOOLEAN
+HostGuidEqual (
+  IN CONST EFI_GUID   *Left,
+  IN CONST EFI_GUID   *Right
+  )
+{
+  return (BOOLEAN) (memcmp (Left, Right, sizeof (EFI_GUID)) == 0);
+}
+
+//
+// Events and TPL.
+//
+
+/**
+  Run the pending notifications the current TPL no longer holds off,
+  highest notification TPL first.
+
+**/
+STATIC
+VOID
+HostDispatchNotifies (
+  VOID
+  )
+{
+  HOST_EVENT  *Event;
+  HOST_EVENT  *Best;
+  EFI_TPL     Saved;
+  UINTN       Index;
+
+  for (;;) {
+    Best = NULL;
+    for (Index = 0; Index < HOST_MAX_EVENTS; Index++) {
+      Event = &mHostEvents[Index];
+      if (Event->InUse && Event->NotifyPending && Event->NotifyTpl > mHostTpl &&
+          (Best == NULL || Event->NotifyTpl > Best->NotifyTpl)) {
+        Best = Event;
+      }
+    }
+    if (Best == NULL) {
+      return;
+    }
+
+    Best->NotifyPending = FALSE;
+    Saved    = mHostTpl;
+    mHostTpl = Best->NotifyTpl;
+    Best->Notify ((EFI_EVENT) Best, Best->Context);
+    mHostTpl = Saved;
+  }
+}
+
+/**
+  Run the device model and signal the expired timers.
+
+  @return The time of the next device or timer event.
+
+**/
+STATIC
+UINT64
+HostDispatch (
+  VOID
+  )
+{
+  HOST_EVENT  *Event;
+  UINT64      Next;
+  UINTN       Index;
+
+  Next = MAX_UINT64;
+  mHostDispatchDepth++;
+
+  if (mHostDevicePoll != NULL) {
+    Next = mHostDevicePoll (mHostNow, mHostDeviceContext);
+  }
+
+  for (Index = 0; Index < HOST_MAX_EVENTS; Index++) {
+    Event = &mHostEvents[Index];
+    if (!Event->InUse || Event->TimerType == TimerCancel) {
+      continue;
+    }
+    if (Event->Trigger <= mHostNow) {
+      gBS->SignalEvent ((EFI_EVENT) Event);
+      if (Event->TimerType == TimerPeriodic && Event->Period != 0) {
+        Event->Trigger += Event->Period;
+      } else {
+        Event->TimerType = TimerCancel;
+        continue;
+      }
+    }
+    Next = MIN (Next, Event->Trigger);
+  }
+
+  if (mHostDispatchDepth == 1) {
+    HostDispatchNotifies ();
+  }
+  mHostDispatchDepth--;
+  return Next;
+}
+
+STATIC
+EFI_TPL
+EFIAPI
+HostRaiseTpl (
+  IN EFI_TPL  NewTpl
+  )
+{
+  EFI_TPL   OldTpl;
+
+  OldTpl   = mHostTpl;
+  mHostTpl = MAX (NewTpl, OldTpl);
+  return OldTpl;
+}
+
+STATIC
+VOID
+EFIAPI
+HostRestoreTpl (
+  IN EFI_TPL  OldTpl
+  )
+{
+  EFI_TPL   Previous;
+
+  Previous = mHostTpl;
+  mHostTpl = OldTpl;
+
+  //
+  // Work held off while the TPL was raised runs as it drops, as the
+  // firmware's timer interrupt would.
+  //
+  if (OldTpl < Previous && mHostDispatchDepth == 0) {
+    HostDispatch ();
+  }
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction,
+  IN  VOID              *NotifyContext,
+  OUT EFI_EVENT         *Event
+  )
+{
+  UINTN   Index;
+
+  if (Event == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  for (Index = 0; Index < HOST_MAX_EVENTS; Index++) {
+    if (!mHostEvents[Index].InUse) {
+      ZeroMem (&mHostEvents[Index], sizeof (HOST_EVENT));
+      mHostEvents[Index].InUse     = TRUE;
+      mHostEvents[Index].Type      = Type;
+      mHostEvents[Index].NotifyTpl = NotifyTpl;
+      mHostEvents[Index].Notify    = NotifyFunction;
+      mHostEvents[Index].Context   = NotifyContext;
+      mHostEvents[Index].TimerType = TimerCancel;
+      *Event = (EFI_EVENT) &mHostEvents[Index];
+      return EFI_SUCCESS;
+    }
+  }
+  return EFI_OUT_OF_RESOURCES;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostSetTimer (
+  IN EFI_EVENT        Event,
+  IN EFI_TIMER_DELAY  Type,
+  IN UINT64           TriggerTime
+  )
+{
+  HOST_EVENT  *HostEvent;
+
+  HostEvent = (HOST_EVENT *) Event;
+  if ((HostEvent->Type & EVT_TIMER) == 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  //
+  // TriggerTime is in 100ns units.
+  //
+  HostEvent->TimerType = Type;
+  HostEvent->Period    = TriggerTime * 100;
+  HostEvent->Trigger   = mHostNow + MAX (HostEvent->Period, (UINT64) 1);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostSignalEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  HOST_EVENT  *HostEvent;
+
+  HostEvent = (HOST_EVENT *) Event;
+  HostEvent->Signaled = TRUE;
+  if ((HostEvent->Type & EVT_NOTIFY_SIGNAL) != 0 && HostEvent->Notify != NULL) {
+    HostEvent->NotifyPending = TRUE;
+    if (mHostDispatchDepth == 0) {
+      HostDispatchNotifies ();
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ((HOST_EVENT *) Event)->InUse = FALSE;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostCheckEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  HOST_EVENT  *HostEvent;
+  EFI_TPL     Saved;
+
+  HostEvent = (HOST_EVENT *) Event;
+  if (!HostEvent->Signaled && (HostEvent->Type & EVT_NOTIFY_WAIT) != 0 && HostEvent->Notify != NULL) {
+    Saved    = mHostTpl;
+    mHostTpl = MAX (HostEvent->NotifyTpl, Saved);
+    HostEvent->Notify (Event, HostEvent->Context);
+    mHostTpl = Saved;
+  }
+  if (HostEvent->Signaled) {
+    HostEvent->Signaled = FALSE;
+    return EFI_SUCCESS;
+  }
+  return EFI_NOT_READY;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostStall (
+  IN UINTN  Microseconds
+  )
+{
+  MicroSecondDelay (Microseconds);
+  return EFI_SUCCESS;
+}
+
+//
+// Handle database.
+//
+
+STATIC
+HOST_PROTOCOL *
+HostFindProtocol (
+  IN EFI_HANDLE       Handle,
+  IN CONST EFI_GUID   *Guid
+  )
+{
+  HOST_HANDLE   *HostHandle;
+  UINTN         Index;
+
+  HostHandle = (HOST_HANDLE *) Handle;
+  if (HostHandle == NULL || !HostHandle->InUse) {
+    return NULL;
+  }
+  for (Index = 0; Index < HostHandle->Count; Index++) {
+    if (HostGuidEqual (HostHandle->Protocols[Index].Guid, Guid)) {
+      return &HostHandle->Protocols[Index];
+    }
+  }
+  return NULL;
+}
+
+STATIC
+EFI_STATUS
+HostInstallList (
+  IN OUT EFI_HANDLE   *Handle,
+  IN     va_list      Args
+  )
+{
+  HOST_HANDLE   *HostHandle;
+  EFI_GUID      *Guid;
+  VOID          *Interface;
+  UINTN         Index;
+
+  if (*Handle == NULL) {
+    for (Index = 0; Index < HOST_MAX_HANDLES; Index++) {
+      if (!mHostHandles[Index].InUse) {
+        break;
+      }
+    }
+    if (Index == HOST_MAX_HANDLES) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    ZeroMem (&mHostHandles[Index], sizeof (HOST_HANDLE));
+    mHostHandles[Index].InUse = TRUE;
+    *Handle = (EFI_HANDLE) &mHostHandles[Index];
+  }
+
+  HostHandle = (HOST_HANDLE *) *Handle;
+  while ((Guid = va_arg (Args, EFI_GUID *)) != NULL) {
+    Interface = va_arg (Args, VOID *);
+    if (HostFindProtocol (*Handle, Guid) != NULL) {
+      return EFI_INVALID_PARAMETER;
+    }
+    if (HostHandle->Count == HOST_MAX_PROTOCOLS) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    HostHandle->Protocols[HostHandle->Count].Guid           = Guid;
+    HostHandle->Protocols[HostHandle->Count].Interface      = Interface;
+    HostHandle->Protocols[HostHandle->Count].OpenedByDriver = NULL;
+    HostHandle->Count++;
+  }
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostInstallMultipleProtocolInterfaces (
+  IN OUT EFI_HANDLE  *Handle,
+  ...
+  )
+{
+  EFI_STATUS  Status;
+  va_list     Args;
+
+  va_start (Args, Handle);
+  Status = HostInstallList (Handle, Args);
+  va_end (Args);
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostUninstallMultipleProtocolInterfaces (
+  IN EFI_HANDLE  Handle,
+  ...
+  )
+{
+  HOST_HANDLE     *HostHandle;
+  HOST_PROTOCOL   *Protocol;
+  EFI_GUID        *Guid;
+  va_list         Args;
+
+  HostHandle = (HOST_HANDLE *) Handle;
+  va_start (Args, Handle);
+  while ((Guid = va_arg (Args, EFI_GUID *)) != NULL) {
+    (VOID) va_arg (Args, VOID *);
+    Protocol = HostFindProtocol (Handle, Guid);
+    if (Protocol == NULL) {
+      continue;
+    }
+    *Protocol = HostHandle->Protocols[--HostHandle->Count];
+  }
+  va_end (Args);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostOpenProtocol (
+  IN  EFI_HANDLE  Handle,
+  IN  EFI_GUID    *Guid,
+  OUT VOID        **Interface,
+  IN  EFI_HANDLE  AgentHandle,
+  IN  EFI_HANDLE  ControllerHandle,
+  IN  UINT32      Attributes
+  )
+{
+  HOST_PROTOCOL   *Protocol;
+
+  Protocol = HostFindProtocol (Handle, Guid);
+  if (Protocol == NULL) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if ((Attributes & EFI_OPEN_PROTOCOL_BY_DRIVER) != 0) {
+    if (Protocol->OpenedByDriver == AgentHandle) {
+      return EFI_ALREADY_STARTED;
+    }
+    if (Protocol->OpenedByDriver != NULL) {
+      return EFI_ACCESS_DENIED;
+    }
+    Protocol->OpenedByDriver = AgentHandle;
+  }
+
+  if (Interface != NULL && (Attributes & EFI_OPEN_PROTOCOL_TEST_PROTOCOL) == 0) {
+    *Interface = Protocol->Interface;
+  }
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostCloseProtocol (
+  IN EFI_HANDLE  Handle,
+  IN EFI_GUID    *Guid,
+  IN EFI_HANDLE  AgentHandle,
+  IN EFI_HANDLE  ControllerHandle
+  )
+{
+  HOST_PROTOCOL   *Protocol;
+
+  Protocol = HostFindProtocol (Handle, Guid);
+  if (Protocol == NULL || Protocol->OpenedByDriver != AgentHandle) {
+    return EFI_NOT_FOUND;
+  }
+  Protocol->OpenedByDriver = NULL;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostHandleProtocol (
+  IN  EFI_HANDLE  Handle,
+  IN  EFI_GUID    *Guid,
+  OUT VOID        **Interface
+  )
+{
+  HOST_PROTOCOL   *Protocol;
+
+  Protocol = HostFindProtocol (Handle, Guid);
+  if (Protocol == NULL) {
+    return EFI_UNSUPPORTED;
+  }
+  *Interface = Protocol->Interface;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostInstallConfigurationTable (
+  IN EFI_GUID  *Guid,
+  IN VOID      *Table
+  )
+{
+  UINTN   Index;
+  UINTN   Free;
+
+  Free = HOST_MAX_CONFIG_TABLES;
+  for (Index = 0; Index < HOST_MAX_CONFIG_TABLES; Index++) {
+    if (mHostConfigTables[Index].Guid != NULL && HostGuidEqual (mHostConfigTables[Index].Guid, Guid)) {
+      mHostConfigTables[Index].Table = Table;
+      return EFI_SUCCESS;
+    }
+    if (mHostConfigTables[Index].Guid == NULL && Free == HOST_MAX_CONFIG_TABLES) {
+      Free = Index;
+    }
+  }
+  if (Free == HOST_MAX_CONFIG_TABLES) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  mHostConfigTables[Free].Guid  = Guid;
+  mHostConfigTables[Free].Table = Table;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostCalculateCrc32 (
+  IN  VOID    *Data,
+  IN  UINTN   DataSize,
+  OUT UINT32  *Crc32
+  )
+{
+  CONST UINT8   *Bytes;
+  UINT32        Crc;
+  UINTN         Bit;
+
+  if (Data == NULL || DataSize == 0 || Crc32 == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  //
+  // The IEEE 802.3 CRC32 of the UEFI specification, bit by bit.
+  //
+  Crc = MAX_UINT32;
+  for (Bytes = Data; DataSize-- != 0; Bytes++) {
+    Crc ^= *Bytes;
+    for (Bit = 0; Bit < 8; Bit++) {
+      Crc = (Crc >> 1) ^ ((Crc & 1) != 0 ? 0xEDB88320 : 0);
+    }
+  }
+  *Crc32 = Crc ^ MAX_UINT32;
+  return EFI_SUCCESS;
+}
+
+STATIC
+HOST_VARIABLE *
+HostFindVariable (
+  IN CONST CHAR16   *Name,
+  IN CONST EFI_GUID *Guid
+  )
+{
+  UINTN   Index;
+
+  for (Index = 0; Index < HOST_MAX_VARIABLES; Index++) {
+    if (mHostVariables[Index].InUse && HostGuidEqual (&mHostVariables[Index].Guid, Guid) &&
+        StrCmp (mHostVariables[Index].Name, Name) == 0) {
+      return &mHostVariables[Index];
+    }
+  }
+  return NULL;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostGetVariable (
+  IN     CHAR16    *VariableName,
+  IN     EFI_GUID  *VendorGuid,
+  OUT    UINT32    *Attributes OPTIONAL,
+  IN OUT UINTN     *DataSize,
+  OUT    VOID      *Data OPTIONAL
+  )
+{
+  HOST_VARIABLE   *Variable;
+
+  if (VariableName == NULL || VendorGuid == NULL || DataSize == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Variable = HostFindVariable (VariableName, VendorGuid);
+  if (Variable == NULL) {
+    return EFI_NOT_FOUND;
+  }
+  if (*DataSize < Variable->Size) {
+    *DataSize = Variable->Size;
+    return EFI_BUFFER_TOO_SMALL;
+  }
+  if (Data == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  *DataSize = Variable->Size;
+  CopyMem (Data, Variable->Data, Variable->Size);
+  if (Attributes != NULL) {
+    *Attributes = Variable->Attributes;
+  }
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostSetVariable (
+  IN CHAR16    *VariableName,
+  IN EFI_GUID  *VendorGuid,
+  IN UINT32    Attributes,
+  IN UINTN     DataSize,
+  IN VOID      *Data
+  )
+{
+  HOST_VARIABLE   *Variable;
+  UINTN           Index;
+  VOID            *Copy;
+
+  if (VariableName == NULL || VendorGuid == NULL || StrCmp (VariableName, L"") == 0 ||
+      (DataSize != 0 && Data == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Variable = HostFindVariable (VariableName, VendorGuid);
+
+  //
+  // A size of zero deletes the variable.
+  //
+  if (DataSize == 0 || Attributes == 0) {
+    if (Variable == NULL) {
+      return EFI_NOT_FOUND;
+    }
+    FreePool (Variable->Data);
+    Variable->InUse = FALSE;
+    return EFI_SUCCESS;
+  }
+
+  if (Variable == NULL) {
+    for (Index = 0; Index < HOST_MAX_VARIABLES; Index++) {
+      if (!mHostVariables[Index].InUse) {
+        Variable = &mHostVariables[Index];
+        break;
+      }
+    }
+    if (Variable == NULL || HostStrLen (VariableName) >= HOST_MAX_VARIABLE_NAME) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    CopyMem (Variable->Name, VariableName, (HostStrLen (VariableName) + 1) * sizeof (CHAR16));
+    Variable->Guid = *VendorGuid;
+    Variable->Data = NULL;
+  }
+
+  Copy = AllocateCopyPool (DataSize, Data);
+  if (Copy == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  FreePool (Variable->Data);
+  Variable->InUse      = TRUE;
+  Variable->Attributes = Attributes;
+  Variable->Size       = DataSize;
+  Variable->Data       = Copy;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_BOOT_SERVICES  mHostBootServices = {
+  HostRaiseTpl,
+  HostRestoreTpl,
+  HostCreateEvent,
+  HostSetTimer,
+  HostSignalEvent,
+  HostCloseEvent,
+  HostCheckEvent,
+  HostOpenProtocol,
+  HostCloseProtocol,
+  HostHandleProtocol,
+  HostInstallMultipleProtocolInterfaces,
+  HostUninstallMultipleProtocolInterfaces,
+  HostInstallConfigurationTable,
+  HostStall,
+  HostCalculateCrc32
+};
+
+STATIC EFI_RUNTIME_SERVICES  mHostRuntimeServices = {
+  HostGetVariable,
+  HostSetVariable
+};
+
+STATIC EFI_SYSTEM_TABLE   mHostSystemTable = {
+  &mHostRuntimeServices,
+  &mHostBootServices
+};
+
+EFI_BOOT_SERVICES     *gBS = &mHostBootServices;
+EFI_RUNTIME_SERVICES  *gRT = &mHostRuntimeServices;
+EFI_SYSTEM_TABLE      *gST = &mHostSystemTable;
+
+EFI_STATUS
+EFIAPI
+EfiGetSystemConfigurationTable (
+  IN  EFI_GUID  *TableGuid,
+  OUT VOID      **Table
+  )
+{
+  UINTN   Index;
+
+  for (Index = 0; Index < HOST_MAX_CONFIG_TABLES; Index++) {
+    if (mHostConfigTables[Index].Guid != NULL && HostGuidEqual (mHostConfigTables[Index].Guid, TableGuid)) {
+      *Table = mHostConfigTables[Index].Table;
+      return EFI_SUCCESS;
+    }
+  }
+  return EFI_NOT_FOUND;
+}
+
+//
+// Host environment control.
+//
+
+UINT64
+HostNow (
+  VOID
+  )
+{
+  return mHostNow;
+}
+
+EFI_TPL
+HostCurrentTpl (
+  VOID
+  )
+{
+  return mHostTpl;
+}
+
+VOID
+HostClearVariables (
+  VOID
+  )
+{
+  UINTN   Index;
+
+  for (Index = 0; Index < HOST_MAX_VARIABLES; Index++) {
+    if (mHostVariables[Index].InUse) {
+      FreePool (mHostVariables[Index].Data);
+      mHostVariables[Index].InUse = FALSE;
+    }
+  }
+}
+
+VOID
+HostSetDevicePoll (
+  IN UINT64   (*Poll)(IN UINT64 Now, IN VOID *Context),
+  IN VOID     *Context
+  )
+{
+  mHostDevicePoll    = Poll;
+  mHostDeviceContext = Context;
+}
+
+VOID
+HostAdvance (
+  IN UINT64   NanoSeconds
+  )
+{
+  UINT64    Target;
+  UINT64    Next;
+
+  Target = mHostNow + NanoSeconds;
+  for (;;) {
+    Next = HostDispatch ();
+    if (mHostNow >= Target) {
+      return;
+    }
+    mHostNow = MAX (MIN (Next, Target), mHostNow + 1);
+  }
+}
+
+EFI_STATUS
+EFIAPI
+HostCreateHandle (
+  OUT EFI_HANDLE  *Handle,
+  ...
+  )
+{
+  EFI_STATUS  Status;
+  va_list     Args;
+
+  *Handle = NULL;
+  va_start (Args, Handle);
+  Status = HostInstallList (Handle, Args);
+  va_end (Args);
+  return Status;
+}
+
+VOID
+HostDestroyHandle (
+  IN EFI_HANDLE   Handle
+  )
+{
+  ((HOST_HANDLE *) Handle)->InUse = FALSE;
+}
+
+//
+// BaseLib and SynchronizationLib.
+//
+
+LIST_ENTRY *
+EFIAPI
+InitializeListHead (
+  IN OUT LIST_ENTRY  *ListHead
+  )
+{
+  ListHead->ForwardLink = ListHead;
+  ListHead->BackLink    = ListHead;
+  return ListHead;
+}
+
+LIST_ENTRY *
+EFIAPI
+InsertTailList (
+  IN OUT LIST_ENTRY  *ListHead,
+  IN OUT LIST_ENTRY  *Entry
+  )
+{
+  Entry->ForwardLink           = ListHead;
+  Entry->BackLink              = ListHead->BackLink;
+  Entry->BackLink->ForwardLink = Entry;
+  ListHead->BackLink           = Entry;
+  return ListHead;
+}
+
+LIST_ENTRY * EFIAPI GetFirstNode (IN CONST LIST_ENTRY *List) { return List->ForwardLink; }
+LIST_ENTRY * EFIAPI GetNextNode (IN CONST LIST_ENTRY *List, IN CONST LIST_ENTRY *Node) { return Node->ForwardLink; }
+BOOLEAN EFIAPI IsListEmpty (IN CONST LIST_ENTRY *ListHead) { return (BOOLEAN) (ListHead->ForwardLink == ListHead); }
+BOOLEAN EFIAPI IsNull (IN CONST LIST_ENTRY *List, IN CONST LIST_ENTRY *Node) { return (BOOLEAN) (Node == List); }
+
+LIST_ENTRY *
+EFIAPI
+RemoveEntryList (
+  IN CONST LIST_ENTRY  *Entry
+  )
+{
+  Entry->ForwardLink->BackLink = Entry->BackLink;
+  Entry->BackLink->ForwardLink = Entry->ForwardLink;
+  return Entry->ForwardLink;
+}
+
+UINT64 EFIAPI LShiftU64 (IN UINT64 Operand, IN UINTN Count) { return Operand << Count; }
+UINT64 EFIAPI RShiftU64 (IN UINT64 Operand, IN UINTN Count) { return Operand >> Count; }
+
+UINT64
+EFIAPI
+DivU64x64Remainder (
+  IN  UINT64  Dividend,
+  IN  UINT64  Divisor,
+  OUT UINT64  *Remainder OPTIONAL
+  )
+{
+  if (Remainder != NULL) {
+    *Remainder = Dividend % Divisor;
+  }
+  return Dividend / Divisor;
+}
+
+INTN EFIAPI LowBitSet32 (IN UINT32 Operand) { return (Operand == 0) ? -1 : __builtin_ctz (Operand); }
+INTN EFIAPI HighBitSet32 (IN UINT32 Operand) { return (Operand == 0) ? -1 : 31 - __builtin_clz (Operand); }
+INTN EFIAPI HighBitSet64 (IN UINT64 Operand) { return (Operand == 0) ? -1 : 63 - __builtin_clzll (Operand); }
+
+UINT64
+EFIAPI
+ReadUnaligned64 (
+  IN CONST UINT64   *Buffer
+  )
+{
+  UINT64  Value;
+
+  memcpy (&Value, Buffer, sizeof (Value));
+  return Value;
+}
+
+VOID EFIAPI MemoryFence (VOID) { __atomic_thread_fence (__ATOMIC_SEQ_CST); }
+VOID EFIAPI CpuPause (VOID) { }
+UINT32 EFIAPI InterlockedIncrement (IN volatile UINT32 *Value) { return __atomic_add_fetch (Value, 1, __ATOMIC_SEQ_CST); }
+UINT32 EFIAPI InterlockedDecrement (IN volatile UINT32 *Value) { return __atomic_sub_fetch (Value, 1, __ATOMIC_SEQ_CST); }
+
+INTN
+EFIAPI
+StrCmp (
+  IN CONST CHAR16   *FirstString,
+  IN CONST CHAR16   *SecondString
+  )
+{
+  while (*FirstString != 0 && *FirstString == *SecondString) {
+    FirstString++;
+    SecondString++;
+  }
+  return *FirstString - *SecondString;
+}
+
+//
+// MemoryAllocationLib.
+//
+
+VOID * EFIAPI AllocatePool (IN UINTN AllocationSize) { return malloc (AllocationSize); }
+VOID * EFIAPI AllocateZeroPool (IN UINTN AllocationSize) { return calloc (1, AllocationSize); }
+VOID EFIAPI FreePool (IN VOID *Buffer) { free (Buffer); }
+
+VOID *
+EFIAPI
+AllocateCopyPool (
+  IN UINTN        AllocationSize,
+  IN CONST VOID   *Buffer
+  )
+{
+  VOID  *Copy;
+
+  Copy = malloc (AllocationSize);
+  if (Copy != NULL) {
+    memcpy (Copy, Buffer, AllocationSize);
+  }
+  return Copy;
+}
+
+//
+// TimerLib. The performance counter counts virtual nanoseconds.
+//
+
+UINT64 EFIAPI GetPerformanceCounter (VOID) { return mHostNow; }
+UINT64 EFIAPI GetTimeInNanoSecond (IN UINT64 Ticks) { return Ticks; }
+
+UINT64
+EFIAPI
+GetPerformanceCounterProperties (
+  OUT UINT64  *StartValue OPTIONAL,
+  OUT UINT64  *EndValue OPTIONAL
+  )
+{
+  if (StartValue != NULL) {
+    *StartValue = 0;
+  }
+  if (EndValue != NULL) {
+    *EndValue = MAX_UINT64;
+  }
+  return 1000000000ULL;
+}
+
+UINTN
+EFIAPI
+MicroSecondDelay (
+  IN UINTN  MicroSeconds
+  )
+{
+  HostAdvance ((UINT64) MicroSeconds * 1000);
+  return MicroSeconds;
+}
+
+UINTN
+EFIAPI
+NanoSecondDelay (
+  IN UINTN  NanoSeconds
+  )
+{
+  HostAdvance (NanoSeconds);
+  return NanoSeconds;
+}
+
+//
+// UefiLib.
+//
+
+EFI_STATUS
+EFIAPI
+EfiLibInstallDriverBindingComponentName2 (
+  IN EFI_HANDLE                          ImageHandle,
+  IN EFI_SYSTEM_TABLE                    *SystemTable,
+  IN EFI_DRIVER_BINDING_PROTOCOL         *DriverBinding,
+  IN EFI_HANDLE                          DriverBindingHandle,
+  IN CONST EFI_COMPONENT_NAME_PROTOCOL   *ComponentName OPTIONAL,
+  IN CONST EFI_COMPONENT_NAME2_PROTOCOL  *ComponentName2 OPTIONAL
+  )
+{
+  DriverBinding->ImageHandle         = ImageHandle;
+  DriverBinding->DriverBindingHandle = DriverBindingHandle;
+  return gBS->InstallMultipleProtocolInterfaces (
+                &DriverBinding->DriverBindingHandle,
+                &gEfiDriverBindingProtocolGuid,
+                DriverBinding,
+                NULL
+                );
+}
+
+STATIC
+UINTN
+HostStrLen (
+  IN CONST CHAR16   *String
+  )
+{
+  UINTN   Length;
+
+  for (Length = 0; String[Length] != 0; Length++) {
+  }
+  return Length;
+}
+
+EFI_STATUS
+EFIAPI
+AddUnicodeString2 (
+  IN     CONST CHAR8               *Language,
+  IN     CONST CHAR8               *SupportedLanguages,
+  IN OUT EFI_UNICODE_STRING_TABLE  **UnicodeStringTable,
+  IN     CONST CHAR16              *UnicodeString,
+  IN     BOOLEAN                   Iso639Language
+  )
+{
+  EFI_UNICODE_STRING_TABLE  *Table;
+  UINTN                     Count;
+
+  Count = 0;
+  if (*UnicodeStringTable != NULL) {
+    while ((*UnicodeStringTable)[Count].Language != NULL) {
+      Count++;
+    }
+  }
+
+  Table = realloc (*UnicodeStringTable, (Count + 2) * sizeof (EFI_UNICODE_STRING_TABLE));
+  if (Table == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Table[Count].Language      = strdup (Language);
+  Table[Count].UnicodeString = AllocateCopyPool ((HostStrLen (UnicodeString) + 1) * sizeof (CHAR16), UnicodeString);
+  Table[Count + 1].Language      = NULL;
+  Table[Count + 1].UnicodeString = NULL;
+  *UnicodeStringTable = Table;
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+LookupUnicodeString2 (
+  IN  CONST CHAR8                     *Language,
+  IN  CONST CHAR8                     *SupportedLanguages,
+  IN  CONST EFI_UNICODE_STRING_TABLE  *UnicodeStringTable,
+  OUT CHAR16                          **UnicodeString,
+  IN  BOOLEAN                         Iso639Language
+  )
+{
+  if (Language == NULL || UnicodeString == NULL || UnicodeStringTable == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  for (; UnicodeStringTable->Language != NULL; UnicodeStringTable++) {
+    if (strstr (UnicodeStringTable->Language, Language) != NULL) {
+      *UnicodeString = UnicodeStringTable->UnicodeString;
+      return EFI_SUCCESS;
+    }
+  }
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+EFIAPI
+FreeUnicodeStringTable (
+  IN EFI_UNICODE_STRING_TABLE  *UnicodeStringTable
+  )
+{
+  UINTN   Index;
+
+  if (UnicodeStringTable == NULL) {
+    return EFI_SUCCESS;
+  }
+  for (Index = 0; UnicodeStringTable[Index].Language != NULL; Index++) {
+    free (UnicodeStringTable[Index].Language);
+    free (UnicodeStringTable[Index].UnicodeString);
+  }
+  free (UnicodeStringTable);
+  return EFI_SUCCESS;
+}
+
+//
+// UefiUsbLib.
+//
+
+#define HOST_USB_TIMEOUT_MS     3000
+
+STATIC
+EFI_STATUS
+HostUsbRequest (
+  IN     EFI_USB_IO_PROTOCOL     *UsbIo,
+  IN     UINT8                   RequestType,
+  IN     UINT8                   Request,
+  IN     UINT16                  Value,
+  IN     UINT16                  Index,
+  IN     EFI_USB_DATA_DIRECTION  Direction,
+  IN OUT VOID                    *Data,
+  IN     UINTN                   Length,
+  OUT    UINT32                  *Status
+  )
+{
+  EFI_USB_DEVICE_REQUEST  DevReq;
+  UINT32                  UsbStatus;
+
+  DevReq.RequestType = RequestType;
+  DevReq.Request     = Request;
+  DevReq.Value       = Value;
+  DevReq.Index       = Index;
+  DevReq.Length      = (UINT16) Length;
+  return UsbIo->UsbControlTransfer (
+                  UsbIo,
+                  &DevReq,
+                  Direction,
+                  HOST_USB_TIMEOUT_MS,
+                  Data,
+                  Length,
+                  (Status != NULL) ? Status : &UsbStatus
+                  );
+}
+
+EFI_STATUS
+EFIAPI
+UsbGetConfiguration (
+  IN  EFI_USB_IO_PROTOCOL  *UsbIo,
+  OUT UINT16               *ConfigurationValue,
+  OUT UINT32               *Status
+  )
+{
+  *ConfigurationValue = 0;
+  return HostUsbRequest (UsbIo, 0x80, 0x08, 0, 0, EfiUsbDataIn, ConfigurationValue, 1, Status);
+}
+
+EFI_STATUS
+EFIAPI
+UsbGetProtocolRequest (
+  IN  EFI_USB_IO_PROTOCOL  *UsbIo,
+  IN  UINT8                Interface,
+  OUT UINT8                *Protocol
+  )
+{
+  return HostUsbRequest (UsbIo, 0xA1, 0x03, 0, Interface, EfiUsbDataIn, Protocol, 1, NULL);
+}
+
+EFI_STATUS
+EFIAPI
+UsbSetProtocolRequest (
+  IN EFI_USB_IO_PROTOCOL  *UsbIo,
+  IN UINT8                Interface,
+  IN UINT8                Protocol
+  )
+{
+  return HostUsbRequest (UsbIo, 0x21, 0x0B, Protocol, Interface, EfiUsbNoData, NULL, 0, NULL);
+}
+
+EFI_STATUS
+EFIAPI
+UsbClearEndpointHalt (
+  IN  EFI_USB_IO_PROTOCOL  *UsbIo,
+  IN  UINT8                Endpoint,
+  OUT UINT32               *Status
+  )
+{
+  return HostUsbRequest (UsbIo, 0x02, 0x01, 0, Endpoint, EfiUsbNoData, NULL, 0, Status);
+}
@@ -0,0 +1,521 @@
+/** @file
+  Minimal DXE environment for building the whole USB JoyStick driver into
+  host tools: the boot services, USB I/O protocol and libraries the driver
+  uses, backed by Tools/HostDxe/HostDxe.c.
+
+  Time is virtual. It only moves when a tool advances it or when the driver
+  waits (stalls, transfer timeouts), so runs are deterministic. Define
+  JOYSTICK_HOST_BUILD to pick this header instead of the EDK2 ones.
+
+  YIZD 2021
+
+**/
+
+#ifndef _HOST_DXE_H_
+#define _HOST_DXE_H_
+
+#include <stdlib.h>
+
+#include <HostUefi.h>
+
+//
+// Fixed and feature PCDs, overridable with -D_PCD_VALUE_<Name>=<Value>.
+//
+#ifndef _PCD_VALUE_PcdJoyStickTraceLevel
+#define _PCD_VALUE_PcdJoyStickTraceLevel          2
+#endif
+#ifndef _PCD_VALUE_PcdJoyStickDebounceReports
+#define _PCD_VALUE_PcdJoyStickDebounceReports     1
+#endif
+#ifndef _PCD_VALUE_PcdJoyStickReportsPerTransfer
+#define _PCD_VALUE_PcdJoyStickReportsPerTransfer  1
+#endif
+#ifndef _PCD_VALUE_PcdJoyStickLazyActivation
+#define _PCD_VALUE_PcdJoyStickLazyActivation      FALSE
+#endif
+#ifndef _PCD_VALUE_PcdJoyStickPressKeyButtons
+#define _PCD_VALUE_PcdJoyStickPressKeyButtons     0x00FF3FFF
+#endif
+#ifndef _PCD_VALUE_PcdJoyStickReleaseKeyButtons
+#define _PCD_VALUE_PcdJoyStickReleaseKeyButtons   0
+#endif
+#ifndef _PCD_VALUE_PcdJoyStickMotionSupport
+#define _PCD_VALUE_PcdJoyStickMotionSupport       TRUE
+#endif
+#ifndef _PCD_VALUE_PcdJoyStickStateSupport
+#define _PCD_VALUE_PcdJoyStickStateSupport        TRUE
+#endif
+#ifndef _PCD_VALUE_PcdJoyStickReportSupport
+#define _PCD_VALUE_PcdJoyStickReportSupport       TRUE
+#endif
+#ifndef _PCD_VALUE_PcdJoyStickStatsSupport
+#define _PCD_VALUE_PcdJoyStickStatsSupport        TRUE
+#endif
+
+#define FixedPcdGet8(TokenName)   _PCD_VALUE_##TokenName
+#define FixedPcdGet16(TokenName)  _PCD_VALUE_##TokenName
+#define FixedPcdGet32(TokenName)  _PCD_VALUE_##TokenName
+#define FixedPcdGetBool(TokenName) _PCD_VALUE_##TokenName
+#define FeaturePcdGet(TokenName)  _PCD_VALUE_##TokenName
+
+//
+// Base types and macros.
+//
+typedef VOID    *EFI_HANDLE;
+typedef VOID    *EFI_EVENT;
+typedef UINTN   EFI_TPL;
+
+typedef struct {
+  UINT32  Data1;
+  UINT16  Data2;
+  UINT16  Data3;
+  UINT8   Data4[8];
+} EFI_GUID;
+
+#define MAX_UINT32            ((UINT32) 0xFFFFFFFF)
+#define MAX_UINT64            ((UINT64) 0xFFFFFFFFFFFFFFFFULL)
+#define MAX_UINTN             ((UINTN) -1)
+
+#define EFI_LOAD_ERROR        ENCODE_ERROR (1)
+#define EFI_BAD_BUFFER_SIZE   ENCODE_ERROR (4)
+#define EFI_VOLUME_CORRUPTED  ENCODE_ERROR (10)
+#define EFI_ACCESS_DENIED     ENCODE_ERROR (15)
+#define EFI_NOT_STARTED       ENCODE_ERROR (19)
+#define EFI_ALREADY_STARTED   ENCODE_ERROR (20)
+#define EFI_INCOMPATIBLE_VERSION ENCODE_ERROR (25)
+#define EFI_CRC_ERROR         ENCODE_ERROR (27)
+
+#define OFFSET_OF(TYPE, Field)  ((UINTN) offsetof (TYPE, Field))
+#define BASE_CR(Record, TYPE, Field) \
+  ((TYPE *) ((CHAR8 *) (Record) - OFFSET_OF (TYPE, Field)))
+#define CR(Record, TYPE, Field, TestSignature)  BASE_CR (Record, TYPE, Field)
+#define SIGNATURE_16(A, B)        ((A) | (B << 8))
+#define SIGNATURE_32(A, B, C, D)  (SIGNATURE_16 (A, B) | (SIGNATURE_16 (C, D) << 16))
+
+#define ASSERT(Expression)              do { if (!(Expression)) { HostAssert (__FILE__, __LINE__, #Expression); } } while (FALSE)
+#define ASSERT_EFI_ERROR(StatusParameter) ASSERT (!EFI_ERROR (StatusParameter))
+#define DEBUG(Expression)
+#define PERF_START(Handle, Token, Module, TimeStamp)
+#define PERF_END(Handle, Token, Module, TimeStamp)
+#define REPORT_STATUS_CODE_WITH_DEVICE_PATH(Type, Value, DevicePath)
+
+#define TPL_APPLICATION       4
+#define TPL_CALLBACK          8
+#define TPL_NOTIFY            16
+#define TPL_HIGH_LEVEL        31
+
+#define EVT_TIMER                         0x80000000
+#define EVT_NOTIFY_WAIT                   0x00000100
+#define EVT_NOTIFY_SIGNAL                 0x00000200
+
+#define EFI_TIMER_PERIOD_MILLISECONDS(Milliseconds)  ((UINT64) (Milliseconds) * 10000)
+
+#define EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL  0x00000001
+#define EFI_OPEN_PROTOCOL_GET_PROTOCOL        0x00000002
+#define EFI_OPEN_PROTOCOL_TEST_PROTOCOL       0x00000004
+#define EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER 0x00000008
+#define EFI_OPEN_PROTOCOL_BY_DRIVER           0x00000010
+#define EFI_OPEN_PROTOCOL_EXCLUSIVE           0x00000020
+
+typedef enum {
+  TimerCancel,
+  TimerPeriodic,
+  TimerRelative
+} EFI_TIMER_DELAY;
+
+typedef
+VOID
+(EFIAPI *EFI_EVENT_NOTIFY)(
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  );
+
+//
+// Boot services used by the driver.
+//
+typedef struct {
+  EFI_TPL     (EFIAPI *RaiseTPL)(IN EFI_TPL NewTpl);
+  VOID        (EFIAPI *RestoreTPL)(IN EFI_TPL OldTpl);
+  EFI_STATUS  (EFIAPI *CreateEvent)(IN UINT32 Type, IN EFI_TPL NotifyTpl, IN EFI_EVENT_NOTIFY NotifyFunction, IN VOID *NotifyContext, OUT EFI_EVENT *Event);
+  EFI_STATUS  (EFIAPI *SetTimer)(IN EFI_EVENT Event, IN EFI_TIMER_DELAY Type, IN UINT64 TriggerTime);
+  EFI_STATUS  (EFIAPI *SignalEvent)(IN EFI_EVENT Event);
+  EFI_STATUS  (EFIAPI *CloseEvent)(IN EFI_EVENT Event);
+  EFI_STATUS  (EFIAPI *CheckEvent)(IN EFI_EVENT Event);
+  EFI_STATUS  (EFIAPI *OpenProtocol)(IN EFI_HANDLE Handle, IN EFI_GUID *Protocol, OUT VOID **Interface, IN EFI_HANDLE AgentHandle, IN EFI_HANDLE ControllerHandle, IN UINT32 Attributes);
+  EFI_STATUS  (EFIAPI *CloseProtocol)(IN EFI_HANDLE Handle, IN EFI_GUID *Protocol, IN EFI_HANDLE AgentHandle, IN EFI_HANDLE ControllerHandle);
+  EFI_STATUS  (EFIAPI *HandleProtocol)(IN EFI_HANDLE Handle, IN EFI_GUID *Protocol, OUT VOID **Interface);
+  EFI_STATUS  (EFIAPI *InstallMultipleProtocolInterfaces)(IN OUT EFI_HANDLE *Handle, ...);
+  EFI_STATUS  (EFIAPI *UninstallMultipleProtocolInterfaces)(IN EFI_HANDLE Handle, ...);
+  EFI_STATUS  (EFIAPI *InstallConfigurationTable)(IN EFI_GUID *Guid, IN VOID *Table);
+  EFI_STATUS  (EFIAPI *Stall)(IN UINTN Microseconds);
+  EFI_STATUS  (EFIAPI *CalculateCrc32)(IN VOID *Data, IN UINTN DataSize, OUT UINT32 *Crc32);
+} EFI_BOOT_SERVICES;
+
+//
+// Runtime services used by the driver. Variables live in memory for the
+// life of the tool, or until HostClearVariables().
+//
+#define EFI_VARIABLE_NON_VOLATILE         0x00000001
+#define EFI_VARIABLE_BOOTSERVICE_ACCESS   0x00000002
+#define EFI_VARIABLE_RUNTIME_ACCESS       0x00000004
+
+typedef struct {
+  EFI_STATUS  (EFIAPI *GetVariable)(IN CHAR16 *VariableName, IN EFI_GUID *VendorGuid, OUT UINT32 *Attributes OPTIONAL, IN OUT UINTN *DataSize, OUT VOID *Data OPTIONAL);
+  EFI_STATUS  (EFIAPI *SetVariable)(IN CHAR16 *VariableName, IN EFI_GUID *VendorGuid, IN UINT32 Attributes, IN UINTN DataSize, IN VOID *Data);
+} EFI_RUNTIME_SERVICES;
+
+typedef struct {
+  EFI_RUNTIME_SERVICES  *RuntimeServices;
+  EFI_BOOT_SERVICES     *BootServices;
+} EFI_SYSTEM_TABLE;
+
+extern EFI_BOOT_SERVICES     *gBS;
+extern EFI_RUNTIME_SERVICES  *gRT;
+extern EFI_SYSTEM_TABLE      *gST;
+
+//
+// Device path, only passed through by the driver.
+//
+typedef struct {
+  UINT8   Type;
+  UINT8   SubType;
+  UINT8   Length[2];
+} EFI_DEVICE_PATH_PROTOCOL;
+
+//
+// Simple Text Input and Simple Text Input Ex.
+//
+#define EFI_SHIFT_STATE_VALID     0x80000000
+#define EFI_TOGGLE_STATE_VALID    0x80
+
+typedef struct _EFI_SIMPLE_TEXT_INPUT_PROTOCOL     EFI_SIMPLE_TEXT_INPUT_PROTOCOL;
+typedef struct _EFI_SIMPLE_TEXT_INPUT_EX_PROTOCOL  EFI_SIMPLE_TEXT_INPUT_EX_PROTOCOL;
+
+typedef EFI_STATUS (EFIAPI *EFI_KEY_NOTIFY_FUNCTION)(IN EFI_KEY_DATA *KeyData);
+
+struct _EFI_SIMPLE_TEXT_INPUT_PROTOCOL {
+  EFI_STATUS  (EFIAPI *Reset)(IN EFI_SIMPLE_TEXT_INPUT_PROTOCOL *This, IN BOOLEAN ExtendedVerification);
+  EFI_STATUS  (EFIAPI *ReadKeyStroke)(IN EFI_SIMPLE_TEXT_INPUT_PROTOCOL *This, OUT EFI_INPUT_KEY *Key);
+  EFI_EVENT   WaitForKey;
+};
+
+struct _EFI_SIMPLE_TEXT_INPUT_EX_PROTOCOL {
+  EFI_STATUS  (EFIAPI *Reset)(IN EFI_SIMPLE_TEXT_INPUT_EX_PROTOCOL *This, IN BOOLEAN ExtendedVerification);
+  EFI_STATUS  (EFIAPI *ReadKeyStrokeEx)(IN EFI_SIMPLE_TEXT_INPUT_EX_PROTOCOL *This, OUT EFI_KEY_DATA *KeyData);
+  EFI_EVENT   WaitForKeyEx;
+  EFI_STATUS  (EFIAPI *SetState)(IN EFI_SIMPLE_TEXT_INPUT_EX_PROTOCOL *This, IN EFI_KEY_TOGGLE_STATE *KeyToggleState);
+  EFI_STATUS  (EFIAPI *RegisterKeyNotify)(IN EFI_SIMPLE_TEXT_INPUT_EX_PROTOCOL *This, IN EFI_KEY_DATA *KeyData, IN EFI_KEY_NOTIFY_FUNCTION KeyNotificationFunction, OUT VOID **NotifyHandle);
+  EFI_STATUS  (EFIAPI *UnregisterKeyNotify)(IN EFI_SIMPLE_TEXT_INPUT_EX_PROTOCOL *This, IN VOID *NotificationHandle);
+};
+
+//
+// Driver binding and component name.
+//
+typedef struct _EFI_DRIVER_BINDING_PROTOCOL  EFI_DRIVER_BINDING_PROTOCOL;
+
+struct _EFI_DRIVER_BINDING_PROTOCOL {
+  EFI_STATUS  (EFIAPI *Supported)(IN EFI_DRIVER_BINDING_PROTOCOL *This, IN EFI_HANDLE ControllerHandle, IN EFI_DEVICE_PATH_PROTOCOL *RemainingDevicePath);
+  EFI_STATUS  (EFIAPI *Start)(IN EFI_DRIVER_BINDING_PROTOCOL *This, IN EFI_HANDLE ControllerHandle, IN EFI_DEVICE_PATH_PROTOCOL *RemainingDevicePath);
+  EFI_STATUS  (EFIAPI *Stop)(IN EFI_DRIVER_BINDING_PROTOCOL *This, IN EFI_HANDLE ControllerHandle, IN UINTN NumberOfChildren, IN EFI_HANDLE *ChildHandleBuffer);
+  UINT32      Version;
+  EFI_HANDLE  ImageHandle;
+  EFI_HANDLE  DriverBindingHandle;
+};
+
+typedef struct _EFI_COMPONENT_NAME_PROTOCOL  EFI_COMPONENT_NAME_PROTOCOL;
+typedef EFI_COMPONENT_NAME_PROTOCOL          EFI_COMPONENT_NAME2_PROTOCOL;
+
+typedef EFI_STATUS (EFIAPI *EFI_COMPONENT_NAME_GET_DRIVER_NAME)(IN EFI_COMPONENT_NAME_PROTOCOL *This, IN CHAR8 *Language, OUT CHAR16 **DriverName);
+typedef EFI_STATUS (EFIAPI *EFI_COMPONENT_NAME_GET_CONTROLLER_NAME)(IN EFI_COMPONENT_NAME_PROTOCOL *This, IN EFI_HANDLE ControllerHandle, IN EFI_HANDLE ChildHandle OPTIONAL, IN CHAR8 *Language, OUT CHAR16 **ControllerName);
+typedef EFI_COMPONENT_NAME_GET_DRIVER_NAME      EFI_COMPONENT_NAME2_GET_DRIVER_NAME;
+typedef EFI_COMPONENT_NAME_GET_CONTROLLER_NAME  EFI_COMPONENT_NAME2_GET_CONTROLLER_NAME;
+
+struct _EFI_COMPONENT_NAME_PROTOCOL {
+  EFI_COMPONENT_NAME_GET_DRIVER_NAME      GetDriverName;
+  EFI_COMPONENT_NAME_GET_CONTROLLER_NAME  GetControllerName;
+  CHAR8                                   *SupportedLanguages;
+};
+
+typedef struct {
+  CHAR8   *Language;
+  CHAR16  *UnicodeString;
+} EFI_UNICODE_STRING_TABLE;
+
+//
+// USB I/O.
+//
+#define USB_ENDPOINT_DIR_IN       0x80
+#define USB_ENDPOINT_INTERRUPT    0x03
+
+#define EFI_USB_NOERROR           0x00
+#define EFI_USB_ERR_NOTEXECUTE    0x01
+#define EFI_USB_ERR_STALL         0x02
+#define EFI_USB_ERR_BUFFER        0x04
+#define EFI_USB_ERR_BABBLE        0x08
+#define EFI_USB_ERR_NAK           0x10
+#define EFI_USB_ERR_CRC           0x20
+#define EFI_USB_ERR_TIMEOUT       0x40
+#define EFI_USB_ERR_BITSTUFF      0x80
+#define EFI_USB_ERR_SYSTEM        0x100
+
+#pragma pack(1)
+typedef struct {
+  UINT8     RequestType;
+  UINT8     Request;
+  UINT16    Value;
+  UINT16    Index;
+  UINT16    Length;
+} EFI_USB_DEVICE_REQUEST;
+
+typedef struct {
+  UINT8     Length;
+  UINT8     DescriptorType;
+  UINT16    BcdUSB;
+  UINT8     DeviceClass;
+  UINT8     DeviceSubClass;
+  UINT8     DeviceProtocol;
+  UINT8     MaxPacketSize0;
+  UINT16    IdVendor;
+  UINT16    IdProduct;
+  UINT16    BcdDevice;
+  UINT8     StrManufacturer;
+  UINT8     StrProduct;
+  UINT8     StrSerialNumber;
+  UINT8     NumConfigurations;
+} EFI_USB_DEVICE_DESCRIPTOR;
+
+typedef struct {
+  UINT8     Length;
+  UINT8     DescriptorType;
+  UINT8     InterfaceNumber;
+  UINT8     AlternateSetting;
+  UINT8     NumEndpoints;
+  UINT8     InterfaceClass;
+  UINT8     InterfaceSubClass;
+  UINT8     InterfaceProtocol;
+  UINT8     Interface;
+} EFI_USB_INTERFACE_DESCRIPTOR;
+
+typedef struct {
+  UINT8     Length;
+  UINT8     DescriptorType;
+  UINT8     EndpointAddress;
+  UINT8     Attributes;
+  UINT16    MaxPacketSize;
+  UINT8     Interval;
+} EFI_USB_ENDPOINT_DESCRIPTOR;
+#pragma pack()
+
+typedef enum {
+  EfiUsbDataIn,
+  EfiUsbDataOut,
+  EfiUsbNoData
+} EFI_USB_DATA_DIRECTION;
+
+typedef
+EFI_STATUS
+(EFIAPI *EFI_ASYNC_USB_TRANSFER_CALLBACK)(
+  IN VOID         *Data,
+  IN UINTN        DataLength,
+  IN VOID         *Context,
+  IN UINT32       Status
+  );
+
+typedef struct _EFI_USB_IO_PROTOCOL  EFI_USB_IO_PROTOCOL;
+
+struct _EFI_USB_IO_PROTOCOL {
+  EFI_STATUS  (EFIAPI *UsbControlTransfer)(IN EFI_USB_IO_PROTOCOL *This, IN EFI_USB_DEVICE_REQUEST *Request, IN EFI_USB_DATA_DIRECTION Direction, IN UINT32 Timeout, IN OUT VOID *Data OPTIONAL, IN UINTN DataLength OPTIONAL, OUT UINT32 *Status);
+  EFI_STATUS  (EFIAPI *UsbAsyncInterruptTransfer)(IN EFI_USB_IO_PROTOCOL *This, IN UINT8 DeviceEndpoint, IN BOOLEAN IsNewTransfer, IN UINTN PollingInterval OPTIONAL, IN UINTN DataLength OPTIONAL, IN EFI_ASYNC_USB_TRANSFER_CALLBACK InterruptCallBack OPTIONAL, IN VOID *Context OPTIONAL);
+  EFI_STATUS  (EFIAPI *UsbSyncInterruptTransfer)(IN EFI_USB_IO_PROTOCOL *This, IN UINT8 DeviceEndpoint, IN OUT VOID *Data, IN OUT UINTN *DataLength, IN UINTN Timeout, OUT UINT32 *Status);
+  EFI_STATUS  (EFIAPI *UsbGetDeviceDescriptor)(IN EFI_USB_IO_PROTOCOL *This, OUT EFI_USB_DEVICE_DESCRIPTOR *DeviceDescriptor);
+  EFI_STATUS  (EFIAPI *UsbGetInterfaceDescriptor)(IN EFI_USB_IO_PROTOCOL *This, OUT EFI_USB_INTERFACE_DESCRIPTOR *InterfaceDescriptor);
+  EFI_STATUS  (EFIAPI *UsbGetEndpointDescriptor)(IN EFI_USB_IO_PROTOCOL *This, IN UINT8 EndpointIndex, OUT EFI_USB_ENDPOINT_DESCRIPTOR *EndpointDescriptor);
+  EFI_STATUS  (EFIAPI *UsbPortReset)(IN EFI_USB_IO_PROTOCOL *This);
+};
+
+//
+// Protocol and GUID instances.
+//
+extern EFI_GUID  gEfiUsbIoProtocolGuid;
+extern EFI_GUID  gEfiDevicePathProtocolGuid;
+extern EFI_GUID  gEfiSimpleTextInProtocolGuid;
+extern EFI_GUID  gEfiSimpleTextInputExProtocolGuid;
+extern EFI_GUID  gEfiSimpleTextOutProtocolGuid;
+extern EFI_GUID  gEfiDriverBindingProtocolGuid;
+
+//
+// EFI_PERIPHERAL_KEYBOARD status codes, only named by the driver.
+//
+#define EFI_PROGRESS_CODE                 0x00000001
+#define EFI_ERROR_CODE                    0x00000002
+#define EFI_ERROR_MINOR                   0x40000000
+#define EFI_PERIPHERAL_KEYBOARD           0x01010000
+#define EFI_P_PC_DETECTED                 0x00000003
+#define EFI_P_PC_RESET                    0x00000006
+#define EFI_P_EC_INPUT_ERROR              0x00000008
+#define EFI_P_KEYBOARD_PC_CLEAR_BUFFER    0x00001000
+#define EFI_P_KEYBOARD_PC_SELF_TEST       0x00001001
+
+//
+// BaseLib and SynchronizationLib.
+//
+typedef struct _LIST_ENTRY LIST_ENTRY;
+struct _LIST_ENTRY {
+  LIST_ENTRY  *ForwardLink;
+  LIST_ENTRY  *BackLink;
+};
+
+LIST_ENTRY * EFIAPI InitializeListHead (IN OUT LIST_ENTRY *ListHead);
+LIST_ENTRY * EFIAPI InsertTailList (IN OUT LIST_ENTRY *ListHead, IN OUT LIST_ENTRY *Entry);
+LIST_ENTRY * EFIAPI GetFirstNode (IN CONST LIST_ENTRY *List);
+LIST_ENTRY * EFIAPI GetNextNode (IN CONST LIST_ENTRY *List, IN CONST LIST_ENTRY *Node);
+BOOLEAN EFIAPI IsListEmpty (IN CONST LIST_ENTRY *ListHead);
+BOOLEAN EFIAPI IsNull (IN CONST LIST_ENTRY *List, IN CONST LIST_ENTRY *Node);
+LIST_ENTRY * EFIAPI RemoveEntryList (IN CONST LIST_ENTRY *Entry);
+
+UINT64  EFIAPI LShiftU64 (IN UINT64 Operand, IN UINTN Count);
+UINT64  EFIAPI RShiftU64 (IN UINT64 Operand, IN UINTN Count);
+UINT64  EFIAPI DivU64x64Remainder (IN UINT64 Dividend, IN UINT64 Divisor, OUT UINT64 *Remainder OPTIONAL);
+INTN    EFIAPI LowBitSet32 (IN UINT32 Operand);
+INTN    EFIAPI HighBitSet32 (IN UINT32 Operand);
+INTN    EFIAPI HighBitSet64 (IN UINT64 Operand);
+UINT64  EFIAPI ReadUnaligned64 (IN CONST UINT64 *Buffer);
+VOID    EFIAPI MemoryFence (VOID);
+VOID    EFIAPI CpuPause (VOID);
+UINT32  EFIAPI InterlockedIncrement (IN volatile UINT32 *Value);
+UINT32  EFIAPI InterlockedDecrement (IN volatile UINT32 *Value);
+INTN    EFIAPI StrCmp (IN CONST CHAR16 *FirstString, IN CONST CHAR16 *SecondString);
+
+//
+// MemoryAllocationLib.
+//
+VOID *  EFIAPI AllocatePool (IN UINTN AllocationSize);
+VOID *  EFIAPI AllocateZeroPool (IN UINTN AllocationSize);
+VOID *  EFIAPI AllocateCopyPool (IN UINTN AllocationSize, IN CONST VOID *Buffer);
+VOID    EFIAPI FreePool (IN VOID *Buffer);
+
+//
+// TimerLib, on the virtual clock.
+//
+UINT64  EFIAPI GetPerformanceCounter (VOID);
+UINT64  EFIAPI GetPerformanceCounterProperties (OUT UINT64 *StartValue OPTIONAL, OUT UINT64 *EndValue OPTIONAL);
+UINT64  EFIAPI GetTimeInNanoSecond (IN UINT64 Ticks);
+UINTN   EFIAPI MicroSecondDelay (IN UINTN MicroSeconds);
+UINTN   EFIAPI NanoSecondDelay (IN UINTN NanoSeconds);
+
+//
+// UefiLib.
+//
+EFI_STATUS EFIAPI EfiLibInstallDriverBindingComponentName2 (IN EFI_HANDLE ImageHandle, IN EFI_SYSTEM_TABLE *SystemTable, IN EFI_DRIVER_BINDING_PROTOCOL *DriverBinding, IN EFI_HANDLE DriverBindingHandle, IN CONST EFI_COMPONENT_NAME_PROTOCOL *ComponentName OPTIONAL, IN CONST EFI_COMPONENT_NAME2_PROTOCOL *ComponentName2 OPTIONAL);
+EFI_STATUS EFIAPI AddUnicodeString2 (IN CONST CHAR8 *Language, IN CONST CHAR8 *SupportedLanguages, IN OUT EFI_UNICODE_STRING_TABLE **UnicodeStringTable, IN CONST CHAR16 *UnicodeString, IN BOOLEAN Iso639Language);
+EFI_STATUS EFIAPI LookupUnicodeString2 (IN CONST CHAR8 *Language, IN CONST CHAR8 *SupportedLanguages, IN CONST EFI_UNICODE_STRING_TABLE *UnicodeStringTable, OUT CHAR16 **UnicodeString, IN BOOLEAN Iso639Language);
+EFI_STATUS EFIAPI FreeUnicodeStringTable (IN EFI_UNICODE_STRING_TABLE *UnicodeStringTable);
+EFI_STATUS EFIAPI EfiGetSystemConfigurationTable (IN EFI_GUID *TableGuid, OUT VOID **Table);
+
+//
+// UefiUsbLib, issued as control transfers through the USB I/O protocol.
+//
+#define EFI_USB_INTERRUPT_DELAY  2000000
+
+EFI_STATUS EFIAPI UsbGetConfiguration (IN EFI_USB_IO_PROTOCOL *UsbIo, OUT UINT16 *ConfigurationValue, OUT UINT32 *Status);
+EFI_STATUS EFIAPI UsbGetProtocolRequest (IN EFI_USB_IO_PROTOCOL *UsbIo, IN UINT8 Interface, OUT UINT8 *Protocol);
+EFI_STATUS EFIAPI UsbSetProtocolRequest (IN EFI_USB_IO_PROTOCOL *UsbIo, IN UINT8 Interface, IN UINT8 Protocol);
+EFI_STATUS EFIAPI UsbClearEndpointHalt (IN EFI_USB_IO_PROTOCOL *UsbIo, IN UINT8 Endpoint, OUT UINT32 *Status);
+
+//
+// Host environment control, for the tools.
+//
+
+/**
+  Report a failed ASSERT and abort.
+
+**/
+VOID
+HostAssert (
+  IN CONST CHAR8  *FileName,
+  IN UINTN        LineNumber,
+  IN CONST CHAR8  *Description
+  );
+
+/**
+  Return the virtual time in nanoseconds.
+
+**/
+UINT64
+HostNow (
+  VOID
+  );
+
+/**
+  Register the device model driving the virtual clock. HostAdvance() calls
+  Poll with the new time after every step, so the model can complete
+  transfers and invoke interrupt callbacks. Its next deadline bounds the step.
+
+  @param  Poll             Called with the current time, returns the time of
+                           the next event of the model, or MAX_UINT64.
+  @param  Context          Passed to Poll.
+
+**/
+VOID
+HostSetDevicePoll (
+  IN UINT64   (*Poll)(IN UINT64 Now, IN VOID *Context),
+  IN VOID     *Context
+  );
+
+/**
+  Advance the virtual clock, running the device model and expired timer
+  events on the way.
+
+  @param  NanoSeconds      The time to advance by.
+
+**/
+VOID
+HostAdvance (
+  IN UINT64   NanoSeconds
+  );
+
+/**
+  Return the current TPL.
+
+**/
+EFI_TPL
+HostCurrentTpl (
+  VOID
+  );
+
+/**
+  Delete every variable, as on a platform with an erased variable store.
+
+**/
+VOID
+HostClearVariables (
+  VOID
+  );
+
+/**
+  Create a handle carrying the given protocol interfaces, as a bus driver
+  would for a new device.
+
+  @param  Handle           Receives the handle.
+  @param  ...              GUID and interface pairs, terminated by NULL.
+
+**/
+EFI_STATUS
+EFIAPI
+HostCreateHandle (
+  OUT EFI_HANDLE  *Handle,
+  ...
+  );
+
+/**
+  Remove a handle created by HostCreateHandle() and every interface left on it.
+
+  @param  Handle           The handle.
+
+**/
+VOID
+HostDestroyHandle (
+  IN EFI_HANDLE   Handle
+  );
+
+#endif
@@ -0,0 +1,202 @@
+/** @file
+  Minimal UEFI type and library definitions for building the OS independent
+  driver core (JoyStickCore.c) into host tools.
+
+  Only what the core uses is defined here. Define JOYSTICK_HOST_BUILD to pick
+  this header instead of the EDK2 ones.
+
+  YIZD 2021
+
+**/
+
+#ifndef _HOST_UEFI_H_
+#define _HOST_UEFI_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t       UINT8;
+typedef uint16_t      UINT16;
+typedef uint32_t      UINT32;
+typedef uint64_t      UINT64;
+typedef int8_t        INT8;
+typedef int16_t       INT16;
+typedef int32_t       INT32;
+typedef int64_t       INT64;
+typedef uintptr_t     UINTN;
+typedef intptr_t      INTN;
+typedef uint16_t      CHAR16;
+typedef char          CHAR8;
+typedef uint8_t       BOOLEAN;
+typedef UINTN         RETURN_STATUS;
+typedef RETURN_STATUS EFI_STATUS;
+
+#define VOID          void
+#define CONST         const
+#define STATIC        static
+#define IN
+#define OUT
+#define OPTIONAL
+#define EFIAPI
+#define GLOBAL_REMOVE_IF_UNREFERENCED
+
+#define TRUE          ((BOOLEAN) 1)
+#define FALSE         ((BOOLEAN) 0)
+
+#define MAX_INT16     ((INT16) 0x7FFF)
+#define MAX_INT32     ((INT32) 0x7FFFFFFF)
+#define ARRAY_SIZE(Array)  (sizeof (Array) / sizeof ((Array)[0]))
+#define MIN(a, b)     (((a) < (b)) ? (a) : (b))
+#define MAX(a, b)     (((a) > (b)) ? (a) : (b))
+
+#define BIT0          0x00000001
+#define BIT1          0x00000002
+#define BIT2          0x00000004
+#define BIT3          0x00000008
+#define BIT4          0x00000010
+#define BIT5          0x00000020
+#define BIT6          0x00000040
+#define BIT7          0x00000080
+#define BIT8          0x00000100
+#define BIT9          0x00000200
+#define BIT10         0x00000400
+#define BIT11         0x00000800
+#define BIT12         0x00001000
+#define BIT13         0x00002000
+#define BIT14         0x00004000
+#define BIT15         0x00008000
+#define BIT16         0x00010000
+#define BIT17         0x00020000
+#define BIT18         0x00040000
+#define BIT19         0x00080000
+#define BIT20         0x00100000
+#define BIT21         0x00200000
+#define BIT22         0x00400000
+#define BIT23         0x00800000
+#define BIT24         0x01000000
+#define BIT25         0x02000000
+#define BIT26         0x04000000
+#define BIT27         0x08000000
+#define BIT28         0x10000000
+#define BIT29         0x20000000
+#define BIT30         0x40000000
+#define BIT31         0x80000000
+
+#define MAX_BIT               ((UINTN) 1 << (sizeof (UINTN) * 8 - 1))
+#define ENCODE_ERROR(a)       ((RETURN_STATUS) (MAX_BIT | (a)))
+#define EFI_ERROR(a)          (((INTN) (RETURN_STATUS) (a)) < 0)
+
+#define EFI_SUCCESS           ((EFI_STATUS) 0)
+#define EFI_INVALID_PARAMETER ENCODE_ERROR (2)
+#define EFI_UNSUPPORTED       ENCODE_ERROR (3)
+#define EFI_BUFFER_TOO_SMALL  ENCODE_ERROR (5)
+#define EFI_NOT_READY         ENCODE_ERROR (6)
+#define EFI_DEVICE_ERROR      ENCODE_ERROR (7)
+#define EFI_OUT_OF_RESOURCES  ENCODE_ERROR (9)
+#define EFI_NOT_FOUND         ENCODE_ERROR (14)
+#define EFI_TIMEOUT           ENCODE_ERROR (18)
+
+//
+// Simple Text Input Ex key definitions.
+//
+typedef struct {
+  UINT16  ScanCode;
+  CHAR16  UnicodeChar;
+} EFI_INPUT_KEY;
+
+typedef UINT8 EFI_KEY_TOGGLE_STATE;
+
+typedef struct {
+  UINT32                KeyShiftState;
+  EFI_KEY_TOGGLE_STATE  KeyToggleState;
+} EFI_KEY_STATE;
+
+typedef struct {
+  EFI_INPUT_KEY   Key;
+  EFI_KEY_STATE   KeyState;
+} EFI_KEY_DATA;
+
+#define SCAN_NULL             0x0000
+#define SCAN_UP               0x0001
+#define SCAN_DOWN             0x0002
+#define SCAN_RIGHT            0x0003
+#define SCAN_LEFT             0x0004
+#define SCAN_HOME             0x0005
+#define SCAN_END              0x0006
+#define SCAN_INSERT           0x0007
+#define SCAN_DELETE           0x0008
+#define SCAN_PAGE_UP          0x0009
+#define SCAN_PAGE_DOWN        0x000A
+#define SCAN_ESC              0x0017
+
+#define CHAR_NULL             0x0000
+#define CHAR_BACKSPACE        0x0008
+#define CHAR_TAB              0x0009
+#define CHAR_LINEFEED         0x000A
+#define CHAR_CARRIAGE_RETURN  0x000D
+
+//
+// BaseLib.
+//
+static inline UINT64
+MultU64x32 (
+  IN UINT64  Multiplicand,
+  IN UINT32  Multiplier
+  )
+{
+  return Multiplicand * Multiplier;
+}
+
+static inline UINT64
+DivU64x32 (
+  IN UINT64  Dividend,
+  IN UINT32  Divisor
+  )
+{
+  return Dividend / Divisor;
+}
+
+//
+// BaseMemoryLib.
+//
+static inline VOID *
+CopyMem (
+  OUT VOID        *DestinationBuffer,
+  IN  CONST VOID  *SourceBuffer,
+  IN  UINTN       Length
+  )
+{
+  return memmove (DestinationBuffer, SourceBuffer, Length);
+}
+
+static inline VOID *
+SetMem (
+  OUT VOID   *Buffer,
+  IN  UINTN  Length,
+  IN  UINT8  Value
+  )
+{
+  return memset (Buffer, Value, Length);
+}
+
+static inline VOID *
+ZeroMem (
+  OUT VOID   *Buffer,
+  IN  UINTN  Length
+  )
+{
+  return memset (Buffer, 0, Length);
+}
+
+static inline INTN
+CompareMem (
+  IN CONST VOID  *DestinationBuffer,
+  IN CONST VOID  *SourceBuffer,
+  IN UINTN       Length
+  )
+{
+  return memcmp (DestinationBuffer, SourceBuffer, Length);
+}
+
+#endif
@@ -0,0 +1,706 @@
+/** @file
+  Run the USB JoyStick driver against a simulated Pro Controller.
+
+  Loads the whole driver on the HostDxe virtual clock and, for each
+  iteration, plugs in one or more ProSim controllers, binds the driver to
+  them, reads keys through Simple Text Input for the run duration and
+  unbinds them. Prints Start() latency percentiles, the time until every
+  pad is brought up and the SPI reads it took, the keys the script should have produced against the
+  keys read, and what the injected faults did to the transfer: stalls,
+  lost and slow replies, dropped reports, and whether the driver got
+  reports flowing again after an error.
+
+  Every pad has its own Bluetooth address, so from the second iteration on
+  the driver finds its calibration in the variables kept from the first
+  one. --fresh-nv deletes them before every iteration.
+
+  With --joycon the pads are Joy-Con halves, left on even and right on odd
+  pads, each reporting its side of the script. The driver pairs them, so
+  every two pads make one player reading the whole script.
+
+  With --in-endpoints the pads send their input reports over several
+  interrupt IN endpoints in turn, each with its own transfer in the driver.
+
+  With --chatter every button change bounces back for one report N times.
+  Keys are expected from the buttons of the reports delivered, bounces
+  included, so a bounce the driver's debounce window does not absorb is
+  expected to make a key.
+
+  Time is virtual, so a seed and a script always give the same numbers.
+
+  ProSim [--iterations N] [--pads N] [--duration MS] [--rate HZ] [--reply-us US]
+         [--stall PM] [--timeout PM] [--drop PM] [--slow PM] [--slow-us US]
+         [--seed N] [--fresh-nv] [--joycon] [--in-endpoints N] [--chatter N]
+         [--script FILE]
+
+  YIZD 2021
+
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ProSim.h"
+
+#define PROSIM_DEFAULT_ITERATIONS   20
+#define PROSIM_DEFAULT_DURATION_MS  2000
+#define PROSIM_READ_PERIOD_NS       1000000ULL
+#define PROSIM_HOLD_MS              48
+#define PROSIM_DRAIN_REPORTS        4
+#define PROSIM_MAX_PADS             JOYSTICK_MAX_PLAYERS
+#define PROSIM_MAX_BRING_UP_NS      10000000000ULL
+#define PROSIM_ADDRESS_BASE         0x98B6E9000000ULL
+
+EFI_STATUS
+EFIAPI
+USBJoyStickDriverBindingEntryPoint (
+  IN EFI_HANDLE           ImageHandle,
+  IN EFI_SYSTEM_TABLE     *SystemTable
+  );
+
+//
+// Default script: press and release every key button in turn.
+//
+STATIC CONST UINT32 mProSimCycle[] = {
+  JOYSTICK_BUTTON_UP,   JOYSTICK_BUTTON_DOWN,  JOYSTICK_BUTTON_LEFT,   JOYSTICK_BUTTON_RIGHT,
+  JOYSTICK_BUTTON_A,    JOYSTICK_BUTTON_B,     JOYSTICK_BUTTON_X,      JOYSTICK_BUTTON_Y,
+  JOYSTICK_BUTTON_PLUS, JOYSTICK_BUTTON_MINUS, JOYSTICK_BUTTON_L,      JOYSTICK_BUTTON_R
+};
+
+STATIC PROSIM_STEP  mProSimDefaultScript[ARRAY_SIZE (mProSimCycle) * 2];
+
+typedef struct {
+  UINTN           Iterations;
+  UINTN           Started;
+  UINTN           Failed;
+  UINTN           TplLeaked;
+  UINTN           TransferLost;
+  UINTN           NotActivated;
+  UINT64          *StartNs;
+  UINT64          *BringUpNs;
+  UINT64          Keys;
+  PROSIM_STATS    Device;
+  ///
+  /// The counters of the driver's statistics protocol, summed.
+  ///
+  USB_JOYSTICK_STATS  Driver;
+} PROSIM_TOTALS;
+
+STATIC
+VOID
+ProSimBuildDefaultScript (
+  OUT PROSIM_CONFIG   *Config
+  )
+{
+  UINTN   Index;
+  UINTN   Axis;
+
+  for (Index = 0; Index < ARRAY_SIZE (mProSimDefaultScript); Index++) {
+    mProSimDefaultScript[Index].TimeMs  = (UINT32) (Index * PROSIM_HOLD_MS);
+    mProSimDefaultScript[Index].Buttons = (Index % 2 == 0) ? mProSimCycle[Index / 2] : 0;
+    for (Axis = 0; Axis < JOYSTICK_STICK_AXES; Axis++) {
+      mProSimDefaultScript[Index].Sticks[Axis] = 2048;
+    }
+  }
+  Config->Script      = mProSimDefaultScript;
+  Config->ScriptSteps = ARRAY_SIZE (mProSimDefaultScript);
+  Config->LoopMs      = (UINT32) (ARRAY_SIZE (mProSimDefaultScript) * PROSIM_HOLD_MS);
+}
+
+/**
+  Return the time the shortest step of the script holds its input, the
+  step looping back to the first one included.
+
+**/
+STATIC
+UINT32
+ProSimShortestStepMs (
+  IN CONST PROSIM_CONFIG  *Config
+  )
+{
+  UINT32  Shortest;
+  UINTN   Index;
+
+  Shortest = MAX_UINT32;
+  for (Index = 1; Index < Config->ScriptSteps; Index++) {
+    Shortest = MIN (Shortest, Config->Script[Index].TimeMs - Config->Script[Index - 1].TimeMs);
+  }
+  if (Config->LoopMs != 0 && Config->ScriptSteps != 0) {
+    Shortest = MIN (Shortest, Config->LoopMs - Config->Script[Config->ScriptSteps - 1].TimeMs + Config->Script[0].TimeMs);
+  }
+  return Shortest;
+}
+
+STATIC
+VOID
+ProSimAddStats (
+  IN OUT PROSIM_STATS         *Total,
+  IN     CONST PROSIM_STATS   *Stats
+  )
+{
+  Total->Reports      += Stats->Reports;
+  Total->Dropped      += Stats->Dropped;
+  Total->Overruns     += Stats->Overruns;
+  Total->Delivered    += Stats->Delivered;
+  Total->Replies      += Stats->Replies;
+  Total->LostReplies  += Stats->LostReplies;
+  Total->SlowReplies  += Stats->SlowReplies;
+  Total->Stalls       += Stats->Stalls;
+  Total->HaltsCleared += Stats->HaltsCleared;
+  Total->KeyEdges     += Stats->KeyEdges;
+  Total->Recoveries   += Stats->Recoveries;
+  Total->RecoveryNs   += Stats->RecoveryNs;
+  Total->SpiReads     += Stats->SpiReads;
+}
+
+/**
+  Add the counters of the driver's statistics protocol on a controller,
+  when it is built in.
+
+**/
+STATIC
+VOID
+ProSimAddDriverStats (
+  IN OUT USB_JOYSTICK_STATS   *Total,
+  IN     EFI_HANDLE           Controller
+  )
+{
+  USB_JOYSTICK_STATS_PROTOCOL   *StatsProtocol;
+  USB_JOYSTICK_STATS            Stats;
+  UINTN                         Type;
+
+  if (EFI_ERROR (gBS->HandleProtocol (Controller, &gUsbJoyStickStatsProtocolGuid, (VOID **) &StatsProtocol)) ||
+      EFI_ERROR (StatsProtocol->GetStats (StatsProtocol, &Stats))) {
+    return;
+  }
+
+  Total->Reports     += Stats.Reports;
+  Total->Unchanged   += Stats.Unchanged;
+  Total->KeysQueued  += Stats.KeysQueued;
+  Total->KeysDropped += Stats.KeysDropped;
+  Total->Errors      += Stats.Errors;
+  Total->Recoveries  += Stats.Recoveries;
+  for (Type = 0; Type < USB_JOYSTICK_REPORT_TYPES; Type++) {
+    Total->ReportTypes[Type] += Stats.ReportTypes[Type];
+  }
+}
+
+/**
+  Read every key the pads have queued, through each pad's Simple Text Input
+  in turn as ConSplitter polls them.
+
+  @return The number of keys read.
+
+**/
+STATIC
+UINT64
+ProSimReadKeys (
+  IN     EFI_SIMPLE_TEXT_INPUT_PROTOCOL  **SimpleInput,
+  IN     UINTN                           Pads
+  )
+{
+  EFI_INPUT_KEY   Key;
+  UINTN           Pad;
+  UINT64          Keys;
+
+  Keys = 0;
+  for (Pad = 0; Pad < Pads; Pad++) {
+    if (SimpleInput[Pad] == NULL) {
+      continue;
+    }
+    while (!EFI_ERROR (SimpleInput[Pad]->ReadKeyStroke (SimpleInput[Pad], &Key))) {
+      Keys++;
+    }
+  }
+  return Keys;
+}
+
+/**
+  Start counting the key edges of a pad from the state of the driver's
+  decoder: the buttons it holds, the changes in its debounce window and,
+  for a Joy-Con pair, the halves waiting to be merged. The count then
+  follows the reports the driver decodes from here on: the ones still in
+  the pad's FIFO and the ones sent later, through the drain at the end of
+  the run.
+
+**/
+STATIC
+VOID
+ProSimStartKeyEdges (
+  IN OUT PROSIM_DEVICE    *Device,
+  IN     USB_JS_DEV       *UsbJoyStickDevice
+  )
+{
+  CONST JOYSTICK_DEBOUNCE   *Debounce;
+  UINTN                     Bit;
+  UINTN                     Slice;
+
+  Device->Stats.KeyEdges = 0;
+  Device->PairOwner      = NULL;
+
+  //
+  // A pair decodes on its owner, which holds the buttons of both halves.
+  //
+  if (UsbJoyStickDevice->Partner != NULL) {
+    if (!UsbJoyStickDevice->PairOwner) {
+      UsbJoyStickDevice = UsbJoyStickDevice->Partner;
+    }
+    Device->PairOwner = BASE_CR (UsbJoyStickDevice->UsbIo, PROSIM_DEVICE, UsbIo);
+    CopyMem (&Device->PairOwner->Pair, &UsbJoyStickDevice->Pair, sizeof (JOYSTICK_PAIR));
+  }
+
+  Debounce                 = &UsbJoyStickDevice->Decoder.Debounce;
+  Device->DeliveredButtons = UsbJoyStickDevice->Decoder.Buttons & PROSIM_KEY_BUTTONS;
+  for (Bit = 0; Bit < 32; Bit++) {
+    Device->DebounceCount[Bit] = 0;
+    for (Slice = 0; Slice < JOYSTICK_DEBOUNCE_BITS; Slice++) {
+      Device->DebounceCount[Bit] |= (UINT8) (((Debounce->Counter[Slice] >> Bit) & 1) << Slice);
+    }
+  }
+}
+
+/**
+  Plug in Pads controllers, bind the driver to each in turn, wait for all
+  of them to be brought up, read keys for DurationNs and unbind them.
+
+**/
+STATIC
+VOID
+ProSimRunOnce (
+  IN     CONST PROSIM_CONFIG  *Config,
+  IN     UINTN                Pads,
+  IN     BOOLEAN              JoyCon,
+  IN     UINT64               DurationNs,
+  IN OUT PROSIM_TOTALS        *Totals
+  )
+{
+  EFI_DRIVER_BINDING_PROTOCOL     *Binding;
+  EFI_SIMPLE_TEXT_INPUT_PROTOCOL  *SimpleInput[PROSIM_MAX_PADS];
+  PROSIM_DEVICE                   *Device[PROSIM_MAX_PADS];
+  EFI_HANDLE                      Controller[PROSIM_MAX_PADS];
+  USB_JS_DEV                      *UsbJoyStickDevice;
+  PROSIM_CONFIG                   PadConfig;
+  EFI_STATUS                      Status;
+  UINT64                          Begin;
+  UINT64                          StartBegin;
+  UINT64                          Elapsed;
+  UINT64                          DrainNs;
+  UINTN                           Pad;
+  UINTN                           Up;
+  UINTN                           Index;
+
+  Binding = &gUsbJoyStickDriverBinding;
+  Totals->Iterations++;
+
+  for (Pad = 0; Pad < Pads; Pad++) {
+    CopyMem (&PadConfig, Config, sizeof (PadConfig));
+    PadConfig.Seed    = Config->Seed + (UINT32) (Pad * 7919);
+    PadConfig.Address = PROSIM_ADDRESS_BASE + Pad;
+    if (JoyCon) {
+      PadConfig.Side  = (Pad % 2 == 0) ? JOYSTICK_SIDE_LEFT : JOYSTICK_SIDE_RIGHT;
+    }
+    Device[Pad]       = ProSimCreate (&PadConfig);
+    SimpleInput[Pad]  = NULL;
+    Controller[Pad]   = NULL;
+    if (Device[Pad] == NULL) {
+      continue;
+    }
+    HostCreateHandle (
+      &Controller[Pad],
+      &gEfiUsbIoProtocolGuid,
+      &Device[Pad]->UsbIo,
+      &gEfiDevicePathProtocolGuid,
+      &Device[Pad]->DevicePath,
+      NULL
+      );
+  }
+
+  //
+  // The bus driver connects the pads one after the other.
+  //
+  Begin = HostNow ();
+  for (Pad = 0; Pad < Pads; Pad++) {
+    Status = EFI_OUT_OF_RESOURCES;
+    if (Device[Pad] != NULL) {
+      Status = Binding->Supported (Binding, Controller[Pad], NULL);
+    }
+    if (!EFI_ERROR (Status)) {
+      StartBegin = HostNow ();
+      Status     = Binding->Start (Binding, Controller[Pad], NULL);
+      Totals->StartNs[Totals->Started + Totals->Failed] = HostNow () - StartBegin;
+    }
+
+    //
+    // Start() must return at the TPL it was called at, on its error paths
+    // too. A leak fails the run; the TPL is put back so the run goes on.
+    //
+    if (HostCurrentTpl () != TPL_APPLICATION) {
+      Totals->TplLeaked++;
+      gBS->RestoreTPL (TPL_APPLICATION);
+    }
+
+    if (EFI_ERROR (Status)) {
+      Totals->Failed++;
+      continue;
+    }
+    Totals->Started++;
+    gBS->HandleProtocol (Controller[Pad], &gEfiSimpleTextInProtocolGuid, (VOID **) &SimpleInput[Pad]);
+  }
+
+  //
+  // Bring-up goes on after Start() returns. Reading keys meanwhile, as a
+  // console does, also activates pads bound with lazy activation.
+  //
+  for (Elapsed = 0; Elapsed < PROSIM_MAX_BRING_UP_NS; Elapsed += PROSIM_READ_PERIOD_NS) {
+    Up = 0;
+    for (Pad = 0; Pad < Pads; Pad++) {
+      if (SimpleInput[Pad] == NULL) {
+        Up++;
+        continue;
+      }
+      UsbJoyStickDevice = USB_JS_DEV_FROM_THIS (SimpleInput[Pad]);
+      if (UsbJoyStickDevice->Activated || UsbJoyStickDevice->ActivationFailed) {
+        Up++;
+      }
+    }
+    if (Up == Pads) {
+      break;
+    }
+    HostAdvance (PROSIM_READ_PERIOD_NS);
+    ProSimReadKeys (SimpleInput, Pads);
+  }
+  Totals->BringUpNs[Totals->Iterations - 1] = HostNow () - Begin;
+
+  for (Pad = 0; Pad < Pads; Pad++) {
+    if (SimpleInput[Pad] != NULL && !USB_JS_DEV_FROM_THIS (SimpleInput[Pad])->Activated) {
+      Totals->NotActivated++;
+    }
+  }
+
+  //
+  // Keys are expected from the button edges delivered after every pad is
+  // up, and only counted from then on. The driver does not decode the
+  // reports it receives while bringing a pad up, so edges are counted
+  // from the state of its decoder, not from the last report it was sent.
+  //
+  for (Pad = 0; Pad < Pads; Pad++) {
+    if (Device[Pad] != NULL) {
+      Device[Pad]->Stats.KeyEdges = 0;
+      if (SimpleInput[Pad] != NULL) {
+        ProSimStartKeyEdges (Device[Pad], USB_JS_DEV_FROM_THIS (SimpleInput[Pad]));
+      }
+    }
+  }
+  for (Elapsed = 0; Elapsed < DurationNs; Elapsed += PROSIM_READ_PERIOD_NS) {
+    HostAdvance (PROSIM_READ_PERIOD_NS);
+    Totals->Keys += ProSimReadKeys (SimpleInput, Pads);
+  }
+
+  //
+  // An edge in the last milliseconds is still in the debounce window.
+  // Hold the input where the script left it and give it a few reports to
+  // come out before unbinding, behind whatever the endpoint FIFOs hold.
+  // Reports are delivered once per endpoint interval at most, however
+  // fast the pad sends them. Edges delivered meanwhile are still counted,
+  // so every key read has its edge.
+  //
+  // Endpoints stop stalling meanwhile, and the drain also waits out the
+  // driver's recovery delay, so a transfer still stopped at the end was
+  // lost rather than about to be submitted again.
+  //
+  for (Pad = 0; Pad < Pads; Pad++) {
+    if (Device[Pad] != NULL) {
+      Device[Pad]->Config.ScriptSteps   = 0;
+      Device[Pad]->Config.StallPerMille = 0;
+    }
+  }
+  DrainNs = (PROSIM_FIFO_DEPTH + PROSIM_DRAIN_REPORTS) * MAX (1000000000ULL / Config->ReportRate, Config->Interval * 1000000ULL);
+  if (Config->StallPerMille != 0) {
+    DrainNs += EFI_USB_INTERRUPT_DELAY * 100ULL;
+  }
+  for (Elapsed = 0; Elapsed < DrainNs; Elapsed += PROSIM_READ_PERIOD_NS) {
+    HostAdvance (PROSIM_READ_PERIOD_NS);
+    Totals->Keys += ProSimReadKeys (SimpleInput, Pads);
+  }
+
+  for (Pad = 0; Pad < Pads; Pad++) {
+    if (Device[Pad] == NULL) {
+      continue;
+    }
+    if (SimpleInput[Pad] != NULL) {
+      ProSimAddDriverStats (&Totals->Driver, Controller[Pad]);
+      for (Index = 0; Index < Device[Pad]->Config.InEndpoints; Index++) {
+        if (Device[Pad]->In[Index].AsyncCallback == NULL) {
+          Totals->TransferLost++;
+          break;
+        }
+      }
+      Binding->Stop (Binding, Controller[Pad], 0, NULL);
+    }
+    ProSimAddStats (&Totals->Device, &Device[Pad]->Stats);
+    HostDestroyHandle (Controller[Pad]);
+    ProSimDestroy (Device[Pad]);
+  }
+}
+
+STATIC
+int
+ProSimCompare (
+  CONST VOID  *Left,
+  CONST VOID  *Right
+  )
+{
+  UINT64  A;
+  UINT64  B;
+
+  A = *(CONST UINT64 *) Left;
+  B = *(CONST UINT64 *) Right;
+  return (A > B) - (A < B);
+}
+
+STATIC
+VOID
+ProSimPrint (
+  IN OUT PROSIM_TOTALS  *Totals
+  )
+{
+  CONST PROSIM_STATS  *Stats;
+  UINTN               Count;
+
+  Stats = &Totals->Device;
+  Count = Totals->Started + Totals->Failed;
+  qsort (Totals->StartNs, Count, sizeof (UINT64), ProSimCompare);
+  qsort (Totals->BringUpNs, Totals->Iterations, sizeof (UINT64), ProSimCompare);
+
+  printf (
+    "iterations %llu  started %llu  failed %llu  tpl left raised %llu\n",
+    (unsigned long long) Totals->Iterations,
+    (unsigned long long) Totals->Started,
+    (unsigned long long) Totals->Failed,
+    (unsigned long long) Totals->TplLeaked
+    );
+  if (Count != 0) {
+    printf (
+      "start ms      p50 %.3f  p99 %.3f  max %.3f\n",
+      Totals->StartNs[Count / 2] / 1e6,
+      Totals->StartNs[Count * 99 / 100] / 1e6,
+      Totals->StartNs[Count - 1] / 1e6
+      );
+  }
+  printf (
+    "bring-up ms   p50 %.3f  p99 %.3f  max %.3f  not activated %llu  spi reads %llu\n",
+    Totals->BringUpNs[Totals->Iterations / 2] / 1e6,
+    Totals->BringUpNs[Totals->Iterations * 99 / 100] / 1e6,
+    Totals->BringUpNs[Totals->Iterations - 1] / 1e6,
+    (unsigned long long) Totals->NotActivated,
+    (unsigned long long) Stats->SpiReads
+    );
+  printf (
+    "keys          expected %llu  read %llu\n",
+    (unsigned long long) Stats->KeyEdges,
+    (unsigned long long) Totals->Keys
+    );
+  printf (
+    "reports       sent %llu  delivered %llu  dropped %llu  overrun %llu\n",
+    (unsigned long long) Stats->Reports,
+    (unsigned long long) Stats->Delivered,
+    (unsigned long long) Stats->Dropped,
+    (unsigned long long) Stats->Overruns
+    );
+  printf (
+    "replies       sent %llu  lost %llu  slow %llu\n",
+    (unsigned long long) Stats->Replies,
+    (unsigned long long) Stats->LostReplies,
+    (unsigned long long) Stats->SlowReplies
+    );
+  printf (
+    "stalls        %llu  halts cleared %llu  recovered %llu",
+    (unsigned long long) Stats->Stalls,
+    (unsigned long long) Stats->HaltsCleared,
+    (unsigned long long) Stats->Recoveries
+    );
+  if (Stats->Recoveries != 0) {
+    printf ("  mean %.3f ms", Stats->RecoveryNs / 1e6 / Stats->Recoveries);
+  }
+  printf ("  transfer lost %llu\n", (unsigned long long) Totals->TransferLost);
+  printf (
+    "driver stats  reports %llu  unchanged %llu  keys %llu  dropped %llu  errors %llu  recoveries %llu\n",
+    (unsigned long long) Totals->Driver.Reports,
+    (unsigned long long) Totals->Driver.Unchanged,
+    (unsigned long long) Totals->Driver.KeysQueued,
+    (unsigned long long) Totals->Driver.KeysDropped,
+    (unsigned long long) Totals->Driver.Errors,
+    (unsigned long long) Totals->Driver.Recoveries
+    );
+  printf (
+    "  ids  0x30 %llu  0x3F %llu  0x21 %llu  0x81 %llu  other %llu\n",
+    (unsigned long long) Totals->Driver.ReportTypes[USB_JOYSTICK_REPORT_FULL],
+    (unsigned long long) Totals->Driver.ReportTypes[USB_JOYSTICK_REPORT_SIMPLE],
+    (unsigned long long) Totals->Driver.ReportTypes[USB_JOYSTICK_REPORT_SUBCMD_REPLY],
+    (unsigned long long) Totals->Driver.ReportTypes[USB_JOYSTICK_REPORT_USB_REPLY],
+    (unsigned long long) Totals->Driver.ReportTypes[USB_JOYSTICK_REPORT_OTHER]
+    );
+}
+
+STATIC
+VOID
+ProSimUsage (
+  VOID
+  )
+{
+  fprintf (
+    stderr,
+    "Usage: ProSim [options]\n"
+    "  --iterations N  Plug, bind, run and unbind N times (default %d).\n"
+    "  --pads N        Controllers plugged in per iteration, 1 to %d (default 1).\n"
+    "  --duration MS   Virtual time to read keys per iteration (default %d).\n"
+    "  --rate HZ       Input reports per second (default 125).\n"
+    "  --reply-us US   Delay of handshake and subcommand replies (default 4000).\n"
+    "  --stall PM      Per mille of IN transactions that stall the endpoint.\n"
+    "  --timeout PM    Per mille of replies that never come.\n"
+    "  --drop PM       Per mille of input reports dropped.\n"
+    "  --slow PM       Per mille of replies delayed by --slow-us (default 50000).\n"
+    "  --seed N        Fault generator seed, varied per iteration (default 1).\n"
+    "  --fresh-nv      Delete the driver's variables before every iteration.\n"
+    "  --joycon        Plug Joy-Con halves, left and right in turn; needs even --pads.\n"
+    "  --in-endpoints N\n"
+    "                  Interrupt IN endpoints per pad, 1 to %d (default 1).\n"
+    "  --chatter N     One report bounces after every button change, 0 to %d;\n"
+    "                  the bounce and debounce window must fit the shortest step.\n"
+    "  --script FILE   Input script, lines of \"<ms> <buttons> [<lx> <ly> <rx> <ry>]\".\n",
+    PROSIM_DEFAULT_ITERATIONS,
+    PROSIM_MAX_PADS,
+    PROSIM_DEFAULT_DURATION_MS,
+    PROSIM_MAX_IN_ENDPOINTS,
+    PROSIM_MAX_BOUNCES
+    );
+}
+
+int
+main (
+  int   argc,
+  char  **argv
+  )
+{
+  PROSIM_CONFIG   Config;
+  PROSIM_CONFIG   Run;
+  PROSIM_TOTALS   Totals;
+  CONST char      *Script;
+  UINTN           Iterations;
+  UINTN           Pads;
+  UINTN           DurationMs;
+  BOOLEAN         FreshNv;
+  BOOLEAN         JoyCon;
+  UINTN           Bounces;
+  UINTN           Index;
+  int             Arg;
+
+  ProSimDefaultConfig (&Config);
+  Script     = NULL;
+  Iterations = PROSIM_DEFAULT_ITERATIONS;
+  Pads       = 1;
+  DurationMs = PROSIM_DEFAULT_DURATION_MS;
+  FreshNv    = FALSE;
+  JoyCon     = FALSE;
+  Bounces    = 0;
+
+  for (Arg = 1; Arg < argc; Arg++) {
+    if (strcmp (argv[Arg], "--iterations") == 0 && Arg + 1 < argc) {
+      Iterations = strtoul (argv[++Arg], NULL, 0);
+    } else if (strcmp (argv[Arg], "--pads") == 0 && Arg + 1 < argc) {
+      Pads = strtoul (argv[++Arg], NULL, 0);
+    } else if (strcmp (argv[Arg], "--duration") == 0 && Arg + 1 < argc) {
+      DurationMs = strtoul (argv[++Arg], NULL, 0);
+    } else if (strcmp (argv[Arg], "--rate") == 0 && Arg + 1 < argc) {
+      Config.ReportRate = (UINT32) strtoul (argv[++Arg], NULL, 0);
+    } else if (strcmp (argv[Arg], "--reply-us") == 0 && Arg + 1 < argc) {
+      Config.ReplyDelayNs = strtoull (argv[++Arg], NULL, 0) * 1000;
+    } else if (strcmp (argv[Arg], "--stall") == 0 && Arg + 1 < argc) {
+      Config.StallPerMille = (UINT32) strtoul (argv[++Arg], NULL, 0);
+    } else if (strcmp (argv[Arg], "--timeout") == 0 && Arg + 1 < argc) {
+      Config.TimeoutPerMille = (UINT32) strtoul (argv[++Arg], NULL, 0);
+    } else if (strcmp (argv[Arg], "--drop") == 0 && Arg + 1 < argc) {
+      Config.DropPerMille = (UINT32) strtoul (argv[++Arg], NULL, 0);
+    } else if (strcmp (argv[Arg], "--slow") == 0 && Arg + 1 < argc) {
+      Config.SlowPerMille = (UINT32) strtoul (argv[++Arg], NULL, 0);
+    } else if (strcmp (argv[Arg], "--slow-us") == 0 && Arg + 1 < argc) {
+      Config.SlowNs = strtoull (argv[++Arg], NULL, 0) * 1000;
+    } else if (strcmp (argv[Arg], "--seed") == 0 && Arg + 1 < argc) {
+      Config.Seed = (UINT32) strtoul (argv[++Arg], NULL, 0);
+    } else if (strcmp (argv[Arg], "--fresh-nv") == 0) {
+      FreshNv = TRUE;
+    } else if (strcmp (argv[Arg], "--joycon") == 0) {
+      JoyCon = TRUE;
+    } else if (strcmp (argv[Arg], "--in-endpoints") == 0 && Arg + 1 < argc) {
+      Config.InEndpoints = (UINT8) strtoul (argv[++Arg], NULL, 0);
+    } else if (strcmp (argv[Arg], "--chatter") == 0 && Arg + 1 < argc) {
+      Bounces = strtoul (argv[++Arg], NULL, 0);
+    } else if (strcmp (argv[Arg], "--script") == 0 && Arg + 1 < argc) {
+      Script = argv[++Arg];
+    } else {
+      ProSimUsage ();
+      return 2;
+    }
+  }
+
+  if (Iterations == 0 || Pads == 0 || Pads > PROSIM_MAX_PADS || Config.ReportRate == 0 || Config.ReportRate > 1000 ||
+      (JoyCon && Pads % 2 != 0) || Config.InEndpoints == 0 || Config.InEndpoints > PROSIM_MAX_IN_ENDPOINTS ||
+      Bounces > PROSIM_MAX_BOUNCES) {
+    ProSimUsage ();
+    return 2;
+  }
+  Config.Bounces = (UINT8) Bounces;
+
+  if (Script != NULL) {
+    if (ProSimLoadScript (Script, &Config) != 0) {
+      return 1;
+    }
+  } else {
+    ProSimBuildDefaultScript (&Config);
+  }
+
+  //
+  // A bounce takes two reports per --chatter, and the settled input must
+  // then last the debounce window before the script moves on. Otherwise
+  // the window swallows the change, which says nothing about the driver.
+  //
+  if (Bounces != 0 &&
+      (2 * Bounces + MAX (FixedPcdGet8 (PcdJoyStickDebounceReports), 1)) * 1000000000ULL / Config.ReportRate >
+      ProSimShortestStepMs (&Config) * 1000000ULL) {
+    fprintf (stderr, "--chatter %u outlasts the shortest script step at %u reports per second\n", (unsigned) Bounces, Config.ReportRate);
+    return 2;
+  }
+
+  ZeroMem (&Totals, sizeof (Totals));
+  Totals.StartNs   = calloc (Iterations * Pads, sizeof (UINT64));
+  Totals.BringUpNs = calloc (Iterations, sizeof (UINT64));
+  if (Totals.StartNs == NULL || Totals.BringUpNs == NULL) {
+    fprintf (stderr, "out of memory\n");
+    return 1;
+  }
+
+  if (EFI_ERROR (USBJoyStickDriverBindingEntryPoint (NULL, gST))) {
+    fprintf (stderr, "driver entry point failed\n");
+    return 1;
+  }
+
+  for (Index = 0; Index < Iterations; Index++) {
+    CopyMem (&Run, &Config, sizeof (Run));
+    Run.Seed = Config.Seed + (UINT32) Index;
+    if (FreshNv) {
+      HostClearVariables ();
+    }
+    ProSimRunOnce (&Run, Pads, JoyCon, (UINT64) DurationMs * 1000000, &Totals);
+  }
+
+  ProSimPrint (&Totals);
+  if (Totals.TplLeaked != 0) {
+    fprintf (stderr, "Start() left the TPL raised\n");
+    return 1;
+  }
+  if (Totals.Keys != Totals.Device.KeyEdges) {
+    fprintf (stderr, "keys read differ from the keys expected\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,252 @@
+/** @file
+  Software Switch Pro Controller behind a mock USB I/O protocol.
+
+  The device answers the USB handshake (0x80 0x02 / 0x80 0x04), subcommands
+  (set report mode, SPI flash read, player lights, IMU enable) with 0x21
+  replies, and streams 0x30 or 0x3F input reports from a scripted input
+  sequence. Faults can be injected with a fixed per mille probability:
+  endpoint stalls, lost replies, slow replies and dropped reports. Buttons
+  can chatter, and input reports can be split over several interrupt IN
+  endpoints, as adapters do.
+
+  Every device runs on the HostDxe virtual clock, so the same seed and
+  script give the same run.
+
+  YIZD 2021
+
+**/
+
+#ifndef _PRO_SIM_H_
+#define _PRO_SIM_H_
+
+#include "JoyStick.h"
+
+#define PROSIM_IN_ENDPOINT            0x81
+#define PROSIM_OUT_ENDPOINT           0x01
+#define PROSIM_MAX_IN_ENDPOINTS       4
+#define PROSIM_FIFO_DEPTH             8
+#define PROSIM_MAX_BOUNCES            8
+#define PROSIM_MAX_SYNC_WAIT_NS       5000000000ULL
+
+//
+// Buttons the driver turns into keys, used to count the keys a script
+// should produce.
+//
+#define PROSIM_KEY_BUTTONS            (JOYSTICK_BUTTON_UP | JOYSTICK_BUTTON_DOWN | \
+                                       JOYSTICK_BUTTON_LEFT | JOYSTICK_BUTTON_RIGHT | \
+                                       JOYSTICK_BUTTON_A | JOYSTICK_BUTTON_B | \
+                                       JOYSTICK_BUTTON_X | JOYSTICK_BUTTON_Y | \
+                                       JOYSTICK_BUTTON_PLUS | JOYSTICK_BUTTON_MINUS | \
+                                       JOYSTICK_BUTTON_L | JOYSTICK_BUTTON_R)
+
+///
+/// One step of the input script: from TimeMs after streaming starts the
+/// controller holds Buttons and reports Sticks.
+///
+typedef struct {
+  UINT32    TimeMs;
+  UINT32    Buttons;
+  UINT16    Sticks[JOYSTICK_STICK_AXES];
+} PROSIM_STEP;
+
+typedef struct {
+  ///
+  /// Input reports per second while streaming.
+  ///
+  UINT32              ReportRate;
+  ///
+  /// bInterval of the interrupt endpoints, in milliseconds.
+  ///
+  UINT8               Interval;
+  ///
+  /// Time from a request to its reply.
+  ///
+  UINT64              ReplyDelayNs;
+  ///
+  /// Fault probabilities in per mille: a stall per IN transaction, a lost
+  /// or slow reply per request, a dropped report per input report.
+  ///
+  UINT32              StallPerMille;
+  UINT32              TimeoutPerMille;
+  UINT32              SlowPerMille;
+  UINT32              DropPerMille;
+  UINT64              SlowNs;
+  UINT32              Seed;
+  ///
+  /// Bluetooth address answered to the device info subcommand, 0 for none.
+  ///
+  UINT64              Address;
+  ///
+  /// JOYSTICK_SIDE_LEFT or JOYSTICK_SIDE_RIGHT to be a Joy-Con half, which
+  /// only reports the buttons and stick of its side of the script.
+  /// JOYSTICK_SIDE_NONE for a Pro Controller.
+  ///
+  UINT8               Side;
+  ///
+  /// Interrupt IN endpoints, PROSIM_IN_ENDPOINT and up. Input reports are
+  /// sent on each in turn, replies on the first.
+  ///
+  UINT8               InEndpoints;
+  ///
+  /// Chattering buttons: every button change is followed by this many one
+  /// report bounces back to the previous buttons. Only the change counts as
+  /// a key edge.
+  ///
+  UINT8               Bounces;
+  ///
+  /// Input script, sorted by TimeMs. It restarts every LoopMs when LoopMs
+  /// is not 0, and holds its last step otherwise.
+  ///
+  CONST PROSIM_STEP   *Script;
+  UINTN               ScriptSteps;
+  UINT32              LoopMs;
+} PROSIM_CONFIG;
+
+typedef struct {
+  UINT64    Reports;
+  UINT64    Dropped;
+  UINT64    Overruns;
+  UINT64    Delivered;
+  UINT64    Replies;
+  UINT64    LostReplies;
+  UINT64    SlowReplies;
+  UINT64    Stalls;
+  UINT64    HaltsCleared;
+  UINT64    KeyEdges;
+  UINT64    Recoveries;
+  UINT64    RecoveryNs;
+  UINT64    SpiReads;
+} PROSIM_STATS;
+
+//
+// A reply waiting for its time, or a report in an IN endpoint FIFO.
+//
+typedef struct {
+  UINT64    ReadyNs;
+  UINT8     Data[JOYSTICK_REPORT_SIZE];
+} PROSIM_PACKET;
+
+//
+// An interrupt IN endpoint: its FIFO, halt state and the asynchronous
+// transfer of the driver.
+//
+typedef struct {
+  UINT8                             Address;
+  BOOLEAN                           Halted;
+  PROSIM_PACKET                     Fifo[PROSIM_FIFO_DEPTH];
+  UINTN                             FifoHead;
+  UINTN                             FifoCount;
+
+  EFI_ASYNC_USB_TRANSFER_CALLBACK   AsyncCallback;
+  VOID                              *AsyncContext;
+  UINTN                             AsyncLength;
+  UINT64                            AsyncIntervalNs;
+  UINT64                            NextPollNs;
+  UINT8                             *AsyncBuffer;
+  UINT64                            ErrorNs;
+} PROSIM_ENDPOINT;
+
+typedef struct _PROSIM_DEVICE PROSIM_DEVICE;
+
+struct _PROSIM_DEVICE {
+  EFI_USB_IO_PROTOCOL               UsbIo;
+  EFI_DEVICE_PATH_PROTOCOL          DevicePath;
+  PROSIM_CONFIG                     Config;
+  PROSIM_STATS                      Stats;
+  PROSIM_DEVICE                     *Next;
+
+  UINT32                            Random;
+  BOOLEAN                           Polling;
+
+  //
+  // Input generation. Held is the input of the script, Buttons the one
+  // reported, which differs from it during a bounce. Key edges are
+  // counted from the buttons of the reports delivered, bounces included,
+  // debounced per button against DeliveredButtons. The halves of a Joy-Con
+  // pair merge their reports in the Pair of PairOwner, which counts the
+  // edges of both.
+  //
+  BOOLEAN                           Streaming;
+  UINT8                             Mode;
+  BOOLEAN                           ImuEnabled;
+  UINT8                             Timer;
+  UINT64                            StreamStartNs;
+  UINT64                            NextReportNs;
+  UINT32                            Held;
+  UINT32                            BounceFrom;
+  UINT8                             BounceLeft;
+  UINT32                            Buttons;
+  UINT32                            DeliveredButtons;
+  UINT8                             DebounceCount[32];
+  PROSIM_DEVICE                     *PairOwner;
+  JOYSTICK_PAIR                     Pair;
+  UINT16                            Sticks[JOYSTICK_STICK_AXES];
+  UINT8                             LastSimple[JOYSTICK_REPORT_SIZE];
+
+  //
+  // Replies waiting for their time, and the IN endpoints, NextIn taking
+  // the next input report.
+  //
+  PROSIM_PACKET                     Replies[PROSIM_FIFO_DEPTH];
+  UINTN                             ReplyCount;
+  PROSIM_ENDPOINT                   In[PROSIM_MAX_IN_ENDPOINTS];
+  UINTN                             NextIn;
+};
+
+/**
+  Fill a configuration with the defaults: a Pro Controller, 125 reports per
+  second on one IN endpoint, 8 ms endpoint interval, 4 ms replies, no
+  faults and no input.
+
+  @param  Config           The configuration to fill.
+
+**/
+VOID
+ProSimDefaultConfig (
+  OUT PROSIM_CONFIG   *Config
+  );
+
+/**
+  Plug in a simulated controller. It runs whenever the virtual clock
+  advances, until ProSimDestroy().
+
+  @param  Config           The configuration, copied. The script is not.
+
+  @return The device, or NULL when out of memory.
+
+**/
+PROSIM_DEVICE *
+ProSimCreate (
+  IN CONST PROSIM_CONFIG  *Config
+  );
+
+/**
+  Unplug and free a simulated controller.
+
+  @param  Device           The device.
+
+**/
+VOID
+ProSimDestroy (
+  IN PROSIM_DEVICE    *Device
+  );
+
+/**
+  Read an input script: one step per line, "<ms> <buttons> [<lx> <ly> <rx> <ry>]"
+  with buttons as JOYSTICK_BUTTON_* bits. A "loop <ms>" line sets LoopMs,
+  '#' starts a comment.
+
+  @param  Path             The script file.
+  @param  Config           Receives the script. Free Config->Script with free().
+
+  @retval 0                The script was read.
+  @retval -1               The file could not be read or parsed.
+
+**/
+int
+ProSimLoadScript (
+  IN     CONST char       *Path,
+  IN OUT PROSIM_CONFIG    *Config
+  );
+
+#endif
@@ -0,0 +1,1282 @@
+/** @file
+  Software Switch Pro Controller behind a mock USB I/O protocol.
+
+  The model keeps what the driver can observe on the bus: IN endpoint
+  FIFOs fed by the input report stream and by replies once their delay has
+  passed, an OUT endpoint taking USB commands and subcommands, and per IN
+  endpoint a halt state set by injected stalls and cleared by
+  CLEAR_FEATURE(ENDPOINT_HALT). Synchronous transfers wait on the virtual
+  clock; each asynchronous transfer is polled every endpoint interval and calls the driver at TPL_NOTIFY, but
+  only while the current TPL does not hold it off, as the host controller's
+  timer interrupt would.
+
+  YIZD 2021
+
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ProSim.h"
+
+#define PROSIM_NS_PER_MS              1000000ULL
+#define PROSIM_STICK_CENTER           2048
+#define PROSIM_BATTERY_CONNECTION     0x91
+#define PROSIM_VIBRATOR_REPORT        0x0C
+#define PROSIM_ACCEL_ONE_G            4096
+
+#define PROSIM_USB_REPLY              0x81
+#define PROSIM_USB_STATUS             0x01
+#define PROSIM_USB_HANDSHAKE          0x02
+#define PROSIM_USB_HIGH_SPEED         0x03
+#define PROSIM_USB_HID_ONLY           0x04
+#define PROSIM_USB_BT_ONLY            0x05
+
+#define PROSIM_ACK                    0x80
+#define PROSIM_ACK_SPI_DATA           0x90
+#define PROSIM_NACK                   0x00
+
+#define PROSIM_FIRMWARE               0x0348
+#define PROSIM_JOYCON_L               0x01
+#define PROSIM_JOYCON_R               0x02
+#define PROSIM_PRO_CONTROLLER         0x03
+
+//
+// Simple HID (0x3F) button bits of the controller, bytes 1-2, as
+// JOYSTICK_BUTTON_* bits. The hat switch in byte 3 carries the D-pad.
+//
+STATIC CONST UINT32 mProSimSimpleButtons[16] = {
+  JOYSTICK_BUTTON_B,        JOYSTICK_BUTTON_A,        JOYSTICK_BUTTON_Y,        JOYSTICK_BUTTON_X,
+  JOYSTICK_BUTTON_L,        JOYSTICK_BUTTON_R,        JOYSTICK_BUTTON_ZL,       JOYSTICK_BUTTON_ZR,
+  JOYSTICK_BUTTON_MINUS,    JOYSTICK_BUTTON_PLUS,     JOYSTICK_BUTTON_LSTICK,   JOYSTICK_BUTTON_RSTICK,
+  JOYSTICK_BUTTON_HOME,     JOYSTICK_BUTTON_CAPTURE,  0,                        0
+};
+
+//
+// Hat switch values, clockwise from up, followed by the neutral value.
+//
+STATIC CONST UINT32 mProSimHat[9] = {
+  JOYSTICK_BUTTON_UP,
+  JOYSTICK_BUTTON_UP | JOYSTICK_BUTTON_RIGHT,
+  JOYSTICK_BUTTON_RIGHT,
+  JOYSTICK_BUTTON_DOWN | JOYSTICK_BUTTON_RIGHT,
+  JOYSTICK_BUTTON_DOWN,
+  JOYSTICK_BUTTON_DOWN | JOYSTICK_BUTTON_LEFT,
+  JOYSTICK_BUTTON_LEFT,
+  JOYSTICK_BUTTON_UP | JOYSTICK_BUTTON_LEFT,
+  0
+};
+
+#define PROSIM_DPAD   (JOYSTICK_BUTTON_UP | JOYSTICK_BUTTON_DOWN | JOYSTICK_BUTTON_LEFT | JOYSTICK_BUTTON_RIGHT)
+
+//
+// Populated regions of the SPI flash, everything else reads as erased.
+//
+typedef struct {
+  UINT32        Address;
+  UINT8         Length;
+  CONST UINT8   *Data;
+} PROSIM_FLASH_REGION;
+
+//
+// Factory IMU calibration: zero origins, +-8 g and +-2000 dps sensitivity.
+//
+STATIC CONST UINT8 mProSimFactoryImuCal[24] = {
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x40, 0x00, 0x40, 0x00, 0x40,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x3B, 0x34, 0x3B, 0x34, 0x3B, 0x34
+};
+
+STATIC CONST PROSIM_FLASH_REGION mProSimFlash[] = {
+  { JOYSTICK_SPI_IMU_FACTORY_CAL, sizeof (mProSimFactoryImuCal), mProSimFactoryImuCal }
+};
+
+STATIC PROSIM_DEVICE  *mProSimDevices;
+
+/**
+  Draw from the device's generator.
+
+  @param  Device           The device.
+  @param  PerMille         The probability of TRUE, in per mille.
+
+  @retval TRUE             The event happens.
+
+**/
+STATIC
+BOOLEAN
+ProSimChance (
+  IN OUT PROSIM_DEVICE  *Device,
+  IN     UINT32         PerMille
+  )
+{
+  UINT32  X;
+
+  if (PerMille == 0) {
+    return FALSE;
+  }
+
+  X = Device->Random;
+  X ^= X << 13;
+  X ^= X >> 17;
+  X ^= X << 5;
+  Device->Random = X;
+  return (BOOLEAN) (X % 1000 < PerMille);
+}
+
+/**
+  Read the SPI flash image.
+
+**/
+STATIC
+VOID
+ProSimFlashRead (
+  IN  UINT32    Address,
+  OUT UINT8     *Buffer,
+  IN  UINTN     Length
+  )
+{
+  CONST PROSIM_FLASH_REGION   *Region;
+  UINTN                       Index;
+  UINTN                       Byte;
+
+  SetMem (Buffer, Length, 0xFF);
+  for (Index = 0; Index < ARRAY_SIZE (mProSimFlash); Index++) {
+    Region = &mProSimFlash[Index];
+    for (Byte = 0; Byte < Length; Byte++) {
+      if (Address + Byte >= Region->Address && Address + Byte < Region->Address + Region->Length) {
+        Buffer[Byte] = Region->Data[Address + Byte - Region->Address];
+      }
+    }
+  }
+}
+
+/**
+  Move the held input to the script step current at Now, and step the
+  bounce following the last change.
+
+**/
+STATIC
+VOID
+ProSimSampleInput (
+  IN OUT PROSIM_DEVICE  *Device,
+  IN     UINT64         Now
+  )
+{
+  CONST PROSIM_STEP   *Step;
+  UINT64              TimeMs;
+  UINT32              Buttons;
+  UINTN               Index;
+
+  if (Device->BounceLeft != 0) {
+    Device->BounceLeft--;
+    Device->Buttons = ((Device->BounceLeft % 2) != 0) ? Device->BounceFrom : Device->Held;
+  }
+
+  if (Device->Config.ScriptSteps == 0) {
+    return;
+  }
+
+  TimeMs = (Now - Device->StreamStartNs) / PROSIM_NS_PER_MS;
+  if (Device->Config.LoopMs != 0) {
+    TimeMs %= Device->Config.LoopMs;
+  }
+
+  Step = NULL;
+  for (Index = 0; Index < Device->Config.ScriptSteps; Index++) {
+    if (Device->Config.Script[Index].TimeMs > TimeMs) {
+      break;
+    }
+    Step = &Device->Config.Script[Index];
+  }
+  if (Step == NULL) {
+    return;
+  }
+
+  Buttons = Step->Buttons & JOYSTICK_BUTTON_MASK;
+  CopyMem (Device->Sticks, Step->Sticks, sizeof (Device->Sticks));
+
+  //
+  // A Joy-Con half has the buttons and stick of its side, the stick of the
+  // other side reads 0.
+  //
+  if (Device->Config.Side == JOYSTICK_SIDE_LEFT) {
+    Buttons &= JOYSTICK_LEFT_BUTTONS;
+    Device->Sticks[2] = 0;
+    Device->Sticks[3] = 0;
+  } else if (Device->Config.Side == JOYSTICK_SIDE_RIGHT) {
+    Buttons &= JOYSTICK_RIGHT_BUTTONS;
+    Device->Sticks[0] = 0;
+    Device->Sticks[1] = 0;
+  }
+
+  if (Buttons == Device->Held) {
+    return;
+  }
+
+  Device->BounceFrom = Device->Held;
+  Device->BounceLeft = (UINT8) (Device->Config.Bounces * 2);
+  Device->Held       = Buttons;
+  Device->Buttons    = Buttons;
+}
+
+/**
+  Fill the timer, button and stick bytes shared by 0x21 and 0x30 reports.
+
+**/
+STATIC
+VOID
+ProSimFillInput (
+  IN OUT PROSIM_DEVICE  *Device,
+  OUT    UINT8          *Report
+  )
+{
+  UINTN   Index;
+
+  Report[1] = Device->Timer++;
+  Report[2] = PROSIM_BATTERY_CONNECTION;
+  Report[JOYSTICK_BUTTON_OFFSET]     = (UINT8) Device->Buttons;
+  Report[JOYSTICK_BUTTON_OFFSET + 1] = (UINT8) (Device->Buttons >> 8);
+  Report[JOYSTICK_BUTTON_OFFSET + 2] = (UINT8) (Device->Buttons >> 16);
+  for (Index = 0; Index < 2; Index++) {
+    Report[JOYSTICK_STICK_OFFSET + Index * 3]     = (UINT8) Device->Sticks[Index * 2];
+    Report[JOYSTICK_STICK_OFFSET + Index * 3 + 1] = (UINT8) (((Device->Sticks[Index * 2] >> 8) & 0x0F) |
+                                                             ((Device->Sticks[Index * 2 + 1] & 0x0F) << 4));
+    Report[JOYSTICK_STICK_OFFSET + Index * 3 + 2] = (UINT8) (Device->Sticks[Index * 2 + 1] >> 4);
+  }
+  Report[12] = PROSIM_VIBRATOR_REPORT;
+}
+
+/**
+  Build the input report of the current mode.
+
+  @retval TRUE             Report holds a report to send.
+  @retval FALSE            Simple HID mode and the input did not change.
+
+**/
+STATIC
+BOOLEAN
+ProSimBuildReport (
+  IN OUT PROSIM_DEVICE  *Device,
+  OUT    UINT8          *Report
+  )
+{
+  UINT16  Bits;
+  UINT8   Hat;
+  UINTN   Index;
+
+  ZeroMem (Report, JOYSTICK_REPORT_SIZE);
+
+  if (Device->Mode == JOYSTICK_IN_SIMPLE_HID) {
+    Report[0] = JOYSTICK_IN_SIMPLE_HID;
+    Bits = 0;
+    for (Index = 0; Index < ARRAY_SIZE (mProSimSimpleButtons); Index++) {
+      if ((Device->Buttons & mProSimSimpleButtons[Index]) != 0) {
+        Bits |= (UINT16) (1 << Index);
+      }
+    }
+    for (Hat = 0; Hat < ARRAY_SIZE (mProSimHat) - 1; Hat++) {
+      if ((Device->Buttons & PROSIM_DPAD) == mProSimHat[Hat]) {
+        break;
+      }
+    }
+    Report[1] = (UINT8) Bits;
+    Report[2] = (UINT8) (Bits >> 8);
+    Report[3] = Hat;
+    for (Index = 0; Index < JOYSTICK_STICK_AXES; Index++) {
+      Report[4 + Index * 2] = (UINT8) (Device->Sticks[Index] << 4);
+      Report[5 + Index * 2] = (UINT8) (Device->Sticks[Index] >> 4);
+    }
+
+    if (CompareMem (Report, Device->LastSimple, JOYSTICK_REPORT_SIZE) == 0) {
+      return FALSE;
+    }
+    CopyMem (Device->LastSimple, Report, JOYSTICK_REPORT_SIZE);
+    return TRUE;
+  }
+
+  Report[0] = JOYSTICK_IN_FULL;
+  ProSimFillInput (Device, Report);
+  if (Device->ImuEnabled) {
+    for (Index = 0; Index < JOYSTICK_IMU_SAMPLES; Index++) {
+      Report[JOYSTICK_IMU_OFFSET + Index * 12 + 4] = (UINT8) PROSIM_ACCEL_ONE_G;
+      Report[JOYSTICK_IMU_OFFSET + Index * 12 + 5] = (UINT8) (PROSIM_ACCEL_ONE_G >> 8);
+    }
+  }
+  return TRUE;
+}
+
+/**
+  Put a packet into an IN endpoint FIFO. When it is full the oldest packet
+  is overwritten.
+
+**/
+STATIC
+VOID
+ProSimFifoPush (
+  IN OUT PROSIM_DEVICE    *Device,
+  IN OUT PROSIM_ENDPOINT  *Endpoint,
+  IN     CONST UINT8      *Data
+  )
+{
+  PROSIM_PACKET   *Packet;
+
+  if (Endpoint->FifoCount == PROSIM_FIFO_DEPTH) {
+    Endpoint->FifoHead = (Endpoint->FifoHead + 1) % PROSIM_FIFO_DEPTH;
+    Endpoint->FifoCount--;
+    Device->Stats.Overruns++;
+  }
+  Packet = &Endpoint->Fifo[(Endpoint->FifoHead + Endpoint->FifoCount) % PROSIM_FIFO_DEPTH];
+  CopyMem (Packet->Data, Data, JOYSTICK_REPORT_SIZE);
+  Endpoint->FifoCount++;
+}
+
+/**
+  Take the oldest packet out of an IN endpoint FIFO.
+
+**/
+STATIC
+VOID
+ProSimFifoPop (
+  IN OUT PROSIM_ENDPOINT  *Endpoint,
+  OUT    UINT8            *Data
+  )
+{
+  CopyMem (Data, Endpoint->Fifo[Endpoint->FifoHead].Data, JOYSTICK_REPORT_SIZE);
+  Endpoint->FifoHead = (Endpoint->FifoHead + 1) % PROSIM_FIFO_DEPTH;
+  Endpoint->FifoCount--;
+}
+
+/**
+  Read the buttons back out of an input report, in the layouts the device
+  builds them in.
+
+  @return The JOYSTICK_BUTTON_* bits the report holds.
+
+**/
+STATIC
+UINT32
+ProSimReportButtons (
+  IN CONST UINT8    *Data
+  )
+{
+  UINT32  Buttons;
+  UINT16  Bits;
+  UINTN   Index;
+
+  if (Data[0] != JOYSTICK_IN_SIMPLE_HID) {
+    return (Data[JOYSTICK_BUTTON_OFFSET] | (Data[JOYSTICK_BUTTON_OFFSET + 1] << 8) |
+            (Data[JOYSTICK_BUTTON_OFFSET + 2] << 16)) & JOYSTICK_BUTTON_MASK;
+  }
+
+  Bits    = (UINT16) (Data[1] | (Data[2] << 8));
+  Buttons = 0;
+  for (Index = 0; Index < ARRAY_SIZE (mProSimSimpleButtons); Index++) {
+    if ((Bits & (1 << Index)) != 0) {
+      Buttons |= mProSimSimpleButtons[Index];
+    }
+  }
+  if (Data[3] < ARRAY_SIZE (mProSimHat)) {
+    Buttons |= mProSimHat[Data[3]];
+  }
+  return Buttons;
+}
+
+/**
+  Count the key button edges of an input report delivered to the driver,
+  the ones the driver's key edge PCDs turn into keys. Edges are taken from
+  the buttons of the report, so a bounce makes keys unless the debounce
+  window absorbs it.
+
+**/
+STATIC
+VOID
+ProSimCountKeyEdges (
+  IN OUT PROSIM_DEVICE  *Device,
+  IN     CONST UINT8    *Data
+  )
+{
+  UINT8   Merged[JOYSTICK_REPORT_SIZE];
+  UINT64  MergedArrival;
+  UINT32  Buttons;
+  UINT32  Pressed;
+  UINT32  Released;
+  UINT32  Window;
+  UINTN   Bit;
+
+  if (Data[0] != JOYSTICK_IN_FULL && Data[0] != JOYSTICK_IN_SIMPLE_HID && Data[0] != JOYSTICK_IN_SUBCMD_REPLY) {
+    return;
+  }
+
+  //
+  // A pair is decoded from the reports of both halves merged as the driver
+  // aligns them, the input of each half taken from what it sent.
+  //
+  if (Device->PairOwner != NULL) {
+    if (!JoyStickMergeHalfReport (&Device->PairOwner->Pair, Device->Config.Side, Data, 0, Merged, &MergedArrival)) {
+      return;
+    }
+    Device = Device->PairOwner;
+    Data   = Merged;
+  }
+
+  //
+  // A change counts once it is seen in as many reports in a row as the
+  // debounce window takes, which simple HID reports bypass.
+  //
+  Buttons = ProSimReportButtons (Data) & PROSIM_KEY_BUTTONS;
+  Window  = 1;
+  if (Data[0] != JOYSTICK_IN_SIMPLE_HID) {
+    Window = MAX (FixedPcdGet8 (PcdJoyStickDebounceReports), 1);
+  }
+  for (Bit = 0; Bit < 32; Bit++) {
+    if (((Buttons ^ Device->DeliveredButtons) & (1U << Bit)) == 0) {
+      Device->DebounceCount[Bit] = 0;
+    } else if (++Device->DebounceCount[Bit] < Window) {
+      Buttons ^= 1U << Bit;
+    } else {
+      Device->DebounceCount[Bit] = 0;
+    }
+  }
+
+  Pressed  = Buttons & ~Device->DeliveredButtons & FixedPcdGet32 (PcdJoyStickPressKeyButtons);
+  Released = Device->DeliveredButtons & ~Buttons & FixedPcdGet32 (PcdJoyStickReleaseKeyButtons);
+  Device->Stats.KeyEdges  += __builtin_popcount (Pressed) + __builtin_popcount (Released);
+  Device->DeliveredButtons = Buttons;
+}
+
+/**
+  Look up an IN endpoint by address.
+
+  @return The endpoint, or NULL if the device has none at Address.
+
+**/
+STATIC
+PROSIM_ENDPOINT *
+ProSimInEndpoint (
+  IN PROSIM_DEVICE  *Device,
+  IN UINTN          Address
+  )
+{
+  UINTN   Index;
+
+  for (Index = 0; Index < Device->Config.InEndpoints; Index++) {
+    if (Device->In[Index].Address == Address) {
+      return &Device->In[Index];
+    }
+  }
+  return NULL;
+}
+
+/**
+  Schedule a reply, applying the lost and slow reply faults.
+
+**/
+STATIC
+VOID
+ProSimQueueReply (
+  IN OUT PROSIM_DEVICE  *Device,
+  IN     CONST UINT8    *Reply
+  )
+{
+  UINT64  Delay;
+
+  if (ProSimChance (Device, Device->Config.TimeoutPerMille) ||
+      Device->ReplyCount == PROSIM_FIFO_DEPTH) {
+    Device->Stats.LostReplies++;
+    return;
+  }
+
+  Delay = Device->Config.ReplyDelayNs;
+  if (ProSimChance (Device, Device->Config.SlowPerMille)) {
+    Delay += Device->Config.SlowNs;
+    Device->Stats.SlowReplies++;
+  }
+
+  Device->Replies[Device->ReplyCount].ReadyNs = HostNow () + Delay;
+  CopyMem (Device->Replies[Device->ReplyCount].Data, Reply, JOYSTICK_REPORT_SIZE);
+  Device->ReplyCount++;
+  Device->Stats.Replies++;
+}
+
+/**
+  Handle a 0x01 output report: run the subcommand and queue its 0x21 reply.
+
+**/
+STATIC
+VOID
+ProSimSubcommand (
+  IN OUT PROSIM_DEVICE  *Device,
+  IN     CONST UINT8    *Out
+  )
+{
+  UINT8         Reply[JOYSTICK_REPORT_SIZE];
+  CONST UINT8   *Args;
+  UINT32        Address;
+  UINTN         Index;
+
+  Args = &Out[11];
+
+  ZeroMem (Reply, sizeof (Reply));
+  Reply[0] = JOYSTICK_IN_SUBCMD_REPLY;
+  ProSimFillInput (Device, Reply);
+  Reply[JOYSTICK_SUBCMD_ACK_OFFSET] = PROSIM_ACK;
+  Reply[JOYSTICK_SUBCMD_ID_OFFSET]  = Out[10];
+
+  switch (Out[10]) {
+  case JOYSTICK_SUBCMD_DEVICE_INFO:
+    Reply[JOYSTICK_SUBCMD_ACK_OFFSET] = PROSIM_ACK | JOYSTICK_SUBCMD_DEVICE_INFO;
+    Reply[JOYSTICK_SUBCMD_DATA_OFFSET]     = (UINT8) (PROSIM_FIRMWARE >> 8);
+    Reply[JOYSTICK_SUBCMD_DATA_OFFSET + 1] = (UINT8) PROSIM_FIRMWARE;
+    Reply[JOYSTICK_SUBCMD_DATA_OFFSET + 2] = (Device->Config.Side == JOYSTICK_SIDE_LEFT)  ? PROSIM_JOYCON_L :
+                                             (Device->Config.Side == JOYSTICK_SIDE_RIGHT) ? PROSIM_JOYCON_R :
+                                             PROSIM_PRO_CONTROLLER;
+    Reply[JOYSTICK_SUBCMD_DATA_OFFSET + 3] = 0x02;
+    for (Index = 0; Index < JOYSTICK_MAC_SIZE; Index++) {
+      Reply[JOYSTICK_SUBCMD_DATA_OFFSET + JOYSTICK_DEVICE_INFO_MAC_OFFSET + Index] =
+        (UINT8) (Device->Config.Address >> (8 * (JOYSTICK_MAC_SIZE - 1 - Index)));
+    }
+    break;
+
+  case JOYSTICK_SUBCMD_SET_REPORT_MODE:
+    if (Args[0] == JOYSTICK_IN_FULL || Args[0] == JOYSTICK_IN_SIMPLE_HID) {
+      Device->Mode = Args[0];
+      ZeroMem (Device->LastSimple, sizeof (Device->LastSimple));
+    } else {
+      Reply[JOYSTICK_SUBCMD_ACK_OFFSET] = PROSIM_NACK;
+    }
+    break;
+
+  case JOYSTICK_SUBCMD_SPI_READ:
+    Address = Args[0] | (Args[1] << 8) | (Args[2] << 16) | ((UINT32) Args[3] << 24);
+    if (Args[4] > JOYSTICK_SPI_MAX_READ) {
+      Reply[JOYSTICK_SUBCMD_ACK_OFFSET] = PROSIM_NACK;
+      break;
+    }
+    Reply[JOYSTICK_SUBCMD_ACK_OFFSET] = PROSIM_ACK_SPI_DATA;
+    Device->Stats.SpiReads++;
+    CopyMem (&Reply[JOYSTICK_SUBCMD_DATA_OFFSET], Args, 5);
+    ProSimFlashRead (Address, &Reply[JOYSTICK_SPI_DATA_OFFSET], Args[4]);
+    break;
+
+  case JOYSTICK_SUBCMD_ENABLE_IMU:
+    Device->ImuEnabled = (BOOLEAN) (Args[0] != 0);
+    break;
+
+  default:
+    break;
+  }
+
+  ProSimQueueReply (Device, Reply);
+}
+
+/**
+  Handle an output report received on the OUT endpoint.
+
+**/
+STATIC
+VOID
+ProSimReceive (
+  IN OUT PROSIM_DEVICE  *Device,
+  IN     CONST UINT8    *Out,
+  IN     UINTN          Length
+  )
+{
+  UINT8   Reply[JOYSTICK_REPORT_SIZE];
+
+  if (Length < 2) {
+    return;
+  }
+
+  if (Out[0] == JOYSTICK_OUT_RUMBLE_SUBCMD && Length > 11) {
+    ProSimSubcommand (Device, Out);
+    return;
+  }
+
+  if (Out[0] != JOYSTICK_OUT_USB_CMD) {
+    return;
+  }
+
+  switch (Out[1]) {
+  case PROSIM_USB_STATUS:
+  case PROSIM_USB_HANDSHAKE:
+  case PROSIM_USB_HIGH_SPEED:
+    ZeroMem (Reply, sizeof (Reply));
+    Reply[0] = PROSIM_USB_REPLY;
+    Reply[1] = Out[1];
+    if (Out[1] == PROSIM_USB_STATUS) {
+      Reply[3] = 0x03;
+    }
+    ProSimQueueReply (Device, Reply);
+    break;
+
+  case PROSIM_USB_HID_ONLY:
+    if (!Device->Streaming) {
+      Device->Streaming     = TRUE;
+      Device->StreamStartNs = HostNow ();
+      Device->NextReportNs  = HostNow () + 1000000000ULL / Device->Config.ReportRate;
+    }
+    break;
+
+  case PROSIM_USB_BT_ONLY:
+    Device->Streaming = FALSE;
+    break;
+
+  default:
+    break;
+  }
+}
+
+/**
+  Call the driver's asynchronous transfer callback of an endpoint at
+  TPL_NOTIFY.
+
+**/
+STATIC
+VOID
+ProSimCallAsync (
+  IN OUT PROSIM_ENDPOINT  *Endpoint,
+  IN     VOID             *Data,
+  IN     UINTN            Length,
+  IN     UINT32           Result
+  )
+{
+  EFI_TPL   OldTpl;
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  Endpoint->AsyncCallback (Data, Length, Endpoint->AsyncContext, Result);
+  gBS->RestoreTPL (OldTpl);
+}
+
+/**
+  Poll the asynchronous transfer of an endpoint, as the host controller
+  does every interval.
+
+**/
+STATIC
+VOID
+ProSimPollEndpoint (
+  IN OUT PROSIM_DEVICE    *Device,
+  IN OUT PROSIM_ENDPOINT  *Endpoint,
+  IN     UINT64           Now
+  )
+{
+  UINTN   Count;
+  UINTN   Index;
+
+  while (Endpoint->NextPollNs <= Now) {
+    Endpoint->NextPollNs += Endpoint->AsyncIntervalNs;
+  }
+
+  if (Endpoint->FifoCount != 0 && !Endpoint->Halted && ProSimChance (Device, Device->Config.StallPerMille)) {
+    Endpoint->Halted = TRUE;
+    Device->Stats.Stalls++;
+  }
+
+  if (Endpoint->Halted) {
+    if (Endpoint->ErrorNs == 0) {
+      Endpoint->ErrorNs = Now;
+    }
+    ProSimCallAsync (Endpoint, NULL, 0, EFI_USB_ERR_STALL);
+  } else if (Endpoint->FifoCount != 0) {
+    Count = MIN (Endpoint->FifoCount, Endpoint->AsyncLength / JOYSTICK_REPORT_SIZE);
+    for (Index = 0; Index < Count; Index++) {
+      ProSimFifoPop (Endpoint, &Endpoint->AsyncBuffer[Index * JOYSTICK_REPORT_SIZE]);
+      ProSimCountKeyEdges (Device, &Endpoint->AsyncBuffer[Index * JOYSTICK_REPORT_SIZE]);
+    }
+    Device->Stats.Delivered += Count;
+    if (Endpoint->ErrorNs != 0) {
+      Device->Stats.Recoveries++;
+      Device->Stats.RecoveryNs += Now - Endpoint->ErrorNs;
+      Endpoint->ErrorNs = 0;
+    }
+    ProSimCallAsync (Endpoint, Endpoint->AsyncBuffer, Count * JOYSTICK_REPORT_SIZE, EFI_USB_NOERROR);
+  }
+}
+
+/**
+  Run one device up to Now.
+
+  @return The time of its next event.
+
+**/
+STATIC
+UINT64
+ProSimPoll (
+  IN OUT PROSIM_DEVICE  *Device,
+  IN     UINT64         Now
+  )
+{
+  PROSIM_ENDPOINT   *Endpoint;
+  UINT8             Report[JOYSTICK_REPORT_SIZE];
+  UINT64            Next;
+  UINTN             Index;
+  UINTN             Earliest;
+
+  //
+  // Replies and stream reports, in time order.
+  //
+  for (;;) {
+    Earliest = Device->ReplyCount;
+    for (Index = 0; Index < Device->ReplyCount; Index++) {
+      if (Earliest == Device->ReplyCount || Device->Replies[Index].ReadyNs < Device->Replies[Earliest].ReadyNs) {
+        Earliest = Index;
+      }
+    }
+
+    if (Earliest != Device->ReplyCount && Device->Replies[Earliest].ReadyNs <= Now &&
+        (!Device->Streaming || Device->Replies[Earliest].ReadyNs <= Device->NextReportNs)) {
+      //
+      // The controller fills the input of a subcommand reply when it sends
+      // it, so a slow reply is not stale.
+      //
+      if (Device->Replies[Earliest].Data[0] == JOYSTICK_IN_SUBCMD_REPLY) {
+        ProSimFillInput (Device, Device->Replies[Earliest].Data);
+      }
+      ProSimFifoPush (Device, &Device->In[0], Device->Replies[Earliest].Data);
+      Device->Replies[Earliest] = Device->Replies[--Device->ReplyCount];
+      continue;
+    }
+
+    if (Device->Streaming && Device->NextReportNs <= Now) {
+      ProSimSampleInput (Device, Device->NextReportNs);
+      Device->NextReportNs += 1000000000ULL / Device->Config.ReportRate;
+      if (ProSimBuildReport (Device, Report)) {
+        Device->Stats.Reports++;
+        if (ProSimChance (Device, Device->Config.DropPerMille)) {
+          Device->Stats.Dropped++;
+        } else {
+          ProSimFifoPush (Device, &Device->In[Device->NextIn], Report);
+        }
+        Device->NextIn = (Device->NextIn + 1) % Device->Config.InEndpoints;
+      }
+      continue;
+    }
+    break;
+  }
+
+  //
+  // The host controller polls the asynchronous transfers every interval,
+  // the callbacks wait while the TPL holds them off.
+  //
+  for (Index = 0; Index < Device->Config.InEndpoints; Index++) {
+    Endpoint = &Device->In[Index];
+    if (Endpoint->AsyncCallback != NULL && Endpoint->NextPollNs <= Now && HostCurrentTpl () < TPL_NOTIFY) {
+      ProSimPollEndpoint (Device, Endpoint, Now);
+    }
+  }
+
+  Next = MAX_UINT64;
+  if (Device->Streaming) {
+    Next = MIN (Next, Device->NextReportNs);
+  }
+  for (Index = 0; Index < Device->ReplyCount; Index++) {
+    Next = MIN (Next, Device->Replies[Index].ReadyNs);
+  }
+  for (Index = 0; Index < Device->Config.InEndpoints; Index++) {
+    if (Device->In[Index].AsyncCallback != NULL) {
+      Next = MIN (Next, Device->In[Index].NextPollNs);
+    }
+  }
+  return Next;
+}
+
+/**
+  HostDxe device poll: run every plugged in device.
+
+**/
+STATIC
+UINT64
+ProSimPollAll (
+  IN UINT64   Now,
+  IN VOID     *Context
+  )
+{
+  PROSIM_DEVICE   *Device;
+  UINT64          Next;
+
+  Next = MAX_UINT64;
+  for (Device = mProSimDevices; Device != NULL; Device = Device->Next) {
+    if (Device->Polling) {
+      continue;
+    }
+    Device->Polling = TRUE;
+    Next = MIN (Next, ProSimPoll (Device, Now));
+    Device->Polling = FALSE;
+  }
+  return Next;
+}
+
+/**
+  Wait on the virtual clock inside a transfer. Nothing moves when the driver
+  calls from its own transfer callback.
+
+**/
+STATIC
+VOID
+ProSimWait (
+  IN PROSIM_DEVICE  *Device,
+  IN UINT64         NanoSeconds
+  )
+{
+  if (!Device->Polling) {
+    HostAdvance (NanoSeconds);
+  }
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ProSimControlTransfer (
+  IN     EFI_USB_IO_PROTOCOL     *This,
+  IN     EFI_USB_DEVICE_REQUEST  *Request,
+  IN     EFI_USB_DATA_DIRECTION  Direction,
+  IN     UINT32                  Timeout,
+  IN OUT VOID                    *Data OPTIONAL,
+  IN     UINTN                   DataLength OPTIONAL,
+  OUT    UINT32                  *Status
+  )
+{
+  PROSIM_DEVICE     *Device;
+  PROSIM_ENDPOINT   *Endpoint;
+
+  Device  = BASE_CR (This, PROSIM_DEVICE, UsbIo);
+  *Status = EFI_USB_NOERROR;
+
+  switch ((Request->RequestType << 8) | Request->Request) {
+  case 0x8008:        // GET_CONFIGURATION
+  case 0xA103:        // HID GET_PROTOCOL
+    if (Data == NULL || DataLength == 0) {
+      return EFI_INVALID_PARAMETER;
+    }
+    *(UINT8 *) Data = 1;
+    return EFI_SUCCESS;
+
+  case 0x210A:        // HID SET_IDLE
+  case 0x210B:        // HID SET_PROTOCOL
+    return EFI_SUCCESS;
+
+  case 0x0201:        // CLEAR_FEATURE (ENDPOINT_HALT)
+    Endpoint = ProSimInEndpoint (Device, Request->Index);
+    if (Endpoint != NULL && Endpoint->Halted) {
+      Endpoint->Halted = FALSE;
+      Device->Stats.HaltsCleared++;
+    }
+    return EFI_SUCCESS;
+
+  default:
+    *Status = EFI_USB_ERR_STALL;
+    return EFI_DEVICE_ERROR;
+  }
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ProSimAsyncInterruptTransfer (
+  IN EFI_USB_IO_PROTOCOL              *This,
+  IN UINT8                            DeviceEndpoint,
+  IN BOOLEAN                          IsNewTransfer,
+  IN UINTN                            PollingInterval OPTIONAL,
+  IN UINTN                            DataLength OPTIONAL,
+  IN EFI_ASYNC_USB_TRANSFER_CALLBACK  InterruptCallBack OPTIONAL,
+  IN VOID                             *Context OPTIONAL
+  )
+{
+  PROSIM_DEVICE     *Device;
+  PROSIM_ENDPOINT   *Endpoint;
+
+  Device   = BASE_CR (This, PROSIM_DEVICE, UsbIo);
+  Endpoint = ProSimInEndpoint (Device, DeviceEndpoint);
+  if (Endpoint == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (!IsNewTransfer) {
+    Endpoint->AsyncCallback = NULL;
+    return EFI_SUCCESS;
+  }
+
+  if (Endpoint->AsyncCallback != NULL || InterruptCallBack == NULL ||
+      PollingInterval == 0 || DataLength < JOYSTICK_REPORT_SIZE) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  free (Endpoint->AsyncBuffer);
+  Endpoint->AsyncBuffer = malloc (DataLength);
+  if (Endpoint->AsyncBuffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Endpoint->AsyncCallback   = InterruptCallBack;
+  Endpoint->AsyncContext    = Context;
+  Endpoint->AsyncLength     = DataLength;
+  Endpoint->AsyncIntervalNs = PollingInterval * PROSIM_NS_PER_MS;
+  Endpoint->NextPollNs      = HostNow () + Endpoint->AsyncIntervalNs;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ProSimSyncInterruptTransfer (
+  IN     EFI_USB_IO_PROTOCOL  *This,
+  IN     UINT8                DeviceEndpoint,
+  IN OUT VOID                 *Data,
+  IN OUT UINTN                *DataLength,
+  IN     UINTN                Timeout,
+  OUT    UINT32               *Status
+  )
+{
+  PROSIM_DEVICE     *Device;
+  PROSIM_ENDPOINT   *Endpoint;
+  UINT8             Report[JOYSTICK_REPORT_SIZE];
+  UINT64            Deadline;
+
+  Device = BASE_CR (This, PROSIM_DEVICE, UsbIo);
+
+  if (DeviceEndpoint == PROSIM_OUT_ENDPOINT) {
+    ProSimReceive (Device, Data, *DataLength);
+    ProSimWait (Device, PROSIM_NS_PER_MS);
+    *Status = EFI_USB_NOERROR;
+    return EFI_SUCCESS;
+  }
+
+  Endpoint = ProSimInEndpoint (Device, DeviceEndpoint);
+  if (Endpoint == NULL) {
+    *Status = EFI_USB_ERR_STALL;
+    return EFI_DEVICE_ERROR;
+  }
+
+  //
+  // A timeout of 0 waits forever on hardware, bounded here so a lost reply
+  // fails the run instead of hanging it.
+  //
+  Deadline = HostNow () + ((Timeout != 0) ? Timeout * PROSIM_NS_PER_MS : PROSIM_MAX_SYNC_WAIT_NS);
+  for (;;) {
+    if (Endpoint->FifoCount != 0) {
+      //
+      // The bus driver clears a halt it sees on a synchronous transfer.
+      //
+      if (Endpoint->Halted || ProSimChance (Device, Device->Config.StallPerMille)) {
+        Device->Stats.Stalls++;
+        Device->Stats.HaltsCleared++;
+        Endpoint->Halted = FALSE;
+        *DataLength    = 0;
+        *Status        = EFI_USB_ERR_STALL;
+        return EFI_DEVICE_ERROR;
+      }
+
+      ProSimFifoPop (Endpoint, Report);
+      *DataLength = MIN (*DataLength, (UINTN) JOYSTICK_REPORT_SIZE);
+      CopyMem (Data, Report, *DataLength);
+      *Status = EFI_USB_NOERROR;
+      return EFI_SUCCESS;
+    }
+
+    if (HostNow () >= Deadline || Device->Polling) {
+      *DataLength = 0;
+      *Status     = EFI_USB_ERR_TIMEOUT;
+      return EFI_TIMEOUT;
+    }
+    ProSimWait (Device, MIN (PROSIM_NS_PER_MS, Deadline - HostNow ()));
+  }
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ProSimGetDeviceDescriptor (
+  IN  EFI_USB_IO_PROTOCOL        *This,
+  OUT EFI_USB_DEVICE_DESCRIPTOR  *DeviceDescriptor
+  )
+{
+  PROSIM_DEVICE   *Device;
+
+  Device = BASE_CR (This, PROSIM_DEVICE, UsbIo);
+
+  ZeroMem (DeviceDescriptor, sizeof (*DeviceDescriptor));
+  DeviceDescriptor->Length            = sizeof (*DeviceDescriptor);
+  DeviceDescriptor->DescriptorType    = 0x01;
+  DeviceDescriptor->BcdUSB            = 0x0200;
+  DeviceDescriptor->MaxPacketSize0    = 64;
+  DeviceDescriptor->IdVendor          = NINTENDO_HID;
+  DeviceDescriptor->IdProduct         = (Device->Config.Side == JOYSTICK_SIDE_LEFT)  ? JOYSTICK_PID_JOYCON_L :
+                                        (Device->Config.Side == JOYSTICK_SIDE_RIGHT) ? JOYSTICK_PID_JOYCON_R :
+                                        JOYSTICK_PID;
+  DeviceDescriptor->BcdDevice         = 0x0200;
+  DeviceDescriptor->StrManufacturer   = 1;
+  DeviceDescriptor->StrProduct        = 2;
+  DeviceDescriptor->StrSerialNumber   = 3;
+  DeviceDescriptor->NumConfigurations = 1;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ProSimGetInterfaceDescriptor (
+  IN  EFI_USB_IO_PROTOCOL           *This,
+  OUT EFI_USB_INTERFACE_DESCRIPTOR  *InterfaceDescriptor
+  )
+{
+  PROSIM_DEVICE   *Device;
+
+  Device = BASE_CR (This, PROSIM_DEVICE, UsbIo);
+
+  ZeroMem (InterfaceDescriptor, sizeof (*InterfaceDescriptor));
+  InterfaceDescriptor->Length         = sizeof (*InterfaceDescriptor);
+  InterfaceDescriptor->DescriptorType = 0x04;
+  InterfaceDescriptor->NumEndpoints   = (UINT8) (Device->Config.InEndpoints + 1);
+  InterfaceDescriptor->InterfaceClass = 0x03;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ProSimGetEndpointDescriptor (
+  IN  EFI_USB_IO_PROTOCOL          *This,
+  IN  UINT8                        EndpointIndex,
+  OUT EFI_USB_ENDPOINT_DESCRIPTOR  *EndpointDescriptor
+  )
+{
+  PROSIM_DEVICE   *Device;
+
+  Device = BASE_CR (This, PROSIM_DEVICE, UsbIo);
+  if (EndpointIndex > Device->Config.InEndpoints) {
+    return EFI_NOT_FOUND;
+  }
+
+  //
+  // The IN endpoints come first, the OUT endpoint last.
+  //
+  EndpointDescriptor->Length          = sizeof (*EndpointDescriptor);
+  EndpointDescriptor->DescriptorType  = 0x05;
+  EndpointDescriptor->EndpointAddress = (EndpointIndex < Device->Config.InEndpoints) ?
+                                        Device->In[EndpointIndex].Address : PROSIM_OUT_ENDPOINT;
+  EndpointDescriptor->Attributes      = USB_ENDPOINT_INTERRUPT;
+  EndpointDescriptor->MaxPacketSize   = JOYSTICK_REPORT_SIZE;
+  EndpointDescriptor->Interval        = Device->Config.Interval;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ProSimPortReset (
+  IN EFI_USB_IO_PROTOCOL  *This
+  )
+{
+  PROSIM_DEVICE   *Device;
+  UINTN           Index;
+
+  Device = BASE_CR (This, PROSIM_DEVICE, UsbIo);
+  Device->Streaming  = FALSE;
+  Device->Mode       = JOYSTICK_IN_FULL;
+  Device->ImuEnabled = FALSE;
+  Device->ReplyCount = 0;
+  Device->NextIn     = 0;
+  for (Index = 0; Index < Device->Config.InEndpoints; Index++) {
+    Device->In[Index].Halted    = FALSE;
+    Device->In[Index].FifoCount = 0;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Fill a configuration with the defaults: a Pro Controller, 125 reports per
+  second, 8 ms endpoint interval, 4 ms replies, no faults and no input.
+
+  @param  Config           The configuration to fill.
+
+**/
+VOID
+ProSimDefaultConfig (
+  OUT PROSIM_CONFIG   *Config
+  )
+{
+  ZeroMem (Config, sizeof (*Config));
+  Config->ReportRate   = 125;
+  Config->Interval     = 8;
+  Config->ReplyDelayNs = 4 * PROSIM_NS_PER_MS;
+  Config->SlowNs       = 50 * PROSIM_NS_PER_MS;
+  Config->Seed         = 1;
+  Config->Side         = JOYSTICK_SIDE_NONE;
+  Config->InEndpoints  = 1;
+}
+
+/**
+  Plug in a simulated controller. It runs whenever the virtual clock
+  advances, until ProSimDestroy().
+
+  @param  Config           The configuration, copied. The script is not.
+
+  @return The device, or NULL when out of memory.
+
+**/
+PROSIM_DEVICE *
+ProSimCreate (
+  IN CONST PROSIM_CONFIG  *Config
+  )
+{
+  PROSIM_DEVICE   *Device;
+  UINTN           Index;
+
+  Device = calloc (1, sizeof (*Device));
+  if (Device == NULL) {
+    return NULL;
+  }
+
+  Device->UsbIo.UsbControlTransfer        = ProSimControlTransfer;
+  Device->UsbIo.UsbAsyncInterruptTransfer = ProSimAsyncInterruptTransfer;
+  Device->UsbIo.UsbSyncInterruptTransfer  = ProSimSyncInterruptTransfer;
+  Device->UsbIo.UsbGetDeviceDescriptor    = ProSimGetDeviceDescriptor;
+  Device->UsbIo.UsbGetInterfaceDescriptor = ProSimGetInterfaceDescriptor;
+  Device->UsbIo.UsbGetEndpointDescriptor  = ProSimGetEndpointDescriptor;
+  Device->UsbIo.UsbPortReset              = ProSimPortReset;
+
+  Device->DevicePath.Type      = 0x7F;
+  Device->DevicePath.SubType   = 0xFF;
+  Device->DevicePath.Length[0] = sizeof (Device->DevicePath);
+
+  CopyMem (&Device->Config, Config, sizeof (*Config));
+  if (Device->Config.ReportRate == 0) {
+    Device->Config.ReportRate = 125;
+  }
+  if (Device->Config.Interval == 0) {
+    Device->Config.Interval = 1;
+  }
+  Device->Config.InEndpoints = (UINT8) MIN (MAX (Device->Config.InEndpoints, 1), PROSIM_MAX_IN_ENDPOINTS);
+  for (Index = 0; Index < Device->Config.InEndpoints; Index++) {
+    Device->In[Index].Address = (UINT8) (PROSIM_IN_ENDPOINT + Index);
+  }
+  Device->Random = (Config->Seed != 0) ? Config->Seed : 1;
+  Device->Mode   = JOYSTICK_IN_FULL;
+  for (Index = 0; Index < JOYSTICK_STICK_AXES; Index++) {
+    Device->Sticks[Index] = PROSIM_STICK_CENTER;
+  }
+
+  Device->Next   = mProSimDevices;
+  mProSimDevices = Device;
+  HostSetDevicePoll (ProSimPollAll, NULL);
+  return Device;
+}
+
+/**
+  Unplug and free a simulated controller.
+
+  @param  Device           The device.
+
+**/
+VOID
+ProSimDestroy (
+  IN PROSIM_DEVICE    *Device
+  )
+{
+  PROSIM_DEVICE   **Link;
+  UINTN           Index;
+
+  for (Link = &mProSimDevices; *Link != NULL; Link = &(*Link)->Next) {
+    if (*Link == Device) {
+      *Link = Device->Next;
+      break;
+    }
+  }
+  for (Index = 0; Index < PROSIM_MAX_IN_ENDPOINTS; Index++) {
+    free (Device->In[Index].AsyncBuffer);
+  }
+  free (Device);
+}
+
+/**
+  Read an input script: one step per line, "<ms> <buttons> [<lx> <ly> <rx> <ry>]"
+  with buttons as JOYSTICK_BUTTON_* bits. A "loop <ms>" line sets LoopMs,
+  '#' starts a comment.
+
+  @param  Path             The script file.
+  @param  Config           Receives the script. Free Config->Script with free().
+
+  @retval 0                The script was read.
+  @retval -1               The file could not be read or parsed.
+
+**/
+int
+ProSimLoadScript (
+  IN     CONST char       *Path,
+  IN OUT PROSIM_CONFIG    *Config
+  )
+{
+  FILE          *File;
+  char          Line[256];
+  PROSIM_STEP   *Steps;
+  PROSIM_STEP   *Grown;
+  UINTN         Count;
+  UINTN         Capacity;
+  unsigned      Time;
+  unsigned      Buttons;
+  unsigned      Axis[JOYSTICK_STICK_AXES];
+  unsigned      LineNumber;
+  char          *Comment;
+  int           Fields;
+  UINTN         Index;
+
+  File = fopen (Path, "r");
+  if (File == NULL) {
+    perror (Path);
+    return -1;
+  }
+
+  Steps      = NULL;
+  Count      = 0;
+  Capacity   = 0;
+  LineNumber = 0;
+  while (fgets (Line, sizeof (Line), File) != NULL) {
+    LineNumber++;
+    Comment = strchr (Line, '#');
+    if (Comment != NULL) {
+      *Comment = '\0';
+    }
+
+    if (sscanf (Line, " loop %u", &Time) == 1) {
+      Config->LoopMs = Time;
+      continue;
+    }
+
+    for (Index = 0; Index < JOYSTICK_STICK_AXES; Index++) {
+      Axis[Index] = PROSIM_STICK_CENTER;
+    }
+    Fields = sscanf (Line, "%u %i %u %u %u %u", &Time, (int *) &Buttons, &Axis[0], &Axis[1], &Axis[2], &Axis[3]);
+    if (Fields <= 0) {
+      continue;
+    }
+    if (Fields < 2 || (Count != 0 && Time < Steps[Count - 1].TimeMs)) {
+      fprintf (stderr, "%s:%u: expected \"<ms> <buttons> [<lx> <ly> <rx> <ry>]\" in time order\n", Path, LineNumber);
+      free (Steps);
+      fclose (File);
+      return -1;
+    }
+
+    if (Count == Capacity) {
+      Capacity = (Capacity != 0) ? Capacity * 2 : 64;
+      Grown    = realloc (Steps, Capacity * sizeof (PROSIM_STEP));
+      if (Grown == NULL) {
+        free (Steps);
+        fclose (File);
+        return -1;
+      }
+      Steps = Grown;
+    }
+    Steps[Count].TimeMs  = Time;
+    Steps[Count].Buttons = Buttons & JOYSTICK_BUTTON_MASK;
+    for (Index = 0; Index < JOYSTICK_STICK_AXES; Index++) {
+      Steps[Count].Sticks[Index] = (UINT16) MIN (Axis[Index], 0xFFFU);
+    }
+    Count++;
+  }
+  fclose (File);
+
+  Config->Script      = Steps;
+  Config->ScriptSteps = Count;
+  return 0;
+}
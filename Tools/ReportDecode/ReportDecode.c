@@ -0,0 +1,462 @@
+/** @file
+  Decode large captures of controller input reports into columns.
+
+  Reads a capture of back to back JOYSTICK_REPORT_SIZE byte input reports,
+  the format UhidBridge replays, in chunks and decodes them with a scalar
+  or SIMD kernel (ReportDecodeKernels.c). With --out, every column is
+  written to DIR as a raw little endian array named after it: id.u8,
+  buttons.u32, lx.u16 ly.u16 rx.u16 ry.u16 and imu<sample>_<axis>.i32 for
+  the accelerometer (a) and gyroscope (g) axes. IMU values use the nominal
+  calibration. Prints report counts by type and the decode cost.
+
+  --verify also runs every other supported kernel over each chunk and
+  compares its columns to the scalar kernel's, report for report, failing
+  on the first difference.
+
+  ReportDecode [--kernel auto|scalar|sse2|avx2] [--out DIR] [--verify]
+               [--synth COUNT] [--seed N] [FILE]
+
+  YIZD 2021
+
+**/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "ReportDecode.h"
+
+#define DECODE_CHUNK_REPORTS      65536
+#define DECODE_DEFAULT_SYNTH      1000000
+#define DECODE_SYNTH_RARE_ODDS    64
+#define DECODE_COLUMN_COUNT       (2 + JOYSTICK_STICK_AXES + JOYSTICK_IMU_VALUES)
+
+typedef struct {
+  FILE      *File;
+  UINTN     Synth;
+  UINT32    Random;
+} DECODE_SOURCE;
+
+typedef struct {
+  REPORT_DECODE_COLUMNS   Columns;
+} DECODE_BUFFER;
+
+STATIC CONST char   *mDecodeStickNames[JOYSTICK_STICK_AXES] = { "lx", "ly", "rx", "ry" };
+STATIC CONST char   *mDecodeImuAxisNames[JOYSTICK_IMU_AXES] = { "ax", "ay", "az", "gx", "gy", "gz" };
+
+STATIC
+UINT64
+DecodeNow (
+  VOID
+  )
+{
+  struct timespec   Now;
+
+  clock_gettime (CLOCK_MONOTONIC, &Now);
+  return (UINT64) Now.tv_sec * 1000000000ULL + (UINT64) Now.tv_nsec;
+}
+
+/**
+  Return the column at Index in output order, with its element size.
+
+**/
+STATIC
+VOID *
+DecodeColumn (
+  IN  REPORT_DECODE_COLUMNS   *Columns,
+  IN  UINTN                   Index,
+  OUT UINTN                   *Size
+  )
+{
+  if (Index == 0) {
+    *Size = sizeof (UINT8);
+    return Columns->ReportId;
+  }
+  if (Index == 1) {
+    *Size = sizeof (UINT32);
+    return Columns->Buttons;
+  }
+  Index -= 2;
+  if (Index < JOYSTICK_STICK_AXES) {
+    *Size = sizeof (UINT16);
+    return Columns->Sticks[Index];
+  }
+  *Size = sizeof (INT32);
+  return Columns->Imu[Index - JOYSTICK_STICK_AXES];
+}
+
+/**
+  Format the name of the column at Index in output order.
+
+**/
+STATIC
+VOID
+DecodeColumnName (
+  IN  UINTN   Index,
+  OUT char    *Name,
+  IN  UINTN   NameSize
+  )
+{
+  if (Index == 0) {
+    snprintf (Name, NameSize, "id.u8");
+  } else if (Index == 1) {
+    snprintf (Name, NameSize, "buttons.u32");
+  } else if (Index - 2 < JOYSTICK_STICK_AXES) {
+    snprintf (Name, NameSize, "%s.u16", mDecodeStickNames[Index - 2]);
+  } else {
+    Index -= 2 + JOYSTICK_STICK_AXES;
+    snprintf (
+      Name,
+      NameSize,
+      "imu%u_%s.i32",
+      (unsigned) (Index / JOYSTICK_IMU_AXES),
+      mDecodeImuAxisNames[Index % JOYSTICK_IMU_AXES]
+      );
+  }
+}
+
+STATIC
+int
+DecodeAllocate (
+  OUT DECODE_BUFFER   *Buffer
+  )
+{
+  UINT8     *Id;
+  UINT32    *Buttons;
+  UINTN     Index;
+
+  ZeroMem (Buffer, sizeof (*Buffer));
+  Id      = calloc (DECODE_CHUNK_REPORTS, sizeof (UINT8));
+  Buttons = calloc (DECODE_CHUNK_REPORTS, sizeof (UINT32));
+  Buffer->Columns.ReportId = Id;
+  Buffer->Columns.Buttons  = Buttons;
+  if (Id == NULL || Buttons == NULL) {
+    return -1;
+  }
+  for (Index = 0; Index < JOYSTICK_STICK_AXES; Index++) {
+    Buffer->Columns.Sticks[Index] = calloc (DECODE_CHUNK_REPORTS, sizeof (UINT16));
+    if (Buffer->Columns.Sticks[Index] == NULL) {
+      return -1;
+    }
+  }
+  for (Index = 0; Index < JOYSTICK_IMU_VALUES; Index++) {
+    Buffer->Columns.Imu[Index] = calloc (DECODE_CHUNK_REPORTS, sizeof (INT32));
+    if (Buffer->Columns.Imu[Index] == NULL) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+  Fill Reports with random reports. One in DECODE_SYNTH_RARE_ODDS is a simple
+  HID report, a subcommand reply or a report the decoder ignores, the others
+  are full reports, as in a capture of a streaming controller. The payload
+  is random so every bit of every field is exercised.
+
+**/
+STATIC
+UINTN
+DecodeSynthesize (
+  IN OUT DECODE_SOURCE  *Source,
+  OUT    UINT8          *Reports,
+  IN     UINTN          Count
+  )
+{
+  STATIC CONST UINT8  RareIds[] = {
+    JOYSTICK_IN_SIMPLE_HID, JOYSTICK_IN_SUBCMD_REPLY, JOYSTICK_IN_USB_REPLY, 0x00
+  };
+  UINTN     Index;
+  UINT8     Pick;
+
+  Count = MIN (Count, Source->Synth);
+  for (Index = 0; Index < Count * JOYSTICK_REPORT_SIZE; Index++) {
+    Source->Random ^= Source->Random << 13;
+    Source->Random ^= Source->Random >> 17;
+    Source->Random ^= Source->Random << 5;
+    Reports[Index] = (UINT8) Source->Random;
+  }
+  for (Index = 0; Index < Count; Index++) {
+    Pick = (UINT8) (Reports[Index * JOYSTICK_REPORT_SIZE] % (DECODE_SYNTH_RARE_ODDS / ARRAY_SIZE (RareIds)));
+    Reports[Index * JOYSTICK_REPORT_SIZE] = JOYSTICK_IN_FULL;
+    if (Pick == 0) {
+      Reports[Index * JOYSTICK_REPORT_SIZE] = RareIds[Reports[Index * JOYSTICK_REPORT_SIZE + 1] % ARRAY_SIZE (RareIds)];
+    }
+  }
+  Source->Synth -= Count;
+  return Count;
+}
+
+/**
+  Compare the columns of a kernel to the scalar ones.
+
+  @retval 0                They match.
+  @retval -1               They differ, the first difference is printed.
+
+**/
+STATIC
+int
+DecodeCompare (
+  IN REPORT_DECODE_COLUMNS  *Reference,
+  IN REPORT_DECODE_COLUMNS  *Columns,
+  IN CONST char             *Kernel,
+  IN UINTN                  Count,
+  IN UINT64                 First
+  )
+{
+  CONST UINT8   *Expected;
+  CONST UINT8   *Actual;
+  UINTN         Column;
+  UINTN         Size;
+  UINTN         Row;
+  char          Name[32];
+
+  for (Row = 0; Row < Count; Row++) {
+    for (Column = 0; Column < DECODE_COLUMN_COUNT; Column++) {
+      Expected = DecodeColumn (Reference, Column, &Size);
+      Actual   = DecodeColumn (Columns, Column, &Size);
+      if (memcmp (Expected + Row * Size, Actual + Row * Size, Size) != 0) {
+        DecodeColumnName (Column, Name, sizeof (Name));
+        fprintf (
+          stderr,
+          "verify: %s differs from scalar at report %llu (id 0x%02x), column %s\n",
+          Kernel,
+          (unsigned long long) (First + Row),
+          Reference->ReportId[Row],
+          Name
+          );
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+STATIC
+VOID
+DecodeUsage (
+  VOID
+  )
+{
+  UINTN   Index;
+
+  fprintf (
+    stderr,
+    "Usage: ReportDecode [--kernel NAME] [--out DIR] [--verify] [--synth COUNT] [--seed N] [FILE]\n"
+    "  FILE            Capture of back to back %d byte input reports.\n"
+    "  --kernel NAME   auto (default, the most capable supported) or one of:",
+    JOYSTICK_REPORT_SIZE
+    );
+  for (Index = 0; Index < mReportDecodeKernelCount; Index++) {
+    fprintf (stderr, " %s", mReportDecodeKernels[Index].Name);
+  }
+  fprintf (
+    stderr,
+    ".\n"
+    "  --out DIR       Write every column to DIR as a raw array.\n"
+    "  --verify        Check every supported kernel against the scalar one.\n"
+    "  --synth COUNT   Decode COUNT random reports instead of FILE (default %d).\n"
+    "  --seed N        Random report seed (default 1).\n",
+    DECODE_DEFAULT_SYNTH
+    );
+}
+
+int
+main (
+  int   argc,
+  char  **argv
+  )
+{
+  CONST char                        *Path;
+  CONST char                        *OutDir;
+  CONST char                        *KernelName;
+  CONST REPORT_DECODE_KERNEL_INFO   *Kernel;
+  DECODE_SOURCE                     Source;
+  DECODE_BUFFER                     Output;
+  DECODE_BUFFER                     Reference;
+  DECODE_BUFFER                     Check;
+  JOYSTICK_IMU_SCALE                Scale;
+  FILE                              *Files[DECODE_COLUMN_COUNT];
+  UINT8                             *Reports;
+  BOOLEAN                           Verify;
+  UINT64                            ById[4];
+  UINT64                            Total;
+  UINT64                            DecodeNs;
+  UINT64                            Begin;
+  UINTN                             Count;
+  UINTN                             Index;
+  UINTN                             Row;
+  UINTN                             Size;
+  VOID                              *Data;
+  char                              Name[4096];
+  int                               Arg;
+
+  Path       = NULL;
+  OutDir     = NULL;
+  KernelName = "auto";
+  Verify     = FALSE;
+  ZeroMem (&Source, sizeof (Source));
+  Source.Random = 1;
+
+  for (Arg = 1; Arg < argc; Arg++) {
+    if (strcmp (argv[Arg], "--kernel") == 0 && Arg + 1 < argc) {
+      KernelName = argv[++Arg];
+    } else if (strcmp (argv[Arg], "--out") == 0 && Arg + 1 < argc) {
+      OutDir = argv[++Arg];
+    } else if (strcmp (argv[Arg], "--verify") == 0) {
+      Verify = TRUE;
+    } else if (strcmp (argv[Arg], "--synth") == 0 && Arg + 1 < argc) {
+      Source.Synth = strtoul (argv[++Arg], NULL, 0);
+    } else if (strcmp (argv[Arg], "--seed") == 0 && Arg + 1 < argc) {
+      Source.Random = (UINT32) strtoul (argv[++Arg], NULL, 0);
+    } else if (argv[Arg][0] != '-' && Path == NULL) {
+      Path = argv[Arg];
+    } else {
+      DecodeUsage ();
+      return 2;
+    }
+  }
+
+  if (Path == NULL && Source.Synth == 0) {
+    Source.Synth = DECODE_DEFAULT_SYNTH;
+  }
+  if ((Path != NULL && Source.Synth != 0) || Source.Random == 0) {
+    DecodeUsage ();
+    return 2;
+  }
+
+  Kernel = NULL;
+  for (Index = 0; Index < mReportDecodeKernelCount; Index++) {
+    if (!mReportDecodeKernels[Index].Supported ()) {
+      continue;
+    }
+    if (strcmp (KernelName, "auto") == 0 || strcmp (KernelName, mReportDecodeKernels[Index].Name) == 0) {
+      Kernel = &mReportDecodeKernels[Index];
+    }
+  }
+  if (Kernel == NULL) {
+    fprintf (stderr, "kernel %s is not supported here\n", KernelName);
+    return 2;
+  }
+
+  if (Path != NULL) {
+    Source.File = fopen (Path, "rb");
+    if (Source.File == NULL) {
+      perror (Path);
+      return 1;
+    }
+  }
+
+  Reports = malloc (DECODE_CHUNK_REPORTS * JOYSTICK_REPORT_SIZE);
+  if (Reports == NULL || DecodeAllocate (&Output) != 0 ||
+      (Verify && (DecodeAllocate (&Reference) != 0 || DecodeAllocate (&Check) != 0))) {
+    fprintf (stderr, "out of memory\n");
+    return 1;
+  }
+
+  ZeroMem (Files, sizeof (Files));
+  if (OutDir != NULL) {
+    if (mkdir (OutDir, 0777) != 0 && errno != EEXIST) {
+      perror (OutDir);
+      return 1;
+    }
+    for (Index = 0; Index < DECODE_COLUMN_COUNT; Index++) {
+      snprintf (Name, sizeof (Name), "%s/", OutDir);
+      DecodeColumnName (Index, Name + strlen (Name), sizeof (Name) - strlen (Name));
+      Files[Index] = fopen (Name, "wb");
+      if (Files[Index] == NULL) {
+        perror (Name);
+        return 1;
+      }
+    }
+  }
+
+  JoyStickSetImuScale (NULL, &Scale);
+  ZeroMem (ById, sizeof (ById));
+  Total    = 0;
+  DecodeNs = 0;
+
+  for (;;) {
+    if (Source.File != NULL) {
+      Count = fread (Reports, JOYSTICK_REPORT_SIZE, DECODE_CHUNK_REPORTS, Source.File);
+    } else {
+      Count = DecodeSynthesize (&Source, Reports, DECODE_CHUNK_REPORTS);
+    }
+    if (Count == 0) {
+      break;
+    }
+
+    Begin = DecodeNow ();
+    Kernel->Decode (Reports, Count, &Scale, &Output.Columns);
+    DecodeNs += DecodeNow () - Begin;
+
+    if (Verify) {
+      mReportDecodeKernels[0].Decode (Reports, Count, &Scale, &Reference.Columns);
+      for (Index = 1; Index < mReportDecodeKernelCount; Index++) {
+        if (!mReportDecodeKernels[Index].Supported ()) {
+          continue;
+        }
+        mReportDecodeKernels[Index].Decode (Reports, Count, &Scale, &Check.Columns);
+        if (DecodeCompare (&Reference.Columns, &Check.Columns, mReportDecodeKernels[Index].Name, Count, Total) != 0) {
+          return 1;
+        }
+      }
+    }
+
+    for (Row = 0; Row < Count; Row++) {
+      switch (Output.Columns.ReportId[Row]) {
+      case JOYSTICK_IN_FULL:         ById[0]++; break;
+      case JOYSTICK_IN_SIMPLE_HID:   ById[1]++; break;
+      case JOYSTICK_IN_SUBCMD_REPLY: ById[2]++; break;
+      default:                       ById[3]++; break;
+      }
+    }
+
+    if (OutDir != NULL) {
+      for (Index = 0; Index < DECODE_COLUMN_COUNT; Index++) {
+        Data = DecodeColumn (&Output.Columns, Index, &Size);
+        if (fwrite (Data, Size, Count, Files[Index]) != Count) {
+          perror (OutDir);
+          return 1;
+        }
+      }
+    }
+    Total += Count;
+  }
+
+  if (Source.File != NULL) {
+    if (ftell (Source.File) % JOYSTICK_REPORT_SIZE != 0) {
+      fprintf (stderr, "%s: trailing partial report ignored\n", Path);
+    }
+    fclose (Source.File);
+  }
+  for (Index = 0; Index < DECODE_COLUMN_COUNT; Index++) {
+    if (Files[Index] != NULL && fclose (Files[Index]) != 0) {
+      perror (OutDir);
+      return 1;
+    }
+  }
+
+  printf (
+    "reports       %llu  full %llu  simple %llu  reply %llu  other %llu\n",
+    (unsigned long long) Total,
+    (unsigned long long) ById[0],
+    (unsigned long long) ById[1],
+    (unsigned long long) ById[2],
+    (unsigned long long) ById[3]
+    );
+  if (Total != 0) {
+    printf (
+      "kernel %-6s %.2f ns/report  %.0f MB/s\n",
+      Kernel->Name,
+      (double) DecodeNs / Total,
+      DecodeNs == 0 ? 0.0 : Total * JOYSTICK_REPORT_SIZE * 1e3 / DecodeNs
+      );
+  }
+  if (Verify) {
+    printf ("verify        every supported kernel matches scalar\n");
+  }
+  return 0;
+}
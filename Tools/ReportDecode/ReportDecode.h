@@ -0,0 +1,85 @@
+/** @file
+  Batch decoder of captured input reports.
+
+  Decodes many JOYSTICK_REPORT_SIZE byte reports at once into columns: report
+  id, button word, the four stick axes and the 18 IMU values of a full
+  report. Layouts and the per report decode come from the driver's decoder
+  (JoyStickCore.h), which is the scalar kernel and the reference the SIMD
+  kernels are verified against.
+
+  Rows are defined by the report id: full (0x30) reports fill every column,
+  simple HID (0x3F) reports are normalized to the full layout and
+  subcommand replies (0x21) carry buttons and sticks, with their IMU values
+  left zero. Rows of other reports only carry the id.
+
+  YIZD 2021
+
+**/
+
+#ifndef _REPORT_DECODE_H_
+#define _REPORT_DECODE_H_
+
+#include "JoyStickCore.h"
+
+///
+/// Output columns, each with room for the rows being decoded.
+///
+typedef struct {
+  UINT8     *ReportId;
+  UINT32    *Buttons;
+  UINT16    *Sticks[JOYSTICK_STICK_AXES];
+  INT32     *Imu[JOYSTICK_IMU_VALUES];
+} REPORT_DECODE_COLUMNS;
+
+/**
+  Decode back to back reports into rows 0 to Count - 1 of the columns.
+
+  @param  Reports          Count reports of JOYSTICK_REPORT_SIZE bytes.
+  @param  Count            The number of reports.
+  @param  Scale            The IMU decode scale.
+  @param  Columns          The columns.
+
+**/
+typedef
+VOID
+(*REPORT_DECODE_KERNEL)(
+  IN     CONST UINT8                *Reports,
+  IN     UINTN                      Count,
+  IN     CONST JOYSTICK_IMU_SCALE   *Scale,
+  IN OUT REPORT_DECODE_COLUMNS      *Columns
+  );
+
+typedef struct {
+  CONST char              *Name;
+  REPORT_DECODE_KERNEL    Decode;
+  ///
+  /// Whether the processor runs the kernel.
+  ///
+  BOOLEAN                 (*Supported)(VOID);
+} REPORT_DECODE_KERNEL_INFO;
+
+//
+// The kernels, scalar first, then from the least to the most capable.
+//
+extern CONST REPORT_DECODE_KERNEL_INFO  mReportDecodeKernels[];
+extern CONST UINTN                      mReportDecodeKernelCount;
+
+/**
+  Decode one report into a row of the columns, as the scalar kernel does.
+  The SIMD kernels use it for the reports they do not batch.
+
+  @param  Report           The report.
+  @param  Scale            The IMU decode scale.
+  @param  Columns          The columns.
+  @param  Row              The row to fill.
+
+**/
+VOID
+ReportDecodeOne (
+  IN     CONST UINT8                *Report,
+  IN     CONST JOYSTICK_IMU_SCALE   *Scale,
+  IN OUT REPORT_DECODE_COLUMNS      *Columns,
+  IN     UINTN                      Row
+  );
+
+#endif
@@ -0,0 +1,485 @@
+/** @file
+  Scalar, SSE2 and AVX2 kernels of the batch report decoder.
+
+  The SIMD kernels decode blocks of REPORT_DECODE_BLOCK consecutive full
+  reports, one report per lane, so every column is written with whole
+  vector stores. A block holding any other report is decoded report by
+  report with ReportDecodeOne(), as is the tail of a batch.
+
+  The x86 kernels are compiled with function target attributes and only
+  picked when the processor supports them; other hosts have the scalar
+  kernel only.
+
+  YIZD 2021
+
+**/
+
+#include <string.h>
+
+#include "ReportDecode.h"
+
+#if defined (__x86_64__) || defined (__i386__)
+#define REPORT_DECODE_X86
+#include <immintrin.h>
+#endif
+
+#define REPORT_DECODE_BLOCK       8
+#define REPORT_DECODE_STICK_MASK  0x0FFF
+
+VOID
+ReportDecodeOne (
+  IN     CONST UINT8                *Report,
+  IN     CONST JOYSTICK_IMU_SCALE   *Scale,
+  IN OUT REPORT_DECODE_COLUMNS      *Columns,
+  IN     UINTN                      Row
+  )
+{
+  UINT8     Full[JOYSTICK_REPORT_SIZE];
+  UINT16    Axes[JOYSTICK_STICK_AXES];
+  INT32     Values[JOYSTICK_IMU_VALUES];
+  UINTN     Index;
+
+  Columns->ReportId[Row] = Report[0];
+  ZeroMem (Axes, sizeof (Axes));
+  ZeroMem (Values, sizeof (Values));
+  Columns->Buttons[Row] = 0;
+
+  switch (Report[0]) {
+  case JOYSTICK_IN_SIMPLE_HID:
+    JoyStickNormalizeSimpleReport (Report, Full);
+    Report = Full;
+    //
+    // Fall through.
+    //
+  case JOYSTICK_IN_SUBCMD_REPLY:
+  case JOYSTICK_IN_FULL:
+    Columns->Buttons[Row] = JoyStickDecodeButtons (Report);
+    JoyStickDecodeSticks (Report, Axes);
+    if (Report[0] == JOYSTICK_IN_FULL) {
+      JoyStickDecodeImu (Report, Scale, Values);
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  for (Index = 0; Index < JOYSTICK_STICK_AXES; Index++) {
+    Columns->Sticks[Index][Row] = Axes[Index];
+  }
+  for (Index = 0; Index < JOYSTICK_IMU_VALUES; Index++) {
+    Columns->Imu[Index][Row] = Values[Index];
+  }
+}
+
+STATIC
+VOID
+ReportDecodeScalar (
+  IN     CONST UINT8                *Reports,
+  IN     UINTN                      Count,
+  IN     CONST JOYSTICK_IMU_SCALE   *Scale,
+  IN OUT REPORT_DECODE_COLUMNS      *Columns
+  )
+{
+  UINTN   Row;
+
+  for (Row = 0; Row < Count; Row++) {
+    ReportDecodeOne (Reports + Row * JOYSTICK_REPORT_SIZE, Scale, Columns, Row);
+  }
+}
+
+STATIC
+BOOLEAN
+ReportDecodeAlways (
+  VOID
+  )
+{
+  return TRUE;
+}
+
+#ifdef REPORT_DECODE_X86
+
+/**
+  Check whether the block of reports at Row are all full reports.
+
+**/
+STATIC
+BOOLEAN
+ReportDecodeFullBlock (
+  IN CONST UINT8    *Reports,
+  IN UINTN          Row
+  )
+{
+  UINTN   Lane;
+
+  for (Lane = 0; Lane < REPORT_DECODE_BLOCK; Lane++) {
+    if (Reports[(Row + Lane) * JOYSTICK_REPORT_SIZE] != JOYSTICK_IN_FULL) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+STATIC
+UINT32
+ReportDecodeLoad32 (
+  IN CONST UINT8    *Buffer
+  )
+{
+  UINT32  Value;
+
+  memcpy (&Value, Buffer, sizeof (Value));
+  return Value;
+}
+
+/**
+  Multiply packed 32-bit integers keeping the low 32 bits, which SSE2 only
+  has for the even lanes.
+
+**/
+__attribute__ ((target ("sse2")))
+STATIC
+__m128i
+ReportDecodeMulLo32 (
+  IN __m128i  A,
+  IN __m128i  B
+  )
+{
+  __m128i   Even;
+  __m128i   Odd;
+
+  Even = _mm_mul_epu32 (A, B);
+  Odd  = _mm_mul_epu32 (_mm_srli_si128 (A, 4), _mm_srli_si128 (B, 4));
+  return _mm_unpacklo_epi32 (
+           _mm_shuffle_epi32 (Even, _MM_SHUFFLE (0, 0, 2, 0)),
+           _mm_shuffle_epi32 (Odd, _MM_SHUFFLE (0, 0, 2, 0))
+           );
+}
+
+/**
+  Transpose 8 reports by 8 INT16 values into 8 values by 8 reports.
+
+**/
+__attribute__ ((target ("sse2")))
+STATIC
+VOID
+ReportDecodeTranspose8x8 (
+  IN  CONST __m128i   *In,
+  OUT __m128i         *Out
+  )
+{
+  __m128i   A[8];
+  __m128i   B[8];
+
+  A[0] = _mm_unpacklo_epi16 (In[0], In[1]);
+  A[1] = _mm_unpackhi_epi16 (In[0], In[1]);
+  A[2] = _mm_unpacklo_epi16 (In[2], In[3]);
+  A[3] = _mm_unpackhi_epi16 (In[2], In[3]);
+  A[4] = _mm_unpacklo_epi16 (In[4], In[5]);
+  A[5] = _mm_unpackhi_epi16 (In[4], In[5]);
+  A[6] = _mm_unpacklo_epi16 (In[6], In[7]);
+  A[7] = _mm_unpackhi_epi16 (In[6], In[7]);
+
+  B[0] = _mm_unpacklo_epi32 (A[0], A[2]);
+  B[1] = _mm_unpackhi_epi32 (A[0], A[2]);
+  B[2] = _mm_unpacklo_epi32 (A[1], A[3]);
+  B[3] = _mm_unpackhi_epi32 (A[1], A[3]);
+  B[4] = _mm_unpacklo_epi32 (A[4], A[6]);
+  B[5] = _mm_unpackhi_epi32 (A[4], A[6]);
+  B[6] = _mm_unpacklo_epi32 (A[5], A[7]);
+  B[7] = _mm_unpackhi_epi32 (A[5], A[7]);
+
+  Out[0] = _mm_unpacklo_epi64 (B[0], B[4]);
+  Out[1] = _mm_unpackhi_epi64 (B[0], B[4]);
+  Out[2] = _mm_unpacklo_epi64 (B[1], B[5]);
+  Out[3] = _mm_unpackhi_epi64 (B[1], B[5]);
+  Out[4] = _mm_unpacklo_epi64 (B[2], B[6]);
+  Out[5] = _mm_unpackhi_epi64 (B[2], B[6]);
+  Out[6] = _mm_unpacklo_epi64 (B[3], B[7]);
+  Out[7] = _mm_unpackhi_epi64 (B[3], B[7]);
+}
+
+/**
+  Scale the value of 8 reports in one column, as JoyStickDecodeImu() does.
+
+**/
+__attribute__ ((target ("sse2")))
+STATIC
+VOID
+ReportDecodeImuSse2 (
+  IN  __m128i                     Raw,
+  IN  CONST JOYSTICK_IMU_SCALE    *Scale,
+  IN  UINTN                       Value,
+  OUT INT32                       *Column
+  )
+{
+  __m128i   Offset;
+  __m128i   Factor;
+  __m128i   Low;
+  __m128i   High;
+
+  Offset = _mm_set1_epi32 (Scale->Offset[Value]);
+  Factor = _mm_set1_epi32 (Scale->Scale[Value]);
+
+  Low  = _mm_srai_epi32 (_mm_unpacklo_epi16 (Raw, Raw), 16);
+  High = _mm_srai_epi32 (_mm_unpackhi_epi16 (Raw, Raw), 16);
+  Low  = _mm_srai_epi32 (ReportDecodeMulLo32 (_mm_sub_epi32 (Low, Offset), Factor), JOYSTICK_IMU_SCALE_SHIFT);
+  High = _mm_srai_epi32 (ReportDecodeMulLo32 (_mm_sub_epi32 (High, Offset), Factor), JOYSTICK_IMU_SCALE_SHIFT);
+
+  _mm_storeu_si128 ((__m128i *) Column, Low);
+  _mm_storeu_si128 ((__m128i *) (Column + 4), High);
+}
+
+/**
+  Decode a block of full reports with SSE2. Buttons and sticks are loaded
+  four reports to a vector, the IMU values are transposed so a vector holds
+  one value of eight reports.
+
+**/
+__attribute__ ((target ("sse2")))
+STATIC
+VOID
+ReportDecodeBlockSse2 (
+  IN     CONST UINT8                *Block,
+  IN     CONST JOYSTICK_IMU_SCALE   *Scale,
+  IN OUT REPORT_DECODE_COLUMNS      *Columns,
+  IN     UINTN                      Row
+  )
+{
+  __m128i       Mask;
+  __m128i       Left[2];
+  __m128i       Right[2];
+  __m128i       Rows[REPORT_DECODE_BLOCK];
+  __m128i       Values[REPORT_DECODE_BLOCK];
+  CONST UINT8   *Report;
+  UINTN         Half;
+  UINTN         Lane;
+  UINTN         Index;
+
+  for (Lane = 0; Lane < REPORT_DECODE_BLOCK; Lane++) {
+    Columns->ReportId[Row + Lane] = JOYSTICK_IN_FULL;
+  }
+
+  //
+  // Bytes 3-5 hold the buttons, 6-8 and 9-11 the two packed 12-bit stick
+  // pairs. Each is read as a 32-bit word and masked.
+  //
+  Mask = _mm_set1_epi32 (JOYSTICK_BUTTON_MASK);
+  for (Half = 0; Half < 2; Half++) {
+    Report = Block + Half * 4 * JOYSTICK_REPORT_SIZE;
+    _mm_storeu_si128 (
+      (__m128i *) &Columns->Buttons[Row + Half * 4],
+      _mm_and_si128 (
+        _mm_set_epi32 (
+          (INT32) ReportDecodeLoad32 (Report + 3 * JOYSTICK_REPORT_SIZE + JOYSTICK_BUTTON_OFFSET),
+          (INT32) ReportDecodeLoad32 (Report + 2 * JOYSTICK_REPORT_SIZE + JOYSTICK_BUTTON_OFFSET),
+          (INT32) ReportDecodeLoad32 (Report + 1 * JOYSTICK_REPORT_SIZE + JOYSTICK_BUTTON_OFFSET),
+          (INT32) ReportDecodeLoad32 (Report + JOYSTICK_BUTTON_OFFSET)
+          ),
+        Mask
+        )
+      );
+    Left[Half] = _mm_set_epi32 (
+                   (INT32) ReportDecodeLoad32 (Report + 3 * JOYSTICK_REPORT_SIZE + JOYSTICK_STICK_OFFSET),
+                   (INT32) ReportDecodeLoad32 (Report + 2 * JOYSTICK_REPORT_SIZE + JOYSTICK_STICK_OFFSET),
+                   (INT32) ReportDecodeLoad32 (Report + 1 * JOYSTICK_REPORT_SIZE + JOYSTICK_STICK_OFFSET),
+                   (INT32) ReportDecodeLoad32 (Report + JOYSTICK_STICK_OFFSET)
+                   );
+    Right[Half] = _mm_set_epi32 (
+                    (INT32) ReportDecodeLoad32 (Report + 3 * JOYSTICK_REPORT_SIZE + JOYSTICK_STICK_OFFSET + 3),
+                    (INT32) ReportDecodeLoad32 (Report + 2 * JOYSTICK_REPORT_SIZE + JOYSTICK_STICK_OFFSET + 3),
+                    (INT32) ReportDecodeLoad32 (Report + 1 * JOYSTICK_REPORT_SIZE + JOYSTICK_STICK_OFFSET + 3),
+                    (INT32) ReportDecodeLoad32 (Report + JOYSTICK_STICK_OFFSET + 3)
+                    );
+  }
+
+  Mask = _mm_set1_epi32 (REPORT_DECODE_STICK_MASK);
+  _mm_storeu_si128 (
+    (__m128i *) &Columns->Sticks[0][Row],
+    _mm_packs_epi32 (_mm_and_si128 (Left[0], Mask), _mm_and_si128 (Left[1], Mask))
+    );
+  _mm_storeu_si128 (
+    (__m128i *) &Columns->Sticks[1][Row],
+    _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (Left[0], 12), Mask), _mm_and_si128 (_mm_srli_epi32 (Left[1], 12), Mask))
+    );
+  _mm_storeu_si128 (
+    (__m128i *) &Columns->Sticks[2][Row],
+    _mm_packs_epi32 (_mm_and_si128 (Right[0], Mask), _mm_and_si128 (Right[1], Mask))
+    );
+  _mm_storeu_si128 (
+    (__m128i *) &Columns->Sticks[3][Row],
+    _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (Right[0], 12), Mask), _mm_and_si128 (_mm_srli_epi32 (Right[1], 12), Mask))
+    );
+
+  //
+  // Values 0-7 and 8-15, then 10-17 of which only the last two are new.
+  //
+  for (Index = 0; Index < 3; Index++) {
+    for (Lane = 0; Lane < REPORT_DECODE_BLOCK; Lane++) {
+      Rows[Lane] = _mm_loadu_si128 (
+                     (CONST __m128i *) (Block + Lane * JOYSTICK_REPORT_SIZE + JOYSTICK_IMU_OFFSET +
+                                        (Index < 2 ? Index * 16 : (JOYSTICK_IMU_VALUES - 8) * 2))
+                     );
+    }
+    ReportDecodeTranspose8x8 (Rows, Values);
+    for (Lane = (Index < 2 ? 0 : 6); Lane < REPORT_DECODE_BLOCK; Lane++) {
+      ReportDecodeImuSse2 (
+        Values[Lane],
+        Scale,
+        (Index < 2 ? Index * 8 : JOYSTICK_IMU_VALUES - 8) + Lane,
+        &Columns->Imu[(Index < 2 ? Index * 8 : JOYSTICK_IMU_VALUES - 8) + Lane][Row]
+        );
+    }
+  }
+}
+
+__attribute__ ((target ("sse2")))
+STATIC
+VOID
+ReportDecodeSse2 (
+  IN     CONST UINT8                *Reports,
+  IN     UINTN                      Count,
+  IN     CONST JOYSTICK_IMU_SCALE   *Scale,
+  IN OUT REPORT_DECODE_COLUMNS      *Columns
+  )
+{
+  UINTN   Row;
+
+  Row = 0;
+  while (Row + REPORT_DECODE_BLOCK <= Count) {
+    if (ReportDecodeFullBlock (Reports, Row)) {
+      ReportDecodeBlockSse2 (Reports + Row * JOYSTICK_REPORT_SIZE, Scale, Columns, Row);
+      Row += REPORT_DECODE_BLOCK;
+    } else {
+      ReportDecodeOne (Reports + Row * JOYSTICK_REPORT_SIZE, Scale, Columns, Row);
+      Row++;
+    }
+  }
+  for (; Row < Count; Row++) {
+    ReportDecodeOne (Reports + Row * JOYSTICK_REPORT_SIZE, Scale, Columns, Row);
+  }
+}
+
+STATIC
+BOOLEAN
+ReportDecodeHasSse2 (
+  VOID
+  )
+{
+  __builtin_cpu_init ();
+  return (BOOLEAN) (__builtin_cpu_supports ("sse2") != 0);
+}
+
+/**
+  Decode a block of full reports with AVX2, gathering one 32-bit word per
+  report and lane for every column.
+
+**/
+__attribute__ ((target ("avx2")))
+STATIC
+VOID
+ReportDecodeBlockAvx2 (
+  IN     CONST UINT8                *Block,
+  IN     CONST JOYSTICK_IMU_SCALE   *Scale,
+  IN OUT REPORT_DECODE_COLUMNS      *Columns,
+  IN     UINTN                      Row
+  )
+{
+  __m256i   Lanes;
+  __m256i   Mask;
+  __m256i   Word;
+  __m256i   Pairs;
+  UINTN     Lane;
+  UINTN     Pair;
+  UINTN     Value;
+
+  for (Lane = 0; Lane < REPORT_DECODE_BLOCK; Lane++) {
+    Columns->ReportId[Row + Lane] = JOYSTICK_IN_FULL;
+  }
+
+  Lanes = _mm256_setr_epi32 (
+            0 * JOYSTICK_REPORT_SIZE, 1 * JOYSTICK_REPORT_SIZE, 2 * JOYSTICK_REPORT_SIZE, 3 * JOYSTICK_REPORT_SIZE,
+            4 * JOYSTICK_REPORT_SIZE, 5 * JOYSTICK_REPORT_SIZE, 6 * JOYSTICK_REPORT_SIZE, 7 * JOYSTICK_REPORT_SIZE
+            );
+
+  Word = _mm256_i32gather_epi32 ((CONST int *) (Block + JOYSTICK_BUTTON_OFFSET), Lanes, 1);
+  _mm256_storeu_si256 (
+    (__m256i *) &Columns->Buttons[Row],
+    _mm256_and_si256 (Word, _mm256_set1_epi32 (JOYSTICK_BUTTON_MASK))
+    );
+
+  //
+  // Packing X and Y interleaves the 128-bit lanes, the permute puts the
+  // eight X values in the low half and the eight Y values in the high one.
+  //
+  Mask = _mm256_set1_epi32 (REPORT_DECODE_STICK_MASK);
+  for (Pair = 0; Pair < 2; Pair++) {
+    Word  = _mm256_i32gather_epi32 ((CONST int *) (Block + JOYSTICK_STICK_OFFSET + Pair * 3), Lanes, 1);
+    Pairs = _mm256_permute4x64_epi64 (
+              _mm256_packus_epi32 (
+                _mm256_and_si256 (Word, Mask),
+                _mm256_and_si256 (_mm256_srli_epi32 (Word, 12), Mask)
+                ),
+              _MM_SHUFFLE (3, 1, 2, 0)
+              );
+    _mm_storeu_si128 ((__m128i *) &Columns->Sticks[Pair * 2][Row], _mm256_castsi256_si128 (Pairs));
+    _mm_storeu_si128 ((__m128i *) &Columns->Sticks[Pair * 2 + 1][Row], _mm256_extracti128_si256 (Pairs, 1));
+  }
+
+  for (Value = 0; Value < JOYSTICK_IMU_VALUES; Value++) {
+    Word = _mm256_i32gather_epi32 ((CONST int *) (Block + JOYSTICK_IMU_OFFSET + Value * 2), Lanes, 1);
+    Word = _mm256_srai_epi32 (_mm256_slli_epi32 (Word, 16), 16);
+    Word = _mm256_sub_epi32 (Word, _mm256_set1_epi32 (Scale->Offset[Value]));
+    Word = _mm256_mullo_epi32 (Word, _mm256_set1_epi32 (Scale->Scale[Value]));
+    _mm256_storeu_si256 ((__m256i *) &Columns->Imu[Value][Row], _mm256_srai_epi32 (Word, JOYSTICK_IMU_SCALE_SHIFT));
+  }
+}
+
+__attribute__ ((target ("avx2")))
+STATIC
+VOID
+ReportDecodeAvx2 (
+  IN     CONST UINT8                *Reports,
+  IN     UINTN                      Count,
+  IN     CONST JOYSTICK_IMU_SCALE   *Scale,
+  IN OUT REPORT_DECODE_COLUMNS      *Columns
+  )
+{
+  UINTN   Row;
+
+  Row = 0;
+  while (Row + REPORT_DECODE_BLOCK <= Count) {
+    if (ReportDecodeFullBlock (Reports, Row)) {
+      ReportDecodeBlockAvx2 (Reports + Row * JOYSTICK_REPORT_SIZE, Scale, Columns, Row);
+      Row += REPORT_DECODE_BLOCK;
+    } else {
+      ReportDecodeOne (Reports + Row * JOYSTICK_REPORT_SIZE, Scale, Columns, Row);
+      Row++;
+    }
+  }
+  for (; Row < Count; Row++) {
+    ReportDecodeOne (Reports + Row * JOYSTICK_REPORT_SIZE, Scale, Columns, Row);
+  }
+}
+
+STATIC
+BOOLEAN
+ReportDecodeHasAvx2 (
+  VOID
+  )
+{
+  __builtin_cpu_init ();
+  return (BOOLEAN) (__builtin_cpu_supports ("avx2") != 0);
+}
+
+#endif
+
+CONST REPORT_DECODE_KERNEL_INFO  mReportDecodeKernels[] = {
+  { "scalar", ReportDecodeScalar, ReportDecodeAlways  },
+#ifdef REPORT_DECODE_X86
+  { "sse2",   ReportDecodeSse2,   ReportDecodeHasSse2 },
+  { "avx2",   ReportDecodeAvx2,   ReportDecodeHasAvx2 },
+#endif
+};
+
+CONST UINTN  mReportDecodeKernelCount = ARRAY_SIZE (mReportDecodeKernels);
@@ -0,0 +1,740 @@
+/** @file
+  Linux uhid bridge for the USB JoyStick report decoder.
+
+  Creates a virtual Pro Controller through /dev/uhid, injects recorded or
+  synthesized input reports into it, reads them back from the hidraw node
+  the kernel creates and runs them through the driver's decoder
+  (JoyStickCore.c). Prints decode cost and inject-to-key latency
+  percentiles once per second.
+
+  The device is created on the virtual bus so hid-nintendo does not bind
+  to it and start its own handshake; hid-generic exposes it as hidraw.
+
+  UhidBridge [--replay FILE | --synth COUNT] [--rate HZ] [--debounce N]
+             [--no-uhid]
+
+  YIZD 2021
+
+**/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/uhid.h>
+
+#include "JoyStickCore.h"
+
+#define BRIDGE_VENDOR_ID          0x057E
+#define BRIDGE_PRODUCT_ID         0x2009
+#define BRIDGE_DEFAULT_SYNTH      10000
+#define BRIDGE_DEFAULT_RATE       1000
+#define BRIDGE_HIDRAW_WAIT_MS     2000
+#define BRIDGE_DRAIN_MS           200
+#define BRIDGE_WINDOW_SAMPLES     65536
+#define BRIDGE_SYNTH_CYCLE        10
+
+//
+// Injection time in CLOCK_MONOTONIC nanoseconds, stored little endian in
+// the trailing report bytes. The decoder does not look at them.
+//
+#define BRIDGE_STAMP_OFFSET       (JOYSTICK_REPORT_SIZE - sizeof (UINT64))
+
+//
+// Vendor defined report descriptor declaring the three input report IDs
+// the decoder handles, each 63 bytes after the ID.
+//
+STATIC CONST UINT8 mBridgeReportDescriptor[] = {
+  0x06, 0x00, 0xFF,             // Usage Page (Vendor Defined 0xFF00)
+  0x09, 0x01,                   // Usage (0x01)
+  0xA1, 0x01,                   // Collection (Application)
+  0x15, 0x00,                   //   Logical Minimum (0)
+  0x26, 0xFF, 0x00,             //   Logical Maximum (255)
+  0x75, 0x08,                   //   Report Size (8)
+  0x95, JOYSTICK_REPORT_SIZE - 1, //   Report Count (63)
+  0x85, JOYSTICK_IN_SUBCMD_REPLY, //   Report ID (0x21)
+  0x09, 0x21,                   //   Usage (0x21)
+  0x81, 0x02,                   //   Input (Data, Var, Abs)
+  0x85, JOYSTICK_IN_FULL,       //   Report ID (0x30)
+  0x09, 0x30,                   //   Usage (0x30)
+  0x81, 0x02,                   //   Input (Data, Var, Abs)
+  0x85, JOYSTICK_IN_SIMPLE_HID, //   Report ID (0x3F)
+  0x09, 0x3F,                   //   Usage (0x3F)
+  0x81, 0x02,                   //   Input (Data, Var, Abs)
+  0xC0                          // End Collection
+};
+
+//
+// Buttons cycled through by the synthesized stream, one key each.
+//
+STATIC CONST UINT32 mBridgeSynthButtons[] = {
+  JOYSTICK_BUTTON_UP,
+  JOYSTICK_BUTTON_DOWN,
+  JOYSTICK_BUTTON_LEFT,
+  JOYSTICK_BUTTON_RIGHT,
+  JOYSTICK_BUTTON_A,
+  JOYSTICK_BUTTON_B,
+  JOYSTICK_BUTTON_X,
+  JOYSTICK_BUTTON_Y
+};
+
+typedef struct {
+  UINT8     (*Reports)[JOYSTICK_REPORT_SIZE];
+  UINTN     Count;
+} BRIDGE_STREAM;
+
+//
+// Counters of the current one second window and of the whole run.
+//
+typedef struct {
+  UINT64    Injected;
+  UINT64    Received;
+  UINT64    Keys;
+  UINT64    DecodeNs;
+  UINT64    Dropped;
+  UINTN     LatencyCount;
+  UINT32    Latency[BRIDGE_WINDOW_SAMPLES];
+} BRIDGE_STATS;
+
+STATIC volatile sig_atomic_t  mBridgeStop;
+STATIC UINT8                  mBridgeDebounce = 1;
+STATIC BRIDGE_STATS           mBridgeWindow;
+STATIC BRIDGE_STATS           mBridgeTotal;
+
+/**
+  Return CLOCK_MONOTONIC in nanoseconds.
+
+**/
+STATIC
+UINT64
+BridgeNow (
+  VOID
+  )
+{
+  struct timespec   Now;
+
+  clock_gettime (CLOCK_MONOTONIC, &Now);
+  return (UINT64) Now.tv_sec * 1000000000ULL + (UINT64) Now.tv_nsec;
+}
+
+STATIC
+VOID
+BridgeSignal (
+  int   Signal
+  )
+{
+  (VOID) Signal;
+  mBridgeStop = 1;
+}
+
+/**
+  Load a replay file of back to back JOYSTICK_REPORT_SIZE byte reports.
+
+  @param  Path             The replay file.
+  @param  Stream           Receives the reports.
+
+  @retval 0                The file was loaded.
+  @retval -1               The file could not be read or holds no report.
+
+**/
+STATIC
+int
+BridgeLoadReplay (
+  IN  CONST char      *Path,
+  OUT BRIDGE_STREAM   *Stream
+  )
+{
+  FILE      *File;
+  long      Size;
+
+  File = fopen (Path, "rb");
+  if (File == NULL) {
+    perror (Path);
+    return -1;
+  }
+
+  fseek (File, 0, SEEK_END);
+  Size = ftell (File);
+  fseek (File, 0, SEEK_SET);
+
+  Stream->Count   = (UINTN) Size / JOYSTICK_REPORT_SIZE;
+  Stream->Reports = calloc (Stream->Count ? Stream->Count : 1, JOYSTICK_REPORT_SIZE);
+  if (Stream->Count == 0 || Stream->Reports == NULL ||
+      fread (Stream->Reports, JOYSTICK_REPORT_SIZE, Stream->Count, File) != Stream->Count) {
+    fprintf (stderr, "%s: no complete %d byte report\n", Path, JOYSTICK_REPORT_SIZE);
+    fclose (File);
+    return -1;
+  }
+
+  fclose (File);
+  return 0;
+}
+
+/**
+  Synthesize full (0x30) reports pressing the buttons of mBridgeSynthButtons
+  in turn. Each press is held for BRIDGE_SYNTH_CYCLE / 2 reports and ends
+  with a one report bounce, so it produces two keys without debounce and
+  one with a window of two reports or more.
+
+  @param  Count            The number of reports.
+  @param  Stream           Receives the reports.
+
+  @retval 0                The reports were generated.
+  @retval -1               Out of memory.
+
+**/
+STATIC
+int
+BridgeSynthesize (
+  IN  UINTN           Count,
+  OUT BRIDGE_STREAM   *Stream
+  )
+{
+  UINTN     Index;
+  UINTN     Phase;
+  UINT32    Buttons;
+  UINT8     *Report;
+
+  Stream->Count   = Count;
+  Stream->Reports = calloc (Count, JOYSTICK_REPORT_SIZE);
+  if (Stream->Reports == NULL) {
+    return -1;
+  }
+
+  for (Index = 0; Index < Count; Index++) {
+    Report    = Stream->Reports[Index];
+    Report[0] = JOYSTICK_IN_FULL;
+    Report[1] = (UINT8) Index;
+    Report[2] = 0x8E;
+    Phase     = Index % BRIDGE_SYNTH_CYCLE;
+    Buttons   = (Phase < BRIDGE_SYNTH_CYCLE / 2 - 1 || Phase == BRIDGE_SYNTH_CYCLE / 2) ?
+                mBridgeSynthButtons[(Index / BRIDGE_SYNTH_CYCLE) % ARRAY_SIZE (mBridgeSynthButtons)] : 0;
+    Report[JOYSTICK_BUTTON_OFFSET]     = (UINT8) Buttons;
+    Report[JOYSTICK_BUTTON_OFFSET + 1] = (UINT8) (Buttons >> 8);
+    Report[JOYSTICK_BUTTON_OFFSET + 2] = (UINT8) (Buttons >> 16);
+  }
+  return 0;
+}
+
+/**
+  Run one report through the decoder, then take its keys out of the queue
+  and record their latency.
+
+  @param  Decoder          The decoder.
+  @param  Report           The report read back from hidraw, carrying its
+                           injection time.
+
+**/
+STATIC
+VOID
+BridgeDecode (
+  IN OUT JOYSTICK_DECODER   *Decoder,
+  IN     CONST UINT8        *Report
+  )
+{
+  UINT64          Start;
+  UINT64          Done;
+  UINT64              Injected;
+  JOYSTICK_KEY_ENTRY  Entry;
+
+  CopyMem (&Injected, &Report[BRIDGE_STAMP_OFFSET], sizeof (Injected));
+
+  Start = BridgeNow ();
+  JoyStickProcessReport (Decoder, Report, Injected);
+  Done  = BridgeNow ();
+
+  mBridgeWindow.Received++;
+  mBridgeWindow.DecodeNs += Done - Start;
+
+  while (!EFI_ERROR (JoyStickDequeueKey (&Decoder->Keys, &Entry))) {
+    mBridgeWindow.Keys++;
+    if (Entry.Arrival == 0 || Done < Entry.Arrival) {
+      continue;
+    }
+    if (mBridgeWindow.LatencyCount < BRIDGE_WINDOW_SAMPLES) {
+      mBridgeWindow.Latency[mBridgeWindow.LatencyCount++] =
+        (UINT32) MIN (Done - Entry.Arrival, (UINT64) 0xFFFFFFFF);
+    } else {
+      mBridgeWindow.Dropped++;
+    }
+  }
+}
+
+STATIC
+int
+BridgeCompareLatency (
+  CONST VOID  *A,
+  CONST VOID  *B
+  )
+{
+  UINT32  Left;
+  UINT32  Right;
+
+  Left  = *(CONST UINT32 *) A;
+  Right = *(CONST UINT32 *) B;
+  return (Left > Right) - (Left < Right);
+}
+
+/**
+  Print the counters and latency percentiles of a window, and fold them into
+  the run totals.
+
+  @param  Label            Line prefix.
+  @param  Stats            The window to print.
+
+**/
+STATIC
+VOID
+BridgePrintStats (
+  IN     CONST char     *Label,
+  IN OUT BRIDGE_STATS   *Stats
+  )
+{
+  UINTN     Count;
+
+  Count = Stats->LatencyCount;
+  qsort (Stats->Latency, Count, sizeof (UINT32), BridgeCompareLatency);
+
+  printf (
+    "%s injected %8llu  received %8llu  keys %7llu  decode %6.1f ns/report",
+    Label,
+    (unsigned long long) Stats->Injected,
+    (unsigned long long) Stats->Received,
+    (unsigned long long) Stats->Keys,
+    Stats->Received ? (double) Stats->DecodeNs / (double) Stats->Received : 0.0
+    );
+  if (Count != 0) {
+    printf (
+      "  latency us p50 %.1f p90 %.1f p99 %.1f max %.1f",
+      Stats->Latency[Count / 2] / 1000.0,
+      Stats->Latency[Count * 90 / 100] / 1000.0,
+      Stats->Latency[Count * 99 / 100] / 1000.0,
+      Stats->Latency[Count - 1] / 1000.0
+      );
+  }
+  if (Stats->Dropped != 0) {
+    printf ("  (%llu samples not kept)", (unsigned long long) Stats->Dropped);
+  }
+  printf ("\n");
+  fflush (stdout);
+}
+
+/**
+  Fold the current window into the totals, then clear it.
+
+**/
+STATIC
+VOID
+BridgeCloseWindow (
+  VOID
+  )
+{
+  UINTN     Room;
+
+  mBridgeTotal.Injected += mBridgeWindow.Injected;
+  mBridgeTotal.Received += mBridgeWindow.Received;
+  mBridgeTotal.Keys     += mBridgeWindow.Keys;
+  mBridgeTotal.DecodeNs += mBridgeWindow.DecodeNs;
+  mBridgeTotal.Dropped  += mBridgeWindow.Dropped;
+
+  Room = BRIDGE_WINDOW_SAMPLES - mBridgeTotal.LatencyCount;
+  if (mBridgeWindow.LatencyCount > Room) {
+    mBridgeTotal.Dropped += mBridgeWindow.LatencyCount - Room;
+  }
+  Room = MIN (Room, mBridgeWindow.LatencyCount);
+  CopyMem (
+    &mBridgeTotal.Latency[mBridgeTotal.LatencyCount],
+    mBridgeWindow.Latency,
+    Room * sizeof (UINT32)
+    );
+  mBridgeTotal.LatencyCount += Room;
+
+  mBridgeWindow.Injected     = 0;
+  mBridgeWindow.Received     = 0;
+  mBridgeWindow.Keys         = 0;
+  mBridgeWindow.DecodeNs     = 0;
+  mBridgeWindow.Dropped      = 0;
+  mBridgeWindow.LatencyCount = 0;
+}
+
+/**
+  Decode the stream in process, without the kernel round trip, to measure
+  the decoder alone.
+
+  @param  Stream           The reports.
+
+**/
+STATIC
+VOID
+BridgeRunLocal (
+  IN CONST BRIDGE_STREAM  *Stream
+  )
+{
+  JOYSTICK_DECODER    Decoder;
+  UINTN               Pass;
+  UINTN               Passes;
+  UINTN               Index;
+  UINT64              Start;
+  UINT64              Elapsed;
+  UINT64              Keys;
+  JOYSTICK_KEY_ENTRY  Entry;
+
+  //
+  // Repeat short streams so the measurement covers about a million reports.
+  //
+  Passes = MAX ((UINTN) 1, (UINTN) 1000000 / Stream->Count);
+  Keys   = 0;
+
+  JoyStickInitDecoder (&Decoder);
+  JoyStickSetDebounce (&Decoder, mBridgeDebounce);
+  Start = BridgeNow ();
+  for (Pass = 0; Pass < Passes; Pass++) {
+    for (Index = 0; Index < Stream->Count; Index++) {
+      JoyStickProcessReport (&Decoder, Stream->Reports[Index], Index);
+      while (!EFI_ERROR (JoyStickDequeueKey (&Decoder.Keys, &Entry))) {
+        Keys++;
+      }
+    }
+  }
+  Elapsed = BridgeNow () - Start;
+
+  printf (
+    "decoded %llu reports, %llu keys, %.1f ns/report\n",
+    (unsigned long long) (Passes * Stream->Count),
+    (unsigned long long) Keys,
+    (double) Elapsed / (double) (Passes * Stream->Count)
+    );
+}
+
+/**
+  Send one uhid event.
+
+  @retval 0                The event was written.
+  @retval -1               The write failed.
+
+**/
+STATIC
+int
+BridgeUhidWrite (
+  IN int                        Uhid,
+  IN CONST struct uhid_event    *Event
+  )
+{
+  if (write (Uhid, Event, sizeof (*Event)) != (ssize_t) sizeof (*Event)) {
+    perror ("uhid write");
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  Create the virtual controller.
+
+  @param  Uhid             The /dev/uhid file.
+  @param  Uniq             Unique id used to find the hidraw node.
+
+**/
+STATIC
+int
+BridgeUhidCreate (
+  IN int          Uhid,
+  IN CONST char   *Uniq
+  )
+{
+  struct uhid_event   Event;
+
+  ZeroMem (&Event, sizeof (Event));
+  Event.type = UHID_CREATE2;
+  snprintf ((char *) Event.u.create2.name, sizeof (Event.u.create2.name), "Pro Controller (uhid bridge)");
+  snprintf ((char *) Event.u.create2.uniq, sizeof (Event.u.create2.uniq), "%s", Uniq);
+  Event.u.create2.rd_size = sizeof (mBridgeReportDescriptor);
+  Event.u.create2.bus     = BUS_VIRTUAL;
+  Event.u.create2.vendor  = BRIDGE_VENDOR_ID;
+  Event.u.create2.product = BRIDGE_PRODUCT_ID;
+  CopyMem (Event.u.create2.rd_data, mBridgeReportDescriptor, sizeof (mBridgeReportDescriptor));
+
+  return BridgeUhidWrite (Uhid, &Event);
+}
+
+/**
+  Find and open the hidraw node of the virtual controller.
+
+  @param  Uniq             Unique id given at creation.
+
+  @return The open hidraw file, or -1 if it did not appear in time.
+
+**/
+STATIC
+int
+BridgeOpenHidraw (
+  IN CONST char   *Uniq
+  )
+{
+  glob_t    Nodes;
+  char      Match[128];
+  char      Line[256];
+  char      Path[64];
+  unsigned  Node;
+  FILE      *Uevent;
+  size_t    Index;
+  int       Found;
+  int       Waited;
+
+  snprintf (Match, sizeof (Match), "HID_UNIQ=%s\n", Uniq);
+  for (Waited = 0; Waited < BRIDGE_HIDRAW_WAIT_MS; Waited += 10) {
+    if (glob ("/sys/class/hidraw/hidraw*/device/uevent", 0, NULL, &Nodes) == 0) {
+      for (Index = 0; Index < Nodes.gl_pathc; Index++) {
+        Uevent = fopen (Nodes.gl_pathv[Index], "r");
+        if (Uevent == NULL) {
+          continue;
+        }
+        Found = 0;
+        while (fgets (Line, sizeof (Line), Uevent) != NULL) {
+          if (strcmp (Line, Match) == 0) {
+            Found = 1;
+            break;
+          }
+        }
+        fclose (Uevent);
+        if (Found) {
+          Found = sscanf (Nodes.gl_pathv[Index], "/sys/class/hidraw/hidraw%u/", &Node);
+          globfree (&Nodes);
+          if (Found != 1) {
+            return -1;
+          }
+          snprintf (Path, sizeof (Path), "/dev/hidraw%u", Node);
+          return open (Path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        }
+      }
+      globfree (&Nodes);
+    }
+    usleep (10000);
+  }
+  return -1;
+}
+
+/**
+  Inject the stream at the given rate through uhid, and decode what comes
+  back out of hidraw.
+
+  @param  Stream           The reports.
+  @param  Rate             Reports per second.
+
+  @retval 0                The run completed.
+  @retval -1               The virtual controller could not be set up.
+
+**/
+STATIC
+int
+BridgeRunUhid (
+  IN CONST BRIDGE_STREAM  *Stream,
+  IN UINTN                Rate
+  )
+{
+  int                 Uhid;
+  int                 Hidraw;
+  char                Uniq[32];
+  struct uhid_event   Event;
+  struct pollfd       Fds[2];
+  struct timespec     Timeout;
+  JOYSTICK_DECODER    Decoder;
+  UINT8               Report[JOYSTICK_REPORT_SIZE];
+  UINT64              Period;
+  UINT64              Now;
+  UINT64              NextInject;
+  UINT64              NextPrint;
+  UINT64              Deadline;
+  UINTN               Index;
+  UINT64              Stamp;
+  ssize_t             Length;
+
+  Uhid = open ("/dev/uhid", O_RDWR | O_CLOEXEC);
+  if (Uhid < 0) {
+    perror ("/dev/uhid");
+    return -1;
+  }
+
+  snprintf (Uniq, sizeof (Uniq), "jsbridge-%d", (int) getpid ());
+  if (BridgeUhidCreate (Uhid, Uniq) != 0) {
+    close (Uhid);
+    return -1;
+  }
+
+  Hidraw = BridgeOpenHidraw (Uniq);
+  if (Hidraw < 0) {
+    fprintf (stderr, "hidraw node of the virtual controller did not appear\n");
+    close (Uhid);
+    return -1;
+  }
+
+  JoyStickInitDecoder (&Decoder);
+  JoyStickSetDebounce (&Decoder, mBridgeDebounce);
+  Period     = 1000000000ULL / Rate;
+  NextInject = BridgeNow ();
+  NextPrint  = NextInject + 1000000000ULL;
+  Deadline   = 0;
+  Index      = 0;
+
+  Fds[0].fd     = Hidraw;
+  Fds[0].events = POLLIN;
+  Fds[1].fd     = Uhid;
+  Fds[1].events = POLLIN;
+
+  while (!mBridgeStop) {
+    Now = BridgeNow ();
+
+    if (Index < Stream->Count && Now >= NextInject) {
+      ZeroMem (&Event, sizeof (Event));
+      Event.type = UHID_INPUT2;
+      Event.u.input2.size = JOYSTICK_REPORT_SIZE;
+      CopyMem (Event.u.input2.data, Stream->Reports[Index], JOYSTICK_REPORT_SIZE);
+      Stamp = BridgeNow ();
+      CopyMem (&Event.u.input2.data[BRIDGE_STAMP_OFFSET], &Stamp, sizeof (Stamp));
+      if (BridgeUhidWrite (Uhid, &Event) != 0) {
+        break;
+      }
+      mBridgeWindow.Injected++;
+      NextInject += Period;
+      Index++;
+      if (Index == Stream->Count) {
+        Deadline = Now + BRIDGE_DRAIN_MS * 1000000ULL;
+      }
+      continue;
+    }
+
+    if (Now >= NextPrint) {
+      BridgePrintStats ("[1s]  ", &mBridgeWindow);
+      BridgeCloseWindow ();
+      NextPrint += 1000000000ULL;
+    }
+
+    if (Deadline != 0 && Now >= Deadline) {
+      break;
+    }
+
+    Stamp = MIN ((Index < Stream->Count) ? NextInject : Deadline, NextPrint);
+    Stamp = (Stamp > Now) ? Stamp - Now : 0;
+    Timeout.tv_sec  = (time_t) (Stamp / 1000000000ULL);
+    Timeout.tv_nsec = (long) (Stamp % 1000000000ULL);
+    if (ppoll (Fds, 2, &Timeout, NULL) <= 0) {
+      continue;
+    }
+
+    if ((Fds[0].revents & POLLIN) != 0) {
+      while ((Length = read (Hidraw, Report, sizeof (Report))) > 0) {
+        if (Length == JOYSTICK_REPORT_SIZE) {
+          BridgeDecode (&Decoder, Report);
+        }
+      }
+    }
+
+    if ((Fds[1].revents & POLLIN) != 0) {
+      //
+      // Start, open and output events carry nothing the bridge acts on.
+      //
+      if (read (Uhid, &Event, sizeof (Event)) < 0 && errno != EINTR) {
+        perror ("uhid read");
+        break;
+      }
+    }
+  }
+
+  BridgePrintStats ("[1s]  ", &mBridgeWindow);
+  BridgeCloseWindow ();
+  BridgePrintStats ("[total]", &mBridgeTotal);
+
+  ZeroMem (&Event, sizeof (Event));
+  Event.type = UHID_DESTROY;
+  BridgeUhidWrite (Uhid, &Event);
+  close (Hidraw);
+  close (Uhid);
+  return 0;
+}
+
+STATIC
+VOID
+BridgeUsage (
+  VOID
+  )
+{
+  fprintf (
+    stderr,
+    "Usage: UhidBridge [--replay FILE | --synth COUNT] [--rate HZ] [--debounce N] [--no-uhid]\n"
+    "  --replay FILE   Inject FILE, back to back %d byte input reports.\n"
+    "  --synth COUNT   Inject COUNT synthesized full reports (default %d).\n"
+    "  --rate HZ       Injection rate in reports per second (default %d).\n"
+    "  --debounce N    Debounce window in reports, 1-%d (default 1, off).\n"
+    "  --no-uhid       Decode in process only, to measure decoder cost.\n",
+    JOYSTICK_REPORT_SIZE,
+    BRIDGE_DEFAULT_SYNTH,
+    BRIDGE_DEFAULT_RATE,
+    JOYSTICK_DEBOUNCE_MAX
+    );
+}
+
+int
+main (
+  int   argc,
+  char  **argv
+  )
+{
+  BRIDGE_STREAM   Stream;
+  CONST char      *Replay;
+  UINTN           Synth;
+  UINTN           Rate;
+  BOOLEAN         UseUhid;
+  int             Index;
+
+  Replay  = NULL;
+  Synth   = BRIDGE_DEFAULT_SYNTH;
+  Rate    = BRIDGE_DEFAULT_RATE;
+  UseUhid = TRUE;
+
+  for (Index = 1; Index < argc; Index++) {
+    if (strcmp (argv[Index], "--replay") == 0 && Index + 1 < argc) {
+      Replay = argv[++Index];
+    } else if (strcmp (argv[Index], "--synth") == 0 && Index + 1 < argc) {
+      Synth = strtoul (argv[++Index], NULL, 0);
+    } else if (strcmp (argv[Index], "--rate") == 0 && Index + 1 < argc) {
+      Rate = strtoul (argv[++Index], NULL, 0);
+    } else if (strcmp (argv[Index], "--debounce") == 0 && Index + 1 < argc) {
+      mBridgeDebounce = (UINT8) strtoul (argv[++Index], NULL, 0);
+    } else if (strcmp (argv[Index], "--no-uhid") == 0) {
+      UseUhid = FALSE;
+    } else {
+      BridgeUsage ();
+      return 2;
+    }
+  }
+
+  if (Synth == 0 || Rate == 0 || mBridgeDebounce > JOYSTICK_DEBOUNCE_MAX) {
+    BridgeUsage ();
+    return 2;
+  }
+
+  if (Replay != NULL) {
+    if (BridgeLoadReplay (Replay, &Stream) != 0) {
+      return 1;
+    }
+  } else if (BridgeSynthesize (Synth, &Stream) != 0) {
+    fprintf (stderr, "out of memory\n");
+    return 1;
+  }
+
+  signal (SIGINT, BridgeSignal);
+  signal (SIGTERM, BridgeSignal);
+
+  if (!UseUhid) {
+    BridgeRunLocal (&Stream);
+    return 0;
+  }
+
+  return (BridgeRunUhid (&Stream, Rate) == 0) ? 0 : 1;
+}
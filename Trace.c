@@ -0,0 +1,91 @@
+/** @file
+  Binary trace buffer of the USB JoyStick driver.
+
+  Trace points write fixed-size records into a ring published as an EFI
+  configuration table. Formatting is left to the offline decoder.
+
+  YIZD 2021
+
+**/
+
+#include "JoyStick.h"
+
+JOYSTICK_TRACE_BUFFER  *mJoyStickTrace = NULL;
+
+/**
+  Allocate the trace buffer and publish it as the USB_JOYSTICK_TRACE_GUID
+  configuration table. Trace points are dropped if this fails.
+
+**/
+VOID
+JoyStickTraceInit (
+  VOID
+  )
+{
+  EFI_STATUS              Status;
+  JOYSTICK_TRACE_BUFFER   *Trace;
+
+  if (FixedPcdGet8 (PcdJoyStickTraceLevel) == JOYSTICK_TRACE_LEVEL_NONE) {
+    return;
+  }
+
+  Trace = AllocateZeroPool (
+            OFFSET_OF (JOYSTICK_TRACE_BUFFER, Records) +
+            JOYSTICK_TRACE_CAPACITY * sizeof (JOYSTICK_TRACE_RECORD)
+            );
+  if (Trace == NULL) {
+    return;
+  }
+
+  Trace->Signature      = JOYSTICK_TRACE_SIGNATURE;
+  Trace->Version        = JOYSTICK_TRACE_VERSION;
+  Trace->RecordSize     = sizeof (JOYSTICK_TRACE_RECORD);
+  Trace->Capacity       = JOYSTICK_TRACE_CAPACITY;
+  Trace->TimerFrequency = GetPerformanceCounterProperties (&Trace->TimerStart, &Trace->TimerEnd);
+
+  Status = gBS->InstallConfigurationTable (&gUsbJoyStickTraceGuid, Trace);
+  if (EFI_ERROR (Status)) {
+    FreePool (Trace);
+    return;
+  }
+
+  mJoyStickTrace = Trace;
+}
+
+/**
+  Append one record to the trace buffer, overwriting the oldest one.
+
+  Use JOYSTICK_TRACE rather than calling this directly, so that trace points
+  above the configured level are compiled out.
+
+  @param  Event            The JOYSTICK_TRACE_* event id.
+  @param  Arg0             First event argument.
+  @param  Arg1             Second event argument.
+
+**/
+VOID
+JoyStickTraceWrite (
+  IN UINT32     Event,
+  IN UINT64     Arg0,
+  IN UINT64     Arg1
+  )
+{
+  JOYSTICK_TRACE_RECORD   *Record;
+  UINT32                  Slot;
+
+  if (mJoyStickTrace == NULL) {
+    return;
+  }
+
+  //
+  // Trace points are hit at TPL_CALLBACK and from the TPL_NOTIFY transfer
+  // callback, claim the slot atomically.
+  //
+  Slot   = InterlockedIncrement (&mJoyStickTrace->Written) - 1;
+  Record = &mJoyStickTrace->Records[Slot & (JOYSTICK_TRACE_CAPACITY - 1)];
+
+  Record->Timestamp = GetPerformanceCounter ();
+  Record->Event     = Event;
+  Record->Arg0      = Arg0;
+  Record->Arg1      = Arg1;
+}